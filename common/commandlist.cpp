@@ -16,6 +16,7 @@ using namespace std;
 CommandList::CommandList(cornerBlendMethod_e blendMethod) {
     cornerBlendMethod = blendMethod;
     cornerBlendMaxFraction = 0.8f;
+    programId = 0;
     posLimitLower = scv::vec3(0,0,0);
     posLimitUpper = scv::vec3(1,1,1);
     for (int i = 0 ; i < NUM_ROTATION_AXES; i++) {
@@ -32,6 +33,7 @@ CommandList::~CommandList()
 int CommandList::getSize() {
     int s = sizeof(uint8_t) + // blend method
             sizeof(float) +   // blend fraction
+            sizeof(uint16_t) + // program id
             sizeof(uint16_t); // for numCommands
     for (int i = 0; i < (int)commands.size(); i++) {
         s += commands[i]->getSize();
@@ -48,6 +50,9 @@ int CommandList::pack(uint8_t* data) {
     memcpy(&data[pos], &cornerBlendMaxFraction, sizeof(cornerBlendMaxFraction));
     pos += sizeof(cornerBlendMaxFraction);
 
+    memcpy(&data[pos], &programId, sizeof(programId));
+    pos += sizeof(programId);
+
     uint16_t numCommands = (uint16_t)commands.size();
     memcpy(&data[pos], &numCommands, sizeof(numCommands));
     pos += sizeof(numCommands);
@@ -70,6 +75,9 @@ bool CommandList::unpack(uint8_t* data) {
     memcpy(&cornerBlendMaxFraction, &data[pos], sizeof(cornerBlendMaxFraction));
     pos += sizeof(cornerBlendMaxFraction);
 
+    memcpy(&programId, &data[pos], sizeof(programId));
+    pos += sizeof(programId);
+
     memcpy(&numCommands, &data[pos], sizeof(numCommands));
     pos += sizeof(numCommands);
 
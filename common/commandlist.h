@@ -13,6 +13,7 @@ class CommandList : public Packable {
 public:
     cornerBlendMethod_e cornerBlendMethod;
     float cornerBlendMaxFraction;
+    uint16_t programId; // chosen by the client so it can match up the result, zero to let the server choose
     scv::vec3 posLimitLower;
     scv::vec3 posLimitUpper;
     scv::vec2 rotationPositionLimits[NUM_ROTATION_AXES];
@@ -65,10 +65,40 @@ const char* getTrajectoryResultName(int mode) {
     case TR_FAIL_OUTSIDE_BOUNDS: return "fail (move outside bounds)";
     case TR_FAIL_FOLLOWING_ERROR: return "fail (following error)";
     case TR_FAIL_LIMIT_TRIGGERED: return "fail (limit triggered)";
+    case TR_FAIL_BUSY: return "fail (busy)";
+    case TR_FAIL_ABORTED: return "fail (aborted)";
     }
     return "getTrajectoryResultName: unknown";
 }
 
+const char* getRTStatsHistogramName(int which) {
+    switch ( which ) {
+    case RTH_WAKEUP_LATENESS: return "Wakeup lateness";
+    case RTH_COMPUTE_TIME: return "Compute time";
+    case RTH_SPI_TIME: return "SPI time";
+    }
+    return "getRTStatsHistogramName: unknown";
+}
+
+// Bins 0 and 1 are for 0us and 1us, after that each power of two is split into two halves,
+// eg. bin 2 is 2us, bin 3 is 3us, bin 4 is 4-5us, bin 5 is 6-7us, bin 6 is 8-11us etc.
+// The last bin also collects everything above it.
+int getRTStatsBin(uint32_t micros) {
+    if ( micros < 2 )
+        return micros;
+    int msb = 31 - __builtin_clz(micros);
+    int bin = 2 * msb + ((micros >> (msb - 1)) & 1);
+    return bin < RT_STATS_NUM_BINS ? bin : RT_STATS_NUM_BINS - 1;
+}
+
+// The smallest value in microseconds that goes into the given bin
+uint32_t getRTStatsBinStart(int bin) {
+    if ( bin < 2 )
+        return bin;
+    int msb = bin / 2;
+    return (1u << msb) + (bin & 1) * (1u << (msb - 1));
+}
+
 commandRequest_t createCommandRequest(uint16_t msgType)
 {
     commandRequest_t req;
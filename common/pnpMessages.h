@@ -6,7 +6,7 @@
 
 #include "../common/config.h"
 
-#define MESSAGE_VERSION 4
+#define MESSAGE_VERSION 7
 
 #define NUM_ROTATION_AXES 4
 
@@ -16,6 +16,11 @@
 
 #define JOINTS 4
 
+#define PROGRAM_QUEUE_SIZE      4   // max number of programs the server will hold, including the one currently running
+#define PROGRAM_RESULT_HISTORY  8   // number of recent program results repeated in every status report
+
+#define RT_STATS_NUM_BINS       32  // histogram bins, two per power of two microseconds, see getRTStatsBin
+
 #define COMMAND_MESSAGE_LIST \
     tmpMacro(MT_ACK)\
     tmpMacro(MT_NACK)\
@@ -53,6 +58,7 @@
     tmpMacro(MT_CONFIG_PROBING_FETCH)\
     tmpMacro(MT_CONFIG_ESTOP_SET)\
     tmpMacro(MT_CONFIG_ESTOP_FETCH)\
+    tmpMacro(MT_RT_STATS_FETCH)\
     tmpMacro(MT_MAX)
 
 
@@ -101,6 +107,8 @@ enum trajectoryResult_e {
     TR_FAIL_OUTSIDE_BOUNDS,
     TR_FAIL_FOLLOWING_ERROR,
     TR_FAIL_LIMIT_TRIGGERED,
+    TR_FAIL_BUSY,
+    TR_FAIL_ABORTED,
 };
 
 enum probeType_t {
@@ -114,6 +122,19 @@ enum probePhase_t {
     PP_SLOW_APPROACH = 0x2
 };
 
+typedef struct PACKED {
+    uint16_t programId;
+    uint8_t result;
+} programResult_t;
+
+// Timing of the realtime thread, one histogram of microseconds for each of these
+enum rtStatsHistogram_e {
+    RTH_WAKEUP_LATENESS,    // how long after the scheduled time the loop actually woke up
+    RTH_COMPUTE_TIME,       // time spent in the loop other than the SPI transfer
+    RTH_SPI_TIME,           // time spent in the SPI transfer
+    RTH_MAX
+};
+
 typedef struct PACKED {
     uint8_t messageVersion;
     bool spiOk;
@@ -151,6 +172,13 @@ typedef struct PACKED {
     uint16_t pwm;
     float weight;
     float probedHeight;
+
+    // Programs are queued on the server and run back to back. Results are given per program, and
+    // the most recent few are repeated in every report so that they survive dropped (conflated) reports.
+    uint8_t programQueueDepth;                          // number of programs waiting or running
+    uint16_t queuedProgramIds[PROGRAM_QUEUE_SIZE];      // in the order they will run, first is the one running now
+    uint16_t programResultCount;                        // total number of results so far (wraps)
+    programResult_t programResults[PROGRAM_RESULT_HISTORY]; // result number n is at index n % PROGRAM_RESULT_HISTORY
 } clientReport_t;
 
 
@@ -205,6 +233,10 @@ typedef struct PACKED {
     float z;
 } msg_probe;
 
+typedef struct PACKED {
+    uint8_t reset; // start collecting again from zero after this fetch
+} msg_rtStatsFetch;
+
 
 
 typedef struct PACKED {
@@ -276,6 +308,13 @@ typedef struct PACKED {
     uint8_t pwmUsed;
 } msg_configEstop;
 
+typedef struct PACKED {
+    uint32_t ticks;                                 // loop iterations counted
+    uint32_t overruns;                              // iterations that were still running when the next should have started
+    uint32_t maxMicros[RTH_MAX];
+    uint32_t bins[RTH_MAX][RT_STATS_NUM_BINS];
+} msg_rtStats;
+
 
 
 // Note that a commandRequest_t must be POD because it might be queued in requestsQueue
@@ -295,6 +334,7 @@ typedef struct PACKED {
         msg_homeAxes homeAxes;
         msg_probe probe;
         msg_resetLoadcell resetLoadcell;
+        msg_rtStatsFetch rtStatsFetch;
         msg_configSteps configSteps;
         msg_configWorkingArea workingArea;
         msg_configMotionLimits motionLimits;
@@ -326,6 +366,7 @@ typedef struct PACKED {
         msg_configLoadCellCalib loadcellCalib;
         msg_configProbing probingParams;
         msg_configEstop estopParams;
+        msg_rtStats rtStats;
     } PACKED;
 } commandReply_t;
 
@@ -336,6 +377,10 @@ const char* getModeName(int mode);
 const char* getHomingResultName(int mode);
 const char* getProbingResultName(int mode);
 const char* getTrajectoryResultName(int mode);
+const char* getRTStatsHistogramName(int which);
+
+int getRTStatsBin(uint32_t micros);
+uint32_t getRTStatsBinStart(int bin);
 
 commandRequest_t createCommandRequest(uint16_t msgType);
 
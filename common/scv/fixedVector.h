@@ -0,0 +1,77 @@
+
+#ifndef SCV_FIXEDVECTOR_H
+#define SCV_FIXEDVECTOR_H
+
+#include <stddef.h>
+
+namespace scv {
+
+    // A vector with its storage inside the object itself, for the small lists of segments
+    // each move and rotation is made of. Unlike std::vector, copying or clearing one of these
+    // never touches the heap, so planners can be rebuilt from the realtime thread.
+    // Items added beyond the capacity are dropped, and the overflowed flag is set.
+    template <typename T, int N>
+    class fixedVector {
+        T items[N];
+        int count;
+
+    public:
+        bool overflowed;
+
+        fixedVector() {
+            count = 0;
+            overflowed = false;
+        }
+
+        typedef T* iterator;
+
+        int capacity() const { return N; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        void clear() { count = 0; overflowed = false; }
+
+        T& operator[] (size_t i) { return items[i]; }
+        const T& operator[] (size_t i) const { return items[i]; }
+
+        T& front() { return items[0]; }
+        T& back() { return items[count-1]; }
+
+        iterator begin() { return items; }
+        iterator end() { return items + count; }
+
+        void push_back(const T& t) {
+            if ( count >= N ) {
+                overflowed = true;
+                return;
+            }
+            items[count++] = t;
+        }
+
+        void pop_back() {
+            if ( count > 0 )
+                count--;
+        }
+
+        void insert(iterator pos, const T& t) {
+            if ( count >= N ) {
+                overflowed = true;
+                return;
+            }
+            for (iterator it = end(); it != pos; it--)
+                *it = *(it-1);
+            *pos = t;
+            count++;
+        }
+
+        // Removes [first,last), as used with std::remove_if
+        void erase(iterator first, iterator last) {
+            iterator dst = first;
+            for (iterator it = last; it != end(); it++)
+                *dst++ = *it;
+            count -= (int)(last - first);
+        }
+    };
+
+} // namespace
+
+#endif
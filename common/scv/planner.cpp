@@ -83,11 +83,14 @@ planner::planner()
     velLimit = vec3_zero;
     accLimit = vec3_zero;
     jerkLimit = vec3_zero;
+    numSyncedEventIds = 0;
     resetTraverse();
 }
 
 bool planner::calculateMoves()
 {
+    compiled.clear();
+
     bool invalidSettings = false;
     if ( velLimit.anyZero() ) {
         g_log.log(LL_ERROR, "Global velocity limit has zero component!\n");
@@ -163,7 +166,7 @@ bool planner::calculateMoves()
         // remove segments that were replaced by a blended corner
         for (size_t i = 0; i < moves.size(); i++) {
             move& m = moves[i];
-            std::vector<segment>& segs = m.segments;
+            fixedVector<segment, MAX_SEGMENTS_PER_MOVE>& segs = m.segments;
             segs.erase( std::remove_if(std::begin(segs), std::end(segs), [](segment& s) { return s.toDelete || s.duration <= 0; }), segs.end());
         }
 
@@ -182,6 +185,10 @@ bool planner::calculateMoves()
     // set the 'duration' of each move from its segments
     for (size_t i = 0; i < moves.size(); i++) {
         move& m = moves[i];
+        if ( m.segments.overflowed ) {
+            g_log.log(LL_ERROR, "Move %d has more than %d segments!\n", (int)i, MAX_SEGMENTS_PER_MOVE);
+            return false;
+        }
         m.duration = 0;
         if ( m.moveType == MT_SYNC )
             continue;
@@ -196,6 +203,8 @@ bool planner::calculateMoves()
 
     collateSegments();
 
+    compileTrajectory();
+
     return true;
 }
 
@@ -203,9 +212,23 @@ void planner::clear()
 {
     moves.clear();
     segments.clear();
+    compiled.clear();
     delayableEvents.clear();
     rotationsInProgress.clear();
-    unsyncedDelayableEvents.clear();
+    syncableEventIds.clear();
+    numSyncedEventIds = 0;
+}
+
+// Preallocates everything needed for a plan of up to this many moves and delayable events, so that
+// it can be cleared and recalculated again without any heap allocation, eg. in the realtime thread.
+void planner::reserve(int maxMoves, int maxEvents)
+{
+    moves.reserve( maxMoves );
+    segments.reserve( maxMoves * MAX_SEGMENTS_PER_MOVE );
+    delayableEvents.reserve( maxEvents );
+    syncableEventIds.reserve( maxEvents );
+    rotationsInProgress.reserve( maxEvents );
+    compiled.reserve( maxMoves * MAX_SEGMENTS_PER_MOVE, maxMoves, maxEvents );
 }
 
 void planner::setCornerBlendMethod(cornerBlendMethod_e m)
@@ -723,6 +746,8 @@ void planner::addOffsetToMoves(vec3 offset)
             s.pos -= offset;
         }
     }
+
+    compileTrajectory();
 }
 
 void planner::getSegmentState(segment& s, float t, vec3* pos, vec3* vel, vec3* acc, vec3* jerk )
@@ -848,12 +873,12 @@ void planner::resetTraverse()
     rotationsInProgress.clear();
 
     traversal_time = 0;
+    traversal_moveIndex = 0;
     //traversal_pos = vec3_zero;
     //traversal_vel = vec3_zero;
-    for (size_t i = 0; i < moves.size(); i++) {
-        move& m = moves[i];
-        m.traversal_segmentIndex = 0;
-        m.traversal_segmentTime = 0;
+    for (size_t i = 0; i < compiled.moveFirstSegment.size(); i++) {
+        compiled.moveSegmentIndex[i] = compiled.moveFirstSegment[i];
+        compiled.moveTime[i] = 0;
     }
 }
 
@@ -912,43 +937,140 @@ bool planner::advanceRotations(float dt)
     return anyStillGoing;
 }
 
-bool advanceMoveTraverse(move &m, scv_float dt, vec3 *p, vec3 *v)
+void compiledTrajectory::reserve(int numSegments, int numMoves, int numEvents)
 {
-    if ( m.segments.empty() ) {
-        *p = m.src;
-        *v = vec3_zero;
-        return false;
+    segmentDuration.reserve( numSegments );
+    for (int i = 0; i < 3; i++)
+        coeffs[i].reserve( 4 * numSegments );
+
+    moveFirstSegment.reserve( numMoves );
+    moveLastSegment.reserve( numMoves );
+    moveStart.reserve( numMoves );
+    moveEnd.reserve( numMoves );
+    moveIsSync.reserve( numMoves );
+    moveSrc.reserve( numMoves );
+    moveSegmentIndex.reserve( numMoves );
+    moveTime.reserve( numMoves );
+
+    eventTime.reserve( numEvents );
+}
+
+void compiledTrajectory::clear()
+{
+    segmentDuration.clear();
+    for (int i = 0; i < 3; i++)
+        coeffs[i].clear();
+
+    moveFirstSegment.clear();
+    moveLastSegment.clear();
+    moveStart.clear();
+    moveEnd.clear();
+    moveIsSync.clear();
+    moveSrc.clear();
+    moveSegmentIndex.clear();
+    moveTime.clear();
+
+    eventTime.clear();
+}
+
+void compiledTrajectory::addSegment(segment& s)
+{
+    segmentDuration.push_back( s.duration );
+    for (int i = 0; i < 3; i++) {
+        coeffs[i].push_back( s.pos[i] );
+        coeffs[i].push_back( s.vel[i] );
+        coeffs[i].push_back( s.acc[i] / 2.0f );
+        coeffs[i].push_back( s.jerk[i] / 6.0f );
     }
+}
 
-    m.traversal_segmentTime += dt;
-    segment seg = m.segments[m.traversal_segmentIndex];
+void compiledTrajectory::evaluateSegment(int s, float t, vec3* pos, vec3* vel)
+{
+    for (int i = 0; i < 3; i++) {
+        const float* c = &coeffs[i][4*s];
+        (*pos)[i] = c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+        (*vel)[i] = c[1] + t * (2 * c[2] + t * 3 * c[3]);
+    }
+}
 
+// Moves the segment index s forward to the segment containing time t, and evaluates it there. The time
+// is relative to the start of segment s, and is kept that way (rather than relative to the start of the
+// whole trajectory) so that it doesn't lose precision on long trajectories.
+// Returns false if t is already past the end of lastSegment, in which case the end point is given.
+bool compiledTrajectory::evaluateAt(int& s, int lastSegment, float& t, vec3* pos, vec3* vel)
+{
     // Use 'while' here to consume zero-duration (or otherwise very short) segments immediately!
-    // It's pretty important to make sure that dt is actually within the next segment instead of
+    // It's pretty important to make sure that t is actually within the next segment instead of
     // just assuming it is, otherwise we might return a location beyond the end of the next
     // segment, and then in the following iteration a location near the start of the following
     // segment, which could potentially reverse the direction of travel!
-    while ( m.traversal_segmentTime > seg.duration ) {
-        // exceeded current segment
-        if ( m.traversal_segmentIndex < ((int)m.segments.size()-1) ) {
+    while ( t > segmentDuration[s] ) {
+        if ( s < lastSegment ) {
             // more segments remain
-            m.traversal_segmentIndex++;
-            m.traversal_segmentTime -= seg.duration;
-            seg = m.segments[m.traversal_segmentIndex];
+            t -= segmentDuration[s];
+            s++;
         }
         else {
             // already on final segment
-            vec3 tmpA;
-            getSegmentPosVelAcc(seg, seg.duration, p, v, &tmpA);
+            evaluateSegment(s, segmentDuration[s], pos, vel);
             return false;
         }
     }
 
-    vec3 tmpA;
-    getSegmentPosVelAcc(seg, m.traversal_segmentTime, p, v, &tmpA);
+    evaluateSegment(s, t, pos, vel);
     return true;
 }
 
+// Copies the segments into the compiled table, from the moves for interpolated moves or from the
+// collated segments otherwise. This must be done again after anything that changes the segments.
+void planner::compileTrajectory()
+{
+    compiled.clear();
+
+    if ( cornerBlendMethod == CBM_INTERPOLATED_MOVES ) {
+        for (size_t i = 0; i < moves.size(); i++) {
+            move& m = moves[i];
+
+            compiled.moveFirstSegment.push_back( (int)compiled.segmentDuration.size() );
+            for (size_t k = 0; k < m.segments.size(); k++)
+                compiled.addSegment( m.segments[k] );
+            compiled.moveLastSegment.push_back( (int)compiled.segmentDuration.size() - 1 );
+
+            compiled.moveStart.push_back( m.scheduledTime );
+            compiled.moveEnd.push_back( m.scheduledTime + m.duration );
+            compiled.moveIsSync.push_back( m.moveType == MT_SYNC );
+            compiled.moveSrc.push_back( m.src );
+        }
+        compiled.moveSegmentIndex = compiled.moveFirstSegment;
+        compiled.moveTime.assign( moves.size(), 0 );
+    }
+    else {
+        for (size_t i = 0; i < segments.size(); i++)
+            compiled.addSegment( segments[i] );
+    }
+
+    for (size_t i = 0; i < delayableEvents.size(); i++) {
+        delayableEvent& de = delayableEvents[i];
+        compiled.eventTime.push_back( de.triggerTime + de.delay );
+    }
+
+    // advanceTraverse adds to this as rotations start, make sure that won't need to allocate
+    rotationsInProgress.reserve( delayableEvents.size() );
+}
+
+bool planner::advanceCompiledMove(int i, scv_float dt, vec3 *p, vec3 *v)
+{
+    if ( compiled.moveLastSegment[i] < compiled.moveFirstSegment[i] ) {
+        *p = compiled.moveSrc[i];
+        *v = vec3_zero;
+        return false;
+    }
+
+    compiled.moveTime[i] += dt;
+
+    return compiled.evaluateAt( compiled.moveSegmentIndex[i], compiled.moveLastSegment[i], compiled.moveTime[i], p, v );
+}
+
 bool planner::advanceTraverse(float dt, float speedScale, vec3 *p, vec3 *v, float* rots, traverseFeedback_t *feedback)
 {
     feedback->stillRunning = false;
@@ -961,9 +1083,9 @@ bool planner::advanceTraverse(float dt, float speedScale, vec3 *p, vec3 *v, floa
 
     traversal_totalTime += dt;
 
-    while ( traversal_delayableEventIndex < (int8_t)delayableEvents.size() ) {
-        delayableEvent& de = delayableEvents[traversal_delayableEventIndex];
-        if ( traversal_totalTime >= (de.triggerTime + de.delay) ) {
+    while ( traversal_delayableEventIndex < (int)compiled.eventTime.size() ) {
+        if ( traversal_totalTime >= compiled.eventTime[traversal_delayableEventIndex] ) {
+            delayableEvent& de = delayableEvents[traversal_delayableEventIndex];
             if ( de.type == DET_DIGITAL_OUTPUT ) {
                 feedback->digitalOutputBits = (feedback->digitalOutputBits & ~de.changed) | (de.bits & de.changed);
                 feedback->digitalOutputChanged |= de.changed; // or-equals here, to apply all changes if more than one digital output in a row
@@ -994,21 +1116,30 @@ bool planner::advanceTraverse(float dt, float speedScale, vec3 *p, vec3 *v, floa
 
         traversal_time += dt;
 
-        for (size_t i = 0; i < moves.size(); i++) {
-            move& m = moves[i];
+        // Skip over moves that are already finished, so that we don't have to check the whole list
+        // from the beginning on every call. The end times of moves are in ascending order, and syncs
+        // are never used here, so anything before this index will never be needed again.
+        int numMoves = (int)compiled.moveStart.size();
+        while ( traversal_moveIndex < numMoves ) {
+            if ( ! compiled.moveIsSync[traversal_moveIndex] && traversal_time <= compiled.moveEnd[traversal_moveIndex] )
+                break;
+            traversal_moveIndex++;
+        }
+
+        for (int i = traversal_moveIndex; i < numMoves; i++) {
 
-            if ( m.moveType == MT_SYNC )
+            if ( compiled.moveIsSync[i] )
                 continue;
 
-            if ( traversal_time < m.scheduledTime ) {
+            if ( traversal_time < compiled.moveStart[i] ) {
                 stillRunning |= true;
                 break;
             }
-            if ( traversal_time > m.scheduledTime + m.duration )
+            if ( traversal_time > compiled.moveEnd[i] )
                 continue;
 
             vec3 tmpP, tmpV;
-            stillRunning |= advanceMoveTraverse(m, dt, &tmpP, &tmpV);
+            stillRunning |= advanceCompiledMove(i, dt, &tmpP, &tmpV);
 
             if ( movesUsed == 0 ) {
                 *p = vec3_zero;
@@ -1018,7 +1149,7 @@ bool planner::advanceTraverse(float dt, float speedScale, vec3 *p, vec3 *v, floa
             *p += tmpP;
             *v += tmpV;
 
-            lastSrc = m.src;
+            lastSrc = compiled.moveSrc[i];
             movesUsed++;
         }
 
@@ -1036,37 +1167,15 @@ bool planner::advanceTraverse(float dt, float speedScale, vec3 *p, vec3 *v, floa
         return stillRunning | rotationsStillRunning;
     }
     else {
-        if ( segments.empty() ) {
+        if ( compiled.segmentDuration.empty() ) {
             return rotationsStillRunning;
         }
 
-        segment seg = segments[traversal_segmentIndex];
-
         traversal_segmentTime += dt;
 
-        // Use 'while' here to consume zero-duration (or otherwise very short) segments immediately!
-        // It's pretty important to make sure that dt is actually within the next segment instead of
-        // just assuming it is, otherwise we might return a location beyond the end of the next
-        // segment, and then in the following iteration a location near the start of the following
-        // segment, which could potentially reverse the direction of travel!
-        while ( traversal_segmentTime > seg.duration ) {
-            // exceeded current segment
-            if ( traversal_segmentIndex < ((int)segments.size()-1) ) {
-                // more segments remain
-                traversal_segmentIndex++;
-                traversal_segmentTime -= seg.duration;
-                seg = segments[traversal_segmentIndex];
-            }
-            else {
-                // already on final segment
-                vec3 tmpA;
-                getSegmentPosVelAcc(seg, seg.duration, p, v, &tmpA);
-                return rotationsStillRunning;
-            }
-        }
+        if ( ! compiled.evaluateAt( traversal_segmentIndex, (int)compiled.segmentDuration.size()-1, traversal_segmentTime, p, v ) )
+            return rotationsStillRunning;
 
-        vec3 tmpA;
-        getSegmentPosVelAcc(seg, traversal_segmentTime, p, v, &tmpA);
         return true;
     }
 }
@@ -1596,7 +1705,7 @@ void planner::appendRotate( rotate& r, float delay )
     de.id = id;
 
     delayableEvents.push_back( de );
-    unsyncedDelayableEvents.push_back( id );
+    syncableEventIds.push_back( id );
 }
 
 void planner::appendSync(vec3& where)
@@ -1616,8 +1725,9 @@ void planner::appendSync(vec3& where)
 
     m.dst = m.src;
 
-    m.eventIndicesToSync = unsyncedDelayableEvents;
-    unsyncedDelayableEvents.clear();
+    m.syncEventsBegin = numSyncedEventIds;
+    m.syncEventsEnd = (int)syncableEventIds.size();
+    numSyncedEventIds = m.syncEventsEnd;
 
     moves.push_back(m);
 }
@@ -1698,8 +1808,8 @@ void planner::collateSegments()
             int highestUsedId = 0;
 
             float extraDelay = 0;
-            for (size_t k = 0; k < m.eventIndicesToSync.size(); k++) {
-                int id = m.eventIndicesToSync[k];
+            for (int k = m.syncEventsBegin; k < m.syncEventsEnd; k++) {
+                int id = syncableEventIds[k];
                 highestUsedId = max(highestUsedId, id);
                 delayableEvent& de = delayableEvents[id];
                 float endTime = de.triggerTime + de.delay + getRotationDuration(de.rot);
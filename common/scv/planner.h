@@ -4,12 +4,17 @@
 #include <vector>
 #include <stdint.h>
 #include "vec3.h"
+#include "fixedVector.h"
 
 //#include "../commands.h"
 
 #define NUM_ROTATION_AXES   4
 #define NUM_PWM_VALS        4
 
+// Enough for the 7 segments of a move, plus those added for corner blends and syncs
+#define MAX_SEGMENTS_PER_MOVE       12
+#define MAX_SEGMENTS_PER_ROTATION   8
+
 void initInvalidFloats(float* v, int n);
 
 enum cornerBlendMethod_e {
@@ -80,7 +85,7 @@ namespace scv {
         scv_float acc;
         scv_float jerk;
 
-        std::vector<rotateSegment> rotation_segments;
+        fixedVector<rotateSegment, MAX_SEGMENTS_PER_ROTATION> rotation_segments;
         int rotation_segmentIndex;
         scv_float rotation_segmentTime;
 
@@ -127,8 +132,9 @@ namespace scv {
         // for wait 'moves'
         float waitDuration;
 
-        // for sync 'moves'
-        std::vector<int> eventIndicesToSync; // index into delayableEvents of the plan
+        // for sync 'moves', the range of syncableEventIds in the plan that must finish before continuing
+        int syncEventsBegin;
+        int syncEventsEnd;
 
         // constraints on the movement
         scv_float vel;
@@ -138,31 +144,60 @@ namespace scv {
         scv_float blendClearance;
         bool containsBlend;        
 
-        std::vector<segment> segments;
+        fixedVector<segment, MAX_SEGMENTS_PER_MOVE> segments;
 
         float duration;
         float scheduledTime;
-        int traversal_segmentIndex;
-        scv_float traversal_segmentTime;
 
         move() {
             moveType = MT_NORMAL;
             src = vec3_zero;
             dst = vec3_zero;
             waitDuration = 0;
+            syncEventsBegin = 0;
+            syncEventsEnd = 0;
             vel = 0;
             acc = 0;
             jerk = 0;
             blendType = CBT_MAX_JERK;
             blendClearance = -1; // none
             containsBlend = false;
-            traversal_segmentIndex = 0;
-            traversal_segmentTime = 0;
             duration = 0;
             scheduledTime = 0;
         }
     };
 
+    // The calculated trajectory flattened into a few contiguous arrays, so that traversing it
+    // (every tick in the realtime thread) touches as little memory as possible and never copies
+    // a whole segment. Each segment is stored as coefficients of its position polynomial,
+    //     pos(t) = c0 + t * (c1 + t * (c2 + t * c3))
+    // where t is the time since the segment started.
+    struct compiledTrajectory {
+
+        // per segment
+        std::vector<float> segmentDuration;
+        std::vector<float> coeffs[3];           // for each axis, c0,c1,c2,c3 of each segment
+
+        // per move, only used for interpolated moves
+        std::vector<int> moveFirstSegment;
+        std::vector<int> moveLastSegment;       // less than moveFirstSegment if the move has no segments
+        std::vector<float> moveStart;
+        std::vector<float> moveEnd;
+        std::vector<uint8_t> moveIsSync;
+        std::vector<vec3> moveSrc;
+        std::vector<int> moveSegmentIndex;      // traversal state
+        std::vector<float> moveTime;            // traversal state, time since the current segment of the move started
+
+        // per delayable event
+        std::vector<float> eventTime;           // trigger time including delay
+
+        void clear();
+        void reserve(int numSegments, int numMoves, int numEvents);
+        void addSegment(segment& s);
+        void evaluateSegment(int s, float t, vec3* pos, vec3* vel);
+        bool evaluateAt(int& s, int lastSegment, float& t, vec3* pos, vec3* vel);
+    };
+
     struct traverseFeedback_t {
         moveType_e moveType;
         uint16_t digitalOutputBits;
@@ -205,26 +240,32 @@ namespace scv {
         std::vector<segment> segments;
 
         std::vector<delayableEvent> delayableEvents;
-        std::vector<int> unsyncedDelayableEvents; // these are ids of a delayable event
+        std::vector<int> syncableEventIds; // ids of delayable events that a sync waits for, in the order they were appended
+        int numSyncedEventIds;             // how many of syncableEventIds are covered by a sync already
 
         std::vector<rotate*> rotationsInProgress;
 
+        compiledTrajectory compiled;
+
         scv_float traversal_totalTime;
         int traversal_delayableEventIndex;
-        int traversal_segmentIndex;
-        scv_float traversal_segmentTime;
+        int traversal_segmentIndex;     // for segments, when not using interpolated moves
+        scv_float traversal_segmentTime; // time since the start of the current segment, when not using interpolated moves
         float traversal_rots[NUM_ROTATION_AXES];
 
         // for interpolated moves
         //vec3 traversal_pos;
         //vec3 traversal_vel;
         scv_float traversal_time; // same as traversal_totalTime ?
+        int traversal_moveIndex; // index of the earliest move that has not finished yet, only ever increases
 
         void calculateMove(move& m);
         void calculateSchedules();
         void calculateRotation(rotate& r);
         void blendCorner(move& m0, move& m1, bool isFirst, bool isLast);
         void collateSegments();
+        void compileTrajectory();
+        bool advanceCompiledMove(int i, scv_float dt, vec3* p, vec3* v);
         void getSegmentState(segment& s, scv_float t, vec3* pos, vec3* vel, vec3* acc, vec3* jerk );
         //void getSegmentPosition(segment& s, scv_float t, scv::vec3* pos);
         //void getSegmentPosVelAcc(segment& s, scv_float t, scv::vec3* pos, scv::vec3* vel, vec3 *acc);
@@ -238,6 +279,7 @@ namespace scv {
         planner();
 
         void clear();
+        void reserve(int maxMoves, int maxEvents);
 
         void setCornerBlendMethod(cornerBlendMethod_e m);
         void setMaxCornerBlendOverlapFraction(scv_float f);
@@ -0,0 +1,149 @@
+
+#include <string.h>
+
+#include "telemetry.h"
+
+static void toChannels(const telemetrySample_t& s, uint32_t* c) {
+    int n = 0;
+    c[n++] = s.seq;
+    memcpy(&c[n], s.targetPos, sizeof(s.targetPos)); n += 3;
+    memcpy(&c[n], s.actualPos, sizeof(s.actualPos)); n += 3;
+    memcpy(&c[n], s.vel, sizeof(s.vel));             n += 3;
+    memcpy(&c[n], s.freq, sizeof(s.freq));           n += JOINTS;
+    c[n++] = s.inputs;
+    c[n++] = s.outputs;
+    c[n++] = s.pressure;
+    c[n++] = (uint32_t)s.loadcell;
+}
+
+static void fromChannels(const uint32_t* c, telemetrySample_t& s) {
+    int n = 0;
+    s.seq = c[n++];
+    memcpy(s.targetPos, &c[n], sizeof(s.targetPos)); n += 3;
+    memcpy(s.actualPos, &c[n], sizeof(s.actualPos)); n += 3;
+    memcpy(s.vel, &c[n], sizeof(s.vel));             n += 3;
+    memcpy(s.freq, &c[n], sizeof(s.freq));           n += JOINTS;
+    s.inputs = c[n++];
+    s.outputs = c[n++];
+    s.pressure = c[n++];
+    s.loadcell = (int32_t)c[n++];
+}
+
+static inline void putVarint(uint8_t* buf, int& pos, uint32_t v) {
+    while ( v >= 0x80 ) {
+        buf[pos++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    buf[pos++] = v;
+}
+
+static inline bool getVarint(const uint8_t* buf, int size, int& pos, uint32_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if ( pos >= size )
+            return false;
+        uint8_t b = buf[pos++];
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if ( ! (b & 0x80) )
+            return true;
+    }
+    return false;
+}
+
+// small differences in either direction become small unsigned values
+static inline uint32_t zigzag(uint32_t d) {
+    return (d << 1) ^ (uint32_t)((int32_t)d >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t z) {
+    return (z >> 1) ^ (0 - (z & 1));
+}
+
+// The sequence number is expected to go up by one each sample, so that channel is stored as the
+// difference from that rather than from the previous value, and is usually not stored at all.
+static inline void predictNext(uint32_t* prev) {
+    prev[0]++;
+}
+
+// Returns the number of bytes written, or -1 if the buffer might not be big enough.
+int encodeTelemetryFrame(const telemetrySample_t* samples, int numSamples, uint8_t* buf, int bufSize) {
+
+    if ( numSamples < 1 || numSamples > 0xffff )
+        return -1;
+    if ( bufSize < (int)sizeof(telemetryFrameHeader_t) + numSamples * TELEMETRY_MAX_SAMPLE_SIZE )
+        return -1;
+
+    telemetryFrameHeader_t header;
+    header.messageVersion = MESSAGE_VERSION;
+    header.numSamples = numSamples;
+    header.firstSeq = samples[0].seq;
+    memcpy(buf, &header, sizeof(header));
+
+    int pos = sizeof(header);
+
+    uint32_t prev[TELEMETRY_NUM_CHANNELS] = {0};
+    prev[0] = header.firstSeq - 1;
+
+    for (int i = 0; i < numSamples; i++) {
+
+        uint32_t cur[TELEMETRY_NUM_CHANNELS];
+        toChannels(samples[i], cur);
+
+        predictNext(prev);
+
+        uint32_t changed = 0;
+        for (int k = 0; k < TELEMETRY_NUM_CHANNELS; k++) {
+            if ( cur[k] != prev[k] )
+                changed |= 1 << k;
+        }
+
+        putVarint(buf, pos, changed);
+        for (int k = 0; k < TELEMETRY_NUM_CHANNELS; k++) {
+            if ( changed & (1 << k) )
+                putVarint(buf, pos, zigzag(cur[k] - prev[k]));
+        }
+
+        memcpy(prev, cur, sizeof(prev));
+    }
+
+    return pos;
+}
+
+// Returns the number of samples decoded, or -1 if the frame is not valid.
+int decodeTelemetryFrame(const uint8_t* buf, int size, telemetrySample_t* samples, int maxSamples) {
+
+    telemetryFrameHeader_t header;
+    if ( size < (int)sizeof(header) )
+        return -1;
+    memcpy(&header, buf, sizeof(header));
+
+    if ( header.messageVersion != MESSAGE_VERSION || header.numSamples > maxSamples )
+        return -1;
+
+    int pos = sizeof(header);
+
+    uint32_t prev[TELEMETRY_NUM_CHANNELS] = {0};
+    prev[0] = header.firstSeq - 1;
+
+    for (int i = 0; i < header.numSamples; i++) {
+
+        predictNext(prev);
+
+        uint32_t changed;
+        if ( ! getVarint(buf, size, pos, changed) )
+            return -1;
+
+        for (int k = 0; k < TELEMETRY_NUM_CHANNELS; k++) {
+            if ( changed & (1 << k) ) {
+                uint32_t z;
+                if ( ! getVarint(buf, size, pos, z) )
+                    return -1;
+                prev[k] += unzigzag(z);
+            }
+        }
+
+        fromChannels(prev, samples[i]);
+    }
+
+    return header.numSamples;
+}
@@ -0,0 +1,44 @@
+#ifndef PNP_TELEMETRY_H
+#define PNP_TELEMETRY_H
+
+#include <stdint.h>
+#include "pnpMessages.h"
+
+// Every tick of the realtime loop is sampled and published on its own socket, in frames of
+// TELEMETRY_SAMPLES_PER_FRAME samples. Unlike the status reports this socket is not conflated,
+// and each sample has the tick number so the client can tell if anything was lost.
+//
+// A frame is a telemetryFrameHeader_t followed by the samples. Each sample is a bitmask (varint)
+// of which channels changed from the previous sample, then a zigzag varint of the difference for
+// each of those channels. Floats are differenced as their bit patterns so nothing is lost, and
+// the first sample is relative to zero so every frame can be decoded on its own.
+
+#define TELEMETRY_PORT                  5563
+#define TELEMETRY_SAMPLES_PER_FRAME     50      // 50ms at 1kHz
+
+#define TELEMETRY_NUM_CHANNELS          18      // number of 32 bit values in a sample, see toChannels
+#define TELEMETRY_MAX_SAMPLE_SIZE       (3 + 5 * TELEMETRY_NUM_CHANNELS)
+#define TELEMETRY_MAX_FRAME_SIZE        (sizeof(telemetryFrameHeader_t) + TELEMETRY_SAMPLES_PER_FRAME * TELEMETRY_MAX_SAMPLE_SIZE)
+
+typedef struct {
+    uint32_t seq;               // realtime tick number, consecutive unless samples were lost
+    float targetPos[3];
+    float actualPos[3];
+    float vel[3];
+    float freq[JOINTS];         // frequency commands sent to the PRU
+    uint16_t inputs;
+    uint16_t outputs;
+    uint16_t pressure;
+    int32_t loadcell;
+} telemetrySample_t;
+
+typedef struct PACKED {
+    uint16_t messageVersion;
+    uint16_t numSamples;
+    uint32_t firstSeq;
+} telemetryFrameHeader_t;
+
+int encodeTelemetryFrame(const telemetrySample_t* samples, int numSamples, uint8_t* buf, int bufSize);
+int decodeTelemetryFrame(const uint8_t* buf, int size, telemetrySample_t* samples, int maxSamples);
+
+#endif
@@ -6,6 +6,7 @@
 #include "commandlist_parse.h"
 #include "script/engine.h"
 #include "net_requester.h"
+#include "run.h"
 
 using namespace std;
 using namespace scv;
@@ -171,7 +172,6 @@ int CommandEditorWindow::pushStyleColors()
     return 9;
 }
 
-extern trajectoryResult_e lastTrajResult;
 
 bool CommandEditorWindow::runCommandList(bool previewOnly)
 {
@@ -218,7 +218,7 @@ bool CommandEditorWindow::runCommandList(bool previewOnly)
         }
         else {
             if ( sanityCheckCommandList(program) ) {
-                lastTrajResult = TR_NONE;
+                assignProgramId(program);
                 sendPackable(MT_SET_PROGRAM, program);
             }
         }
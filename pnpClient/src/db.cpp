@@ -45,7 +45,7 @@ bool openDatabase(std::string filename)
     if ( ! ensureDBFileExists(filename) )
         return false;
 
-    int rc = sqlite3_open_v2(filename.c_str(), &db, SQLITE_OPEN_READWRITE, NULL);
+    int rc = sqlite3_open_v2(filename.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX, NULL); // also used from camera threads
     if( SQLITE_OK != rc ) {
         //g_log.log(LL_ERROR, "Can't open database: %s", sqlite3_errmsg(db));
         sqlite3_close(db);
@@ -0,0 +1,258 @@
+
+#include "hsv.h"
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HSV_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HSV_SSE2
+#endif
+
+void rgb2hsv(const uint8_t* rgb, uint8_t* hsv)
+{
+    int min, max, delta;
+
+    int r = rgb[0];
+    int g = rgb[1];
+    int b = rgb[2];
+
+    min = r < g ? r : g;
+    min = min < b ? min : b;
+
+    max = r > g ? r : g;
+    max = max  > b ? max : b;
+
+    hsv[2] = max;
+    delta = max - min;
+    if (delta < 1)
+    {
+        hsv[1] = 0;
+        hsv[0] = 0; // undefined, maybe nan?
+        return;
+    }
+
+    if ( max > 0.0 ) { // NOTE: if Max is == 0, this divide would cause a crash
+        hsv[1] = (delta / (float)max) * 255;
+    } else {
+        // if max is 0, then r = g = b = 0
+        // s = 0, h is undefined
+        hsv[1] = 0.0;
+        hsv[0] = 0;                            // its now undefined
+        return;
+    }
+
+    float h = 0;
+    if( r >= max )                           // > is bogus, just keeps compilor happy
+        h = ( g - b ) / (float)delta;        // between yellow & magenta
+    else if ( g >= max )
+        h = 2 + ( b - r ) / (float)delta;  // between cyan & yellow
+    else
+        h = 4 + ( r - g ) / (float)delta;  // between magenta & cyan
+
+    //out.h *= 60.0;                              // degrees
+
+    if ( h < 0.0 )
+        h += 6;
+
+    hsv[0] = h * 42.4;
+}
+
+// The vector versions below do 16 pixels at a time, giving planar h, s and v. To match rgb2hsv
+// exactly they use the same float operations in the same order: the divides are exact in both,
+// adding the 0/2/4 sector offset to the quotient is the same single rounding, and the final
+// multiply by 42.4 is done in double like the scalar one (in float it differs for a few hundred
+// colors). Where max == min both h and s come out as zero, the same as the early return above.
+
+#define HSV_BLOCK 16
+
+#ifdef HSV_SSE2
+
+static inline __m128i select128(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// 4 pixels, all inputs are 32 bit ints
+static inline void hueSat(__m128i num, __m128i delta, __m128i max, __m128i off, __m128i& h, __m128i& s)
+{
+    __m128i one = _mm_set1_epi32(1);
+    __m128i deltaDiv = select128(_mm_cmpeq_epi32(delta, _mm_setzero_si128()), one, delta);
+    __m128i maxDiv = select128(_mm_cmpeq_epi32(max, _mm_setzero_si128()), one, max);
+
+    __m128 fh = _mm_add_ps(_mm_div_ps(_mm_cvtepi32_ps(num), _mm_cvtepi32_ps(deltaDiv)), _mm_cvtepi32_ps(off));
+    fh = _mm_add_ps(fh, _mm_and_ps(_mm_cmplt_ps(fh, _mm_setzero_ps()), _mm_set1_ps(6)));
+
+    __m128d k = _mm_set1_pd(42.4);
+    __m128i h0 = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtps_pd(fh), k));
+    __m128i h1 = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(fh, fh)), k));
+    h = _mm_unpacklo_epi64(h0, h1);
+
+    __m128 fs = _mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(delta), _mm_cvtepi32_ps(maxDiv)), _mm_set1_ps(255));
+    s = _mm_cvttps_epi32(fs);
+}
+
+static inline void hsvBlock(const uint8_t* rgb, uint8_t* ho, uint8_t* so, uint8_t* vo)
+{
+    // SSE2 has no byte shuffle, the deinterleave is cheap next to the divides anyway
+    alignas(16) uint8_t rr[HSV_BLOCK], gg[HSV_BLOCK], bb[HSV_BLOCK];
+    for (int k = 0; k < HSV_BLOCK; k++) {
+        rr[k] = rgb[3*k];
+        gg[k] = rgb[3*k+1];
+        bb[k] = rgb[3*k+2];
+    }
+    __m128i r = _mm_load_si128((__m128i*)rr);
+    __m128i g = _mm_load_si128((__m128i*)gg);
+    __m128i b = _mm_load_si128((__m128i*)bb);
+
+    __m128i max = _mm_max_epu8(_mm_max_epu8(r, g), b);
+    __m128i min = _mm_min_epu8(_mm_min_epu8(r, g), b);
+    __m128i delta = _mm_sub_epi8(max, min);
+
+    // which channel is the max decides the sector: r: g-b, g: 2 + b-r, b: 4 + r-g
+    __m128i rMax = _mm_cmpeq_epi8(r, max);
+    __m128i gMax = _mm_andnot_si128(rMax, _mm_cmpeq_epi8(g, max));
+    __m128i bMax = _mm_andnot_si128(_mm_or_si128(rMax, gMax), _mm_set1_epi8(-1));
+    __m128i p = select128(rMax, g, select128(gMax, b, r));
+    __m128i q = select128(rMax, b, select128(gMax, r, g));
+    __m128i off = _mm_or_si128(_mm_and_si128(gMax, _mm_set1_epi8(2)), _mm_and_si128(bMax, _mm_set1_epi8(4)));
+
+    __m128i zero = _mm_setzero_si128();
+    __m128i h[2], s[2];
+    for (int half = 0; half < 2; half++) {
+        __m128i p16 = half ? _mm_unpackhi_epi8(p, zero) : _mm_unpacklo_epi8(p, zero);
+        __m128i q16 = half ? _mm_unpackhi_epi8(q, zero) : _mm_unpacklo_epi8(q, zero);
+        __m128i num16 = _mm_sub_epi16(p16, q16);
+        __m128i delta16 = half ? _mm_unpackhi_epi8(delta, zero) : _mm_unpacklo_epi8(delta, zero);
+        __m128i max16 = half ? _mm_unpackhi_epi8(max, zero) : _mm_unpacklo_epi8(max, zero);
+        __m128i off16 = half ? _mm_unpackhi_epi8(off, zero) : _mm_unpacklo_epi8(off, zero);
+        __m128i h32[2], s32[2];
+        for (int quarter = 0; quarter < 2; quarter++) {
+            __m128i num32 = quarter ? _mm_unpackhi_epi16(zero, num16) : _mm_unpacklo_epi16(zero, num16);
+            num32 = _mm_srai_epi32(num32, 16); // sign extend
+            hueSat(num32,
+                   quarter ? _mm_unpackhi_epi16(delta16, zero) : _mm_unpacklo_epi16(delta16, zero),
+                   quarter ? _mm_unpackhi_epi16(max16, zero) : _mm_unpacklo_epi16(max16, zero),
+                   quarter ? _mm_unpackhi_epi16(off16, zero) : _mm_unpacklo_epi16(off16, zero),
+                   h32[quarter], s32[quarter]);
+        }
+        h[half] = _mm_packs_epi32(h32[0], h32[1]);
+        s[half] = _mm_packs_epi32(s32[0], s32[1]);
+    }
+
+    __m128i grey = _mm_cmpeq_epi8(delta, zero);
+    _mm_storeu_si128((__m128i*)ho, _mm_andnot_si128(grey, _mm_packus_epi16(h[0], h[1])));
+    _mm_storeu_si128((__m128i*)so, _mm_packus_epi16(s[0], s[1]));
+    _mm_storeu_si128((__m128i*)vo, max);
+}
+
+#endif // SSE2
+
+#ifdef HSV_NEON
+
+// 4 pixels, all inputs are 32 bit ints
+static inline void hueSat(int32x4_t num, uint32x4_t delta, uint32x4_t max, uint32x4_t off, int32x4_t& h, int32x4_t& s)
+{
+    uint32x4_t one = vdupq_n_u32(1);
+
+    float32x4_t fh = vaddq_f32(vdivq_f32(vcvtq_f32_s32(num), vcvtq_f32_u32(vmaxq_u32(delta, one))), vcvtq_f32_u32(off));
+    uint32x4_t neg = vcltq_f32(fh, vdupq_n_f32(0));
+    fh = vaddq_f32(fh, vreinterpretq_f32_u32(vandq_u32(neg, vreinterpretq_u32_f32(vdupq_n_f32(6)))));
+
+    float64x2_t k = vdupq_n_f64(42.4);
+    int64x2_t h0 = vcvtq_s64_f64(vmulq_f64(vcvt_f64_f32(vget_low_f32(fh)), k));
+    int64x2_t h1 = vcvtq_s64_f64(vmulq_f64(vcvt_high_f64_f32(fh), k));
+    h = vcombine_s32(vmovn_s64(h0), vmovn_s64(h1));
+
+    float32x4_t fs = vmulq_f32(vdivq_f32(vcvtq_f32_u32(delta), vcvtq_f32_u32(vmaxq_u32(max, one))), vdupq_n_f32(255));
+    s = vcvtq_s32_f32(fs);
+}
+
+static inline void hsvBlock(const uint8_t* rgb, uint8_t* ho, uint8_t* so, uint8_t* vo)
+{
+    uint8x16x3_t px = vld3q_u8(rgb);
+    uint8x16_t r = px.val[0];
+    uint8x16_t g = px.val[1];
+    uint8x16_t b = px.val[2];
+
+    uint8x16_t max = vmaxq_u8(vmaxq_u8(r, g), b);
+    uint8x16_t min = vminq_u8(vminq_u8(r, g), b);
+    uint8x16_t delta = vsubq_u8(max, min);
+
+    // which channel is the max decides the sector: r: g-b, g: 2 + b-r, b: 4 + r-g
+    uint8x16_t rMax = vceqq_u8(r, max);
+    uint8x16_t gMax = vbicq_u8(vceqq_u8(g, max), rMax);
+    uint8x16_t bMax = vmvnq_u8(vorrq_u8(rMax, gMax));
+    uint8x16_t p = vbslq_u8(rMax, g, vbslq_u8(gMax, b, r));
+    uint8x16_t q = vbslq_u8(rMax, b, vbslq_u8(gMax, r, g));
+    uint8x16_t off = vorrq_u8(vandq_u8(gMax, vdupq_n_u8(2)), vandq_u8(bMax, vdupq_n_u8(4)));
+
+    int16x8_t h[2], s[2];
+    for (int half = 0; half < 2; half++) {
+        int16x8_t num16 = vreinterpretq_s16_u16(half ? vsubl_high_u8(p, q) : vsubl_u8(vget_low_u8(p), vget_low_u8(q)));
+        uint16x8_t delta16 = half ? vmovl_high_u8(delta) : vmovl_u8(vget_low_u8(delta));
+        uint16x8_t max16 = half ? vmovl_high_u8(max) : vmovl_u8(vget_low_u8(max));
+        uint16x8_t off16 = half ? vmovl_high_u8(off) : vmovl_u8(vget_low_u8(off));
+        int32x4_t h32[2], s32[2];
+        for (int quarter = 0; quarter < 2; quarter++) {
+            hueSat(quarter ? vmovl_high_s16(num16) : vmovl_s16(vget_low_s16(num16)),
+                   quarter ? vmovl_high_u16(delta16) : vmovl_u16(vget_low_u16(delta16)),
+                   quarter ? vmovl_high_u16(max16) : vmovl_u16(vget_low_u16(max16)),
+                   quarter ? vmovl_high_u16(off16) : vmovl_u16(vget_low_u16(off16)),
+                   h32[quarter], s32[quarter]);
+        }
+        h[half] = vcombine_s16(vmovn_s32(h32[0]), vmovn_s32(h32[1]));
+        s[half] = vcombine_s16(vmovn_s32(s32[0]), vmovn_s32(s32[1]));
+    }
+
+    uint8x16_t grey = vceqq_u8(delta, vdupq_n_u8(0));
+    vst1q_u8(ho, vbicq_u8(vcombine_u8(vqmovun_s16(h[0]), vqmovun_s16(h[1])), grey));
+    vst1q_u8(so, vcombine_u8(vqmovun_s16(s[0]), vqmovun_s16(s[1])));
+    vst1q_u8(vo, max);
+}
+
+#endif // NEON
+
+void rgb2hsvRow(const uint8_t* rgb, uint8_t* hsv, int n)
+{
+    int i = 0;
+#if defined(HSV_NEON) || defined(HSV_SSE2)
+    uint8_t h[HSV_BLOCK], s[HSV_BLOCK], v[HSV_BLOCK];
+    for (; i + HSV_BLOCK <= n; i += HSV_BLOCK) {
+        hsvBlock(&rgb[3*i], h, s, v);
+        uint8_t* out = &hsv[3*i];
+        for (int k = 0; k < HSV_BLOCK; k++) {
+            out[3*k] = h[k];
+            out[3*k+1] = s[k];
+            out[3*k+2] = v[k];
+        }
+    }
+#endif
+    for (; i < n; i++)
+        rgb2hsv(&rgb[3*i], &hsv[3*i]);
+}
+
+int hsvThresholdRow(const uint8_t* rgb, uint8_t* mask, int n, const hsvRange_t& range)
+{
+    int passed = 0;
+    int i = 0;
+#if defined(HSV_NEON) || defined(HSV_SSE2)
+    uint8_t h[HSV_BLOCK], s[HSV_BLOCK], v[HSV_BLOCK];
+    for (; i + HSV_BLOCK <= n; i += HSV_BLOCK) {
+        hsvBlock(&rgb[3*i], h, s, v);
+        for (int k = 0; k < HSV_BLOCK; k++) {
+            uint8_t m = range.h[h[k]] & range.s[s[k]] & range.v[v[k]];
+            mask[i+k] = m;
+            passed += m & 1;
+        }
+    }
+#endif
+    uint8_t hsv[3];
+    for (; i < n; i++) {
+        rgb2hsv(&rgb[3*i], hsv);
+        uint8_t m = range.h[hsv[0]] & range.s[hsv[1]] & range.v[hsv[2]];
+        mask[i] = m;
+        passed += m & 1;
+    }
+    return passed;
+}
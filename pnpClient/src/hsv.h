@@ -0,0 +1,26 @@
+#ifndef HSV_H
+#define HSV_H
+
+#include <stdint.h>
+
+// RGB to HSV conversion, with all channels 0-255 (hue goes round the circle once in 0-254).
+// The row functions do 16 pixels at a time with NEON on ARM, or SSE2 on x86, and give
+// exactly the same result as rgb2hsv for every color.
+
+// Pass/fail for each value of each channel, 255 where the value passes.
+typedef struct {
+    uint8_t h[256];
+    uint8_t s[256];
+    uint8_t v[256];
+} hsvRange_t;
+
+void rgb2hsv(const uint8_t* rgb, uint8_t* hsv);
+
+// Converts n pixels, hsv can be the same as rgb.
+void rgb2hsvRow(const uint8_t* rgb, uint8_t* hsv, int n);
+
+// Converts n pixels and sets mask to 255 where all three channels are in range, or 0 where
+// not. Returns the number of pixels that passed.
+int hsvThresholdRow(const uint8_t* rgb, uint8_t* mask, int n, const hsvRange_t& range);
+
+#endif
@@ -33,6 +33,7 @@
 
 #include "pnpMessages.h"
 #include "net_subscriber.h"
+#include "telemetry_view.h"
 #include "net_requester.h"
 
 #include "commandEditorWindow.h"
@@ -58,6 +59,7 @@
 #include "nfd.h"
 
 #include "preview.h"
+#include "run.h"
 #include "machinelimits.h"
 
 #include "overrides.h"
@@ -831,25 +833,36 @@ void showPlotsView(bool* p_open) {
 
     ImGui::Begin(PLOTS_WINDOW_TITLE, p_open);
     {
-        ImGui::Checkbox("Pause graph", &pausePlot);
-
-        ImVec2 sz = ImGui::GetWindowSize();
-        sz.x -= 16;
-        sz.y -= 70;
-
-        if (ImPlot::BeginPlot("Line Plots", sz)) {
-            ImPlot::SetupAxes("t","");
-            ImPlot::PlotLineG("Pos X", MyDataGetter, (void*)plotPosX, MAXPLOTPOINTS);
-            ImPlot::PlotLineG("Pos Y", MyDataGetter, (void*)plotPosY, MAXPLOTPOINTS);
-            ImPlot::PlotLineG("Pos Z", MyDataGetter, (void*)plotPosZ, MAXPLOTPOINTS);
-            ImPlot::PlotLineG("Vel X", MyDataGetter, (void*)plotVelX, MAXPLOTPOINTS);
-            ImPlot::PlotLineG("Vel Y", MyDataGetter, (void*)plotVelY, MAXPLOTPOINTS);
-            ImPlot::PlotLineG("Vel Z", MyDataGetter, (void*)plotVelZ, MAXPLOTPOINTS);
-            ImPlot::PlotLineG("Rot 0", MyDataGetter, (void*)plotRot0, MAXPLOTPOINTS);
-            ImPlot::PlotLineG("Vac", MyDataGetter, (void*)plotVac, MAXPLOTPOINTS);
-            ImPlot::PlotLineG("Load", MyDataGetter, (void*)plotLoad, MAXPLOTPOINTS);
-            ImPlot::PlotLineG("Norm", MyDataGetter, (void*)plotWeight, MAXPLOTPOINTS);
-            ImPlot::EndPlot();
+        if (ImGui::BeginTabBar("plottabs", ImGuiTabBarFlags_None))
+        {
+            if (ImGui::BeginTabItem("Status"))
+            {
+                ImGui::Checkbox("Pause graph", &pausePlot);
+
+                ImVec2 sz = ImGui::GetContentRegionAvail();
+
+                if (ImPlot::BeginPlot("Line Plots", sz)) {
+                    ImPlot::SetupAxes("t","");
+                    ImPlot::PlotLineG("Pos X", MyDataGetter, (void*)plotPosX, MAXPLOTPOINTS);
+                    ImPlot::PlotLineG("Pos Y", MyDataGetter, (void*)plotPosY, MAXPLOTPOINTS);
+                    ImPlot::PlotLineG("Pos Z", MyDataGetter, (void*)plotPosZ, MAXPLOTPOINTS);
+                    ImPlot::PlotLineG("Vel X", MyDataGetter, (void*)plotVelX, MAXPLOTPOINTS);
+                    ImPlot::PlotLineG("Vel Y", MyDataGetter, (void*)plotVelY, MAXPLOTPOINTS);
+                    ImPlot::PlotLineG("Vel Z", MyDataGetter, (void*)plotVelZ, MAXPLOTPOINTS);
+                    ImPlot::PlotLineG("Rot 0", MyDataGetter, (void*)plotRot0, MAXPLOTPOINTS);
+                    ImPlot::PlotLineG("Vac", MyDataGetter, (void*)plotVac, MAXPLOTPOINTS);
+                    ImPlot::PlotLineG("Load", MyDataGetter, (void*)plotLoad, MAXPLOTPOINTS);
+                    ImPlot::PlotLineG("Norm", MyDataGetter, (void*)plotWeight, MAXPLOTPOINTS);
+                    ImPlot::EndPlot();
+                }
+                ImGui::EndTabItem();
+            }
+            if (ImGui::BeginTabItem("Telemetry"))
+            {
+                showTelemetryPlots();
+                ImGui::EndTabItem();
+            }
+            ImGui::EndTabBar();
         }
     }
 
@@ -1456,10 +1469,7 @@ int main(int, char**)
             lastStatusReport = statRep;
             lastPublishTime = std::chrono::steady_clock::now();
 
-            if ( lastStatusReport.trajResult != TR_NONE ) {
-                lastTrajResult = (trajectoryResult_e)lastStatusReport.trajResult;
-                doNotifiesForTrajectoryResult( lastTrajResult );
-            }
+            updateProgramQueueStatus( statRep ); // sets lastTrajResult
             if ( lastStatusReport.homingResult != HR_NONE ) {
                 lastHomingResult = (homingResult_e)lastStatusReport.homingResult;
                 doNotifiesForHomingResult( lastHomingResult );
@@ -1482,6 +1492,8 @@ int main(int, char**)
             pwmOut = lastStatusReport.pwm / 65535.0f;
         }
 
+        checkTelemetry();
+
         float vac = ((float)lastStatusReport.pressure - 50000) / 500.0f;
         float load = lastStatusReport.loadcell;//((float)lastStatusReport.loadcell) / 8388607.0f;
 
@@ -1579,6 +1591,9 @@ int main(int, char**)
             else if ( rep.type == MT_CONFIG_PROBING_FETCH ) {
                 config_probing = rep.probingParams.params;
             }
+            else if ( rep.type == MT_RT_STATS_FETCH ) {
+                config_rtStats = rep.rtStats;
+            }
             else {
                 g_log.log(LL_DEBUG, "Ignoring command reply %s", getMessageName(rep.type));
             }
@@ -1788,6 +1803,7 @@ int main(int, char**)
             CodeEditorWindow* w = scriptEditorWindows[i];
             if ( ! w->shouldRemainOpen ) {
                 removeActiveScriptLog( &w->log );
+                removeUSBCameraScriptLog( &w->log );
                 scriptEditorWindows.erase(scriptEditorWindows.begin() + i);
                 delete w;
                 break;
@@ -1918,6 +1934,7 @@ int main(int, char**)
                 if ( ! serverConnected ) {
                     firstTimeSetDone = false;
                     lastStatusReport = {0};
+                    resetProgramQueueStatus();
                 }
 
                 showStatusIndicator("Server connection", serverConnected );
@@ -2621,8 +2638,8 @@ int main(int, char**)
     //                delete[] data;
 
                         if ( sanityCheckCommandList(program) ) {
+                            assignProgramId(program);
                             sendPackable(MT_SET_PROGRAM, program);
-                            lastTrajResult = TR_NONE;
                         }
                         //program.clear();
                     }
@@ -2669,6 +2686,7 @@ int main(int, char**)
     closeAllPorts();
 
     stopRequester();
+    stopTelemetryRecording();
     stopSubscriber();
 
     closeAllUSBCameras();
@@ -0,0 +1,70 @@
+
+#include <stdio.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+#include "mjpeg.h"
+
+// libjpeg's default error handling exits the program, jump back out instead
+struct mjpegError_t {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+static void mjpegErrorExit(j_common_ptr cinfo)
+{
+    mjpegError_t* err = (mjpegError_t*)cinfo->err;
+    longjmp(err->jump, 1);
+}
+
+static void mjpegOutputMessage(j_common_ptr cinfo)
+{
+    // corrupt frames are common enough with USB cameras, don't spam stderr
+}
+
+bool decodeMJPEG(const uint8_t* data, size_t size, bool gray, int scale, uint8_t* out, size_t outSize, int& width, int& height)
+{
+    struct jpeg_decompress_struct dinfo;
+    mjpegError_t err;
+
+    dinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = mjpegErrorExit;
+    err.pub.output_message = mjpegOutputMessage;
+
+    if ( setjmp(err.jump) ) {
+        jpeg_destroy_decompress(&dinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&dinfo);
+    jpeg_mem_src(&dinfo, (unsigned char*)data, size);
+    jpeg_read_header(&dinfo, TRUE);
+
+    dinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = scale;
+    dinfo.dct_method = JDCT_IFAST;
+
+    // the size in the JPEG header doesn't have to be the one the camera said it would send
+    jpeg_calc_output_dimensions(&dinfo);
+    if ( (size_t)dinfo.output_width * dinfo.output_height * dinfo.output_components > outSize ) {
+        jpeg_destroy_decompress(&dinfo);
+        return false;
+    }
+
+    jpeg_start_decompress(&dinfo);
+
+    int stride = dinfo.output_width * dinfo.output_components;
+    while ( dinfo.output_scanline < dinfo.output_height ) {
+        JSAMPROW row = out + dinfo.output_scanline * stride;
+        jpeg_read_scanlines(&dinfo, &row, 1);
+    }
+
+    width = dinfo.output_width;
+    height = dinfo.output_height;
+
+    jpeg_finish_decompress(&dinfo);
+    jpeg_destroy_decompress(&dinfo);
+
+    return true;
+}
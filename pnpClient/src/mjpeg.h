@@ -0,0 +1,15 @@
+#ifndef MJPEG_H
+#define MJPEG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Decodes an MJPEG camera frame with libjpeg. With gray set the output is one byte per pixel
+// and the color components are never decoded, otherwise it is RGB. scale can be 1, 2 or 4 to
+// have the decoder give a smaller image by dropping DCT coefficients, which is much cheaper
+// than decoding at full size and shrinking afterwards. outSize is the size of out in bytes.
+// Returns false if the data could not be decoded, eg. some cameras leave out the Huffman tables,
+// which older versions of libjpeg can't cope with, or if the image would not fit in out.
+bool decodeMJPEG(const uint8_t* data, size_t size, bool gray, int scale, uint8_t* out, size_t outSize, int& width, int& height);
+
+#endif
@@ -7,6 +7,7 @@
 #include <zmq.h>
 
 #include "pnpMessages.h"
+#include "telemetry.h"
 #include "log.h"
 #include "server_view.h"
 
@@ -14,12 +15,50 @@
 
 void* context = NULL;
 void* subscriber = NULL;
+void* telemetrySubscriber = NULL;
 
 pthread_t subscriberThread = 0;
 void* dataRecvSocket = NULL;
+void* telemetryRecvSocket = NULL;
 
 bool alreadyReportedWrongSubscriberMessageVersion = false;
 
+// Passes a message from one of the network sockets on to the main thread
+void forwardMessage(void* fromSocket, void* toSocket) {
+
+    zmq_msg_t msgIn;
+    if ( 0 != zmq_msg_init(&msgIn) ) {
+        g_log.log(LL_FATAL, "zmq_msg_init failed");
+    }
+    else {
+        int rc = zmq_msg_recv( &msgIn, fromSocket, 0);
+        if ( rc == -1 ) {
+            g_log.log(LL_ERROR, "zmq_msg_recv failed: %d (%s)", errno, strerror(errno));
+        }
+        else {
+            //clientReport_t* apr = (clientReport_t*)zmq_msg_data( &msg );
+            //printf("spi: %d, mode: %d, actualPos: %f %f %f\n", apr->spiOk, apr->mode, apr->x, apr->y, apr->z); fflush(stdout);
+
+            int msgSize = (int)zmq_msg_size(&msgIn);
+
+            zmq_msg_t msgOut;
+            if ( 0 != zmq_msg_init_size(&msgOut, msgSize)) {
+                g_log.log(LL_FATAL, "zmq_msg_init_size failed");
+            }
+            else {
+                memcpy( zmq_msg_data(&msgOut), zmq_msg_data(&msgIn), msgSize );
+//printf("sending\n"); fflush(stdout);
+                if ( msgSize != zmq_msg_send( &msgOut, toSocket, 0 ) ) {
+                    g_log.log(LL_ERROR, "zmq_msg_send failed");
+                }
+
+                zmq_msg_close( &msgOut );
+            }
+            zmq_msg_close( &msgIn );
+        }
+    }
+}
+
 void* subscriberThreadFunc( void* ptr ) {
 
     if ( ! context )
@@ -47,15 +86,26 @@ void* subscriberThreadFunc( void* ptr ) {
         }
     }
 
+    void* telemetryDataSocket = zmq_socket(context, ZMQ_PAIR);
+    if ( ! telemetryDataSocket ) {
+        g_log.log(LL_FATAL, "zmq_socket failed (telemetryDataSocket)");
+    }
+    else {
+        int rc = zmq_connect(telemetryDataSocket, "inproc://telemetryData");
+        if ( rc != 0 ) {
+            g_log.log(LL_ERROR, "zmq_connect failed (telemetryDataSocket)");
+        }
+    }
 
     zmq_pollitem_t items[] = {
         { subscriber, 0, ZMQ_POLLIN, 0 },
-        { signalStopSocket, 0, ZMQ_POLLIN, 0 }
+        { signalStopSocket, 0, ZMQ_POLLIN, 0 },
+        { telemetrySubscriber, 0, ZMQ_POLLIN, 0 }
     };
 
     while (1)
     {
-        zmq_poll(items, 2, -1);
+        zmq_poll(items, 3, -1);
         if (items[1].revents & ZMQ_POLLIN)
         {
             //printf("Exiting subscriberThreadFunc\n"); fflush(stdout);
@@ -64,43 +114,19 @@ void* subscriberThreadFunc( void* ptr ) {
 
         if (items[0].revents & ZMQ_POLLIN)
         {
-            zmq_msg_t msgIn;
-            if ( 0 != zmq_msg_init(&msgIn) ) {
-                g_log.log(LL_FATAL, "zmq_msg_init failed");
-            }
-            else {
-                int rc = zmq_msg_recv( &msgIn, subscriber, 0);
-                if ( rc == -1 ) {
-                    g_log.log(LL_ERROR, "zmq_msg_recv failed: %d (%s)", errno, strerror(errno));
-                }
-                else {
-                    //clientReport_t* apr = (clientReport_t*)zmq_msg_data( &msg );
-                    //printf("spi: %d, mode: %d, actualPos: %f %f %f\n", apr->spiOk, apr->mode, apr->x, apr->y, apr->z); fflush(stdout);
-
-                    int msgSize = (int)zmq_msg_size(&msgIn);
-
-                    zmq_msg_t msgOut;
-                    if ( 0 != zmq_msg_init_size(&msgOut, msgSize)) {
-                        g_log.log(LL_FATAL, "zmq_msg_init_size failed");
-                    }
-                    else {
-                        memcpy( zmq_msg_data(&msgOut), zmq_msg_data(&msgIn), msgSize );
-//printf("sending\n"); fflush(stdout);
-                        if ( msgSize != zmq_msg_send( &msgOut, reportDataSocket, 0 ) ) {
-                            g_log.log(LL_ERROR, "zmq_msg_send failed");
-                        }
+            forwardMessage(subscriber, reportDataSocket);
+        }
 
-                        zmq_msg_close( &msgOut );
-                    }
-                    zmq_msg_close( &msgIn );
-                }
-            }
+        if (items[2].revents & ZMQ_POLLIN)
+        {
+            forwardMessage(telemetrySubscriber, telemetryDataSocket);
         }
 
     }
 
     zmq_close(signalStopSocket);
     zmq_close(reportDataSocket);
+    zmq_close(telemetryDataSocket);
 
     return NULL;
 }
@@ -128,6 +154,15 @@ void startSubscriber()
     int trueValue = 1;
     zmq_setsockopt(subscriber, ZMQ_CONFLATE, &trueValue, sizeof(int)); // keep only most recent message
 
+    // Telemetry is not conflated, every frame is wanted. Queue plenty in case the main thread stalls.
+    sprintf(url, "tcp://%s:%d", serverHostname, TELEMETRY_PORT);
+
+    telemetrySubscriber = zmq_socket(context, ZMQ_SUB);
+    int hwm = 2000; // frames, about 100 seconds
+    zmq_setsockopt(telemetrySubscriber, ZMQ_RCVHWM, &hwm, sizeof(int));
+    zmq_connect(telemetrySubscriber, url);
+    zmq_setsockopt(telemetrySubscriber, ZMQ_SUBSCRIBE, "", 0);
+
     //sleep(1);
 
     //printf("Subscriber listening...\n"); fflush(stdout);
@@ -146,6 +181,18 @@ void startSubscriber()
 //        }
     }
 
+    telemetryRecvSocket = zmq_socket(context, ZMQ_PAIR);
+    if ( ! telemetryRecvSocket ) {
+        g_log.log(LL_ERROR, "zmq_socket failed (telemetryRecvSocket)");
+    }
+    else {
+        zmq_setsockopt(telemetryRecvSocket, ZMQ_RCVHWM, &hwm, sizeof(int));
+        int rc = zmq_bind(telemetryRecvSocket, "inproc://telemetryData");
+        if ( rc != 0 ) {
+            g_log.log(LL_FATAL, "zmq_bind failed (telemetryRecvSocket)");
+        }
+    }
+
     int rc = pthread_create( &subscriberThread, NULL, subscriberThreadFunc, NULL );
     if ( rc != 0 ) {
         g_log.log(LL_FATAL, "pthread_create failed (startSubscriber)");
@@ -182,13 +229,17 @@ void stopSubscriber()
 
     zmq_close(doSignalSocket);
     zmq_close(dataRecvSocket);
+    zmq_close(telemetryRecvSocket);
     zmq_close(subscriber);
+    zmq_close(telemetrySubscriber);
 
     zmq_ctx_destroy(context);
 
     context = NULL;
     subscriber = NULL;
+    telemetrySubscriber = NULL;
     dataRecvSocket = NULL;
+    telemetryRecvSocket = NULL;
 
     //printf("done.\n"); fflush(stdout);
 }
@@ -277,5 +328,22 @@ bool checkSubscriberMessages(clientReport_t* rep) {
     return gotSomething;
 }
 
+// Reads one telemetry frame if there is one waiting, returns the size of it or zero if none.
+// Frames that are bigger than the buffer are skipped.
+int checkTelemetryFrame(uint8_t* buf, int bufSize) {
 
+    if ( ! telemetryRecvSocket )
+        return 0;
 
+    while ( true ) {
+        int rc = zmq_recv(telemetryRecvSocket, buf, bufSize, ZMQ_DONTWAIT);
+        if ( rc == -1 ) {
+            if ( errno != EAGAIN )
+                g_log.log(LL_DEBUG, "zmq_recv for telemetryRecvSocket failed: %d (%s)\n", errno, strerror(errno));
+            return 0;
+        }
+        if ( rc <= bufSize )
+            return rc;
+        g_log.log(LL_WARN, "Telemetry frame too big (%d bytes), skipped", rc);
+    }
+}
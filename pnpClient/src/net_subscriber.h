@@ -7,5 +7,6 @@
 void startSubscriber();
 void stopSubscriber();
 bool checkSubscriberMessages(clientReport_t* rep);
+int checkTelemetryFrame(uint8_t* buf, int bufSize);
 
 #endif
@@ -0,0 +1,106 @@
+
+#include "pyramid.h"
+#include "workerpool.h"
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PYRAMID_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PYRAMID_SSE2
+#endif
+
+// One row of output from two rows of input. Each output byte is (a + b + c + d + 2) / 4, where
+// a,b are the same channel of two pixels side by side in the first row and c,d in the second.
+static void halveRGBRow(const uint8_t* row0, const uint8_t* row1, uint8_t* out, int outWidth)
+{
+    int x = 0;
+
+#if defined(PYRAMID_NEON)
+    // vld3 splits the channels apart, so each pair of pixels is just two neighbouring lanes
+    for (; x + 8 <= outWidth; x += 8) {
+        uint8x16x3_t a = vld3q_u8(&row0[x*6]);
+        uint8x16x3_t b = vld3q_u8(&row1[x*6]);
+        uint8x8x3_t o;
+        o.val[0] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[0]), vpaddlq_u8(b.val[0])), 2);
+        o.val[1] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[1]), vpaddlq_u8(b.val[1])), 2);
+        o.val[2] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[2]), vpaddlq_u8(b.val[2])), 2);
+        vst3_u8(&out[x*3], o);
+    }
+#elif defined(PYRAMID_SSE2)
+    // SSE2 has nothing to split the channels apart, so instead every byte is added to the byte
+    // 3 along (the same channel of the next pixel), giving the wanted sums at bytes 0-2 of every
+    // 6. The loads 3 along read one pixel past the 16 being done, hence x + 9.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    uint8_t sums[48];
+    for (; x + 9 <= outWidth; x += 8) {
+        for (int k = 0; k < 48; k += 16) {
+            const uint8_t* p0 = &row0[x*6 + k];
+            const uint8_t* p1 = &row1[x*6 + k];
+            __m128i a = _mm_loadu_si128((const __m128i*)p0);
+            __m128i b = _mm_loadu_si128((const __m128i*)(p0 + 3));
+            __m128i c = _mm_loadu_si128((const __m128i*)p1);
+            __m128i d = _mm_loadu_si128((const __m128i*)(p1 + 3));
+            __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                                       _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+            __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+                                       _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+            _mm_storeu_si128((__m128i*)&sums[k], _mm_packus_epi16(lo, hi));
+        }
+        uint8_t* o = &out[x*3];
+        for (int i = 0; i < 8; i++) {
+            o[i*3+0] = sums[i*6+0];
+            o[i*3+1] = sums[i*6+1];
+            o[i*3+2] = sums[i*6+2];
+        }
+    }
+#endif
+
+    for (; x < outWidth; x++) {
+        const uint8_t* p0 = &row0[x*6];
+        const uint8_t* p1 = &row1[x*6];
+        for (int c = 0; c < 3; c++)
+            out[x*3+c] = (p0[c] + p0[c+3] + p1[c] + p1[c+3] + 2) >> 2;
+    }
+}
+
+struct halveJob_t {
+    const uint8_t* in;
+    int inStride;
+    uint8_t* out;
+    int outWidth;
+};
+
+static void halveRGBRows(void* arg, int firstRow, int lastRow)
+{
+    halveJob_t* job = (halveJob_t*)arg;
+    for (int y = firstRow; y < lastRow; y++) {
+        const uint8_t* row0 = &job->in[(2*y) * job->inStride];
+        halveRGBRow(row0, row0 + job->inStride, &job->out[y * job->outWidth * 3], job->outWidth);
+    }
+}
+
+void halveRGB(const uint8_t* in, int width, int height, uint8_t* out)
+{
+    halveJob_t job;
+    job.in = in;
+    job.inStride = width * 3;
+    job.out = out;
+    job.outWidth = width / 2;
+    runInRowBands(height / 2, halveRGBRows, &job);
+}
+
+void halveGray(const uint8_t* in, int width, int height, uint8_t* out)
+{
+    int outWidth = width / 2;
+    int outHeight = height / 2;
+    for (int y = 0; y < outHeight; y++) {
+        const uint8_t* row0 = &in[(2*y) * width];
+        const uint8_t* row1 = row0 + width;
+        for (int x = 0; x < outWidth; x++)
+            *out++ = (row0[2*x] + row0[2*x+1] + row1[2*x] + row1[2*x+1] + 2) >> 2;
+    }
+}
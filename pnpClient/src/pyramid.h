@@ -0,0 +1,16 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <stdint.h>
+
+// Halves an RGB image in each direction, each output pixel being the rounded average of a 2x2
+// block of input pixels. The output is width/2 x height/2, so an odd last row or column of the
+// input is left out. The rows are done 8 output pixels at a time with NEON on ARM or SSE2 on
+// x86, in bands of rows on the worker pool.
+void halveRGB(const uint8_t* in, int width, int height, uint8_t* out);
+
+// The same for a gray image, one byte per pixel. This is only used by template matching, where
+// it's a small part of the work, so it's a plain loop.
+void halveGray(const uint8_t* in, int width, int height, uint8_t* out);
+
+#endif
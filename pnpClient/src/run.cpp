@@ -1,11 +1,13 @@
 
 #include <thread>
+#include <atomic>
 
 #include "scv/planner.h"
 #include "commandlist.h"
 //#include "plangroup.h"
 #include "run.h"
 #include "log.h"
+#include "feedback.h"
 
 #include "commandlist_parse.h"
 #include "machinelimits.h"
@@ -23,25 +25,82 @@ extern float cornerBlendMaxOverlap;
 
 extern trajectoryResult_e lastTrajResult;
 
-bool waitingForPreviousActualRun = false; // true when server is running a command list
+bool waitingForProgramQueueSlot = false; // true while waiting for the server to have room for another command list
+
+// Number of command lists sent to the server that have not had a result yet. The server
+// queues these and runs them back to back, so we only need to wait when its queue is full.
+std::atomic<int> numProgramsAwaitingResult(0);
+uint16_t lastProgramResultCount = 0;
+bool programResultCountKnown = false;
+
+// lastTrajResult is only set from the result for this program, so that a script checking
+// the result of its own last run is not given the result of some other program.
+uint16_t nextProgramId = 1;
+std::atomic<uint16_t> awaitedProgramId(0);
+
+void assignProgramId(CommandList& program)
+{
+    program.programId = nextProgramId++;
+    if ( nextProgramId == 0 )
+        nextProgramId = 1; // zero means the server should choose
+    lastTrajResult = TR_NONE;
+    awaitedProgramId = program.programId;
+}
+
+void updateProgramQueueStatus(clientReport_t& rep)
+{
+    if ( ! programResultCountKnown ) {
+        lastProgramResultCount = rep.programResultCount;
+        programResultCountKnown = true;
+        numProgramsAwaitingResult = rep.programQueueDepth;
+        return;
+    }
+
+    uint16_t numNewResults = rep.programResultCount - lastProgramResultCount;
+    uint16_t firstNewResult = lastProgramResultCount;
+    if ( numNewResults > PROGRAM_RESULT_HISTORY ) {
+        g_log.log(LL_WARN, "Missed %d program results", numNewResults - PROGRAM_RESULT_HISTORY);
+        firstNewResult = rep.programResultCount - PROGRAM_RESULT_HISTORY;
+    }
+
+    for (uint16_t i = firstNewResult; i != rep.programResultCount; i++) {
+        programResult_t& pr = rep.programResults[i % PROGRAM_RESULT_HISTORY];
+        g_log.log(LL_DEBUG, "Program %d result: %s", pr.programId, getTrajectoryResultName(pr.result));
+        if ( pr.programId == awaitedProgramId )
+            lastTrajResult = (trajectoryResult_e)pr.result;
+        doNotifiesForTrajectoryResult( pr.result );
+    }
+
+    lastProgramResultCount = rep.programResultCount;
+
+    if ( numProgramsAwaitingResult.fetch_sub(numNewResults) < numNewResults )
+        numProgramsAwaitingResult = 0;
+}
+
+void resetProgramQueueStatus()
+{
+    programResultCountKnown = false;
+    numProgramsAwaitingResult = 0;
+}
 
 bool doActualRun(vector<string> &lines)
 {
     g_log.log(LL_DEBUG, "doActualRun");
 
-    while ( waitingForPreviousActualRun ) {
+    waitingForProgramQueueSlot = true;
+
+    while ( numProgramsAwaitingResult >= PROGRAM_QUEUE_SIZE ) {
 
-        if ( ! currentlyRunningScriptThread() ) {
-            waitingForPreviousActualRun = false;
+        if ( ! currentlyRunningScriptThread() || ! waitingForProgramQueueSlot ) {
+            waitingForProgramQueueSlot = false;
             return false; // script was aborted
         }
 
-        if ( lastTrajResult != TR_NONE )
-            waitingForPreviousActualRun = false;
-        else
-            this_thread::sleep_for( 10ms );
+        this_thread::sleep_for( 10ms );
     }
 
+    waitingForProgramQueueSlot = false;
+
     CommandList program(blendMethod);
     program.cornerBlendMaxFraction = cornerBlendMaxOverlap;
 
@@ -52,13 +111,15 @@ bool doActualRun(vector<string> &lines)
 
     if ( parseCommandList(lines, program) ) { // uses heap
         if ( sanityCheckCommandList(program) ) {
-            lastTrajResult = TR_NONE;
+            assignProgramId(program);
+            numProgramsAwaitingResult++; // before sending, in case the result comes back very quickly
             if ( sendPackable(MT_SET_PROGRAM, program) ) {
-                waitingForPreviousActualRun = true;
                 return true;
             }
-            else
+            else {
+                numProgramsAwaitingResult--;
                 g_log.log(LL_DEBUG, "doActualRun: sendPackable failed - is server running?");
+            }
         }
     }
 
@@ -5,10 +5,15 @@
 #include <vector>
 
 #include "plangroup.h"
+#include "pnpMessages.h"
+#include "commandlist.h"
 
 extern PlanGroup planGroup_run;
 
 bool doActualRun(std::vector<std::string> &lines);
+void updateProgramQueueStatus(clientReport_t& rep);
+void resetProgramQueueStatus();
+void assignProgramId(CommandList& program);
 
 
 #endif // RUN_H
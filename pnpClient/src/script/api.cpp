@@ -42,6 +42,8 @@ int script_MR_FAIL_NOT_TRIGGERED = 5;
 int script_MR_FAIL_OUTSIDE_BOUNDS = 6;
 int script_MR_FAIL_FOLLOWING_ERROR = 7;
 int script_MR_FAIL_LIMIT_TRIGGERED = 8;
+int script_MR_FAIL_BUSY = 9;
+int script_MR_FAIL_ABORTED = 10;
 
 int script_NT_NONE      = 0;
 int script_NT_SUCCESS   = 1;
@@ -923,6 +925,8 @@ int script_getTrajectoryResult()
     case TR_FAIL_OUTSIDE_BOUNDS:    return script_MR_FAIL_OUTSIDE_BOUNDS;
     case TR_FAIL_FOLLOWING_ERROR:   return script_MR_FAIL_FOLLOWING_ERROR;
     case TR_FAIL_LIMIT_TRIGGERED:   return script_MR_FAIL_LIMIT_TRIGGERED;
+    case TR_FAIL_BUSY:              return script_MR_FAIL_BUSY;
+    case TR_FAIL_ABORTED:           return script_MR_FAIL_ABORTED;
     }
     return -1;
 }
@@ -27,6 +27,8 @@ extern int script_MR_FAIL_NOT_TRIGGERED;
 extern int script_MR_FAIL_OUTSIDE_BOUNDS;
 extern int script_MR_FAIL_FOLLOWING_ERROR;
 extern int script_MR_FAIL_LIMIT_TRIGGERED;
+extern int script_MR_FAIL_BUSY;
+extern int script_MR_FAIL_ABORTED;
 
 enum dbResultStatus_e {
     DBRS_FAILED,    // includes not done yet
@@ -95,6 +97,9 @@ public:
     int bb_x1, bb_y1, bb_x2, bb_y2;
     int w, h;
     int pixels;
+    int perimeter;      // pixel edges between the blob and anything else, including around holes
+    float angle;        // of the longest axis, in degrees
+    float eccentricity; // 0 for a circle or square, towards 1 for long thin shapes
 };
 
 // class script_point {
@@ -114,6 +119,14 @@ public:
     float angle;
 };
 
+class script_templateMatch {
+public:
+    float x;
+    float y;
+    float angle;
+    float score;
+};
+
 class script_renderText {
 public:
     std::string text;
@@ -242,6 +255,7 @@ bool script_runCommandList(std::string filename);
 bool script_runCommandList_dict(std::string filename, void* dict );
 
 bool script_setUSBCameraParams(int index, int zoom, int focus, int exposure, int whiteBalance, int saturation);
+bool script_setUSBCameraDecode(int index, bool gray, int scale);
 
 bool script_isPreview();
 void script_wait(int millis);
@@ -32,6 +32,8 @@ using namespace std;
 asIScriptEngine *engine = NULL;
 
 void* activeScriptLog = NULL;
+static thread_local bool useThreadScriptLog = false; // camera threads print to their own log, see setThreadScriptLog
+static thread_local void* threadScriptLog = NULL;
 string activeCommandListPath = "";
 bool activePreviewOnly = false;
 
@@ -59,9 +61,18 @@ void setActiveScriptLog(void* sl) {
 }
 
 void* getActiveScriptLog() {
+    if ( useThreadScriptLog )
+        return threadScriptLog;
     return activeScriptLog;
 }
 
+// For threads other than the UI and script threads, the log used by the calling thread from now on
+// instead of the active one, NULL for none
+void setThreadScriptLog(void* sl) {
+    useThreadScriptLog = true;
+    threadScriptLog = sl;
+}
+
 void removeActiveScriptLog(void* sl) {
     if ( activeScriptLog == sl )
         activeScriptLog = NULL;
@@ -209,6 +220,10 @@ bool setupScriptEngine()
     assert( r >= 0 );
     r = engine->RegisterGlobalProperty("const int MR_FAIL_LIMIT_ALREADY_TRIGGERED", &script_MR_FAIL_LIMIT_TRIGGERED);
     assert( r >= 0 );
+    r = engine->RegisterGlobalProperty("const int MR_FAIL_BUSY", &script_MR_FAIL_BUSY);
+    assert( r >= 0 );
+    r = engine->RegisterGlobalProperty("const int MR_FAIL_ABORTED", &script_MR_FAIL_ABORTED);
+    assert( r >= 0 );
 
 
     r = engine->RegisterGlobalProperty("const int PT_DIGITAL", &script_PT_DIGITAL);
@@ -226,6 +241,13 @@ bool setupScriptEngine()
     r = engine->RegisterGlobalProperty("const int QR_DATAMATRIX", &script_QR_DATAMATRIX);
     assert( r >= 0 );
 
+    r = engine->RegisterGlobalProperty("const int QR_BIN_LOCAL", &script_QR_BIN_LOCAL);
+    assert( r >= 0 );
+    r = engine->RegisterGlobalProperty("const int QR_BIN_GLOBAL", &script_QR_BIN_GLOBAL);
+    assert( r >= 0 );
+    r = engine->RegisterGlobalProperty("const int QR_BIN_FIXED", &script_QR_BIN_FIXED);
+    assert( r >= 0 );
+
 
     r = engine->RegisterGlobalFunction("void print(string s)", asFUNCTION(script_print), asCALL_CDECL);
     assert( r >= 0 );
@@ -298,6 +320,8 @@ bool setupScriptEngine()
 
     r = engine->RegisterGlobalFunction("bool setUSBCameraParams(int index, int zoom, int focus, int exposure, int whiteBalance, int saturation)", asFUNCTION(script_setUSBCameraParams), asCALL_CDECL);
     assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("bool setUSBCameraDecode(int index, bool gray, int scale = 1)", asFUNCTION(script_setUSBCameraDecode), asCALL_CDECL);
+    assert( r >= 0 );
 
     r = engine->RegisterGlobalFunction("float getTweakValue(string tweakKey)", asFUNCTION(script_getTweakValue), asCALL_CDECL);
     assert( r >= 0 );
@@ -341,6 +365,12 @@ bool setupScriptEngine()
     assert( r >= 0 );
     r = engine->RegisterObjectProperty("blob", "int pixelCount", offsetof(script_blob,pixels));
     assert( r >= 0 );
+    r = engine->RegisterObjectProperty("blob", "int perimeter", offsetof(script_blob,perimeter));
+    assert( r >= 0 );
+    r = engine->RegisterObjectProperty("blob", "float angle", offsetof(script_blob,angle));
+    assert( r >= 0 );
+    r = engine->RegisterObjectProperty("blob", "float eccentricity", offsetof(script_blob,eccentricity));
+    assert( r >= 0 );
 
 
     r = engine->RegisterObjectType("rect", sizeof(script_rotatedRect), asOBJ_VALUE | asOBJ_POD | asOBJ_APP_CLASS | asOBJ_APP_CLASS_ALLFLOATS );
@@ -360,9 +390,20 @@ bool setupScriptEngine()
     r = engine->RegisterObjectProperty("rect", "float area", offsetof(script_rotatedRect,area));
     assert( r >= 0 );
 
+    r = engine->RegisterObjectType("templateMatch", sizeof(script_templateMatch), asOBJ_VALUE | asOBJ_POD | asOBJ_APP_CLASS | asOBJ_APP_CLASS_ALLFLOATS );
+    assert( r >= 0 );
+    r = engine->RegisterObjectProperty("templateMatch", "float x", offsetof(script_templateMatch,x));
+    assert( r >= 0 );
+    r = engine->RegisterObjectProperty("templateMatch", "float y", offsetof(script_templateMatch,y));
+    assert( r >= 0 );
+    r = engine->RegisterObjectProperty("templateMatch", "float angle", offsetof(script_templateMatch,angle));
+    assert( r >= 0 );
+    r = engine->RegisterObjectProperty("templateMatch", "float score", offsetof(script_templateMatch,score));
+    assert( r >= 0 );
+
     r = engine->RegisterGlobalFunction("int getUSBCameraIndexByHash(string fragment)", asFUNCTION(script_getUSBCameraIndexByHash), asCALL_CDECL);
     assert( r >= 0 );
-    r = engine->RegisterGlobalFunction("bool grabFrame(int cameraIndex = 0)", asFUNCTION(script_grabFrame), asCALL_CDECL);
+    r = engine->RegisterGlobalFunction("bool grabFrame(int cameraIndex = 0, uint64 newerThan = 0)", asFUNCTION(script_grabFrame), asCALL_CDECL);
     assert( r >= 0 );
     r = engine->RegisterGlobalFunction("bool saveImage(string filename)", asFUNCTION(script_saveImage), asCALL_CDECL);
     assert( r >= 0 );
@@ -371,6 +412,14 @@ bool setupScriptEngine()
 
     r = engine->RegisterGlobalFunction("void setVisionWindowSize(float size)", asFUNCTION(script_setVisionWindowSizeF), asCALL_CDECL);
     assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("void setVisionWindowCenter(float x = -1, float y = -1)", asFUNCTION(script_setVisionWindowCenter), asCALL_CDECL);
+    assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("bool buildPyramid()", asFUNCTION(script_buildPyramid), asCALL_CDECL);
+    assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("bool setPyramidLevel(int level)", asFUNCTION(script_setPyramidLevel), asCALL_CDECL);
+    assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("int getPyramidLevel()", asFUNCTION(script_getPyramidLevel), asCALL_CDECL);
+    assert( r >= 0 );
     //r = engine->RegisterGlobalFunction("blob[]@ quickblob()", asFUNCTION(script_quickblob_default), asCALL_CDECL);
     //assert( r >= 0 );
     r = engine->RegisterGlobalFunction("blob[]@ quickblob(int targetColor = -1, int minpixels = -1, int maxpixels = -1, int minwidth = -1, int maxwidth = -1)", asFUNCTION(script_quickblob), asCALL_CDECL);
@@ -379,6 +428,10 @@ bool setupScriptEngine()
     assert( r >= 0 );
     r = engine->RegisterGlobalFunction("void grow(float pixels = 1)", asFUNCTION(script_grow), asCALL_CDECL);
     assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("void openMask(float pixels = 1)", asFUNCTION(script_openMask), asCALL_CDECL);
+    assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("void closeMask(float pixels = 1)", asFUNCTION(script_closeMask), asCALL_CDECL);
+    assert( r >= 0 );
     r = engine->RegisterGlobalFunction("int rgbThreshold(float minRed, float maxRed, float minGreen, float maxGreen, float minBlue, float maxBlue)", asFUNCTION(script_rgbThresholdF), asCALL_CDECL);
     assert( r >= 0 );
     r = engine->RegisterGlobalFunction("void findContour(int method = FC_ALL)", asFUNCTION(script_findContour), asCALL_CDECL);
@@ -393,6 +446,12 @@ bool setupScriptEngine()
     assert( r >= 0 );
     r = engine->RegisterGlobalFunction("float[]@ findCircles(float diameter)", asFUNCTION(script_findCircles), asCALL_CDECL);
     assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("float[]@ findCircles(float minDiameter, float maxDiameter)", asFUNCTION(script_findCirclesRange), asCALL_CDECL);
+    assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("bool captureTemplate(string name)", asFUNCTION(script_captureTemplate), asCALL_CDECL);
+    assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("templateMatch[]@ matchTemplate(string name, float minScore = 0.8, int howMany = 1, float angleRange = 0, float angleStep = 5)", asFUNCTION(script_matchTemplate), asCALL_CDECL);
+    assert( r >= 0 );
 
     r = engine->RegisterGlobalFunction("int hsvThreshold(float hueCenter, float hueRange, float minSat, float maxSat, float minVar, float maxVar)", asFUNCTION(script_hsvThresholdF), asCALL_CDECL);
     assert( r >= 0 );
@@ -627,7 +686,9 @@ bool setupScriptEngine()
     r = engine->RegisterObjectMethod("qrcode", "int getOrientation()", asMETHOD(script_qrcode,getOrientation), asCALL_THISCALL);
     assert( r >= 0 );
 
-    r = engine->RegisterGlobalFunction("qrcode[]@ findQRCodes(int howMany = 1, int types = 7)", asFUNCTION(script_findQRCodes), asCALL_CDECL);
+    r = engine->RegisterGlobalFunction("qrcode[]@ findQRCodes(int howMany = 1, int types = 7, bool tryHarder = true, int binarizer = 0)", asFUNCTION(script_findQRCodes), asCALL_CDECL);
+    assert( r >= 0 );
+    r = engine->RegisterGlobalFunction("qrcode[]@ findQRCodesAsync(int howMany = 1, int types = 7, bool tryHarder = true, int binarizer = 0)", asFUNCTION(script_findQRCodesAsync), asCALL_CDECL);
     assert( r >= 0 );
     r = engine->RegisterGlobalFunction("void drawQRCode(qrcode &in c, float fontSize = 20)", asFUNCTION(script_drawQRCode), asCALL_CDECL);
     assert( r >= 0 );
@@ -971,6 +1032,7 @@ void generateScriptDocs()
     scopes.push_back("dbRow");
     scopes.push_back("blob");
     scopes.push_back("rect");
+    scopes.push_back("templateMatch");
     scopes.push_back("serialReply");
     scopes.push_back("qrcode");
     scopes.push_back("affine");
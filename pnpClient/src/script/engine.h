@@ -22,6 +22,7 @@ asITypeInfo* GetScriptTypeIdByDecl(const char *decl);
 void setActiveScriptLog(void* sl);
 void* getActiveScriptLog();
 void removeActiveScriptLog(void* sl);
+void setThreadScriptLog(void* sl);
 
 void setActiveCommandListPath(std::string sl);
 std::string getActiveCommandListPath();
@@ -3,6 +3,7 @@
 
 #include "script_globals.h"
 #include "db.h"
+#include "scopelock.h"
 #include "script/engine.h"
 
 using namespace std;
@@ -12,16 +13,23 @@ map<string, string> globalStringMap;
 map<string, script_vec3> globalVec3Map;
 map<string, script_affine> globalAffineMap;
 
+// Held while using any of the maps above. Scripts running in camera threads can use these too.
+static pthread_mutex_t memoryValueMutex = PTHREAD_MUTEX_INITIALIZER;
+
 void script_setMemoryValue(string name, float v)
 {
     if ( getActivePreviewOnly() )
         return;
 
+    ScopeLock lock(&memoryValueMutex);
+
     globalValuesMap[name] = v;
 }
 
 float script_getMemoryValue(string name)
 {
+    ScopeLock lock(&memoryValueMutex);
+
     map<string, float>::iterator it = globalValuesMap.find(name);
     if ( it == globalValuesMap.end() )
         return 0;
@@ -30,6 +38,8 @@ float script_getMemoryValue(string name)
 
 bool script_haveMemoryValue(string name)
 {
+    ScopeLock lock(&memoryValueMutex);
+
     return globalValuesMap.find(name) != globalValuesMap.end();
 }
 
@@ -40,11 +50,15 @@ void script_setMemoryString(string name, string s)
     if ( getActivePreviewOnly() )
         return;
 
+    ScopeLock lock(&memoryValueMutex);
+
     globalStringMap[name] = s;
 }
 
 string script_getMemoryString(string name)
 {
+    ScopeLock lock(&memoryValueMutex);
+
     map<string, string>::iterator it = globalStringMap.find(name);
     if ( it == globalStringMap.end() )
         return "";
@@ -53,6 +67,8 @@ string script_getMemoryString(string name)
 
 bool script_haveMemoryString(string name)
 {
+    ScopeLock lock(&memoryValueMutex);
+
     return globalStringMap.find(name) != globalStringMap.end();
 }
 
@@ -66,6 +82,14 @@ bool script_haveMemoryString(string name)
 
 vector< vector<string> > dbValueResult;
 
+// Held while using dbValueResult. The DB values are also used by vision functions running in
+// camera threads, eg. for templates. Recursive because the setters check if the value exists.
+#ifdef __APPLE__
+static pthread_mutex_t dbValueMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER;
+#else
+static pthread_mutex_t dbValueMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+#endif
+
 static int globalValue_callback(void *NotUsed, int argc, char **argv, char **azColName) {
 
     vector<string> cols;
@@ -87,6 +111,8 @@ void script_setDBString(string name, string val)
     if ( getActivePreviewOnly() )
         return;
 
+    ScopeLock lock(&dbValueMutex);
+
     string errMsg;
     string sql;
 
@@ -99,6 +125,8 @@ void script_setDBString(string name, string val)
 
 string script_getDBString(string name)
 {
+    ScopeLock lock(&dbValueMutex);
+
     string errMsg;
 
     dbValueResult.clear();
@@ -116,6 +144,8 @@ string script_getDBString(string name)
 
 bool script_haveDBString(string name)
 {
+    ScopeLock lock(&dbValueMutex);
+
     string errMsg;
 
     dbValueResult.clear();
@@ -136,6 +166,8 @@ void script_setDBValue(string name, float val)
     if ( getActivePreviewOnly() )
         return;
 
+    ScopeLock lock(&dbValueMutex);
+
     string errMsg;
     string sql;
 
@@ -148,6 +180,8 @@ void script_setDBValue(string name, float val)
 
 float script_getDBValue(string name)
 {
+    ScopeLock lock(&dbValueMutex);
+
     string errMsg;
 
     dbValueResult.clear();
@@ -165,6 +199,8 @@ float script_getDBValue(string name)
 
 bool script_haveDBValue(string name)
 {
+    ScopeLock lock(&dbValueMutex);
+
     string errMsg;
 
     dbValueResult.clear();
@@ -183,11 +219,15 @@ void script_setMemoryVec3(string name, script_vec3& v)
     if ( getActivePreviewOnly() )
         return;
 
+    ScopeLock lock(&memoryValueMutex);
+
     globalVec3Map[name] = v;
 }
 
 script_vec3 script_getMemoryVec3(string name)
 {
+    ScopeLock lock(&memoryValueMutex);
+
     map<string, script_vec3>::iterator it = globalVec3Map.find(name);
     if ( it == globalVec3Map.end() )
         return script_vec3();
@@ -196,6 +236,8 @@ script_vec3 script_getMemoryVec3(string name)
 
 bool script_haveMemoryVec3(string name)
 {
+    ScopeLock lock(&memoryValueMutex);
+
     return globalVec3Map.find(name) != globalVec3Map.end();
 }
 
@@ -206,11 +248,15 @@ void script_setMemoryAffine(string name, script_affine& v)
     if ( getActivePreviewOnly() )
         return;
 
+    ScopeLock lock(&memoryValueMutex);
+
     globalAffineMap[name] = v;
 }
 
 script_affine script_getMemoryAffine(string name)
 {
+    ScopeLock lock(&memoryValueMutex);
+
     map<string, script_affine>::iterator it = globalAffineMap.find(name);
     if ( it == globalAffineMap.end() )
         return script_affine();
@@ -219,6 +265,8 @@ script_affine script_getMemoryAffine(string name)
 
 bool script_haveMemoryAffine(string name)
 {
+    ScopeLock lock(&memoryValueMutex);
+
     return globalAffineMap.find(name) != globalAffineMap.end();
 }
 
@@ -8,6 +8,8 @@
 #define DBSTRING_HIDE_TABLE_NAMES           "internal_hideInMainViewTableNames"
 #define DBSTRING_USB_CAMERA_FUNCTIONS       "internal_usbCameraFunctions"
 #define DBSTRING_TABLE_BUTTON_FUNCTIONS     "internal_dbTableButtonFunctions"
+#define DBSTRING_USB_CAMERA_MODE_PREFIX     "internal_usbCameraMode_"   // followed by the camera id hash
+#define DBSTRING_VISION_TEMPLATE_PREFIX     "internal_visionTemplate_"  // followed by the template name
 
 void script_setMemoryValue(std::string name, float v);
 float script_getMemoryValue(std::string name);
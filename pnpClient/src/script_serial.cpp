@@ -12,6 +12,7 @@
 using namespace std;
 
 extern pthread_t mainThreadId;
+bool isCameraViewThread();
 
 unsigned long nextHandle = 1;
 sp_port* selectedSerial = NULL;
@@ -123,7 +124,7 @@ script_serialReply* script_sendSerial(string str, int timeoutMs, string pattern)
     reply->vals = NULL;
     reply->str = "";
 
-    if ( pthread_self() == mainThreadId ) // don't allow live camera scripts to do this at 30fps!
+    if ( isCameraViewThread() ) // don't allow live camera scripts to do this at 30fps!
         return reply;
 
     ScriptLog* log = (ScriptLog*)getActiveScriptLog();
@@ -110,3 +110,37 @@ bool script_setUSBCameraParams(int index, int zoom, int focus, int exposure, int
 
     return allok;
 }
+
+bool script_setUSBCameraDecode(int index, bool gray, int scale)
+{
+    ScriptLog* slog = (ScriptLog*)getActiveScriptLog();
+
+    if ( index < 0 || index >= (int)usbCameraInfos.size() ) {
+        g_log.log(LL_ERROR, "Invalid USB camera index: %d", index);
+        if ( slog )
+            slog->log(LL_ERROR, NULL, 0, "Invalid USB camera index: %d", index);
+        return false;
+    }
+
+    usbCameraInfo_t *info = usbCameraInfos[index];
+
+    if ( scale != 1 && scale != 2 && scale != 4 ) {
+        g_log.log(LL_ERROR, "decode scale should be 1, 2 or 4");
+        if ( slog )
+            slog->log(LL_ERROR, NULL, 0, "decode scale should be 1, 2 or 4");
+        return false;
+    }
+
+    if ( scale != 1 && info->devh && info->currentFrameFormat != UVC_FRAME_FORMAT_MJPEG ) {
+        g_log.log(LL_ERROR, "decode scale is only available for MJPG cameras");
+        if ( slog )
+            slog->log(LL_ERROR, NULL, 0, "decode scale is only available for MJPG cameras");
+        return false;
+    }
+
+    // takes effect from the next frame, use grabFrame with a time to be sure of getting it
+    info->decodeGray = gray;
+    info->decodeScale = scale;
+
+    return true;
+}
@@ -3,9 +3,11 @@
 #include <string.h>
 #include <math.h>
 #include <vector>
+#include <algorithm>
 #include <pthread.h>
-#include <map>
 #include <float.h>
+#include <map>
+#include <memory>
 
 #include <scriptarray/scriptarray.h>
 #include "script/engine.h"
@@ -15,8 +17,16 @@
 
 #include "script_vision.h"
 #include "vision.h"
+#include "hsv.h"
+#include "pyramid.h"
+#include "templatematch.h"
+#include "script_globals.h"
+#include "workerpool.h"
+#include "scopelock.h"
 #include "image.h"
 #include "usbcamera.h"
+#include "log.h"
+#include "scriptlog.h"
 
 #define PACKED __attribute__((__packed__))
 
@@ -28,40 +38,69 @@
 using namespace std;
 using namespace ZXing;
 
-// There can only be two threads running vision scripts at the same time.
-// A single vision context is held for each thread type (main or async).
-// The context values persist between script calls, so for example a call
-// to setDrawColor(...) will change the draw color for other scripts of
-// the same thread type.
-visionContext_t* mainThreadVisionContext;
+// Each open USB camera has its own thread running the camera view script, using the vision
+// context of that camera. Any other thread is the async script thread, which has a single
+// context of its own. The context values persist between script calls, so for example a call
+// to setDrawColor(...) will change the draw color for other scripts of the same thread.
+static thread_local visionContext_t* cameraThreadVisionContext = NULL;
 visionContext_t asyncThreadVisionContext;
 
 
-void setMainThreadVisionContext(visionContext_t* ctx)
+void setCameraThreadVisionContext(visionContext_t* ctx)
 {
-    //mainThreadVisionContext.buffers = b;
-    mainThreadVisionContext = ctx;
+    cameraThreadVisionContext = ctx;
 }
 
-extern pthread_t mainThreadId;
+bool isCameraViewThread()
+{
+    return cameraThreadVisionContext != NULL;
+}
 
 visionContext_t* getVisionContextForThread()
 {
-    if ( pthread_self() == mainThreadId )
-        return mainThreadVisionContext;
+    if ( cameraThreadVisionContext )
+        return cameraThreadVisionContext;
     else
         return &asyncThreadVisionContext;
 }
 
-bool script_grabFrame(int cameraIndex)
+// Call when the frame changes, so the pyramid is made again when it's next used
+void resetPyramid(visionContext_t* ctx)
+{
+    ctx->pyramidValid = false;
+    ctx->pyramidLevel = 0;
+}
+
+videoFrameBuffers_t* getLevelBuffers(visionContext_t* ctx)
+{
+    if ( ctx->pyramidLevel > 0 )
+        return &ctx->pyramidBuffers[ctx->pyramidLevel - 1];
+    return ctx->buffers;
+}
+
+// How many times to halve frame pixels to get pixels of b
+int getLevelShift(visionContext_t* ctx, videoFrameBuffers_t* b)
+{
+    return b == ctx->buffers ? 0 : ctx->pyramidLevel;
+}
+
+// Position of the middle of pixel p of a level, in frame pixels
+float levelToFrame(float p, int shift)
+{
+    int scale = 1 << shift;
+    return p * scale + 0.5f * (scale - 1);
+}
+
+bool script_grabFrame(int cameraIndex, uint64_t newerThan)
 {
-    if ( pthread_self() == mainThreadId )
-        return true; // will use mainThreadVisionContext
+    if ( isCameraViewThread() )
+        return true; // the camera thread already copied the latest frame in
     visionContext_t* ctx = getVisionContextForThread();
     if ( ! ctx->buffers ) {
         ctx->buffers = new videoFrameBuffers_t();
     }
-    bool ok = grabUSBCameraFrame(cameraIndex, ctx->buffers);
+    bool ok = grabUSBCameraFrame(cameraIndex, ctx->buffers, newerThan);
+    resetPyramid(ctx);
     return ok;
 }
 
@@ -73,6 +112,12 @@ void freeAsyncFrameBuffer() {
 
 
 #define GET_THREAD_CONTEXT_ELSE \
+    visionContext_t* ctx = getVisionContextForThread();\
+    videoFrameBuffers_t* b = ctx ? getLevelBuffers(ctx) : NULL;\
+    if ( ! b || ! b->rgbData )
+
+// Drawing always goes on the frame itself, whichever pyramid level is in use
+#define GET_FRAME_CONTEXT_ELSE \
     visionContext_t* ctx = getVisionContextForThread();\
     videoFrameBuffers_t* b = ctx ? ctx->buffers : NULL;\
     if ( ! b || ! b->rgbData )
@@ -84,6 +129,8 @@ bool script_saveImage(string filename)
     GET_THREAD_CONTEXT_ELSE
         return false;
 
+    flushMask(b);
+
     return savePNG(filename, b->width, b->height, 3, b->rgbData);
 }
 
@@ -98,8 +145,11 @@ bool script_loadImage(string filename)
     if ( ctx->shouldTryImageLoad )
         ctx->lastLoadImageResult = false; // invalidate last load
 
-    if ( (filename == ctx->lastLoadedImageFilename) && ctx->lastLoadImageResult ) {
+    if ( (filename == ctx->lastLoadedImageFilename) && ctx->lastLoadImageResult &&
+         ctx->lastLoadedImageWidth == ctx->buffers->width && ctx->lastLoadedImageHeight == ctx->buffers->height ) {
         memcpy( ctx->buffers->rgbData, ctx->lastLoadedImageBuffer, ctx->buffers->width * ctx->buffers->height * 3 );
+        resetMask(ctx->buffers);
+        resetPyramid(ctx);
         return true;
     }
 
@@ -108,7 +158,14 @@ bool script_loadImage(string filename)
 
     ctx->shouldTryImageLoad = false;
 
+    if ( ctx->lastLoadedImageBuffer && (ctx->lastLoadedImageWidth != ctx->buffers->width || ctx->lastLoadedImageHeight != ctx->buffers->height) ) {
+        delete[] ctx->lastLoadedImageBuffer;
+        ctx->lastLoadedImageBuffer = NULL;
+    }
+
     if ( ! ctx->lastLoadedImageBuffer ) {
+        ctx->lastLoadedImageWidth = ctx->buffers->width;
+        ctx->lastLoadedImageHeight = ctx->buffers->height;
         ctx->lastLoadedImageBuffer = new uint8_t[ ctx->buffers->width * ctx->buffers->height * 3 ];
         memset( ctx->lastLoadedImageBuffer, 0, ctx->buffers->width * ctx->buffers->height * 3 );
     }
@@ -135,6 +192,26 @@ void initFrameBuffers(videoFrameBuffers_t* vfb, int width, int height) {
     vfb->rgbData = new uint8_t[width * height * 3];
 }
 
+void freeFrameBuffers(videoFrameBuffers_t* vfb) {
+    delete[] vfb->rgbData;
+    delete[] vfb->rgbData2;
+    delete[] vfb->grayData;
+    delete[] vfb->grayData2;
+    delete[] vfb->voteData;
+    delete[] vfb->blurData;
+    delete[] vfb->maskData;
+    *vfb = videoFrameBuffers_t();
+}
+
+// Cameras can have different resolutions, so the buffers of the async context can change size
+// depending on which camera the frame was grabbed from.
+void resizeFrameBuffers(videoFrameBuffers_t* vfb, int width, int height) {
+    if ( vfb->rgbData && vfb->width == width && vfb->height == height )
+        return;
+    freeFrameBuffers(vfb);
+    initFrameBuffers(vfb, width, height);
+}
+
 bool haveGrayData(videoFrameBuffers_t* vfb) {
     return vfb->grayData != NULL;
 }
@@ -157,12 +234,109 @@ void ensureRGBData2(videoFrameBuffers_t* vfb) {
     vfb->rgbData2 = new uint8_t[vfb->width * vfb->height * 3];
 }
 
+void ensureBlurData(videoFrameBuffers_t* vfb) {
+    if ( vfb->blurData )
+        return;
+    vfb->blurData = new uint8_t[vfb->width * vfb->height * 3];
+}
+
 void ensureVoteData(videoFrameBuffers_t* vfb) {
     if ( vfb->voteData )
         return;
     vfb->voteData = new uint32_t[vfb->width * vfb->height];
 }
 
+void ensureMaskData(videoFrameBuffers_t* vfb) {
+    if ( vfb->maskData )
+        return;
+    vfb->maskData = new uint8_t[vfb->width * vfb->height];
+}
+
+// Call when rgbData has been replaced with a new image, any mask belongs to the old one.
+void resetMask(videoFrameBuffers_t* vfb) {
+    vfb->maskValid = false;
+    vfb->maskPending = false;
+}
+
+// Draws the mask into rgbData as white/black if it has changed, so that rgbData shows the
+// same thing it would have if the binary functions had written to it directly.
+void flushMask(videoFrameBuffers_t* vfb) {
+    if ( ! vfb->maskPending )
+        return;
+    vfb->maskPending = false;
+    for (int y = vfb->maskLY; y < vfb->maskUY; y++) {
+        int i = y * vfb->width + vfb->maskLX;
+        uint8_t* m = &vfb->maskData[i];
+        uint8_t* rgb = &vfb->rgbData[i * 3];
+        for (int x = vfb->maskLX; x < vfb->maskUX; x++) {
+            uint8_t v = *m++;
+            *rgb++ = v;
+            *rgb++ = v;
+            *rgb++ = v;
+        }
+    }
+}
+
+// For functions that read rgbData.
+inline void readRGB(videoFrameBuffers_t* vfb) {
+    flushMask(vfb);
+}
+
+// For functions that change rgbData, after which the mask no longer matches it.
+inline void writeRGB(videoFrameBuffers_t* vfb) {
+    flushMask(vfb);
+    vfb->maskValid = false;
+}
+
+// For functions that take a binary image. Returns the mask for the given area, making it from
+// rgbData (any non-black pixel is set) if the current mask is not for the same area.
+uint8_t* readMask(videoFrameBuffers_t* vfb, int lx, int ux, int ly, int uy) {
+
+    ensureMaskData(vfb);
+
+    if ( vfb->maskValid && vfb->maskLX == lx && vfb->maskUX == ux && vfb->maskLY == ly && vfb->maskUY == uy )
+        return vfb->maskData;
+
+    flushMask(vfb);
+
+    for (int y = ly; y < uy; y++) {
+        int i = y * vfb->width + lx;
+        uint8_t* m = &vfb->maskData[i];
+        uint8_t* rgb = &vfb->rgbData[i * 3];
+        for (int x = lx; x < ux; x++) {
+            *m++ = (rgb[0] | rgb[1] | rgb[2]) ? 255 : 0;
+            rgb += 3;
+        }
+    }
+
+    vfb->maskLX = lx;
+    vfb->maskUX = ux;
+    vfb->maskLY = ly;
+    vfb->maskUY = uy;
+    vfb->maskValid = true;
+
+    return vfb->maskData;
+}
+
+// For functions that produce a binary image. The caller must set every pixel in the area.
+uint8_t* writeMask(videoFrameBuffers_t* vfb, int lx, int ux, int ly, int uy) {
+
+    ensureMaskData(vfb);
+
+    // a pending mask for some other area has to be drawn first, or it would be lost
+    if ( vfb->maskLX != lx || vfb->maskUX != ux || vfb->maskLY != ly || vfb->maskUY != uy )
+        flushMask(vfb);
+
+    vfb->maskLX = lx;
+    vfb->maskUX = ux;
+    vfb->maskLY = ly;
+    vfb->maskUY = uy;
+    vfb->maskValid = true;
+    vfb->maskPending = true;
+
+    return vfb->maskData;
+}
+
 void cleanupVideoFrameBuffers(videoFrameBuffers_t* vfb)
 {
     if ( vfb->rgbData )
@@ -184,13 +358,22 @@ void cleanupVideoFrameBuffers(videoFrameBuffers_t* vfb)
     if ( vfb->voteData )
         delete[] vfb->voteData;
     vfb->voteData = NULL;
+
+    if ( vfb->blurData )
+        delete[] vfb->blurData;
+    vfb->blurData = NULL;
+
+    if ( vfb->maskData )
+        delete[] vfb->maskData;
+    vfb->maskData = NULL;
+    resetMask(vfb);
 }
 
 
 
 inline void setPixelColor(videoFrameBuffers_t* bf, int x, int y, int r, int g, int b, int size = 1) {
-    for (int xx = x-size+1; xx < x+size; xx++) {
-        for (int yy = y-size+1; yy < y+size; yy++) {
+    for (int yy = y-size+1; yy < y+size; yy++) {
+        for (int xx = x-size+1; xx < x+size; xx++) {
             if ( xx >= 0 && xx < bf->width && yy >= 0 && yy < bf->height ) {
                 int i = (yy * bf->width + xx) * 3;
                 bf->rgbData[i++] = r;
@@ -209,6 +392,8 @@ inline void setPixelColor(videoFrameBuffers_t* bf, int x, int y, int r, int g, i
 
 void drawRect(videoFrameBuffers_t* b, int x1, int x2, int y1, int y2, uint8_t red, uint8_t grn, uint8_t blu) {
 
+    writeRGB(b);
+
     if ( y1 >= 0 && y1 < b->height )
         for (int x = std::max(0,x1); x <= std::min(b->width,x2); x++)
             setPixelColor( b, x, y1, red, grn, blu);
@@ -228,6 +413,8 @@ void drawRect(videoFrameBuffers_t* b, int x1, int x2, int y1, int y2, uint8_t re
 
 void drawLine(videoFrameBuffers_t* b, int x1, int x2, int y1, int y2, uint8_t red, uint8_t grn, uint8_t blu)
 {
+    writeRGB(b);
+
     if ( (y1 == y2) && (y1 < b->height) ) { // horizontal line special case, optimize
         int xs = max(0, min(x1, x2));
         int xe = min(max(x1, x2), b->width - 1);
@@ -287,6 +474,8 @@ void rotatePixel(videoFrameBuffers_t* b, int x, int y, int &xout, int &yout, flo
 
 void drawCross(videoFrameBuffers_t* b, int x, int y, int size, float angle, uint8_t red, uint8_t grn, uint8_t blu)
 {
+    writeRGB(b);
+
     int midw = b->width/2;
     int midh = b->height/2;
 
@@ -324,6 +513,8 @@ void drawCross(videoFrameBuffers_t* b, int x, int y, int size, float angle, uint
 
 void drawCircle(videoFrameBuffers_t* b, int x, int y, float radius, uint8_t red, uint8_t grn, uint8_t blu)
 {
+    writeRGB(b);
+
     float r = radius * 0.7071;
 
     int x1 = x - r;
@@ -373,8 +564,11 @@ void script_setDrawColor(int r, int g, int bb)
 }
 
 
+// The window size and center are in frame pixels, and scaled down here for pyramid levels. A
+// window moved off the middle is kept inside the frame by sliding it back in.
 #define GETWINDOW \
-    int windowSize = ctx->windowSize;\
+    int levelShift = getLevelShift(ctx, b);\
+    int windowSize = ctx->windowSize >> levelShift;\
     if ( windowSize < 16 )\
         windowSize = 16;\
     else {\
@@ -386,16 +580,24 @@ void script_setDrawColor(int r, int g, int bb)
     \
     int midw = b->width/2;\
     int midh = b->height/2;\
+    if ( ctx->windowCenterX >= 0 && ctx->windowCenterY >= 0 ) {\
+        midw = (int)ctx->windowCenterX >> levelShift;\
+        midh = (int)ctx->windowCenterY >> levelShift;\
+    }\
     \
     int hw = windowSize/2;\
     int lx = midw - hw;\
     int ux = midw + hw;\
     int ly = midh - hw;\
-    int uy = midh + hw;
+    int uy = midh + hw;\
+    if ( lx < 0 ) { ux -= lx; lx = 0; }\
+    if ( ly < 0 ) { uy -= ly; ly = 0; }\
+    if ( ux > b->width ) { lx = max(0, lx - (ux - b->width)); ux = b->width; }\
+    if ( uy > b->height ) { ly = max(0, ly - (uy - b->height)); uy = b->height; }
 
 void script_drawWindow()
 {
-    GET_THREAD_CONTEXT_ELSE
+    GET_FRAME_CONTEXT_ELSE
         return;
 
     GETWINDOW;
@@ -405,7 +607,7 @@ void script_drawWindow()
 
 void script_drawRect(int x1, int x2, int y1, int y2)
 {
-    GET_THREAD_CONTEXT_ELSE
+    GET_FRAME_CONTEXT_ELSE
         return;
     drawRect(b, x1, x2, y1, y2, ctx->colred, ctx->colgrn, ctx->colblu);
 }
@@ -417,7 +619,7 @@ void script_drawRectF(float x1, float x2, float y1, float y2)
 
 void script_drawRotatedRect(script_rotatedRect& r)
 {
-    GET_THREAD_CONTEXT_ELSE
+    GET_FRAME_CONTEXT_ELSE
         return;
 
     float c = cos( r.angle * DEGTORAD );
@@ -455,7 +657,7 @@ void script_drawRotatedRect(script_rotatedRect& r)
 
 void script_drawLine(int x1, int x2, int y1, int y2)
 {
-    GET_THREAD_CONTEXT_ELSE
+    GET_FRAME_CONTEXT_ELSE
         return;
     drawLine(b, x1, x2, y1, y2, ctx->colred, ctx->colgrn, ctx->colblu);
 }
@@ -467,7 +669,7 @@ void script_drawLineF(float x1, float x2, float y1, float y2)
 
 void script_drawCross(int x, int y, int size, float angle)
 {
-    GET_THREAD_CONTEXT_ELSE
+    GET_FRAME_CONTEXT_ELSE
         return;
     drawCross(b, x, y, size, angle, ctx->colred, ctx->colgrn, ctx->colblu);
 }
@@ -479,7 +681,7 @@ void script_drawCrossF(float x, float y, float size, float angle)
 
 void script_drawCircle(int x, int y, float radius)
 {
-    GET_THREAD_CONTEXT_ELSE
+    GET_FRAME_CONTEXT_ELSE
         return;
     drawCircle(b, x, y, radius, ctx->colred, ctx->colgrn, ctx->colblu);
 }
@@ -495,69 +697,14 @@ struct rgb_t {
     uint8_t b;
 } PACKED;
 
-struct hsv_t {
-    uint8_t h;
-    uint8_t s;
-    uint8_t v;
-} PACKED;
-
-
-
-void rgb2hsv(rgb_t *in, hsv_t *out)
-{
-    int min, max, delta;
-
-    int r = in->r;
-    int g = in->g;
-    int b = in->b;
-
-    min = r < g ? r : g;
-    min = min < b ? min : b;
-
-    max = r > g ? r : g;
-    max = max  > b ? max : b;
-
-    out->v = max;
-    delta = max - min;
-    if (delta < 1)
-    {
-        out->s = 0;
-        out->h = 0; // undefined, maybe nan?
-        return;
-    }
-
-    if ( max > 0.0 ) { // NOTE: if Max is == 0, this divide would cause a crash
-        out->s = (delta / (float)max) * 255;
-    } else {
-        // if max is 0, then r = g = b = 0
-        // s = 0, h is undefined
-        out->s = 0.0;
-        out->h = 0;                            // its now undefined
-        return;
-    }
-
-    float h = 0;
-    if( r >= max )                           // > is bogus, just keeps compilor happy
-        h = ( g - b ) / (float)delta;        // between yellow & magenta
-    else if ( g >= max )
-        h = 2 + ( b - r ) / (float)delta;  // between cyan & yellow
-    else
-        h = 4 + ( r - g ) / (float)delta;  // between magenta & cyan
-
-    //out.h *= 60.0;                              // degrees
-
-    if ( h < 0.0 )
-        h += 6;
-
-    out->h = h * 42.4;
-}
-
 
 void script_copyRGB()
 {
     GET_THREAD_CONTEXT_ELSE
         return;
 
+    readRGB(b);
+
     ensureRGBData2(b);
     memcpy(b->rgbData2, b->rgbData, b->width*b->height*3);
 }
@@ -570,6 +717,8 @@ void script_overlayRGB(float opacity)
     if ( ! b->rgbData2 )
         return;
 
+    writeRGB(b);
+
     GETWINDOW;
 
     for (int y = ly; y < uy; y++) {
@@ -590,6 +739,8 @@ void script_RGB2BGR()
     GET_THREAD_CONTEXT_ELSE
         return;
 
+    writeRGB(b);
+
     for (int i = 0; i < b->width * b->height; i++) {
         uint8_t tmp = b->rgbData[i*3];
         b->rgbData[i*3] = b->rgbData[i*3+2];
@@ -610,25 +761,18 @@ void script_RGB2HSV(int planeForVisual)
     if ( planeForVisual < -1 || planeForVisual > 2 )
         return;
 
-    hsv_t hsv;
+    writeRGB(b);
 
-    for (int i = 0; i < b->width * b->height; i++) {
-        rgb_t* rgb = (rgb_t*)&b->rgbData[i*3];
-        rgb2hsv(rgb, &hsv);
-        if ( planeForVisual == -1 ) {
-            rgb->r = hsv.h;
-            rgb->g = hsv.s;
-            rgb->b = hsv.v;
-        }
-        else {
-            uint8_t val = hsv.h;
-            if ( planeForVisual == 1 )
-                val = hsv.s;
-            if ( planeForVisual == 2 )
-                val = hsv.v;
-            rgb->r = val;
-            rgb->g = val;
-            rgb->b = val;
+    for (int y = 0; y < b->height; y++) {
+        uint8_t* row = &b->rgbData[y*b->width*3];
+        rgb2hsvRow(row, row, b->width);
+        if ( planeForVisual == -1 )
+            continue;
+        for (int x = 0; x < b->width; x++) {
+            uint8_t val = row[x*3+planeForVisual];
+            row[x*3+0] = val;
+            row[x*3+1] = val;
+            row[x*3+2] = val;
         }
     }
 }
@@ -645,6 +789,8 @@ void script_RGB2RGB(int planeForVisual)
     if ( planeForVisual < 0 || planeForVisual > 2 )
         return;
 
+    writeRGB(b);
+
     for (int i = 0; i < b->width * b->height; i++) {
         rgb_t* rgb = (rgb_t*)&b->rgbData[i*3];
         uint8_t val = rgb->r;
@@ -680,6 +826,64 @@ void script_setVisionWindowSizeF(float windowSize)
     script_setVisionWindowSize(windowSize);
 }
 
+// Give a negative position to put the window back in the middle of the frame
+void script_setVisionWindowCenter(float x, float y)
+{
+    visionContext_t* ctx = getVisionContextForThread();
+    ctx->windowCenterX = x;
+    ctx->windowCenterY = y;
+}
+
+// Makes the half and quarter size levels from the frame as it is now. Changes made to the frame
+// after this (eg. blur) are not seen at the other levels unless this is called again.
+bool script_buildPyramid()
+{
+    visionContext_t* ctx = getVisionContextForThread();
+    videoFrameBuffers_t* b = ctx->buffers;
+    if ( ! b || ! b->rgbData )
+        return false;
+
+    readRGB(b);
+
+    videoFrameBuffers_t* below = b;
+    for (int i = 0; i < VISION_PYRAMID_LEVELS; i++) {
+        videoFrameBuffers_t* level = &ctx->pyramidBuffers[i];
+        if ( below->width < 2 || below->height < 2 )
+            return false;
+        resizeFrameBuffers(level, below->width / 2, below->height / 2);
+        halveRGB(below->rgbData, below->width, below->height, level->rgbData);
+        resetMask(level);
+        below = level;
+    }
+
+    ctx->pyramidValid = true;
+    return true;
+}
+
+// The vision functions after this work on the given level, 0 being the frame itself, 1 half
+// size and 2 quarter size. The pyramid is made from the frame if it hasn't been already.
+bool script_setPyramidLevel(int level)
+{
+    visionContext_t* ctx = getVisionContextForThread();
+
+    if ( level < 0 || level > VISION_PYRAMID_LEVELS )
+        return false;
+
+    if ( level > 0 && ! ctx->pyramidValid ) {
+        if ( ! script_buildPyramid() )
+            return false;
+    }
+
+    ctx->pyramidLevel = level;
+    return true;
+}
+
+int script_getPyramidLevel()
+{
+    visionContext_t* ctx = getVisionContextForThread();
+    return ctx->pyramidLevel;
+}
+
 // CScriptArray* script_quickblob_default() {
 //     return script_quickblob(-1,-1,-1,-1,-1);
 // }
@@ -694,22 +898,9 @@ CScriptArray* script_quickblob(int color, int minpixels, int maxpixels, int minw
         return arr;
     }
 
-    ensureGrayData(b);
-
     GETWINDOW;
 
-    int gi = 0;
-    for (int y = ly; y < uy; y++) {
-        for (int x = lx; x < ux; x++) {
-            int i = y*b->width+x;
-            rgb_t* rgb = (rgb_t*)&b->rgbData[i*3];
-            if ( rgb->r > 0 || rgb->g > 0 || rgb->b > 0 )
-                b->grayData[gi] = 255;
-            else
-                b->grayData[gi] = 0;
-            gi++;
-        }
-    }
+    uint8_t* mask = readMask(b, lx, ux, ly, uy);
 
     if ( color < 0 )
         color = VISION_DEFAULT_COLOR;
@@ -722,6 +913,12 @@ CScriptArray* script_quickblob(int color, int minpixels, int maxpixels, int minw
     if ( maxwidth < 0 )
         maxwidth = VISION_DEFAULT_MAXWIDTH;
 
+    // limits are in frame pixels
+    minpixels >>= 2 * levelShift;
+    maxpixels >>= 2 * levelShift;
+    minwidth >>= levelShift;
+    maxwidth >>= levelShift;
+
     // br.params.color = VISION_DEFAULT_COLOR;
     // //br.params.threshold = VISION_DEFAULT_THRESHOLD;
     // //br.params.maskSize = VISION_DEFAULT_MASKSIZE;
@@ -737,27 +934,27 @@ CScriptArray* script_quickblob(int color, int minpixels, int maxpixels, int minw
     br.params.minWidth = minwidth;
     br.params.maxWidth = maxwidth;
 
-    br.bytes = b->grayData;
-    br.frame = 0;
+    br.bytes = &mask[ly*b->width+lx];
     br.width = ux - lx;
     br.height = uy - ly;
+    br.stride = b->width;
 
-    bool ok = runQuickblob(&br);
-    if ( ! ok ) {
-        savePNG("blobfail.png", br.width, br.height, 1, br.bytes);
-    }
+    bool ok = findBlobs(&br);
 
     CScriptArray* arr = CScriptArray::Create(t, br.blobs.size());
 
     if ( ok ) {
         int i = 0;
         for (script_blob& blob : br.blobs) {
-            blob.ax += lx;
-            blob.ay += ly;
-            blob.bb_x1 += lx;
-            blob.bb_x2 += lx;
-            blob.bb_y1 += ly;
-            blob.bb_y2 += ly;
+            blob.ax = levelToFrame(blob.ax + lx, levelShift);
+            blob.ay = levelToFrame(blob.ay + ly, levelShift);
+            blob.bb_x1 = (blob.bb_x1 + lx) << levelShift;
+            blob.bb_x2 = ((blob.bb_x2 + lx + 1) << levelShift) - 1;
+            blob.bb_y1 = (blob.bb_y1 + ly) << levelShift;
+            blob.bb_y2 = ((blob.bb_y2 + ly + 1) << levelShift) - 1;
+            blob.size <<= 2 * levelShift;
+            blob.pixels <<= 2 * levelShift;
+            blob.perimeter <<= levelShift;
 
             blob.w = blob.bb_x2 - blob.bb_x1;
             blob.h = blob.bb_y2 - blob.bb_y1;
@@ -773,106 +970,302 @@ CScriptArray* script_quickblob(int color, int minpixels, int maxpixels, int minw
 }
 
 // https://blog.ivank.net/fastest-gaussian-blur.html
-void boxesForGauss(int sigma, int n, vector<int> &boxSizes)  // standard deviation, number of boxes
-{
-    float wIdeal = sqrt((12*sigma*sigma/n)+1);  // Ideal averaging filter width
-    int wl = floor(wIdeal);
-    if( wl % 2 == 0 )
-        wl--;
-    int wu = wl+2;
-
-    float mIdeal = (12*sigma*sigma - n*wl*wl - 4*n*wl - 3*n)/(-4*wl - 4);
-    int m = round(mIdeal);
+// Gaussian blur approximated by three box blurs, which is close enough for vision purposes and
+// takes the same time for any sigma. Plain box blurs can only match the sigma in steps, so each
+// box has a fractional weight on the two samples just outside it, chosen to give exactly the
+// right variance ("extended box", Gwosdek et al. 2011). Edges are extended by repeating the
+// first/last pixel.
+//
+// Each pass works on interleaved pixels of any number of channels: along a row each channel
+// has its own running sum, and down the columns one running sum per byte of the row is kept,
+// so the vertical passes are plain loops over whole rows. Each pass is split into bands of rows
+// done in parallel, the vertical pass reads from a separate buffer so the bands can each start
+// their sums from the rows above them.
+
+#define BLUR_PASSES 3
+
+struct boxBlurJob_t {
+    const uint8_t* src;
+    uint8_t* dst;
+    int srcStride;
+    int dstStride;
+    int w;
+    int h;
+    int channels;
+    int r;          // box radius
+    float mulInside;    // weight of the samples within r, and
+    float mulEdge;      // of the two at r+1, divided by the total weight
+};
 
+static void extendedBoxForGauss(float sigma, boxBlurJob_t& job)
+{
+    float variance = sigma * sigma / BLUR_PASSES; // variance of each pass
+    int r = floor(0.5 * sqrt(12 * variance + 1) - 0.5);
+    float boxVariance = r * (r + 1) / 3.0f;
+    float alpha = (2*r + 1) * (variance - boxVariance) / (2 * ((r + 1) * (r + 1) - variance));
+    float total = 2*r + 1 + 2*alpha;
+    job.r = r;
+    job.mulInside = 1 / total;
+    job.mulEdge = alpha / total;
+}
+
+// One row of output, from the sum of the samples within r and the sum of the two at r+1. These
+// are written as plain loops over the whole row with nothing aliased, so the compiler can
+// vectorize them.
+static inline void boxBlurOutput(const int* __restrict sum, const uint8_t* __restrict edge1, const uint8_t* __restrict edge2,
+                                 uint8_t* __restrict dst, int n, float mulInside, float mulEdge)
+{
     for (int i = 0; i < n; i++)
-        boxSizes.push_back( i < m ? wl : wu );
+        dst[i] = (int)std::min(sum[i] * mulInside + (edge1[i] + edge2[i]) * mulEdge + 0.5f, 255.0f);
 }
 
-void boxBlurH_4 (uint8_t* scl, uint8_t* tcl, int w, int h, int r)
+static void boxBlurRows(void* arg, int firstRow, int lastRow)
 {
-    float iarr = 1 / (float)(r+r+1);
-    for(int i=0; i<h; i++) {
-        int ti = i*w, li = ti, ri = ti+r;
-        float fv = scl[ti], lv = scl[ti+w-1], val = (r+1)*fv;
-        for(int j=0; j<r; j++) val += scl[ti+j];
-        for(int j=0  ; j<=r ; j++) { val += scl[ri++] - fv       ;   tcl[ti++] = (val*iarr); }
-        for(int j=r+1; j<w-r; j++) { val += scl[ri++] - scl[li++];   tcl[ti++] = (val*iarr); }
-        for(int j=w-r; j<w  ; j++) { val += lv        - scl[li++];   tcl[ti++] = (val*iarr); }
+    boxBlurJob_t& job = *(boxBlurJob_t*)arg;
+    int c = job.channels;
+    int n = job.w * c;
+    int r = job.r;
+
+    // row with r+1 repeated pixels either side, so the sums don't need to check for the edges
+    int pad = (r + 1) * c;
+    vector<uint8_t> padded(n + 2 * pad);
+    vector<int> prefix(n + 2 * pad); // running total of each channel along the padded row
+    vector<int> sum(n);
+
+    for (int y = firstRow; y < lastRow; y++) {
+        const uint8_t* src = &job.src[y * job.srcStride];
+        uint8_t* dst = &job.dst[y * job.dstStride];
+
+        memcpy(&padded[pad], src, n);
+        for (int i = 0; i < pad; i++) {
+            padded[i] = src[i % c];
+            padded[pad + n + i] = src[n - c + i % c];
+        }
+
+        for (int ch = 0; ch < c; ch++) {
+            int total = 0;
+            for (int i = ch; i < n + 2 * pad; i += c) {
+                total += padded[i];
+                prefix[i] = total;
+            }
+        }
+
+        // sum from x-r to x+r, for pixel x at padded[pad + i]
+        const int* upper = &prefix[pad + r*c];
+        const int* lower = &prefix[pad - (r+1)*c];
+        for (int i = 0; i < n; i++)
+            sum[i] = upper[i] - lower[i];
+
+        boxBlurOutput(sum.data(), &padded[0], &padded[2 * pad], dst, n, job.mulInside, job.mulEdge);
     }
 }
 
-void boxBlurT_4 (uint8_t* scl, uint8_t* tcl, int w, int h, int r)
+static void boxBlurColumns(void* arg, int firstRow, int lastRow)
 {
-    float iarr = 1 / (float)(r+r+1);
-    for(int i=0; i<w; i++) {
-        int ti = i, li = ti, ri = ti+r*w;
-        float fv = scl[ti], lv = scl[ti+w*(h-1)], val = (r+1)*fv;
-        for(int j=0; j<r; j++) val += scl[ti+j*w];
-        for(int j=0  ; j<=r ; j++) { val += scl[ri] - fv     ;  tcl[ti] = (val*iarr);  ri+=w; ti+=w; }
-        for(int j=r+1; j<h-r; j++) { val += scl[ri] - scl[li];  tcl[ti] = (val*iarr);  li+=w; ri+=w; ti+=w; }
-        for(int j=h-r; j<h  ; j++) { val += lv      - scl[li];  tcl[ti] = (val*iarr);  li+=w; ti+=w; }
+    boxBlurJob_t& job = *(boxBlurJob_t*)arg;
+    int n = job.w * job.channels;
+    int r = job.r;
+
+    #define BLUR_ROW(y) (&job.src[std::min(std::max((y), 0), job.h - 1) * job.srcStride])
+
+    vector<int> sum(n, 0);
+    for (int k = -r; k <= r; k++) {
+        const uint8_t* s = BLUR_ROW(firstRow + k);
+        for (int i = 0; i < n; i++)
+            sum[i] += s[i];
+    }
+
+    for (int y = firstRow; y < lastRow; y++) {
+        const uint8_t* above = BLUR_ROW(y - r - 1);
+        const uint8_t* top = BLUR_ROW(y - r);
+        const uint8_t* below = BLUR_ROW(y + r + 1);
+        boxBlurOutput(sum.data(), above, below, &job.dst[y * job.dstStride], n, job.mulInside, job.mulEdge);
+        int* s = sum.data();
+        for (int i = 0; i < n; i++)
+            s[i] += below[i] - top[i];
     }
+
+    #undef BLUR_ROW
 }
 
-void boxBlur_4 (uint8_t* scl, uint8_t* tcl, int w, int h, int r)
+// Blurs w*h pixels of 'channels' bytes each in place, tmp must have room for w*h*channels.
+void gaussianBlur(uint8_t* data, int stride, int w, int h, int channels, float sigma, uint8_t* tmp)
 {
-    memcpy(tcl, scl, w*h);
-    boxBlurH_4(tcl, scl, w, h, r);
-    boxBlurT_4(scl, tcl, w, h, r);
+    boxBlurJob_t job;
+    extendedBoxForGauss(sigma, job);
+    job.w = w;
+    job.h = h;
+    job.channels = channels;
+
+    for (int pass = 0; pass < BLUR_PASSES; pass++) {
+        job.src = data;
+        job.srcStride = stride;
+        job.dst = tmp;
+        job.dstStride = w * channels;
+        runInRowBands(h, boxBlurRows, &job);
+
+        job.src = tmp;
+        job.srcStride = w * channels;
+        job.dst = data;
+        job.dstStride = stride;
+        runInRowBands(h, boxBlurColumns, &job);
+    }
 }
 
-void gaussBlur_4 (uint8_t* scl, uint8_t* tcl, int w, int h, int r)
+void script_blur(int kernelSize)
 {
-    vector<int> bxs;
-    boxesForGauss(r, 3, bxs);
-    boxBlur_4 (scl, tcl, w, h, (bxs[0]-1)/2);
-    boxBlur_4 (tcl, scl, w, h, (bxs[1]-1)/2);
-    boxBlur_4 (scl, tcl, w, h, (bxs[2]-1)/2);
+    script_blurF(kernelSize);
 }
 
-void script_blur(int kernelSize)
+// kernelSize is the sigma of the gaussian
+void script_blurF(float kernelSize)
 {
-    if ( kernelSize < 1 )
+    if ( kernelSize <= 0 )
         return;
 
     GET_THREAD_CONTEXT_ELSE
         return;
 
-    ensureGrayData(b);
-    ensureGrayData2(b); // actually used for one color plane here
+    ensureBlurData(b);
 
-    if ( kernelSize > 24 )
-        kernelSize = 24;
+    writeRGB(b);
 
     GETWINDOW;
 
-    for (int c = 0; c < 3; c++) {
+    kernelSize /= 1 << levelShift;
+    if ( kernelSize > VISION_MAX_BLUR )
+        kernelSize = VISION_MAX_BLUR;
 
-        int gi = 0;
-        for (int x = lx; x < ux; x++) {
-            for (int y = ly; y < uy; y++) {
-                int i = y*b->width+x;
-                b->grayData[gi++] = b->rgbData[3*i+c];
-            }
+    gaussianBlur(&b->rgbData[3*(ly*b->width+lx)], 3*b->width, ux-lx, uy-ly, 3, kernelSize, b->blurData);
+}
+
+// One step of counting how many rows away the last feature in each column was, up to far.
+// Features are the white pixels if featureSet is true or the black ones otherwise, and only
+// from flx to fux. Returns false if every column is at far. prev and run can be the same.
+static inline bool countFeatureDistance(uint8_t* row, const uint32_t* prev, uint32_t* run, int w, uint32_t far, bool featureSet, int flx, int fux)
+{
+    uint8_t notFeature = featureSet ? 0 : 255;
+    uint32_t nearest = far;
+    for (int x = 0; x < flx; x++) {
+        run[x] = std::min(prev[x] + 1, far);
+        nearest = std::min(nearest, run[x]);
+    }
+    for (int x = flx; x < fux; x++) {
+        run[x] = row[x] == notFeature ? std::min(prev[x] + 1, far) : 0;
+        nearest = std::min(nearest, run[x]);
+    }
+    for (int x = std::max(flx, fux); x < w; x++) {
+        run[x] = std::min(prev[x] + 1, far);
+        nearest = std::min(nearest, run[x]);
+    }
+    return nearest < far;
+}
+
+// Grows (pixels > 0) or shrinks (pixels < 0) the white area of the mask window by a disk of
+// the given radius. Only white pixels at least the radius away from the window edges are grown
+// or shrunk, so the result stays inside the window.
+//
+// Rather than visiting a disk around every pixel, this finds the pixels that are within the
+// radius of a 'feature' (a white pixel being grown, or a black pixel that eats into the white
+// when shrinking) in two passes, so the time taken doesn't depend on the radius:
+//  - bottom up, how far down the nearest feature is in each column
+//  - top down, how far up it is, which together give the vertical distance g to the nearest
+//    feature in each column. A feature at distance g in column x covers the row from
+//    x - halfWidth[g] to x + halfWidth[g], where halfWidth is the half width of the disk at
+//    that height, and the union of those spans is found in one sweep along the row.
+// This gives exactly the pixels where the Euclidean distance to a feature is <= radius.
+static void growMask(videoFrameBuffers_t* b, uint8_t* mask, int pixels, int lx, int ux, int ly, int uy)
+{
+    bool grow = pixels > 0;
+    pixels = abs(pixels);
+
+    int w = ux - lx;
+
+    // don't go all the way to the edges for actual grow
+    int wlx = lx + pixels;
+    int wux = ux - pixels;
+    int wly = ly + pixels;
+    int wuy = uy - pixels;
+
+    if ( wlx >= wux || wly >= wuy ) {
+        if ( grow ) {
+            // nothing to grow from
+            for (int y = ly; y < uy; y++)
+                memset(&mask[y*b->width+lx], 0, w);
         }
+        return;
+    }
 
-        gaussBlur_4(b->grayData, b->grayData2, ux-lx, uy-ly, kernelSize);
+    // where features can be, in window coordinates
+    int flx = grow ? wlx-lx : 0;
+    int fux = grow ? wux-lx : w;
+    int fly = grow ? wly : ly;
+    int fuy = grow ? wuy : uy;
+
+    int far = pixels + 1; // distances are only counted up to here
+
+    // -1 for 'far' makes an empty span, so the row sweep doesn't need to check
+    vector<int> halfWidths(far+1);
+    int hw = pixels;
+    for (int yy = 0; yy <= pixels; yy++) {
+        while ( hw*hw + yy*yy > pixels*pixels )
+            hw--;
+        halfWidths[yy] = hw;
+    }
+    halfWidths[far] = -1;
 
-        gi = 0;
-        for (int x = lx; x < ux; x++) {
-            for (int y = ly; y < uy; y++) {
-                int i = y*b->width+x;
-                b->rgbData[3*i+c] = b->grayData2[gi++];
+    ensureVoteData(b);
+    uint32_t* below = b->voteData;
+    vector<uint32_t> run(w, far);
+    vector<bool> nearBelow(uy-ly);
+
+    for (int y = uy-1; y >= ly; y--) {
+        uint8_t* row = &mask[y*b->width+lx];
+        uint32_t* d = &below[(y-ly)*w];
+        uint32_t* prev = y < uy-1 ? d + w : run.data();
+        nearBelow[y-ly] = countFeatureDistance(row, prev, d, w, far, grow, y >= fly && y < fuy ? flx : w, fux);
+    }
+
+    vector<int> reach(w+1);
+    for (int y = ly; y < uy; y++) {
+        uint8_t* row = &mask[y*b->width+lx];
+        uint32_t* d = &below[(y-ly)*w];
+        bool nearAbove = countFeatureDistance(row, run.data(), run.data(), w, far, grow, y >= fly && y < fuy ? flx : w, fux);
+
+        if ( ! nearAbove && ! nearBelow[y-ly] ) {
+            // nothing within reach of this row
+            if ( grow )
+                memset(row, 0, w);
+            continue;
+        }
+        if ( ! grow && (y < wly || y >= wuy || ! memchr(&row[wlx-lx], 255, wux-wlx)) )
+            continue; // no white to shrink
+
+        // reach[s] is the furthest right that a span starting at s covers
+        std::fill(reach.begin(), reach.end(), -1);
+        for (int x = 0; x < w; x++) {
+            int span = halfWidths[std::min(run[x], d[x])];
+            int start = std::max(x - span, 0);
+            reach[start] = std::max(reach[start], std::min(x + span, w - 1));
+        }
+
+        int covered = -1;
+        if ( grow ) {
+            for (int x = 0; x < w; x++) {
+                covered = std::max(covered, reach[x]);
+                row[x] = covered >= x ? 255 : 0;
+            }
+        }
+        else if ( y >= wly && y < wuy ) {
+            for (int x = 0; x < wux-lx; x++) {
+                covered = std::max(covered, reach[x]);
+                if ( covered >= x && x >= wlx-lx )
+                    row[x] = 0;
             }
         }
     }
 }
 
-void script_blurF(float kernelSize)
-{
-    script_blur(kernelSize);
-}
-
 void script_grow(float pixls)
 {
     int pixels = floor(pixls);
@@ -883,92 +1276,64 @@ void script_grow(float pixls)
     GET_THREAD_CONTEXT_ELSE
         return;
 
-    ensureGrayData(b);
+    GETWINDOW;
 
-    bool grow = pixels > 0;
+    pixels /= 1 << levelShift;
+    if ( pixels == 0 )
+        return;
 
-    pixels = abs(pixels);
+    readMask(b, lx, ux, ly, uy);
+    uint8_t* mask = writeMask(b, lx, ux, ly, uy);
 
-    if ( pixels > 12 )
-        pixels = 12;
+    growMask(b, mask, pixels, lx, ux, ly, uy);
+}
+
+// Shrink then grow, removes white specks smaller than the radius.
+void script_openMask(float pixls)
+{
+    int pixels = floor(pixls);
+
+    if ( pixels < 1 )
+        return;
+
+    GET_THREAD_CONTEXT_ELSE
+        return;
 
     GETWINDOW;
 
-    memset(b->grayData, 0, b->width*b->height);
+    pixels /= 1 << levelShift;
+    if ( pixels == 0 )
+        return;
 
-    // don't go all the way to the edges for actual grow
-    int wlx = lx + pixels;
-    int wux = ux - pixels;
-    int wly = ly + pixels;
-    int wuy = uy - pixels;
+    readMask(b, lx, ux, ly, uy);
+    uint8_t* mask = writeMask(b, lx, ux, ly, uy);
 
-    if ( grow ) {
-        // grow can start with all black
-        memset(b->grayData, 0, b->width*b->height);
-    }
-    else {
-        // shrink needs to copy values from rgb, to make them zero later
-        for (int x = lx; x < ux; x++) {
-            for (int y = ly; y < uy; y++) {
-                int i = y*b->width+x;
-                if ( b->rgbData[3*i+0] )
-                    b->grayData[i] = 255;
-                else
-                    b->grayData[i] = 0;
-            }
-        }
-    }
+    growMask(b, mask, -pixels, lx, ux, ly, uy);
+    growMask(b, mask, pixels, lx, ux, ly, uy);
+}
 
-    float dSquared = pixels * pixels;
+// Grow then shrink, fills black holes and gaps smaller than the radius.
+void script_closeMask(float pixls)
+{
+    int pixels = floor(pixls);
 
-    for (int x = wlx; x < wux; x++) {
-        for (int y = wly; y < wuy; y++) {
-            int i = y*b->width+x;
+    if ( pixels < 1 )
+        return;
 
-            if ( grow ) {
-                if ( b->rgbData[3*i+0] ) { // using red only
-                    for (int xx = -pixels; xx <= pixels; xx++) {
-                        for (int yy = -pixels; yy <= pixels; yy++) {
-                            if ( (xx*xx + yy*yy) > dSquared )
-                                continue;
-                            int ii = (y+yy)*b->width+(x+xx);
-                            b->grayData[ii] = 255;
-                        }
-                    }
-                }
-            }
-            else { // shrink
-                if ( b->grayData[i] ) {
-                    for (int xx = -pixels; xx <= pixels; xx++) {
-                        for (int yy = -pixels; yy <= pixels; yy++) {
-                            if ( (xx*xx + yy*yy) > dSquared )
-                                continue;
-                            int ii = (y+yy)*b->width+(x+xx);
-                            if ( ! b->grayData[ii] ) {
-                                b->rgbData[3*i+0] = 0;
-                                b->rgbData[3*i+1] = 0;
-                                b->rgbData[3*i+2] = 0;
-                                break;
-                            }
-                        }
-                    }
-                }
-            }
+    GET_THREAD_CONTEXT_ELSE
+        return;
 
-        }
-    }
+    GETWINDOW;
 
-    if ( grow ) { // shrink has already finalized rgbData
-        // copy grayData into rgbData
-        for (int x = lx; x < ux; x++) {
-            for (int y = ly; y < uy; y++) {
-                int i = y*b->width+x;
-                b->rgbData[3*i+0] = b->grayData[i];
-                b->rgbData[3*i+1] = b->grayData[i];
-                b->rgbData[3*i+2] = b->grayData[i];
-            }
-        }
-    }
+    pixels /= 1 << levelShift;
+    if ( pixels == 0 )
+        return;
+
+    readMask(b, lx, ux, ly, uy);
+    uint8_t* mask = writeMask(b, lx, ux, ly, uy);
+
+    growMask(b, mask, pixels, lx, ux, ly, uy);
+    growMask(b, mask, -pixels, lx, ux, ly, uy);
 }
 
 int script_rgbThreshold(int lr, int ur, int lg, int ug, int lb, int ub)
@@ -978,32 +1343,31 @@ int script_rgbThreshold(int lr, int ur, int lg, int ug, int lb, int ub)
 
     GETWINDOW;
 
+    readRGB(b);
+    uint8_t* mask = writeMask(b, lx, ux, ly, uy);
+
     int passed = 0;
 
-    for (int x = lx; x < ux; x++) {
-        for (int y = ly; y < uy; y++) {
+    for (int y = ly; y < uy; y++) {
+        for (int x = lx; x < ux; x++) {
 
-            int i = (y*b->width+x) * 3;
+            int i = y*b->width+x;
 
-            rgb_t* rgb = (rgb_t*)&b->rgbData[i];
+            rgb_t* rgb = (rgb_t*)&b->rgbData[i*3];
             if ( rgb->r < lr || rgb->r > ur ||
                  rgb->g < lg || rgb->g > ug ||
                  rgb->b < lb || rgb->b > ub ) {
-                b->rgbData[i+0] = 0;
-                b->rgbData[i+1] = 0;
-                b->rgbData[i+2] = 0;
+                mask[i] = 0;
             }
             else
             {
-                b->rgbData[i+0] = 255;
-                b->rgbData[i+1] = 255;
-                b->rgbData[i+2] = 255;
+                mask[i] = 255;
                 passed++;
             }
         }
     }
 
-    return passed;
+    return passed << (2 * levelShift); // in frame pixels
 }
 
 void normalize255( int& angle )
@@ -1038,46 +1402,28 @@ int script_hsvThreshold(int mh, int hRange, int ls, int us, int lv, int uv)
 
     GETWINDOW;
 
-    hsv_t hsv;
+    readRGB(b);
+    uint8_t* mask = writeMask(b, lx, ux, ly, uy);
+
+    // each channel only has 256 possible values, so work out the tests for all of them first
+    hsvRange_t range;
+    for (int i = 0; i < 256; i++) {
+        //int lh = mh - hRange/2;
+        //int uh = mh + hRange/2;
+        // range.h[i] = isWithinRange255( i, lh, uh ) ? 255 : 0;
+        range.h[i] = isHueWithinRange( i, mh, hRange ) ? 255 : 0;
+        range.s[i] = ( i >= ls && i <= us ) ? 255 : 0;
+        range.v[i] = ( i >= lv && i <= uv ) ? 255 : 0;
+    }
 
     int passed = 0;
 
-    for (int x = lx; x < ux; x++) {
-        for (int y = ly; y < uy; y++) {
-
-            int i = (y*b->width+x) * 3;
-
-            rgb_t* rgb = (rgb_t*)&b->rgbData[i];
-            rgb2hsv(rgb, &hsv);
-
-            //int lh = mh - hRange/2;
-            //int uh = mh + hRange/2;
-
-            if ( hsv.s < ls || hsv.s > us ||
-                 hsv.v < lv || hsv.v > uv ||
-                 // ! isWithinRange255( hsv.h, lh, uh ) )
-                 ! isHueWithinRange( hsv.h, mh, hRange ))
-            {
-                b->rgbData[i+0] = 0;
-                b->rgbData[i+1] = 0;
-                b->rgbData[i+2] = 0;
-            }
-            else {
-                b->rgbData[i+0] = 255;
-                b->rgbData[i+1] = 255;
-                b->rgbData[i+2] = 255;
-                passed++;
-            }
-            /*else
-            {
-                b->rgbData[i+0] = sdc_red;
-                b->rgbData[i+1] = sdc_grn;
-                b->rgbData[i+2] = sdc_blu;
-            }*/
-        }
+    for (int y = ly; y < uy; y++) {
+        int i = y*b->width+lx;
+        passed += hsvThresholdRow(&b->rgbData[i*3], &mask[i], ux-lx, range);
     }
 
-    return passed;
+    return passed << (2 * levelShift);
 }
 
 int script_rgbThresholdF(float lr, float ur, float lg, float ug, float lb, float ub)
@@ -1094,12 +1440,6 @@ int script_hsvThresholdF(float mh, float hRange, float ls, float us, float lv, f
 int script_FC_ALL = 0;
 int script_FC_ROW = 1;
 
-inline bool isBlack( uint8_t* rgbData, int indexOfRedPixel ) {
-    uint32_t i32 = *(uint32_t*)(rgbData + indexOfRedPixel);
-    i32 <<= 8;
-    return i32 == 0;
-}
-
 // intended for already binary image
 void script_findContour(int method)
 {
@@ -1108,83 +1448,53 @@ void script_findContour(int method)
 
     GETWINDOW;
 
+    uint8_t* mask = readMask(b, lx, ux, ly, uy);
+
     if ( method == script_FC_ROW ) {
+        mask = writeMask(b, lx, ux, ly, uy);
+
         // keep only outermost pixels of each row
         for (int y = ly; y < uy; y++) {
-            int i = y*b->width+lx;
+            uint8_t* row = &mask[y*b->width];
             int lwx = -1;
             int uwx = -1;
             for (int x = lx; x < ux; x++) {
-                //if ( b->rgbData[i*3] ) {
-                if ( ! isBlack(b->rgbData, i*3) ) {
-                    if ( lwx == -1 ) {
-                        lwx = i;
-                        b->rgbData[i*3] = 255;
-                        b->rgbData[i*3+1] = 255;
-                        b->rgbData[i*3+2] = 255;
-                    }
-                    else {
-                        if ( uwx != -1 ) {
-                            b->rgbData[uwx*3] = 0;
-                            b->rgbData[uwx*3+1] = 0;
-                            b->rgbData[uwx*3+2] = 0;
-                        }
-                        uwx = i;
-                        b->rgbData[uwx*3] = 255;
-                        b->rgbData[uwx*3+1] = 255;
-                        b->rgbData[uwx*3+2] = 255;
-                    }
+                if ( row[x] ) {
+                    if ( lwx == -1 )
+                        lwx = x;
+                    uwx = x;
                 }
-                i++;
             }
+            for (int x = lwx + 1; x < uwx; x++)
+                row[x] = 0;
         }
     }
     else {
         // keep all outlines
         ensureGrayData(b);
 
-        for (int x = lx; x < ux; x++) {
-            for (int y = ly; y < uy; y++) {
-                int i = y*b->width+x;
-                b->grayData[i] = ( isBlack(b->rgbData,i*3) ? 0 : 255);
-            }
+        uint8_t* src = b->grayData;
+        for (int y = ly; y < uy; y++) {
+            int i = y*b->width+lx;
+            memcpy(&src[i], &mask[i], ux-lx);
         }
 
-        for (int x = lx; x < ux; x++) {
-            for (int y = ly; y < uy; y++) {
+        mask = writeMask(b, lx, ux, ly, uy);
+
+        // a set pixel stays set only if it has a black neighbor, outside the window counts as black
+        for (int y = ly; y < uy; y++) {
+            for (int x = lx; x < ux; x++) {
                 int i = y*b->width+x;
+                if ( ! src[i] )
+                    continue;
                 bool anyBlack =
-                    ( ! b->grayData[i] ) ||
-                    ( ! b->grayData[ i - 1 ] ) ||
-                    ( ! b->grayData[ i + 1 ] ) ||
-                    ( ! b->grayData[ i - b->width ] ) ||
-                    ( ! b->grayData[ i + b->width ] );
-
-                if ( anyBlack ) {
-                    if ( ! isBlack(b->rgbData,i*3) ) {
-                        b->rgbData[ i*3 ] = 255;
-                        b->rgbData[ i*3+1 ] = 255;
-                        b->rgbData[ i*3+2 ] = 255;
-                    }
-                }
-                else {
-                    b->rgbData[ i*3 ] = 0;
-                    b->rgbData[ i*3+1 ] = 0;
-                    b->rgbData[ i*3+2 ] = 0;
-                }
+                    ( x == lx   || ! src[ i - 1 ] ) ||
+                    ( x == ux-1 || ! src[ i + 1 ] ) ||
+                    ( y == ly   || ! src[ i - b->width ] ) ||
+                    ( y == uy-1 || ! src[ i + b->width ] );
+                mask[i] = anyBlack ? 255 : 0;
             }
         }
-
-        /*for (int x = lx; x < ux; x++) {
-            for (int y = ly; y < uy; y++) {
-                int i = y*b->width+x;
-                if ( ! isBlack(b->rgbData,i*3) ) {
-                    b->rgbData[ i*3 ] = 255;
-                    b->rgbData[ i*3+1 ] = 255;
-                    b->rgbData[ i*3+2 ] = 255;
-                }
-            }
-        }*/
     }
 }
 
@@ -1225,45 +1535,57 @@ void convexHull(vector<chp> &P, vector<chp> &H)
     H.resize(k-1);
 }
 
-// intended for already binary image
-void script_convexHull(bool drawLines)
+// Adds the topmost and bottommost set pixel of each column, in order of x. This is all the
+// convex hull needs, and makes a lot less points to sort through. The rows are scanned in
+// memory order, keeping track of every column at once.
+void getColumnExtents(uint8_t* mask, int width, int lx, int ux, int ly, int uy, vector<chp> &points)
 {
-    GET_THREAD_CONTEXT_ELSE
-        return;
-
-    GETWINDOW;
+    vector<int> lwy(ux-lx, -1);
+    vector<int> uwy(ux-lx, -1);
 
-    vector<chp> points;
-
-    for (int x = lx; x < ux; x++) {
-        int lwy = -1;
-        int uwy = -1;
-        for (int y = ly; y < uy; y++) {
-            int i = y*b->width+x;
-            if ( b->rgbData[i*3] || b->rgbData[i*3+1] || b->rgbData[i*3+2] ) {
-                if ( lwy == -1 )
-                    lwy = y;
-                uwy = y;
+    for (int y = ly; y < uy; y++) {
+        uint8_t* row = &mask[y*width+lx];
+        for (int x = 0; x < ux-lx; x++) {
+            if ( row[x] ) {
+                if ( lwy[x] == -1 )
+                    lwy[x] = y;
+                uwy[x] = y;
             }
-            //b->rgbData[i*3+0] = 0;
-            //b->rgbData[i*3+1] = 0;
-            //b->rgbData[i*3+2] = 0;
         }
-        if ( lwy != -1 ) {
+    }
+
+    for (int x = 0; x < ux-lx; x++) {
+        if ( lwy[x] != -1 ) {
             chp p;
-            p.x = x;
-            p.y = lwy;
+            p.x = lx + x;
+            p.y = lwy[x];
             points.push_back(p);
-            if ( lwy != uwy ) {
-                p.y = uwy;
+            if ( lwy[x] != uwy[x] ) {
+                p.y = uwy[x];
                 points.push_back(p);
             }
         }
     }
+}
+
+// intended for already binary image
+void script_convexHull(bool drawLines)
+{
+    GET_THREAD_CONTEXT_ELSE
+        return;
+
+    GETWINDOW;
+
+    uint8_t* mask = readMask(b, lx, ux, ly, uy);
+
+    vector<chp> points;
+    getColumnExtents(mask, b->width, lx, ux, ly, uy, points);
 
     vector<chp> hull;
     convexHull(points, hull);
 
+    writeRGB(b);
+
     if ( drawLines ) {
         for (int i = 1; i < (int)hull.size(); i++) {
             chp &p0 = hull[i-1];
@@ -1313,6 +1635,7 @@ void script_flipFrame(int method)
         return;
 
     ensureGrayData(b);
+    writeRGB(b);
 
     if ( method == script_FF_VERT ) {
         verticalFlip(b);
@@ -1326,7 +1649,79 @@ void script_flipFrame(int method)
     }
 }
 
-script_rotatedRect rr;
+// Rotating calipers: the smallest rectangle around a convex polygon always has one side along
+// one of the polygon's edges, so only those directions need to be checked. Going around the
+// edges in order, the points furthest ahead, furthest behind and furthest away from the edge
+// only ever move forward around the polygon too, so they are each carried on from the last edge
+// instead of being searched for again. The hull must be in the order convexHull gives.
+// Gives the angle of the side along the edge (the width), and the center in image coordinates.
+static void minAreaRectOfHull(const vector<chp> &H, float &radians, float &centerX, float &centerY, float &width, float &height)
+{
+    int n = H.size();
+
+    radians = 0;
+    centerX = H[0].x;
+    centerY = H[0].y;
+    width = 0;
+    height = 0;
+
+    double bestArea = DBL_MAX;
+    int ahead = 1;
+    int behind = 0;
+    int away = 1;
+
+    for (int i = 0; i < n; i++) {
+        const chp &p0 = H[i];
+        const chp &p1 = H[(i+1) % n];
+
+        double ux = p1.x - p0.x;
+        double uy = p1.y - p0.y;
+        double len = sqrt(ux*ux + uy*uy);
+        if ( len == 0 )
+            continue;
+        ux /= len;
+        uy /= len;
+
+        // distance of point k along the edge from p0, and out from the edge on the hull's side
+        auto along = [&](int k) { const chp &p = H[k % n]; return (p.x - p0.x) * ux + (p.y - p0.y) * uy; };
+        auto out = [&](int k) { const chp &p = H[k % n]; return (p.y - p0.y) * ux - (p.x - p0.x) * uy; };
+
+        if ( i == 0 )
+            ahead = 1;
+        for (int steps = 0; steps < n && along(ahead + 1) > along(ahead); steps++)
+            ahead++;
+
+        if ( i == 0 )
+            away = ahead;
+        for (int steps = 0; steps < n && out(away + 1) > out(away); steps++)
+            away++;
+
+        if ( i == 0 )
+            behind = away;
+        for (int steps = 0; steps < n && along(behind + 1) < along(behind); steps++)
+            behind++;
+
+        double front = along(ahead);
+        double back = along(behind);
+        double w = front - back;
+        double h = out(away);
+        double area = w * h;
+
+        if ( area < bestArea ) {
+            bestArea = area;
+            radians = atan2(uy, ux);
+            width = w;
+            height = h;
+            double mu = 0.5 * (front + back);
+            double mv = 0.5 * h;
+            centerX = p0.x + mu * ux - mv * uy;
+            centerY = p0.y + mu * uy + mv * ux;
+        }
+    }
+}
+
+// returned by reference to the script, one per thread since camera threads run scripts at the same time
+static thread_local script_rotatedRect rr;
 
 /*script_rotatedRect* script_minAreaRectF(float ratioMin, float ratioMax, float minSideLength, float maxSideLength, float maxDistFromCenter) {
     return script_minAreaRect(lx, ux, ly, uy);
@@ -1365,33 +1760,13 @@ script_rotatedRect* script_minAreaRect(float minRatio, float maxRatio, float min
     if ( ((ux - lx) < 1) || ((uy - ly) < 1) )
         return &rr;
 
+    uint8_t* mask = readMask(b, lx, ux, ly, uy);
+
     vector<chp> points;
 
     // get initial input for convex hull algorithm, by throwing away
-    // all pixels that are not the leftmost or rightmost in their row
-
-    for (int x = lx; x < ux; x++) {
-        int lwy = -1;
-        int uwy = -1;
-        for (int y = ly; y < uy; y++) {
-            int i = y*b->width+x;
-            if ( b->rgbData[i*3] || b->rgbData[i*3+1] || b->rgbData[i*3+2] ) {
-                if ( lwy == -1 )
-                    lwy = y;
-                uwy = y;
-            }
-        }
-        if ( lwy != -1 ) {
-            chp p;
-            p.x = x;
-            p.y = lwy;
-            points.push_back(p);
-            if ( lwy != uwy ) {
-                p.y = uwy;
-                points.push_back(p);
-            }
-        }
-    }
+    // all pixels that are not the topmost or bottommost in their column
+    getColumnExtents(mask, b->width, lx, ux, ly, uy, points);
 
     // get actual convex hull points, this is usually 20 - 30 points
 
@@ -1402,133 +1777,45 @@ script_rotatedRect* script_minAreaRect(float minRatio, float maxRatio, float min
     //for (chp &p : hull)
     //    setPixelColor(b, p.x, p.y, 255, 0, 255, 2);
 
-    // naive min-area-rect first step: rotate all convex hull points and measure
-    // their maximum extents at 20 different angles. Range is over +/- 47 degrees.
+    if ( hull.empty() )
+        return &rr;
 
-    std::map<float, int> areas;
+    // convexHull passes three or less points straight through, which could be the wrong way round
+    if ( hull.size() == 3 && cross(hull[0], hull[1], hull[2]) < 0 )
+        swap(hull[1], hull[2]);
 
-    float minAngle = -0.26f;
-    float maxAngle =  0.26f;
-    float angleStep = (maxAngle - minAngle) / 20.0f;
+    for (chp &p : hull) {
+        p.x += 0.5; // add 0.5 to be at pixel center
+        p.y += 0.5;
+    }
 
     float bestRadians = 0;
-    float bestArea = FLT_MAX;
     float bestCenterX = 0;
     float bestCenterY = 0;
     float bestWidth = 0;
     float bestHeight = 0;
+    minAreaRectOfHull(hull, bestRadians, bestCenterX, bestCenterY, bestWidth, bestHeight);
 
-    float bestSplitArea = FLT_MAX;
-    float splitLeftRadians = 0;
-    float splitRightRadians = 0;
-
-    int i = 0;
-    float lastArea = 0;
-    float lastRadians = 0;
-    for (float angle = minAngle; angle < maxAngle; angle += angleStep) {
-
-        float minrx = 99999;
-        float maxrx = -99999;
-        float minry = 99999;
-        float maxry = -99999;
-
-        float radians = angle * M_PI;
-        float c = cos( radians );
-        float s = sin( radians );
-
-        for (chp &p : hull) {
-
-            float px = p.x + 0.5; // add 0.5 to be at pixel center
-            float py = p.y + 0.5;
-
-            float rx = c * px - s * py;
-            float ry = s * px + c * py;
-
-            minrx = min(minrx, rx);
-            maxrx = max(maxrx, rx);
-            minry = min(minry, ry);
-            maxry = max(maxry, ry);
-        }
-
-        float area = (maxrx - minrx) * (maxry - minry);
-        areas[radians] = area;
-
-        if ( area < bestArea ) {
-            bestRadians = radians;
-            bestArea = area;
-            bestCenterX = (minrx + maxrx) * 0.5f;
-            bestCenterY = (minry + maxry) * 0.5f;
-            bestWidth = maxrx - minrx;
-            bestHeight = maxry - minry;
-        }
-
-        if ( i > 0 ) {
-            float splitArea = (lastArea + area) * 0.5f;
-            if ( splitArea < bestSplitArea ) {
-                bestSplitArea = splitArea;
-                splitLeftRadians = lastRadians;
-                splitRightRadians = radians;
-            }
-        }
-
-        lastArea = area;
-        lastRadians = radians;
-
-        i++;
+    // the same rectangle can be described four ways, keep the angle within +/- 45 degrees
+    while ( bestRadians > 0.25 * M_PI ) {
+        bestRadians -= 0.5 * M_PI;
+        swap(bestWidth, bestHeight);
     }
-
-    // naive min-area-rect second step: same as first step but limited to
-    // the angle range between the best two adjacent angles from above.
-
-    angleStep = (splitRightRadians - splitLeftRadians) / 20.0f;
-    for (float radians = splitLeftRadians; radians < splitRightRadians; radians += angleStep) {
-
-        float minrx = 99999;
-        float maxrx = -99999;
-        float minry = 99999;
-        float maxry = -99999;
-
-        float c = cos( radians );
-        float s = sin( radians );
-
-        for (chp &p : hull) {
-
-            float px = p.x + 0.5; // add 0.5 to be at pixel center
-            float py = p.y + 0.5;
-
-            float rx = c * px - s * py;
-            float ry = s * px + c * py;
-
-            minrx = min(minrx, rx);
-            maxrx = max(maxrx, rx);
-            minry = min(minry, ry);
-            maxry = max(maxry, ry);
-        }
-
-        float area = (maxrx - minrx) * (maxry - minry);
-        areas[radians] = area;
-
-        if ( area < bestArea ) {
-            bestRadians = radians;
-            bestArea = area;
-            bestCenterX = (minrx + maxrx) * 0.5f;
-            bestCenterY = (minry + maxry) * 0.5f;
-            bestWidth = maxrx - minrx;
-            bestHeight = maxry - minry;
-        }
+    while ( bestRadians <= -0.25 * M_PI ) {
+        bestRadians += 0.5 * M_PI;
+        swap(bestWidth, bestHeight);
     }
 
+    // the hull points are at pixel centers by adding 0.5, so scaling to frame pixels is simple
+    float scale = 1 << levelShift;
+    bestCenterX *= scale;
+    bestCenterY *= scale;
+    bestWidth *= scale;
+    bestHeight *= scale;
 
-    rr.angle = -bestRadians * RADTODEG;
-
-    float c = cos( -bestRadians );
-    float s = sin( -bestRadians );
-
-    float mrx = bestCenterX;
-    float mry = bestCenterY;
-
-    rr.x = c * mrx - s * mry;
-    rr.y = s * mrx + c * mry;
+    rr.angle = bestRadians * RADTODEG;
+    rr.x = bestCenterX;
+    rr.y = bestCenterY;
     rr.w = bestWidth;
     rr.h = bestHeight;
     rr.area = rr.w * rr.h;
@@ -1553,8 +1840,8 @@ script_rotatedRect* script_minAreaRect(float minRatio, float maxRatio, float min
     }
     if ( rr.valid ) {
         if ( maxDistFromCenter != -1 ) {
-            float dx = rr.x - 320;
-            float dy = rr.y - 240;
+            float dx = rr.x - 0.5f * ctx->buffers->width;
+            float dy = rr.y - 0.5f * ctx->buffers->height;
             float dist = sqrt(dx*dx + dy*dy);
             if ( dist > maxDistFromCenter )
                 rr.valid = false;
@@ -1565,8 +1852,163 @@ script_rotatedRect* script_minAreaRect(float minRatio, float maxRatio, float min
 }
 
 
+// Circles are found with a Hough transform. Each lit pixel on the edge of a lit area votes for
+// the points one radius away along the normal to the edge, on both sides since it's not known
+// which side the center is on. The normal comes from the structure tensor (summed products of
+// the gradients) around the pixel, which also works for one pixel wide lines like the output of
+// findContour, where the gradient along the middle of the line is zero. Votes for all radii in
+// the range go into the same accumulator, then the radius of each circle found is picked by
+// seeing which distance most of the edge pixels around its center are at.
+
+#define CIRCLE_DIRECTIONS   128     // normals are quantized to this many directions over 180 degrees
+
+struct circleVoteJob_t {
+    videoFrameBuffers_t* b;
+    int lx, ux, ly, uy;             // window, edge pixels are only looked for 2 pixels inside this
+    int numRadii;
+    int reach;                      // furthest a vote can be from its edge pixel, in rows
+    vector<short> offsets;          // dx,dy for each radius, for each direction
+    pthread_mutex_t mutex;          // held while adding the results of a band to the ones below
+    vector<int> edges;              // index of every edge pixel that voted
+};
+
+// Direction of the normal to the edge at p, or false if there is no clear direction (eg. a
+// single pixel on its own).
+static bool circleEdgeDirection(const uint8_t* p, int width, int& dir)
+{
+    // 5x5 lit/unlit around p, enough for the gradients of the 3x3 around it
+    int lit[5][5];
+    for (int j = 0; j < 5; j++)
+        for (int i = 0; i < 5; i++)
+            lit[j][i] = p[(j-2)*width + (i-2)] ? 1 : 0;
+
+    int jxx = 0, jxy = 0, jyy = 0;
+    for (int j = 1; j < 4; j++) {
+        for (int i = 1; i < 4; i++) {
+            int gx = (lit[j-1][i+1] + 2*lit[j][i+1] + lit[j+1][i+1]) - (lit[j-1][i-1] + 2*lit[j][i-1] + lit[j+1][i-1]);
+            int gy = (lit[j+1][i-1] + 2*lit[j+1][i] + lit[j+1][i+1]) - (lit[j-1][i-1] + 2*lit[j-1][i] + lit[j-1][i+1]);
+            jxx += gx * gx;
+            jxy += gx * gy;
+            jyy += gy * gy;
+        }
+    }
+
+    if ( jxx == jyy && jxy == 0 )
+        return false;
+
+    float angle = 0.5f * atan2f(2 * jxy, jxx - jyy);
+    if ( angle < 0 )
+        angle += M_PI;
+    dir = (int)lroundf(angle * (CIRCLE_DIRECTIONS / M_PI)) % CIRCLE_DIRECTIONS;
+    return true;
+}
+
+// Voting for a band of rows, counted separately and then added to the full accumulator at the
+// end so that bands running at the same time don't have to lock for every vote.
+static void circleVoteRows(void* arg, int firstRow, int lastRow)
+{
+    circleVoteJob_t& job = *(circleVoteJob_t*)arg;
+    videoFrameBuffers_t* b = job.b;
+    int width = b->width;
+
+    int y0 = job.ly + 2 + firstRow;
+    int y1 = job.ly + 2 + lastRow;
+    int accLY = max(job.ly, y0 - job.reach);
+    int accUY = min(job.uy, y1 + job.reach);
+    int accW = job.ux - job.lx;
+
+    vector<uint32_t> acc(accW * (accUY - accLY), 0);
+    vector<int> edges;
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = job.lx + 2; x < job.ux - 2; x++) {
+            const uint8_t* p = &b->grayData[y*width+x];
+            if ( ! p[0] )
+                continue;
+            if ( p[-width-1] && p[-width] && p[-width+1] && p[-1] && p[1] && p[width-1] && p[width] && p[width+1] )
+                continue; // inside a lit area
+
+            int dir;
+            if ( ! circleEdgeDirection(p, width, dir) )
+                continue;
+
+            edges.push_back(y*width+x);
+
+            const short* off = &job.offsets[2 * dir * job.numRadii];
+            for (int k = 0; k < job.numRadii; k++) {
+                int dx = off[2*k];
+                int dy = off[2*k+1];
+
+                int cx = x + dx;
+                int cy = y + dy;
+                if ( cx >= job.lx && cx < job.ux && cy >= accLY && cy < accUY )
+                    acc[(cy-accLY)*accW + cx-job.lx]++;
+
+                cx = x - dx;
+                cy = y - dy;
+                if ( cx >= job.lx && cx < job.ux && cy >= accLY && cy < accUY )
+                    acc[(cy-accLY)*accW + cx-job.lx]++;
+            }
+        }
+    }
+
+    ScopeLock lock(&job.mutex);
+
+    for (int y = accLY; y < accUY; y++) {
+        uint32_t* dst = &b->voteData[y*width + job.lx];
+        const uint32_t* src = &acc[(y-accLY)*accW];
+        for (int i = 0; i < accW; i++)
+            dst[i] += src[i];
+    }
+
+    job.edges.insert(job.edges.end(), edges.begin(), edges.end());
+}
+
+// Picks the radius which the most edge pixels around the center are at. Bigger circles have more
+// edge pixels, so the counts are divided by the radius. The edge pixels are the lit ones, half a
+// pixel inside the actual edge, so that is added to their distance.
+static float bestCircleRadius(circleVoteJob_t& job, int width, float cx, float cy, float minRadius, float maxRadius)
+{
+    int lowBin = (int)floorf(minRadius);
+    int numBins = (int)ceilf(maxRadius) - lowBin + 1;
+    vector<int> count(numBins, 0);
+    vector<float> total(numBins, 0);
+
+    for (int i : job.edges) {
+        float dx = (i % width) - cx;
+        float dy = (i / width) - cy;
+        float d = sqrtf(dx*dx + dy*dy) + 0.5f;
+        if ( d < minRadius - 0.5f || d > maxRadius + 0.5f )
+            continue;
+        int bin = min(max((int)lroundf(d) - lowBin, 0), numBins - 1);
+        count[bin]++;
+        total[bin] += d;
+    }
+
+    int best = -1;
+    float bestScore = 0;
+    for (int k = 0; k < numBins; k++) {
+        float score = count[k] / (float)max(lowBin + k, 1);
+        if ( score > bestScore ) {
+            bestScore = score;
+            best = k;
+        }
+    }
+    if ( best < 0 )
+        return 0.5f * (minRadius + maxRadius);
+
+    // average over the neighboring bins too, for a bit better than whole pixels
+    int n = 0;
+    float sum = 0;
+    for (int k = max(best - 1, 0); k <= min(best + 1, numBins - 1); k++) {
+        n += count[k];
+        sum += total[k];
+    }
+    return min(max(sum / n, minRadius), maxRadius);
+}
+
 bool display = true;
-CScriptArray* script_findCircles(float diameter) {
+static CScriptArray* findCircles(float minDiameter, float maxDiameter, bool withDiameters) {
 
     asITypeInfo* t = GetScriptTypeIdByDecl("array<float>");
 
@@ -1581,16 +2023,26 @@ CScriptArray* script_findCircles(float diameter) {
     ensureGrayData(b);
     ensureGrayData2(b);
     ensureVoteData(b);
-    memset(b->voteData, 0, sizeof(uint32_t)*b->width*b->height);
+
+    writeRGB(b);
 
     GETWINDOW;
 
-    float radius = 0.5 * diameter;
+    float scale = 1 << levelShift;
+    minDiameter /= scale;
+    maxDiameter /= scale;
 
-    for (int x = lx; x < ux; x++) {
-        for (int y = ly; y < uy; y++) {
+    if ( minDiameter > maxDiameter )
+        swap(minDiameter, maxDiameter);
+    float minRadius = max(0.5f * minDiameter, 1.0f);
+    float maxRadius = min(max(0.5f * maxDiameter, minRadius), (float)windowSize);
+    float radius = minRadius; // for finding the center of each peak
+
+    for (int y = ly; y < uy; y++) {
+        memset(&b->voteData[y*b->width+lx], 0, sizeof(uint32_t)*(ux-lx));
+        for (int x = lx; x < ux; x++) {
             int i = y*b->width+x;
-            b->grayData[i] = (b->rgbData[i*3] + b->rgbData[i*3+1] + b->rgbData[i*3+2]) / 3.0f;
+            b->grayData[i] = (b->rgbData[i*3] + b->rgbData[i*3+1] + b->rgbData[i*3+2]) / 3;
             if ( display ) {
                 b->rgbData[i*3+0] = 0;
                 b->rgbData[i*3+1] = 0;
@@ -1599,58 +2051,42 @@ CScriptArray* script_findCircles(float diameter) {
         }
     }
 
-    //memset(b->rgbData, 0, 3*sizeof(uint8_t)*b->width*b->height);
-
-    uint32_t highestVote = 0;
-
-    //uint32_t totalCirclePixels = 0;
-    //int samplesPerCircle = 0;
-
-    for (int y = ly; y < uy; y++) {
-        for (int x = lx; x < ux; x++) {
-
-            int i = y * b->width + x;
-
-            if ( ! b->grayData[i] )
-                continue;
-
-            //samplesPerCircle = 0;
-
-            int lastCx = -1;
-            int lastCy = -1;
-
-            // draw a circle centered on xx,yy
-            for (float a = 0; a < 2*M_PI; a+=0.5) {
-                int cx = x + sin(a) * radius;
-                int cy = y + cos(a) * radius;
-
-                if ( cx == lastCx && cy == lastCy )
-                    continue;
-
-                //samplesPerCircle++;
-
-                if ( cx < 0 || cx > b->width-1 || cy < 0 || cy > b->height-1 )
-                    continue;
-
-                //totalCirclePixels++;
+    circleVoteJob_t job;
+    job.b = b;
+    job.lx = lx;
+    job.ux = ux;
+    job.ly = ly;
+    job.uy = uy;
+    job.numRadii = (int)ceilf(maxRadius - minRadius) + 1;
+    job.reach = (int)ceilf(maxRadius) + 1;
+    pthread_mutex_init(&job.mutex, NULL);
+
+    // offsets from an edge pixel to the centers it votes for, at each radius
+    job.offsets.resize(2 * CIRCLE_DIRECTIONS * job.numRadii);
+    for (int d = 0; d < CIRCLE_DIRECTIONS; d++) {
+        float a = d * M_PI / CIRCLE_DIRECTIONS;
+        for (int k = 0; k < job.numRadii; k++) {
+            float r = job.numRadii > 1 ? minRadius + (maxRadius - minRadius) * k / (job.numRadii - 1) : minRadius;
+            job.offsets[2 * (d * job.numRadii + k) + 0] = lroundf(r * cosf(a));
+            job.offsets[2 * (d * job.numRadii + k) + 1] = lroundf(r * sinf(a));
+        }
+    }
 
-                int ci = cy*b->width+cx;
+    runInRowBands(uy - ly - 4, circleVoteRows, &job);
 
-                b->voteData[ci] += 1;
-                if ( b->voteData[ci] > highestVote )
-                    highestVote = b->voteData[ci];
+    pthread_mutex_destroy(&job.mutex);
 
-                if ( display ) {
-                    b->rgbData[ci*3+0] = max(b->grayData[i], b->rgbData[ci*3+0]);
-                    b->rgbData[ci*3+1] = max(b->grayData[i], b->rgbData[ci*3+1]);
-                    b->rgbData[ci*3+2] = max(b->grayData[i], b->rgbData[ci*3+2]);
-                }
+    // bands finish in any order, keep the radius averages the same every time
+    sort(job.edges.begin(), job.edges.end());
 
-                lastCx = cx;
-                lastCy = cy;
-            }
+    uint32_t highestVote = 0;
+    for (int y = ly; y < uy; y++)
+        for (int x = lx; x < ux; x++)
+            highestVote = max(highestVote, b->voteData[y * b->width + x]);
 
-        }
+    if ( highestVote == 0 ) {
+        CScriptArray* arr = CScriptArray::Create(t, (asUINT)0);
+        return arr;
     }
 
     // make normalized grayscale
@@ -1658,23 +2094,33 @@ CScriptArray* script_findCircles(float diameter) {
     for (int y = ly; y < uy; y++) {
         for (int x = lx; x < ux; x++) {
             int i = y * b->width + x;
-            float f = b->voteData[i] / (float)highestVote;
-            b->grayData[gi++] = f * 255;
+            uint8_t v = (uint64_t)b->voteData[i] * 255 / highestVote;
+            b->grayData[gi++] = v;
+            if ( display ) {
+                b->rgbData[i*3+0] = v;
+                b->rgbData[i*3+1] = v;
+                b->rgbData[i*3+2] = v;
+            }
         }
     }
 
     // blur a bit
-    gaussBlur_4(b->grayData, b->grayData2, ux-lx, uy-ly, 1);
-
-    gi = 0;
-    for (int y = ly; y < uy; y++) {
-        for (int x = lx; x < ux; x++) {
-            int i = y * b->width + x;
-            b->grayData[i] = b->grayData2[gi++];
-        }
+    gaussianBlur(b->grayData, ux-lx, ux-lx, uy-ly, 1, 1, b->grayData2);
+
+    // Votes along the edge normals pile up on very few pixels, which the blur spreads out a lot,
+    // so stretch the result back up to 255 for the thresholds below.
+    int highestGray = *max_element(b->grayData, b->grayData + (ux-lx)*(uy-ly));
+    if ( highestGray > 0 && highestGray < 255 ) {
+        for (int i = 0; i < (ux-lx)*(uy-ly); i++)
+            b->grayData[i] = b->grayData[i] * 255 / highestGray;
     }
 
+    // back to full frame layout
+    for (int y = uy-1; y >= ly; y--)
+        memmove(&b->grayData[y*b->width+lx], &b->grayData[(y-ly)*(ux-lx)], ux-lx);
+
     vector<pair<float,float> > centers;
+    vector<float> diameters;
 
     while ( true ) {
         int bestX = -1;
@@ -1730,116 +2176,384 @@ CScriptArray* script_findCircles(float diameter) {
         if ( avgCount > 0 ) {
             avgX /= (float)avgCount;
             avgY /= (float)avgCount;
-            centers.push_back( make_pair(avgX,avgY));
+            if ( withDiameters )
+                diameters.push_back( 2 * scale * bestCircleRadius(job, b->width, avgX, avgY, minRadius, maxRadius) );
+            centers.push_back( make_pair(levelToFrame(avgX, levelShift), levelToFrame(avgY, levelShift)));
         }
     }
 
-    CScriptArray* arr = CScriptArray::Create(t, 2*centers.size());
+    int valuesPerCircle = withDiameters ? 3 : 2;
+    CScriptArray* arr = CScriptArray::Create(t, valuesPerCircle * centers.size());
 
     int arrInd = 0;
-    for (auto c : centers) {
+    for (int c = 0; c < (int)centers.size(); c++) {
         float * p = static_cast<float*>(arr->At(arrInd++));
-        *p = c.first;
+        *p = centers[c].first;
         p = static_cast<float*>(arr->At(arrInd++));
-        *p = c.second;
+        *p = centers[c].second;
+        if ( withDiameters ) {
+            p = static_cast<float*>(arr->At(arrInd++));
+            *p = diameters[c];
+        }
     }
 
-    // if ( ok ) {
-    //     int i = 0;
-    //     for (script_blob& blob : br.blobs) {
+    return arr;
+}
 
-    //         script_blob * p = static_cast<script_blob *>(arr->At(i++));
-    //         *p = blob;
-    //     }
-    // }
+// Returns x,y for each circle found
+CScriptArray* script_findCircles(float diameter) {
+    return findCircles(diameter, diameter, false);
+}
 
-    return arr;
+// Returns x,y,diameter for each circle found
+CScriptArray* script_findCirclesRange(float minDiameter, float maxDiameter) {
+    return findCircles(minDiameter, maxDiameter, true);
 }
 
 int script_QR_NORMAL        = 0x1;
 int script_QR_MICRO         = 0x2;
 int script_QR_DATAMATRIX    = 0x4;
 
-CScriptArray* script_findQRCodes(int howMany,int types) {
+int script_QR_BIN_LOCAL     = 0;
+int script_QR_BIN_GLOBAL    = 1;
+int script_QR_BIN_FIXED     = 2;
 
-    asITypeInfo* t = GetScriptTypeIdByDecl("array<qrcode>");
+struct qrOptions_t {
+    int howMany;
+    int typesFlag;      // ZXing formats
+    bool tryHarder;
+    int binarizer;
+    int levelShift;     // pyramid level being searched
+};
 
-    GET_THREAD_CONTEXT_ELSE
-    {
-        CScriptArray* arr = CScriptArray::Create(t, (asUINT)0);
-        return arr;
+// Codes are kept in frame coordinates, not relative to the window they were found in
+struct qrCacheEntry_t {
+    uint64_t hash;
+    vector<script_qrcode> codes;
+};
+
+#define QR_CACHE_SIZE   8
+
+struct qrDecodeState_t {
+    pthread_mutex_t mutex;          // held for cache and results, not while decoding
+    vector<qrCacheEntry_t> cache;   // most recently used is last
+
+    // Async decoding. The job* values belong to the worker while busy is set.
+    bool busy;
+    vector<uint8_t> jobLum;
+    int jobWidth, jobHeight;
+    int jobOffsetX, jobOffsetY;
+    qrOptions_t jobOptions;
+    uint64_t jobHash;
+    vector<script_qrcode> asyncCodes; // from the latest decode to finish
+
+    qrDecodeState_t() {
+        pthread_mutex_init(&mutex, NULL);
+        busy = false;
+        jobWidth = jobHeight = 0;
+        jobOffsetX = jobOffsetY = 0;
+        jobOptions = qrOptions_t();
+        jobHash = 0;
     }
+};
 
-    if ( howMany < 1 )
-        howMany = 1;
+// These are never deleted, the worker may still be using one when the camera closes
+qrDecodeState_t* getQRDecodeState(visionContext_t* ctx)
+{
+    if ( ! ctx->qrState )
+        ctx->qrState = new qrDecodeState_t();
+    return ctx->qrState;
+}
+
+// Returns false if no formats were requested
+bool getQROptions(qrOptions_t& opts, int howMany, int types, bool tryHarder, int binarizer)
+{
+    opts.howMany = howMany < 1 ? 1 : howMany;
 
-    int typesFlag = 0;
+    opts.typesFlag = 0;
     if ( types & script_QR_NORMAL )
-        typesFlag |= (int)ZXing::BarcodeFormat::QRCode;
+        opts.typesFlag |= (int)ZXing::BarcodeFormat::QRCode;
     if ( types & script_QR_MICRO )
-        typesFlag |= (int)ZXing::BarcodeFormat::MicroQRCode;
+        opts.typesFlag |= (int)ZXing::BarcodeFormat::MicroQRCode;
     if ( types & script_QR_DATAMATRIX )
-        typesFlag |= (int)ZXing::BarcodeFormat::DataMatrix;
+        opts.typesFlag |= (int)ZXing::BarcodeFormat::DataMatrix;
 
-    if ( typesFlag == 0 ) {
-        CScriptArray* arr = CScriptArray::Create(t, (asUINT)0);
-        return arr;
+    opts.tryHarder = tryHarder;
+    opts.binarizer = binarizer;
+    opts.levelShift = 0;
+
+    return opts.typesFlag != 0;
+}
+
+// Luminance of a w x h area of rgbData, call readRGB first
+void getLuminance(videoFrameBuffers_t* b, int x, int y, int w, int h, uint8_t* out)
+{
+    for (int row = y; row < y + h; row++) {
+        uint8_t* in = &b->rgbData[ 3 * (row * b->width + x) ];
+        for (int col = 0; col < w; col++) {
+            *out++ = (77 * in[0] + 150 * in[1] + 29 * in[2]) >> 8;
+            in += 3;
+        }
     }
+}
+
+// The whole frame is used unless the window has been set smaller than the frame or moved, so
+// that the default window still finds codes anywhere. The luminance of the area is put in lum.
+void getQRLuminance(visionContext_t* ctx, videoFrameBuffers_t* b, vector<uint8_t>& lum, int& x, int& y, int& w, int& h)
+{
+    x = 0;
+    y = 0;
+    w = b->width;
+    h = b->height;
+
+    int shift = getLevelShift(ctx, b);
+    bool windowMoved = ctx->windowCenterX >= 0 && ctx->windowCenterY >= 0;
+    if ( windowMoved || ((ctx->windowSize >> shift) < b->width && (ctx->windowSize >> shift) < b->height) ) {
+        GETWINDOW;
+        x = lx;
+        y = ly;
+        w = ux - lx;
+        h = uy - ly;
+    }
+
+    readRGB(b);
+
+    lum.resize( w * h );
+    getLuminance(b, x, y, w, h, lum.data());
+}
+
+// Sensor noise changes the odd pixel from frame to frame, so the hash is made from the average
+// of each 4x4 block, cut down to 32 levels. An unchanged label in a still view will then give
+// the same hash for most frames.
+uint64_t hashQRLuminance(const vector<uint8_t>& lum, int x, int y, int w, int h, const qrOptions_t& opts)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](uint32_t v) {
+        hash ^= v;
+        hash *= 1099511628211ULL;
+    };
+
+    add(x); add(y); add(w); add(h);
+    add(opts.howMany); add(opts.typesFlag); add(opts.tryHarder); add(opts.binarizer); add(opts.levelShift);
+
+    for (int by = 0; by + 4 <= h; by += 4) {
+        for (int bx = 0; bx + 4 <= w; bx += 4) {
+            const uint8_t* p = &lum[ by * w + bx ];
+            int sum = 0;
+            for (int r = 0; r < 4; r++) {
+                sum += p[0] + p[1] + p[2] + p[3];
+                p += w;
+            }
+            add( sum >> 7 ); // sum/16 for the average, then >> 3
+        }
+    }
+
+    return hash;
+}
+
+// Call with the state mutex held
+bool findCachedQRCodes(qrDecodeState_t* s, uint64_t hash, vector<script_qrcode>& codes)
+{
+    for (int i = 0; i < (int)s->cache.size(); i++) {
+        if ( s->cache[i].hash == hash ) {
+            qrCacheEntry_t e = s->cache[i];
+            s->cache.erase( s->cache.begin() + i );
+            s->cache.push_back( e );
+            codes = e.codes;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Call with the state mutex held
+void cacheQRCodes(qrDecodeState_t* s, uint64_t hash, const vector<script_qrcode>& codes)
+{
+    if ( s->cache.size() >= QR_CACHE_SIZE )
+        s->cache.erase( s->cache.begin() );
+    qrCacheEntry_t e;
+    e.hash = hash;
+    e.codes = codes;
+    s->cache.push_back( e );
+}
+
+void decodeQRCodes(const uint8_t* lum, int w, int h, int offsetX, int offsetY, const qrOptions_t& opts, vector<script_qrcode>& codes)
+{
+    ZXing::Binarizer binarizer = ZXing::Binarizer::LocalAverage;
+    if ( opts.binarizer == script_QR_BIN_GLOBAL )
+        binarizer = ZXing::Binarizer::GlobalHistogram;
+    else if ( opts.binarizer == script_QR_BIN_FIXED )
+        binarizer = ZXing::Binarizer::FixedThreshold;
 
-    auto image = ZXing::ImageView(b->rgbData, b->width, b->height, ZXing::ImageFormat::RGB);
+    auto image = ZXing::ImageView(lum, w, h, ZXing::ImageFormat::Lum);
     auto options = ZXing::ReaderOptions();
-    options.setTryHarder( true );
+    options.setTryHarder( opts.tryHarder );
     options.setTryInvert( false );
-    options.setMaxNumberOfSymbols( howMany );
-    options.setFormats( (ZXing::BarcodeFormat)typesFlag );
+    options.setBinarizer( binarizer );
+    options.setMaxNumberOfSymbols( opts.howMany );
+    options.setFormats( (ZXing::BarcodeFormat)opts.typesFlag );
     auto barcodes = ZXing::ReadBarcodes(image, options);
 
-    CScriptArray* arr = CScriptArray::Create(t, barcodes.size());
-
-    int arrInd = 0;
+    codes.clear();
     for (auto&& barcode : barcodes) {
 
-        script_qrcode* p = static_cast<script_qrcode*>(arr->At(arrInd++));
-        snprintf(p->value, sizeof(p->value), "%s", barcode.text().c_str());
-        p->orientation = barcode.orientation();
+        script_qrcode q;
+        snprintf(q.value, sizeof(q.value), "%s", barcode.text().c_str());
+        q.orientation = barcode.orientation();
 
         int ind = 0;
         for (auto bp : barcode.position()) {
-            p->outlinePoints[ind++] = bp.x;
-            p->outlinePoints[ind++] = bp.y;
+            q.outlinePoints[ind++] = levelToFrame(bp.x + offsetX, opts.levelShift);
+            q.outlinePoints[ind++] = levelToFrame(bp.y + offsetY, opts.levelShift);
             if ( ind >= 8 )
                 break;
         }
-        p->numPoints = ind / 2;
-
-        // int bpInd = 0;
-        // int lastX = 0;
-        // int lastY = 0;
-        // float avgX = 0;
-        // float avgY = 0;
-        // for (auto bp : barcode.position()) {
-        //     if ( bpInd > 0 ) {
-        //         int dx = bp.x - lastX;
-        //         int dy = bp.y - lastY;
-        //         float d = sqrt( dx*dx + dy*dy );
-        //         p->outline.w = d;
-        //         p->outline.h = d;
-        //     }
-        //     avgX += bp.x;
-        //     avgY += bp.y;
-        //     lastX = bp.x;
-        //     lastY = bp.y;
-        //     bpInd++;
-        // }
-        // avgX /= 4.0f;
-        // avgY /= 4.0f;
-        // p->outline.x = avgX;
-        // p->outline.y = avgY;
+        q.numPoints = ind / 2;
+
+        codes.push_back( q );
     }
+}
 
+CScriptArray* makeQRCodeArray(const vector<script_qrcode>& codes)
+{
+    asITypeInfo* t = GetScriptTypeIdByDecl("array<qrcode>");
+    CScriptArray* arr = CScriptArray::Create(t, codes.size());
+    for (int i = 0; i < (int)codes.size(); i++)
+        *static_cast<script_qrcode*>(arr->At(i)) = codes[i];
     return arr;
 }
 
+CScriptArray* script_findQRCodes(int howMany, int types, bool tryHarder, int binarizer) {
+
+    vector<script_qrcode> codes;
+
+    GET_THREAD_CONTEXT_ELSE
+        return makeQRCodeArray(codes);
+
+    qrOptions_t opts;
+    if ( ! getQROptions(opts, howMany, types, tryHarder, binarizer) )
+        return makeQRCodeArray(codes);
+    opts.levelShift = getLevelShift(ctx, b);
+
+    vector<uint8_t> lum;
+    int x, y, w, h;
+    getQRLuminance(ctx, b, lum, x, y, w, h);
+    uint64_t hash = hashQRLuminance(lum, x, y, w, h, opts);
+
+    qrDecodeState_t* s = getQRDecodeState(ctx);
+    {
+        ScopeLock lock(&s->mutex);
+        if ( findCachedQRCodes(s, hash, codes) )
+            return makeQRCodeArray(codes);
+    }
+
+    decodeQRCodes(lum.data(), w, h, x, y, opts, codes);
+
+    {
+        ScopeLock lock(&s->mutex);
+        cacheQRCodes(s, hash, codes);
+    }
+
+    return makeQRCodeArray(codes);
+}
+
+// A single worker thread decodes for all vision contexts, taking them in the order they asked
+static pthread_mutex_t qrWorkerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t qrWorkerCond = PTHREAD_COND_INITIALIZER;
+static vector<qrDecodeState_t*> qrWorkerQueue;
+static bool qrWorkerStarted = false;
+
+void* qrWorkerThread(void*)
+{
+    while ( true ) {
+        qrDecodeState_t* s = NULL;
+        {
+            ScopeLock lock(&qrWorkerMutex);
+            while ( qrWorkerQueue.empty() )
+                pthread_cond_wait(&qrWorkerCond, &qrWorkerMutex);
+            s = qrWorkerQueue.front();
+            qrWorkerQueue.erase( qrWorkerQueue.begin() );
+        }
+
+        vector<script_qrcode> codes;
+        decodeQRCodes(s->jobLum.data(), s->jobWidth, s->jobHeight, s->jobOffsetX, s->jobOffsetY, s->jobOptions, codes);
+
+        ScopeLock lock(&s->mutex);
+        cacheQRCodes(s, s->jobHash, codes);
+        s->asyncCodes = codes;
+        s->busy = false;
+    }
+    return NULL;
+}
+
+bool queueQRDecode(qrDecodeState_t* s)
+{
+    ScopeLock lock(&qrWorkerMutex);
+    if ( ! qrWorkerStarted ) {
+        pthread_t thread;
+        if ( pthread_create(&thread, NULL, qrWorkerThread, NULL) != 0 ) {
+            g_log.log(LL_ERROR, "Could not start QR decode thread");
+            return false;
+        }
+        pthread_detach(thread);
+        qrWorkerStarted = true;
+    }
+    qrWorkerQueue.push_back(s);
+    pthread_cond_signal(&qrWorkerCond);
+    return true;
+}
+
+// Does not wait for decoding. Returns the codes from the latest decode to finish, which may be
+// of an earlier frame, and starts decoding this frame if no decode is running for this context.
+// An area that was decoded recently is taken from the cache instead.
+CScriptArray* script_findQRCodesAsync(int howMany, int types, bool tryHarder, int binarizer) {
+
+    vector<script_qrcode> codes;
+
+    GET_THREAD_CONTEXT_ELSE
+        return makeQRCodeArray(codes);
+
+    qrOptions_t opts;
+    if ( ! getQROptions(opts, howMany, types, tryHarder, binarizer) )
+        return makeQRCodeArray(codes);
+    opts.levelShift = getLevelShift(ctx, b);
+
+    qrDecodeState_t* s = getQRDecodeState(ctx);
+
+    {
+        ScopeLock lock(&s->mutex);
+        if ( s->busy ) {
+            codes = s->asyncCodes;
+            return makeQRCodeArray(codes);
+        }
+    }
+
+    // The worker is idle so the job values can be filled in without the lock
+    getQRLuminance(ctx, b, s->jobLum, s->jobOffsetX, s->jobOffsetY, s->jobWidth, s->jobHeight);
+    uint64_t hash = hashQRLuminance(s->jobLum, s->jobOffsetX, s->jobOffsetY, s->jobWidth, s->jobHeight, opts);
+
+    bool startJob = false;
+    {
+        ScopeLock lock(&s->mutex);
+        if ( findCachedQRCodes(s, hash, codes) )
+            s->asyncCodes = codes;
+        else {
+            codes = s->asyncCodes;
+            s->jobOptions = opts;
+            s->jobHash = hash;
+            s->busy = true;
+            startJob = true;
+        }
+    }
+
+    if ( startJob && ! queueQRDecode(s) ) {
+        ScopeLock lock(&s->mutex);
+        s->busy = false;
+    }
+
+    return makeQRCodeArray(codes);
+}
+
 
 
 
@@ -1874,7 +2588,7 @@ script_vec3 script_qrcode::getCenter()
 
 void script_drawText(string msg, float x, float y, float fontSize)
 {
-    if ( pthread_self() != mainThreadId )
+    if ( ! isCameraViewThread() )
         return; // only webcam views can actually do anything
 
     GET_THREAD_CONTEXT_ELSE
@@ -1893,10 +2607,10 @@ void script_drawText(string msg, float x, float y, float fontSize)
 
 void script_drawQRCode(script_qrcode& q, float fontSize)
 {
-    if ( pthread_self() != mainThreadId )
+    if ( ! isCameraViewThread() )
         return; // only webcam views can actually do anything
 
-    GET_THREAD_CONTEXT_ELSE
+    GET_FRAME_CONTEXT_ELSE
         return;
 
     //script_drawRotatedRect(q.outline);
@@ -1929,7 +2643,174 @@ void script_drawQRCode(script_qrcode& q, float fontSize)
 
 
 
+// Templates are kept in the database as "width,height,pixels" with the gray pixels in hex, and
+// in memory once they have been used. The prepared template is shared, so a thread can carry on
+// matching with it after another thread has replaced it (eg. with different angles).
+struct cachedTemplate_t {
+    grayImage_t image;
+    float angleRange;
+    float angleStep;
+    shared_ptr<preparedTemplate_t> prepared; // NULL until it's needed
+};
+
+static pthread_mutex_t templateMutex = PTHREAD_MUTEX_INITIALIZER;
+static map<string, cachedTemplate_t> templateCache;
+
+static string templateToString(const grayImage_t& img)
+{
+    static const char* digits = "0123456789abcdef";
+    string str = to_string(img.width) + "," + to_string(img.height) + ",";
+    str.reserve(str.size() + 2 * img.pixels.size());
+    for (uint8_t p : img.pixels) {
+        str += digits[p >> 4];
+        str += digits[p & 0xf];
+    }
+    return str;
+}
+
+static int hexDigit(char c)
+{
+    if ( c >= '0' && c <= '9' )
+        return c - '0';
+    if ( c >= 'a' && c <= 'f' )
+        return c - 'a' + 10;
+    return -1;
+}
+
+static bool templateFromString(const string& str, grayImage_t& img)
+{
+    int w = 0, h = 0, n = 0;
+    if ( sscanf(str.c_str(), "%d,%d,%n", &w, &h, &n) != 2 || w < 1 || h < 1 )
+        return false;
+    if ( (int)str.size() - n != 2 * w * h )
+        return false;
+
+    img.width = w;
+    img.height = h;
+    img.pixels.resize(w * h);
+    const char* hex = &str[n];
+    for (int i = 0; i < w * h; i++) {
+        int hi = hexDigit(hex[2*i]);
+        int lo = hexDigit(hex[2*i+1]);
+        if ( hi < 0 || lo < 0 )
+            return false;
+        img.pixels[i] = (hi << 4) | lo;
+    }
+    return true;
+}
+
+static void logTemplateError(const char* msg, const string& name)
+{
+    g_log.log(LL_ERROR, "%s: %s", msg, name.c_str());
+    ScriptLog* slog = (ScriptLog*)getActiveScriptLog();
+    if ( slog )
+        slog->log(LL_ERROR, NULL, 0, "%s: %s", msg, name.c_str());
+}
+
+// Returns NULL if there is no template of that name
+static shared_ptr<preparedTemplate_t> getPreparedTemplate(const string& name, float angleRange, float angleStep)
+{
+    ScopeLock lock(&templateMutex);
+
+    auto it = templateCache.find(name);
+    if ( it == templateCache.end() ) {
+        cachedTemplate_t ct;
+        if ( ! templateFromString(script_getDBString(DBSTRING_VISION_TEMPLATE_PREFIX + name), ct.image) )
+            return NULL;
+        it = templateCache.insert( make_pair(name, ct) ).first;
+    }
+
+    cachedTemplate_t& ct = it->second;
+    if ( ! ct.prepared || ct.angleRange != angleRange || ct.angleStep != angleStep ) {
+        shared_ptr<preparedTemplate_t> prepared = make_shared<preparedTemplate_t>();
+        if ( ! prepareTemplate(ct.image, angleRange, angleStep, *prepared) )
+            return NULL;
+        ct.prepared = prepared;
+        ct.angleRange = angleRange;
+        ct.angleStep = angleStep;
+    }
+    return ct.prepared;
+}
+
+// Saves the window of the frame as a template for matchTemplate
+bool script_captureTemplate(string name)
+{
+    if ( getActivePreviewOnly() )
+        return false;
+
+    GET_FRAME_CONTEXT_ELSE
+        return false;
+
+    GETWINDOW;
+
+    readRGB(b);
+
+    grayImage_t img;
+    img.width = ux - lx;
+    img.height = uy - ly;
+    img.pixels.resize(img.width * img.height);
+    getLuminance(b, lx, ly, img.width, img.height, img.pixels.data());
+
+    preparedTemplate_t prepared;
+    if ( ! prepareTemplate(img, 0, 0, prepared) ) {
+        logTemplateError("Window has no detail to use as a template", name);
+        return false;
+    }
+
+    script_setDBString(DBSTRING_VISION_TEMPLATE_PREFIX + name, templateToString(img));
 
+    ScopeLock lock(&templateMutex);
+    cachedTemplate_t ct;
+    ct.image = img;
+    ct.angleRange = 0;
+    ct.angleStep = 0;
+    templateCache[name] = ct;
 
+    return true;
+}
+
+// Looks for a template saved by captureTemplate, in the window of the frame. The template can be
+// turned by up to angleRange degrees either way, in steps of angleStep (a rotated template has
+// its corners cut off, so it should have some margin around the part to be matched). Matching
+// always works on the frame itself, it does its own coarse to fine search.
+CScriptArray* script_matchTemplate(string name, float minScore, int howMany, float angleRange, float angleStep)
+{
+    asITypeInfo* t = GetScriptTypeIdByDecl("array<templateMatch>");
 
+    GET_FRAME_CONTEXT_ELSE
+    {
+        CScriptArray* arr = CScriptArray::Create(t, (asUINT)0);
+        return arr;
+    }
 
+    shared_ptr<preparedTemplate_t> prepared = getPreparedTemplate(name, angleRange, angleStep);
+    if ( ! prepared ) {
+        logTemplateError("No template, or template can't be used", name);
+        CScriptArray* arr = CScriptArray::Create(t, (asUINT)0);
+        return arr;
+    }
+
+    GETWINDOW;
+
+    readRGB(b);
+
+    grayImage_t img;
+    img.width = ux - lx;
+    img.height = uy - ly;
+    img.pixels.resize(img.width * img.height);
+    getLuminance(b, lx, ly, img.width, img.height, img.pixels.data());
+
+    vector<templateMatch_t> matches;
+    matchTemplate(img, *prepared, minScore, howMany, matches);
+
+    CScriptArray* arr = CScriptArray::Create(t, matches.size());
+    for (int i = 0; i < (int)matches.size(); i++) {
+        script_templateMatch* p = static_cast<script_templateMatch*>(arr->At(i));
+        p->x = matches[i].x + lx;
+        p->y = matches[i].y + ly;
+        p->angle = matches[i].angle;
+        p->score = matches[i].score;
+    }
+
+    return arr;
+}
@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include "script/api.h"
 
+#define VISION_MAX_BLUR     100     // largest sigma for blur()
+#define VISION_PYRAMID_LEVELS 2     // levels above the frame itself, at half and quarter size
+
 extern int script_FC_ALL;
 extern int script_FC_ROW;
 
@@ -26,15 +29,28 @@ extern int script_QR_NORMAL;
 extern int script_QR_MICRO;
 extern int script_QR_DATAMATRIX;
 
+extern int script_QR_BIN_LOCAL;
+extern int script_QR_BIN_GLOBAL;
+extern int script_QR_BIN_FIXED;
+
 struct videoFrameBuffers_t {
     int width;
     int height;
-    uint8_t* originalData; // this is owned by libuvc and will always be present (do not free after use!)
-    uint8_t* rgbData;   // this is copied from originalData in each frame
+    uint8_t* rgbData;   // this is copied from the latest camera frame in each frame
     uint8_t* rgbData2;  // this is only set up when required
     uint8_t* grayData;  // this is only set up when required
     uint8_t* grayData2; // this is only set up when required
-    uint32_t* voteData;  // this is only set up when required
+    uint32_t* voteData;  // this is only set up when required, also used by grow for distances
+    uint8_t* blurData;  // this is only set up when required, 3 bytes per pixel
+
+    // Binary results (thresholds, grow, contours...) are kept here as one byte per pixel, 0 or 255,
+    // instead of being written into rgbData as white/black. Only the area given by the mask* bounds
+    // is used. The mask is drawn into rgbData when something needs the RGB image, eg. drawing or
+    // displaying the frame (see flushMask).
+    uint8_t* maskData;  // this is only set up when required
+    int maskLX, maskUX, maskLY, maskUY;
+    bool maskValid;     // maskData holds the binary image for the mask area
+    bool maskPending;   // maskData has changed since it was last drawn into rgbData
 
     videoFrameBuffers_t() {
         width = 0;
@@ -44,13 +60,18 @@ struct videoFrameBuffers_t {
         grayData = NULL;
         grayData2 = NULL;
         voteData = NULL;
+        blurData = NULL;
+        maskData = NULL;
+        maskLX = maskUX = maskLY = maskUY = 0;
+        maskValid = false;
+        maskPending = false;
     }
 };
 
 // Each camera holds its own frame buffers. A 'live' camera view script will
-// directly access the buffer of the relevant camera on the main UI thread.
-// These scripts run synchronously with the UI and only access the camera of
-// the window they are running from.
+// directly access the buffer of the relevant camera, on the vision thread of
+// that camera. These scripts only access the camera of the window they are
+// running from.
 //
 // Other scripts will run in a separate thread and need to make a copy of the
 // frame buffer instead of working directly with the buffer held by the camera.
@@ -59,6 +80,13 @@ struct videoFrameBuffers_t {
 //     grabFrame( 1 ); // camera index
 //     blur(...);
 //     etc...
+//
+// To be sure the frame was captured after something happened (eg. a move
+// finished), give the time from millis() and grabFrame will wait for a newer
+// frame:
+//
+//     uint64 t = millis();
+//     grabFrame( 1, t );
 
 // A script works with a vision context which contains data used by various
 // functions, eg. the frame buffer itself, current draw color
@@ -70,12 +98,24 @@ struct visionContext_t {
     uint8_t colblu;
     float fontSize;
     int windowSize;
+    float windowCenterX;    // -1 for the middle of the frame
+    float windowCenterY;
+
+    // The vision functions work on the level of the pyramid given by pyramidLevel, 0 being the
+    // frame itself. Positions and sizes going in and out of them are always in frame pixels.
+    videoFrameBuffers_t pyramidBuffers[VISION_PYRAMID_LEVELS]; // level 1 upwards
+    bool pyramidValid;      // pyramidBuffers were made from the current frame
+    int pyramidLevel;
 
     bool lastLoadImageResult;
     std::string lastLoadedImageFilename; // well... attempted to load
     uint8_t* lastLoadedImageBuffer;
+    int lastLoadedImageWidth;
+    int lastLoadedImageHeight;
     bool shouldTryImageLoad;
 
+    struct qrDecodeState_t* qrState; // cache and async decoding for findQRCodes, set up when required
+
     visionContext_t() {
         buffers = NULL;
         colred = 255;
@@ -83,23 +123,39 @@ struct visionContext_t {
         colblu = 255;
         fontSize = 20;
         windowSize = 9999;
+        windowCenterX = -1;
+        windowCenterY = -1;
+
+        pyramidValid = false;
+        pyramidLevel = 0;
 
         lastLoadImageResult = false;
         lastLoadedImageFilename = ""; // well... attempted to load
         lastLoadedImageBuffer = NULL;
+        lastLoadedImageWidth = 0;
+        lastLoadedImageHeight = 0;
         shouldTryImageLoad = false;
+
+        qrState = NULL;
     }
 };
 
 visionContext_t* getVisionContextForThread();
 
-void setMainThreadVisionContext(visionContext_t *ctx);
+void setCameraThreadVisionContext(visionContext_t *ctx);
+bool isCameraViewThread();
+void resetPyramid(visionContext_t* ctx);
 //videoFrameBuffers_t* getActiveScriptFrameBuffers();
 
 void initFrameBuffers(videoFrameBuffers_t* vfb, int width, int height);
+void freeFrameBuffers(videoFrameBuffers_t* vfb);
+void resizeFrameBuffers(videoFrameBuffers_t* vfb, int width, int height);
 bool haveGrayData(videoFrameBuffers_t* vfb);
 void ensureGrayData(videoFrameBuffers_t* vfb);
 void ensureVoteData(videoFrameBuffers_t* vfb);
+void ensureBlurData(videoFrameBuffers_t* vfb);
+void resetMask(videoFrameBuffers_t* vfb);
+void flushMask(videoFrameBuffers_t* vfb);
 void cleanupVideoFrameBuffers(videoFrameBuffers_t* vfb);
 
 void script_setDrawColor(int r, int g, int b);
@@ -127,18 +183,25 @@ void script_RGB2HSV_F(float planeForVisual);
 
 void script_selectCamera(int index);
 int script_getCamera();
-bool script_grabFrame(int cameraIndex);
+bool script_grabFrame(int cameraIndex, uint64_t newerThan);
 void freeAsyncFrameBuffer();
 bool script_saveImage(std::string filename);
 bool script_loadImage(std::string filename);
 
 void script_setVisionWindowSize(int windowSize);
 void script_setVisionWindowSizeF(float windowSize);
+void script_setVisionWindowCenter(float x, float y);
+
+bool script_buildPyramid();
+bool script_setPyramidLevel(int level);
+int script_getPyramidLevel();
 
 class CScriptArray* script_quickblob_default();
 class CScriptArray* script_quickblob(int color, int minpixels, int maxpixels, int minwidth, int maxwidth);
 void script_blur(int kernelSize);
 void script_grow(float pixls);
+void script_openMask(float pixls);
+void script_closeMask(float pixls);
 int script_rgbThreshold(int lr, int ur, int lg, int ug, int lb, int ub);
 int script_hsvThreshold(int mh, int hRange, int ls, int us, int lv, int uv);
 void script_findContour(int method);
@@ -150,12 +213,17 @@ void script_flipFrame(int method);
 script_rotatedRect* script_minAreaRect(float minRatio, float maxRatio, float minArea, float maxArea, float maxDistFromCenter);
 
 class CScriptArray* script_findCircles(float diameter);
+class CScriptArray* script_findCirclesRange(float minDiameter, float maxDiameter);
 
-class CScriptArray* script_findQRCodes(int howMany, int types);
+class CScriptArray* script_findQRCodes(int howMany, int types, bool tryHarder, int binarizer);
+class CScriptArray* script_findQRCodesAsync(int howMany, int types, bool tryHarder, int binarizer);
 void script_drawQRCode(script_qrcode& q, float fontSize);
 
 void script_drawText(std::string msg, float x, float y, float fontSize);
 
+bool script_captureTemplate(std::string name);
+class CScriptArray* script_matchTemplate(std::string name, float minScore, int howMany, float angleRange, float angleStep);
+
 void script_blurF(float kernelSize);
 int script_rgbThresholdF(float lr, float ur, float lg, float ug, float lb, float ub);
 int script_hsvThresholdF(float mh, float hRange, float ls, float us, float lv, float uv);
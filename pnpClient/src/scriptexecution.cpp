@@ -1,6 +1,7 @@
 
 #include <chrono>
 #include <thread>
+#include <pthread.h>
 
 #include "scriptexecution.h"
 #include "script/engine.h"
@@ -25,6 +26,27 @@ vector<CodeEditorDocument*> scriptDocuments;
 vector<CodeEditorWindow*> commandEditorWindows;
 vector<CodeEditorWindow*> scriptEditorWindows;
 
+// Camera view scripts run in the camera threads while modules are built and discarded by the UI
+// and script threads, and AngelScript does not allow both at once. The camera threads hold this
+// for reading while they run a function, anything building or discarding a module holds it for
+// writing. Writers are preferred so that cameras taking turns can't keep a rebuild waiting.
+#ifdef __APPLE__
+static pthread_rwlock_t moduleLock = PTHREAD_RWLOCK_INITIALIZER;
+#else
+static pthread_rwlock_t moduleLock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+#endif
+
+struct ModuleWriteLock {
+    ModuleWriteLock() { pthread_rwlock_wrlock(&moduleLock); }
+    ~ModuleWriteLock() { pthread_rwlock_unlock(&moduleLock); }
+};
+
+static void discardModule(asIScriptModule* mod)
+{
+    ModuleWriteLock lock;
+    discardScriptModule(mod);
+}
+
 void addCompileErrorInfo(codeCompileErrorInfo &info)
 {
     compileErrorInfos.push_back(info);
@@ -229,7 +251,7 @@ bool runScript(string moduleName, string funcName, bool previewOnly, void *codeE
 
     // only discard the module if it's not still running in separate thread!
     if ( previewOnly )
-        discardScriptModule(compiled.mod);
+        discardModule(compiled.mod);
 
     return true;
 }
@@ -290,7 +312,7 @@ bool setScriptFunc(compiledScript_t &compiled, string funcName, scriptParams_t *
         g_log.log(LL_ERROR, "GetFunctionByDecl failed looking for '%s'", funcSig.c_str());
         if ( w )
             w->log.log(LL_ERROR, NULL, 0, "[%s] Could not find entry point '%s'", logPrefixArray[LL_ERROR], funcSig.c_str());
-        discardScriptModule(compiled.mod);
+        discardModule(compiled.mod);
         return false;
     }
 
@@ -506,6 +528,8 @@ bool compileScript(string moduleName, compiledScript_t &compiled, void *codeEdit
 {
     saveAllDocuments(commandDocuments);
 
+    ModuleWriteLock lock; // waits for camera threads to finish the function they are running
+
     CodeEditorWindow* w = (CodeEditorWindow*)codeEditorWindow;
 
     if ( ! w ) {
@@ -600,7 +624,7 @@ void* scriptRunThreadFunc(void* ptr)
     g_log.log(LL_INFO, "Script%s run took %lld us", stillRunning?" (partial)":"", timeTaken);
 
     if ( ! stillRunning )
-        discardScriptModule( scriptThreadStartupInfo.mod );
+        discardModule( scriptThreadStartupInfo.mod );
 
     didScriptRunJustComplete = ! stillRunning;
 
@@ -680,19 +704,19 @@ bool runCompiledFunction(compiledScript_t &compiled, bool previewOnly, void *cod
     return true; // always return true for non-threaded preview case, meaning success
 }
 
-bool runCompiledFunction_simple(compiledScript_t &compiled)
+// Called by camera threads. The log to print to is given by the caller rather than taken from
+// the editor windows, which are only to be used by the UI thread.
+bool runCompiledFunction_simple(compiledScript_t &compiled, void* scriptLog)
 {
+    pthread_rwlock_rdlock(&moduleLock);
+
     if ( ! compiled.mod || ! compiled.func ) {
+        pthread_rwlock_unlock(&moduleLock);
         g_log.log(LL_ERROR, "runCompiledFunction_simple: invalid compiled function");
         return false;
     }
 
-    CodeEditorWindow* w = NULL;
-    if ( ! scriptEditorWindows.empty() )
-        w = scriptEditorWindows[0];
-
-    if ( w )
-        setActiveScriptLog(&w->log);
+    setThreadScriptLog(scriptLog);
 
     asIScriptContext* ctx = createScriptContext(compiled.func, NULL);
     int r = ctx->Execute();
@@ -700,13 +724,15 @@ bool runCompiledFunction_simple(compiledScript_t &compiled)
         g_log.log(LL_ERROR, "Exception occurred while executing script: %s", ctx->GetExceptionString());
     ctx->Release();
 
+    pthread_rwlock_unlock(&moduleLock);
+
     return true; // always return true for non-threaded preview case, meaning success
 }
 
 void discardCompiledFunction(compiledScript_t &compiled)
 {
     if ( compiled.mod ) {
-        discardScriptModule(compiled.mod);
+        discardModule(compiled.mod);
     }
     compiled.mod = NULL;
     compiled.func = NULL;
@@ -759,7 +785,7 @@ bool resumeScript()
 }
 
 
-extern bool waitingForPreviousActualRun;
+extern bool waitingForProgramQueueSlot;
 
 void abortScript()
 {
@@ -776,7 +802,7 @@ void abortScript()
                 ctx->Abort();
 
                 cleanupScriptContext(ctx);
-                discardScriptModule( scriptThreadStartupInfo.mod );
+                discardModule( scriptThreadStartupInfo.mod );
             }
             else { // script is running, so it will periodically check if it needs to abort
 
@@ -785,7 +811,7 @@ void abortScript()
                 //setIsRunningScriptThread( false );
 
                 ctx->Abort(); // this sets the script context status to aborted, but it can only check the status in between script function calls
-                waitingForPreviousActualRun = false; // need to exit potential wait loop in doActualRun
+                waitingForProgramQueueSlot = false; // need to exit potential wait loop in doActualRun
 
                 //cleanupScriptContext(ctx);  don't do any cleanup here, let executeScriptContext do it
             }
@@ -78,7 +78,7 @@ bool runScript(std::string moduleName, std::string funcName, bool previewOnly, v
 bool compileScript(std::string moduleName, compiledScript_t &compiled, void* codeEditorWindow = NULL);
 bool setScriptFunc(compiledScript_t &compiled, std::string funcName, scriptParams_t *params = NULL, void* codeEditorWindow = NULL);
 bool runCompiledFunction(compiledScript_t &compiled, bool previewOnly, void *codeEditorWindow, scriptParams_t *params = NULL);
-bool runCompiledFunction_simple(compiledScript_t &compiled);
+bool runCompiledFunction_simple(compiledScript_t &compiled, void* scriptLog);
 void discardCompiledFunction(compiledScript_t &compiled);
 
 bool currentlyRunningScriptThread();
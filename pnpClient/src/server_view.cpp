@@ -1,5 +1,6 @@
 
 #include "imgui.h"
+#include "implot.h"
 #include "custompanel.h"
 #include "eventhooks.h"
 #include "scriptexecution.h"
@@ -42,6 +43,8 @@ probingParams_t config_probing;
 int32_t config_loadcellCalibrationRawOffset;
 float config_loadcellCalibrationWeight;
 
+msg_rtStats config_rtStats = {0};
+
 #define SERVER_WINDOW_TITLE "Server"
 
 void fetchAllServerConfigs() {
@@ -848,6 +851,74 @@ void showLoadcellCalib() {
     ImGui::Text("Result weight: %f", lastStatusReport.weight);
 }
 
+void fetchRealtimeStats(bool reset) {
+    commandRequest_t req = createCommandRequest(MT_RT_STATS_FETCH);
+    req.rtStatsFetch.reset = reset;
+    sendCommandRequest(&req);
+}
+
+void showRealtimeStats() {
+
+    static bool autoRefresh = false;
+    static double lastRefreshTime = 0;
+
+    ImGui::TextWrapped("Timing of the 1ms realtime loop on the server, useful when tuning the kernel and CPU isolation settings. Counts are on a log scale, each bar covers the range of microseconds shown at its left edge.");
+
+    ImGui::NewLine();
+
+    if ( ImGui::Button("Fetch") ) {
+        fetchRealtimeStats(false);
+    }
+    ImGui::SameLine();
+    if ( ImGui::Button("Reset") ) {
+        fetchRealtimeStats(true);
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Auto refresh", &autoRefresh);
+
+    if ( autoRefresh && ImGui::GetTime() - lastRefreshTime > 1 && ! isRequestInProgress() ) {
+        fetchRealtimeStats(false);
+        lastRefreshTime = ImGui::GetTime();
+    }
+
+    showRequestInProgress();
+
+    ImGui::NewLine();
+
+    msg_rtStats& s = config_rtStats;
+
+    ImGui::Text("Loops: %u", s.ticks);
+    ImGui::Text("Deadline overruns: %u (%.4f%%)", s.overruns, s.ticks ? 100.0 * s.overruns / s.ticks : 0.0);
+
+    static const char* binLabels[RT_STATS_NUM_BINS];
+    static char binLabelBufs[RT_STATS_NUM_BINS][16];
+    static double binTicks[RT_STATS_NUM_BINS];
+    int numTicks = 0;
+    for (int i = 0; i < RT_STATS_NUM_BINS; i += 4) {
+        snprintf(binLabelBufs[numTicks], sizeof(binLabelBufs[0]), "%u", getRTStatsBinStart(i));
+        binLabels[numTicks] = binLabelBufs[numTicks];
+        binTicks[numTicks] = i - 0.5; // left edge of the bar
+        numTicks++;
+    }
+
+    for (int h = 0; h < RTH_MAX; h++) {
+
+        ImGui::SeparatorText(getRTStatsHistogramName(h));
+        ImGui::Text("Max: %u us", s.maxMicros[h]);
+
+        if (ImPlot::BeginPlot(getRTStatsHistogramName(h), ImVec2(-1, 160), ImPlotFlags_NoTitle | ImPlotFlags_NoLegend)) {
+            ImPlot::SetupAxes("us", "count");
+            ImPlot::SetupAxisScale(ImAxis_Y1, ImPlotScale_Log10);
+            ImPlot::SetupAxisTicks(ImAxis_X1, binTicks, numTicks, binLabels);
+            ImPlot::SetupAxisLimits(ImAxis_X1, -1, RT_STATS_NUM_BINS, ImPlotCond_Always);
+            uint32_t bins[RT_STATS_NUM_BINS];
+            memcpy(bins, s.bins[h], sizeof(bins)); // not directly from the packed struct
+            ImPlot::PlotBars("##bins", bins, RT_STATS_NUM_BINS, 0.9);
+            ImPlot::EndPlot();
+        }
+    }
+}
+
 extern probingResult_e lastProbingResult;
 extern float lastProbedHeight;
 
@@ -1219,6 +1290,15 @@ void showServerView(bool* p_open)
                 showProbeSetup();
                 ImGui::EndTabItem();
             }
+            whichTab++;
+            if (ImGui::BeginTabItem("Realtime"))
+            {
+                currentTabIndex = whichTab;
+                if ( currentTabIndex != oldTabIndex )
+                    fetchRealtimeStats(false);
+                showRealtimeStats();
+                ImGui::EndTabItem();
+            }
 
             ImGui::EndTabBar();
         }
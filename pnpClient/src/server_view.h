@@ -2,6 +2,7 @@
 #define SERVER_VIEW_H
 
 #include "../common/config.h"
+#include "../common/pnpMessages.h"
 
 #ifndef NO_EXTERNS_FROM_SERVER_VIEW_HEADER
 
@@ -32,6 +33,8 @@ extern probingParams_t config_probing;
 extern int32_t config_loadcellCalibrationRawOffset;
 extern float config_loadcellCalibrationWeight;
 
+extern msg_rtStats config_rtStats;
+
 #endif
 
 void initDefaultConfigs();
@@ -0,0 +1,201 @@
+
+#include <stdio.h>
+#include <string.h>
+
+#include "imgui.h"
+#include "implot.h"
+#include "telemetry.h"
+#include "net_subscriber.h"
+#include "notify.h"
+#include "log.h"
+#include "telemetry_view.h"
+
+#define TELEMETRY_HISTORY   10000 // samples kept for plotting, 10 seconds
+
+telemetrySample_t telemetryHistory[TELEMETRY_HISTORY];
+int telemetryHistoryCount = 0;
+int telemetryHistoryNext = 0; // where the next sample will go
+
+bool haveTelemetrySeq = false;
+uint32_t lastTelemetrySeq = 0;
+uint32_t telemetrySamplesReceived = 0;
+uint32_t telemetrySamplesLost = 0;
+bool alreadyReportedBadTelemetryFrame = false;
+
+bool pauseTelemetryPlot = false;
+
+FILE* telemetryRecordFile = NULL;
+char telemetryRecordFilename[256] = "telemetry.csv";
+uint32_t telemetrySamplesRecorded = 0;
+
+struct telemetrySeries {
+    const char* name;
+    bool show;
+    double (*get)(const telemetrySample_t& s);
+};
+
+telemetrySeries telemetrySeriesList[] = {
+    { "Pos X",          false,  [](const telemetrySample_t& s) -> double { return s.actualPos[0]; } },
+    { "Pos Y",          false,  [](const telemetrySample_t& s) -> double { return s.actualPos[1]; } },
+    { "Pos Z",          false,  [](const telemetrySample_t& s) -> double { return s.actualPos[2]; } },
+    { "Follow err X",   true,   [](const telemetrySample_t& s) -> double { return s.targetPos[0] - s.actualPos[0]; } },
+    { "Follow err Y",   true,   [](const telemetrySample_t& s) -> double { return s.targetPos[1] - s.actualPos[1]; } },
+    { "Follow err Z",   true,   [](const telemetrySample_t& s) -> double { return s.targetPos[2] - s.actualPos[2]; } },
+    { "Vel X",          false,  [](const telemetrySample_t& s) -> double { return s.vel[0]; } },
+    { "Vel Y",          false,  [](const telemetrySample_t& s) -> double { return s.vel[1]; } },
+    { "Vel Z",          false,  [](const telemetrySample_t& s) -> double { return s.vel[2]; } },
+    { "Freq X",         false,  [](const telemetrySample_t& s) -> double { return s.freq[0]; } },
+    { "Freq Y",         false,  [](const telemetrySample_t& s) -> double { return s.freq[1]; } },
+    { "Freq Z",         false,  [](const telemetrySample_t& s) -> double { return s.freq[2]; } },
+    { "Freq A",         false,  [](const telemetrySample_t& s) -> double { return s.freq[3]; } },
+    { "Vac",            false,  [](const telemetrySample_t& s) -> double { return ((double)s.pressure - 50000) / 500.0; } }, // same scaling as the Plots view
+    { "Load",           false,  [](const telemetrySample_t& s) -> double { return s.loadcell; } },
+    { "Inputs",         false,  [](const telemetrySample_t& s) -> double { return s.inputs; } },
+    { "Outputs",        false,  [](const telemetrySample_t& s) -> double { return s.outputs; } },
+};
+
+#define NUM_TELEMETRY_SERIES ((int)(sizeof(telemetrySeriesList) / sizeof(telemetrySeriesList[0])))
+
+static void recordSample(const telemetrySample_t& s) {
+    // %.9g gives back exactly the same float when read in again
+    fprintf(telemetryRecordFile, "%u,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%u,%u,%u,%d\n",
+            s.seq,
+            s.targetPos[0], s.targetPos[1], s.targetPos[2],
+            s.actualPos[0], s.actualPos[1], s.actualPos[2],
+            s.vel[0], s.vel[1], s.vel[2],
+            s.freq[0], s.freq[1], s.freq[2], s.freq[3],
+            s.inputs, s.outputs, s.pressure, s.loadcell);
+    telemetrySamplesRecorded++;
+}
+
+static void addSample(const telemetrySample_t& s) {
+
+    if ( haveTelemetrySeq ) {
+        int32_t gap = (int32_t)(s.seq - (lastTelemetrySeq + 1));
+        if ( gap > 0 ) {
+            telemetrySamplesLost += gap;
+        }
+        else if ( gap < 0 ) {
+            // the server was restarted, the old samples would be plotted in the wrong place
+            g_log.log(LL_INFO, "Telemetry sequence restarted");
+            telemetryHistoryCount = 0;
+        }
+    }
+    lastTelemetrySeq = s.seq;
+    haveTelemetrySeq = true;
+
+    telemetrySamplesReceived++;
+
+    if ( telemetryRecordFile )
+        recordSample(s);
+
+    if ( ! pauseTelemetryPlot ) {
+        telemetryHistory[telemetryHistoryNext] = s;
+        telemetryHistoryNext = (telemetryHistoryNext + 1) % TELEMETRY_HISTORY;
+        if ( telemetryHistoryCount < TELEMETRY_HISTORY )
+            telemetryHistoryCount++;
+    }
+}
+
+// Takes in all telemetry frames that have arrived, should be called every frame even when
+// the plots are not visible, otherwise they will pile up in the subscriber.
+void checkTelemetry() {
+
+    uint8_t buf[TELEMETRY_MAX_FRAME_SIZE];
+    telemetrySample_t samples[TELEMETRY_SAMPLES_PER_FRAME];
+
+    int size;
+    while ( (size = checkTelemetryFrame(buf, sizeof(buf))) > 0 ) {
+
+        int n = decodeTelemetryFrame(buf, size, samples, TELEMETRY_SAMPLES_PER_FRAME);
+        if ( n < 0 ) {
+            if ( ! alreadyReportedBadTelemetryFrame ) {
+                g_log.log(LL_WARN, "Received telemetry from server but could not decode it (wrong message version?)");
+                alreadyReportedBadTelemetryFrame = true;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < n; i++)
+            addSample( samples[i] );
+    }
+}
+
+bool startTelemetryRecording(const char* filename) {
+
+    stopTelemetryRecording();
+
+    telemetryRecordFile = fopen(filename, "w");
+    if ( ! telemetryRecordFile ) {
+        g_log.log(LL_ERROR, "Could not open %s for telemetry recording", filename);
+        notify( "Could not open telemetry recording file", NT_ERROR, 5000 );
+        return false;
+    }
+
+    fprintf(telemetryRecordFile, "seq,targetX,targetY,targetZ,actualX,actualY,actualZ,velX,velY,velZ,freqX,freqY,freqZ,freqA,inputs,outputs,pressure,loadcell\n");
+    telemetrySamplesRecorded = 0;
+
+    g_log.log(LL_INFO, "Recording telemetry to %s", filename);
+
+    return true;
+}
+
+void stopTelemetryRecording() {
+
+    if ( ! telemetryRecordFile )
+        return;
+
+    fclose(telemetryRecordFile);
+    telemetryRecordFile = NULL;
+
+    g_log.log(LL_INFO, "Stopped telemetry recording, %u samples", telemetrySamplesRecorded);
+}
+
+static ImPlotPoint telemetryGetter(int idx, void* data) {
+    telemetrySeries* series = (telemetrySeries*)data;
+    int i = (telemetryHistoryNext - telemetryHistoryCount + idx + TELEMETRY_HISTORY) % TELEMETRY_HISTORY;
+    const telemetrySample_t& s = telemetryHistory[i];
+    return ImPlotPoint( s.seq * 0.001, series->get(s) );
+}
+
+void showTelemetryPlots() {
+
+    ImGui::Text("Samples: %u, lost: %u (%.3f%%)", telemetrySamplesReceived, telemetrySamplesLost,
+                telemetrySamplesReceived ? 100.0 * telemetrySamplesLost / (telemetrySamplesReceived + telemetrySamplesLost) : 0.0);
+
+    ImGui::SetNextItemWidth(200);
+    ImGui::InputText("##telemetryfile", telemetryRecordFilename, sizeof(telemetryRecordFilename));
+    ImGui::SameLine();
+    if ( telemetryRecordFile ) {
+        if ( ImGui::Button("Stop recording") )
+            stopTelemetryRecording();
+        ImGui::SameLine();
+        ImGui::Text("%u samples", telemetrySamplesRecorded);
+    }
+    else {
+        if ( ImGui::Button("Record") )
+            startTelemetryRecording(telemetryRecordFilename);
+    }
+
+    ImGui::Checkbox("Pause", &pauseTelemetryPlot);
+
+    for (int i = 0; i < NUM_TELEMETRY_SERIES; i++) {
+        if ( i % 6 != 0 )
+            ImGui::SameLine();
+        ImGui::Checkbox(telemetrySeriesList[i].name, &telemetrySeriesList[i].show);
+    }
+
+    if (ImPlot::BeginPlot("Telemetry", ImVec2(-1, -1), ImPlotFlags_NoTitle)) {
+        ImPlot::SetupAxes("t", "", 0, ImPlotAxisFlags_AutoFit);
+        if ( ! pauseTelemetryPlot && telemetryHistoryCount > 0 ) {
+            int latest = (telemetryHistoryNext - 1 + TELEMETRY_HISTORY) % TELEMETRY_HISTORY;
+            double t = telemetryHistory[latest].seq * 0.001;
+            ImPlot::SetupAxisLimits(ImAxis_X1, t - TELEMETRY_HISTORY * 0.001, t, ImPlotCond_Always);
+        }
+        for (int i = 0; i < NUM_TELEMETRY_SERIES; i++) {
+            if ( telemetrySeriesList[i].show )
+                ImPlot::PlotLineG(telemetrySeriesList[i].name, telemetryGetter, (void*)&telemetrySeriesList[i], telemetryHistoryCount);
+        }
+        ImPlot::EndPlot();
+    }
+}
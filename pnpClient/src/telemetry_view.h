@@ -0,0 +1,11 @@
+#ifndef TELEMETRY_VIEW_H
+#define TELEMETRY_VIEW_H
+
+void checkTelemetry();
+
+bool startTelemetryRecording(const char* filename);
+void stopTelemetryRecording();
+
+void showTelemetryPlots();
+
+#endif // TELEMETRY_VIEW_H
@@ -0,0 +1,497 @@
+#include <math.h>
+#include <algorithm>
+
+#include "templatematch.h"
+#include "pyramid.h"
+#include "workerpool.h"
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MATCH_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MATCH_SSE2
+#endif
+
+#ifndef DEGTORAD
+#define DEGTORAD 0.01745329252
+#endif
+
+#define TEMPLATE_REFINE_REACH   2   // pixels either side of the position from the level above
+#define TEMPLATE_COARSE_SLACK   0.25f // coarse levels lose detail, so take candidates this far below minScore
+
+// Matching is zero-mean normalized cross correlation. For the template T at a position in the
+// image I, with n pixels:
+//
+//     score = (sum(I*T) - sum(I)*sum(T)/n) / sqrt( (sum(I*I) - sum(I)^2/n) * (sum(T*T) - sum(T)^2/n) )
+//
+// Everything about the template is worked out once in prepareTemplate. The whole area is only
+// searched at the coarsest level, where sum(I) and sum(I*I) come from integral images, so the
+// only work for each position is sum(I*T), done a row at a time with the vector dot product
+// below. The best places found there are then followed down the levels, looking a few pixels
+// around them at each. So few positions are looked at on the finer levels that it's quicker to
+// add up the image under the template directly than to make integral images for them.
+
+struct searchLevel_t {
+    grayImage_t scaled;             // the image halved, not used for level 0
+    const grayImage_t* image;
+    std::vector<uint32_t> sums;     // integral images, (width+1) x (height+1), coarsest level only
+    std::vector<uint64_t> squares;
+};
+
+struct candidate_t {
+    int u, v;       // top left of the template
+    int angle;      // index into the angles
+    float score;
+};
+
+static bool higherScore(const candidate_t& a, const candidate_t& b)
+{
+    return a.score > b.score;
+}
+
+// Sum of a[i]*b[i], for rows of up to 65536 pixels
+static inline uint32_t dotRow(const uint8_t* a, const uint8_t* b, int n)
+{
+    int i = 0;
+    uint32_t total = 0;
+
+#if defined(MATCH_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t va = vld1q_u8(a + i);
+        uint8x16_t vb = vld1q_u8(b + i);
+        acc = vpadalq_u16(acc, vmull_u8(vget_low_u8(va), vget_low_u8(vb)));
+        acc = vpadalq_u16(acc, vmull_u8(vget_high_u8(va), vget_high_u8(vb)));
+    }
+    if ( i + 8 <= n ) {
+        acc = vpadalq_u16(acc, vmull_u8(vld1_u8(a + i), vld1_u8(b + i)));
+        i += 8;
+    }
+    total = vaddvq_u32(acc);
+#elif defined(MATCH_SSE2)
+    // the bytes are widened to 16 bits, madd then multiplies and adds pairs into 32 bits
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero)));
+    }
+    if ( i + 8 <= n ) {
+        __m128i va = _mm_loadl_epi64((const __m128i*)(a + i));
+        __m128i vb = _mm_loadl_epi64((const __m128i*)(b + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)));
+        i += 8;
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1,0,3,2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2,3,0,1)));
+    total = _mm_cvtsi128_si32(acc);
+#endif
+
+    for (; i < n; i++)
+        total += a[i] * b[i];
+    return total;
+}
+
+static void buildIntegrals(searchLevel_t& sl)
+{
+    const grayImage_t& img = *sl.image;
+    int w1 = img.width + 1;
+    sl.sums.resize(w1 * (img.height + 1));
+    sl.squares.resize(w1 * (img.height + 1));
+    for (int x = 0; x < w1; x++) {
+        sl.sums[x] = 0;
+        sl.squares[x] = 0;
+    }
+
+    for (int y = 0; y < img.height; y++) {
+        const uint8_t* row = &img.pixels[y * img.width];
+        uint32_t rowSum = 0;
+        uint64_t rowSquares = 0;
+        sl.sums[(y+1)*w1] = 0;
+        sl.squares[(y+1)*w1] = 0;
+        for (int x = 0; x < img.width; x++) {
+            rowSum += row[x];
+            rowSquares += row[x] * row[x];
+            sl.sums[(y+1)*w1 + x+1] = sl.sums[y*w1 + x+1] + rowSum;
+            sl.squares[(y+1)*w1 + x+1] = sl.squares[y*w1 + x+1] + rowSquares;
+        }
+    }
+}
+
+// Sum and standard deviation (times n) of the image under a w x h template at u,v. Returns false
+// if the area is flat, where the score would mean nothing.
+static inline bool areaStats(const searchLevel_t& sl, int u, int v, int w, int h, int64_t& sum, double& spread)
+{
+    uint64_t squares = 0;
+    if ( ! sl.sums.empty() ) {
+        int w1 = sl.image->width + 1;
+        int i0 = v * w1 + u;
+        int i1 = (v + h) * w1 + u;
+        sum = (int64_t)sl.sums[i1 + w] - sl.sums[i1] - sl.sums[i0 + w] + sl.sums[i0];
+        squares = sl.squares[i1 + w] - sl.squares[i1] - sl.squares[i0 + w] + sl.squares[i0];
+    }
+    else {
+        sum = 0;
+        for (int j = 0; j < h; j++) {
+            const uint8_t* row = &sl.image->pixels[(v + j) * sl.image->width + u];
+            uint32_t rowSum = 0;
+            for (int i = 0; i < w; i++)
+                rowSum += row[i];
+            sum += rowSum;
+            squares += dotRow(row, row, w);
+        }
+    }
+
+    double n = w * h;
+    double variance = squares - (double)sum * sum / n;
+    if ( variance < n ) // less than one gray level
+        return false;
+    spread = sqrt(variance);
+    return true;
+}
+
+static inline float scoreWith(const searchLevel_t& sl, const templateImage_t& t, int u, int v, int64_t sum, double spread)
+{
+    const grayImage_t& img = *sl.image;
+    int tw = t.image.width;
+    int th = t.image.height;
+
+    int64_t cross = 0;
+    const uint8_t* in = &img.pixels[v * img.width + u];
+    const uint8_t* tp = t.image.pixels.data();
+    for (int j = 0; j < th; j++) {
+        cross += dotRow(in, tp, tw);
+        in += img.width;
+        tp += tw;
+    }
+
+    double num = cross - (double)sum * t.sum / (tw * th);
+    return num / (spread * t.norm);
+}
+
+static float scoreAt(const searchLevel_t& sl, const templateImage_t& t, int u, int v)
+{
+    int64_t sum;
+    double spread;
+    if ( ! areaStats(sl, u, v, t.image.width, t.image.height, sum, spread) )
+        return 0;
+    return scoreWith(sl, t, u, v, sum, spread);
+}
+
+struct coarseJob_t {
+    const searchLevel_t* level;
+    const std::vector<templateImage_t>* angles;
+    int cols;
+    float* best;            // best score at each position,
+    uint8_t* bestAngle;     // and the angle it was for
+};
+
+static void coarseRows(void* arg, int firstRow, int lastRow)
+{
+    coarseJob_t* job = (coarseJob_t*)arg;
+    const std::vector<templateImage_t>& angles = *job->angles;
+    int tw = angles[0].image.width;
+    int th = angles[0].image.height;
+
+    for (int v = firstRow; v < lastRow; v++) {
+        for (int u = 0; u < job->cols; u++) {
+            int i = v * job->cols + u;
+            job->best[i] = 0;
+            job->bestAngle[i] = 0;
+
+            int64_t sum;
+            double spread;
+            if ( ! areaStats(*job->level, u, v, tw, th, sum, spread) )
+                continue;
+
+            for (int a = 0; a < (int)angles.size(); a++) {
+                float score = scoreWith(*job->level, angles[a], u, v, sum, spread);
+                if ( score > job->best[i] ) {
+                    job->best[i] = score;
+                    job->bestAngle[i] = a;
+                }
+            }
+        }
+    }
+}
+
+// Keeps the best of any candidates closer than minDist, the input must be sorted best first
+static void removeNearby(std::vector<candidate_t>& cands, int minDist, int maxKeep)
+{
+    std::vector<candidate_t> kept;
+    for (candidate_t& c : cands) {
+        bool near = false;
+        for (candidate_t& k : kept) {
+            if ( abs(c.u - k.u) < minDist && abs(c.v - k.v) < minDist ) {
+                near = true;
+                break;
+            }
+        }
+        if ( ! near )
+            kept.push_back(c);
+        if ( (int)kept.size() >= maxKeep )
+            break;
+    }
+    cands.swap(kept);
+}
+
+// Moves c to the best position within reach, at its own angle and the ones either side
+static void refineCandidate(const searchLevel_t& sl, const std::vector<templateImage_t>& angles, int reach, candidate_t& c)
+{
+    int maxU = sl.image->width - angles[0].image.width;
+    int maxV = sl.image->height - angles[0].image.height;
+
+    candidate_t best = c;
+    best.score = -1;
+    for (int a = std::max(0, c.angle - 1); a <= std::min((int)angles.size() - 1, c.angle + 1); a++) {
+        for (int v = std::max(0, c.v - reach); v <= std::min(maxV, c.v + reach); v++) {
+            for (int u = std::max(0, c.u - reach); u <= std::min(maxU, c.u + reach); u++) {
+                float score = scoreAt(sl, angles[a], u, v);
+                if ( score > best.score ) {
+                    best.u = u;
+                    best.v = v;
+                    best.angle = a;
+                    best.score = score;
+                }
+            }
+        }
+    }
+    c = best;
+}
+
+// Offset of the peak of a parabola through three evenly spaced values, from the middle one
+static float parabolaPeak(float before, float middle, float after)
+{
+    float d = before - 2 * middle + after;
+    if ( d >= 0 )
+        return 0;
+    float offset = 0.5f * (before - after) / d;
+    return std::max(-0.5f, std::min(0.5f, offset));
+}
+
+static void makeTemplateImage(templateImage_t& t)
+{
+    int n = t.image.width * t.image.height;
+    int64_t squares = 0;
+    t.sum = 0;
+    for (uint8_t p : t.image.pixels) {
+        t.sum += p;
+        squares += p * p;
+    }
+    double variance = squares - (double)t.sum * t.sum / n;
+    t.norm = variance > 0 ? sqrt(variance) : 0;
+}
+
+bool prepareTemplate(const grayImage_t& tmpl, float angleRange, float angleStep, preparedTemplate_t& prepared)
+{
+    prepared = preparedTemplate_t();
+
+    prepared.angles.push_back(0);
+    if ( angleRange > 0 && angleStep > 0 ) {
+        int steps = std::min((int)(angleRange / angleStep), (TEMPLATE_MAX_ANGLES - 1) / 2);
+        prepared.angles.clear();
+        for (int i = -steps; i <= steps; i++)
+            prepared.angles.push_back(i * angleStep);
+    }
+
+    // the largest size all the rotations can be cut to without going outside the original
+    float maxRadians = fabsf(prepared.angles.back()) * DEGTORAD;
+    float c = cosf(maxRadians);
+    float s = sinf(maxRadians);
+    float w = tmpl.width;
+    float h = tmpl.height;
+    float k = std::min(w / (w * c + h * s), h / (w * s + h * c));
+    int cw = std::min(tmpl.width, (int)(k * w));
+    int ch = std::min(tmpl.height, (int)(k * h));
+    if ( cw < TEMPLATE_MIN_SIZE / 2 || ch < TEMPLATE_MIN_SIZE / 2 )
+        return false;
+
+    prepared.numLevels = 1;
+    while ( prepared.numLevels < TEMPLATE_LEVELS && std::min(cw, ch) >> prepared.numLevels >= TEMPLATE_MIN_SIZE )
+        prepared.numLevels++;
+
+    float midX = 0.5f * (tmpl.width - 1);
+    float midY = 0.5f * (tmpl.height - 1);
+    float cropMidX = 0.5f * (cw - 1);
+    float cropMidY = 0.5f * (ch - 1);
+
+    for (float angle : prepared.angles) {
+        float radians = angle * DEGTORAD;
+        c = cosf(radians);
+        s = sinf(radians);
+
+        templateImage_t t;
+        t.image.width = cw;
+        t.image.height = ch;
+        t.image.pixels.resize(cw * ch);
+
+        // each pixel is sampled from where it came from before rotating, with bilinear filtering
+        for (int y = 0; y < ch; y++) {
+            for (int x = 0; x < cw; x++) {
+                float dx = x - cropMidX;
+                float dy = y - cropMidY;
+                float sx = midX + c * dx + s * dy;
+                float sy = midY - s * dx + c * dy;
+                sx = std::max(0.0f, std::min(sx, (float)tmpl.width - 1.001f));
+                sy = std::max(0.0f, std::min(sy, (float)tmpl.height - 1.001f));
+                int ix = (int)sx;
+                int iy = (int)sy;
+                float fx = sx - ix;
+                float fy = sy - iy;
+                const uint8_t* p = &tmpl.pixels[iy * tmpl.width + ix];
+                float top = p[0] + fx * (p[1] - p[0]);
+                float bottom = p[tmpl.width] + fx * (p[tmpl.width + 1] - p[tmpl.width]);
+                t.image.pixels[y * cw + x] = (uint8_t)(top + fy * (bottom - top) + 0.5f);
+            }
+        }
+
+        for (int level = 0; level < prepared.numLevels; level++) {
+            if ( level > 0 ) {
+                const grayImage_t& above = prepared.levels[level - 1].back().image;
+                t.image.width = above.width / 2;
+                t.image.height = above.height / 2;
+                t.image.pixels.resize(t.image.width * t.image.height);
+                halveGray(above.pixels.data(), above.width, above.height, t.image.pixels.data());
+            }
+            makeTemplateImage(t);
+            prepared.levels[level].push_back(t);
+        }
+    }
+
+    // nothing to match against in a flat template
+    const templateImage_t& t0 = prepared.levels[0][0];
+    if ( t0.norm * t0.norm < t0.image.width * t0.image.height )
+        return false;
+
+    return true;
+}
+
+void matchTemplate(const grayImage_t& image, const preparedTemplate_t& tmpl, float minScore, int howMany, std::vector<templateMatch_t>& matches)
+{
+    matches.clear();
+
+    if ( tmpl.numLevels < 1 || howMany < 1 )
+        return;
+
+    searchLevel_t levels[TEMPLATE_LEVELS];
+    levels[0].image = &image;
+
+    int numLevels = 0;
+    for (int l = 0; l < tmpl.numLevels; l++) {
+        if ( l > 0 ) {
+            const grayImage_t& above = *levels[l - 1].image;
+            grayImage_t& scaled = levels[l].scaled;
+            scaled.width = above.width / 2;
+            scaled.height = above.height / 2;
+            scaled.pixels.resize(scaled.width * scaled.height);
+            halveGray(above.pixels.data(), above.width, above.height, scaled.pixels.data());
+            levels[l].image = &scaled;
+        }
+        const grayImage_t& t = tmpl.levels[l][0].image;
+        if ( levels[l].image->width < t.width || levels[l].image->height < t.height )
+            break;
+        numLevels++;
+    }
+    if ( numLevels < 1 )
+        return;
+
+    // search every position of the coarsest level
+    int coarse = numLevels - 1;
+    buildIntegrals(levels[coarse]);
+    const std::vector<templateImage_t>& coarseAngles = tmpl.levels[coarse];
+    int tw = coarseAngles[0].image.width;
+    int th = coarseAngles[0].image.height;
+    int cols = levels[coarse].image->width - tw + 1;
+    int rows = levels[coarse].image->height - th + 1;
+
+    std::vector<float> best(cols * rows);
+    std::vector<uint8_t> bestAngle(cols * rows);
+
+    coarseJob_t job;
+    job.level = &levels[coarse];
+    job.angles = &coarseAngles;
+    job.cols = cols;
+    job.best = best.data();
+    job.bestAngle = bestAngle.data();
+    runInRowBands(rows, coarseRows, &job);
+
+    float coarseMinScore = coarse > 0 ? minScore - TEMPLATE_COARSE_SLACK : minScore;
+
+    std::vector<candidate_t> cands;
+    for (int v = 0; v < rows; v++) {
+        for (int u = 0; u < cols; u++) {
+            float score = best[v * cols + u];
+            if ( score < coarseMinScore )
+                continue;
+            bool isPeak = true;
+            for (int dv = -1; dv <= 1 && isPeak; dv++) {
+                for (int du = -1; du <= 1; du++) {
+                    int nu = u + du;
+                    int nv = v + dv;
+                    if ( nu < 0 || nv < 0 || nu >= cols || nv >= rows || (du == 0 && dv == 0) )
+                        continue;
+                    if ( best[nv * cols + nu] > score ) {
+                        isPeak = false;
+                        break;
+                    }
+                }
+            }
+            if ( isPeak ) {
+                candidate_t c;
+                c.u = u;
+                c.v = v;
+                c.angle = bestAngle[v * cols + u];
+                c.score = score;
+                cands.push_back(c);
+            }
+        }
+    }
+
+    std::sort(cands.begin(), cands.end(), higherScore);
+    removeNearby(cands, std::max(1, std::min(tw, th) / 2), 4 * howMany + 4);
+
+    // follow each one down to full size
+    for (candidate_t& c : cands) {
+        for (int l = coarse - 1; l >= 0; l--) {
+            c.u *= 2;
+            c.v *= 2;
+            refineCandidate(levels[l], tmpl.levels[l], TEMPLATE_REFINE_REACH, c);
+        }
+    }
+
+    std::sort(cands.begin(), cands.end(), higherScore);
+    const std::vector<templateImage_t>& angles = tmpl.levels[0];
+    tw = angles[0].image.width;
+    th = angles[0].image.height;
+    removeNearby(cands, std::max(1, std::min(tw, th) / 2), howMany);
+
+    // sub-pixel position and angle, from the scores either side of the peak
+    const searchLevel_t& full = levels[0];
+    int maxU = full.image->width - tw;
+    int maxV = full.image->height - th;
+    for (candidate_t& c : cands) {
+        if ( c.score < minScore )
+            break;
+
+        const templateImage_t& t = angles[c.angle];
+        float dx = 0, dy = 0, da = 0;
+        if ( c.u > 0 && c.u < maxU )
+            dx = parabolaPeak(scoreAt(full, t, c.u - 1, c.v), c.score, scoreAt(full, t, c.u + 1, c.v));
+        if ( c.v > 0 && c.v < maxV )
+            dy = parabolaPeak(scoreAt(full, t, c.u, c.v - 1), c.score, scoreAt(full, t, c.u, c.v + 1));
+        if ( c.angle > 0 && c.angle < (int)angles.size() - 1 )
+            da = parabolaPeak(scoreAt(full, angles[c.angle - 1], c.u, c.v), c.score, scoreAt(full, angles[c.angle + 1], c.u, c.v));
+
+        templateMatch_t m;
+        m.x = c.u + dx + 0.5f * (tw - 1);
+        m.y = c.v + dy + 0.5f * (th - 1);
+        m.angle = tmpl.angles[c.angle];
+        if ( da != 0 )
+            m.angle += da * (tmpl.angles[1] - tmpl.angles[0]);
+        m.score = c.score;
+        matches.push_back(m);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef TEMPLATEMATCH_H
+#define TEMPLATEMATCH_H
+
+#include <stdint.h>
+#include <vector>
+
+#define TEMPLATE_LEVELS         3   // full size, half and quarter
+#define TEMPLATE_MIN_SIZE       8   // coarse levels are only used while the template is at least this big
+#define TEMPLATE_MAX_ANGLES     61
+
+// One byte per pixel, with no padding between rows
+struct grayImage_t {
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;
+
+    grayImage_t() {
+        width = 0;
+        height = 0;
+    }
+};
+
+// One rotation of the template at one level
+struct templateImage_t {
+    grayImage_t image;
+    int64_t sum;        // of the pixels
+    float norm;         // square root of the sum of squared differences from the mean
+};
+
+// The template rotated to each angle, and scaled down for the coarse levels. When rotated, every
+// angle is cut down to the same size, small enough that none of its corners are outside of the
+// original template.
+struct preparedTemplate_t {
+    int numLevels;
+    std::vector<float> angles;  // in degrees, the same way round as the angle of a rect
+    std::vector<templateImage_t> levels[TEMPLATE_LEVELS]; // for each angle
+
+    preparedTemplate_t() {
+        numLevels = 0;
+    }
+};
+
+struct templateMatch_t {
+    float x;        // position of the middle of the template, in pixels of the image searched
+    float y;
+    float angle;
+    float score;    // zero-mean normalized cross correlation, 1 for a perfect match
+};
+
+// Returns false if the template is too small, or flat (nothing to match against).
+bool prepareTemplate(const grayImage_t& tmpl, float angleRange, float angleStep, preparedTemplate_t& prepared);
+
+// Finds up to howMany places the template matches the image with a score of at least minScore,
+// best first. Matches closer together than half the template size count as the same one.
+void matchTemplate(const grayImage_t& image, const preparedTemplate_t& tmpl, float minScore, int howMany, std::vector<templateMatch_t>& matches);
+
+#endif
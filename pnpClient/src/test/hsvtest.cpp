@@ -0,0 +1,88 @@
+
+// Checks that the vectorized HSV row functions give exactly the same result as rgb2hsv, for
+// every one of the 2^24 colors. Run by ctest, or directly: returns non-zero on any difference.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hsv.h"
+
+// An odd length, so the scalar tail is checked along with the vector blocks
+#define ROW_LENGTH (256 + 5)
+
+static int numMismatches = 0;
+
+static void reportMismatch(const char* what, const uint8_t* rgb, const uint8_t* expected, const uint8_t* actual)
+{
+    if ( numMismatches++ < 10 )
+        printf("%s mismatch for rgb %d,%d,%d: expected %d,%d,%d got %d,%d,%d\n", what,
+               rgb[0], rgb[1], rgb[2], expected[0], expected[1], expected[2], actual[0], actual[1], actual[2]);
+}
+
+int main()
+{
+    uint8_t rgb[ROW_LENGTH * 3];
+    uint8_t hsv[ROW_LENGTH * 3];
+    uint8_t inPlace[ROW_LENGTH * 3];
+    uint8_t mask[ROW_LENGTH];
+
+    // passes for roughly half of each channel, in a different pattern for each
+    hsvRange_t range;
+    for (int i = 0; i < 256; i++) {
+        range.h[i] = (i % 3) ? 255 : 0;
+        range.s[i] = (i > 40 && i < 200) ? 255 : 0;
+        range.v[i] = (i & 8) ? 255 : 0;
+    }
+
+    for (int r = 0; r < 256; r++) {
+        for (int g = 0; g < 256; g++) {
+
+            // every blue value, then a few more to fill out the row
+            for (int i = 0; i < ROW_LENGTH; i++) {
+                rgb[3*i] = r;
+                rgb[3*i+1] = g;
+                rgb[3*i+2] = i < 256 ? i : (i * 37) & 0xff;
+            }
+
+            rgb2hsvRow(rgb, hsv, ROW_LENGTH);
+
+            memcpy(inPlace, rgb, sizeof(rgb));
+            rgb2hsvRow(inPlace, inPlace, ROW_LENGTH);
+
+            int passed = hsvThresholdRow(rgb, mask, ROW_LENGTH, range);
+
+            int expectedPassed = 0;
+            for (int i = 0; i < ROW_LENGTH; i++) {
+                uint8_t expected[3];
+                rgb2hsv(&rgb[3*i], expected);
+
+                if ( memcmp(expected, &hsv[3*i], 3) )
+                    reportMismatch("rgb2hsvRow", &rgb[3*i], expected, &hsv[3*i]);
+                if ( memcmp(expected, &inPlace[3*i], 3) )
+                    reportMismatch("rgb2hsvRow in place", &rgb[3*i], expected, &inPlace[3*i]);
+
+                uint8_t expectedMask = range.h[expected[0]] & range.s[expected[1]] & range.v[expected[2]];
+                if ( mask[i] != expectedMask ) {
+                    uint8_t m[3] = { mask[i], mask[i], mask[i] };
+                    uint8_t e[3] = { expectedMask, expectedMask, expectedMask };
+                    reportMismatch("hsvThresholdRow", &rgb[3*i], e, m);
+                }
+                if ( expectedMask )
+                    expectedPassed++;
+            }
+
+            if ( passed != expectedPassed ) {
+                if ( numMismatches++ < 10 )
+                    printf("hsvThresholdRow count mismatch for r=%d, g=%d: expected %d got %d\n", r, g, expectedPassed, passed);
+            }
+        }
+    }
+
+    if ( numMismatches ) {
+        printf("%d mismatches\n", numMismatches);
+        return 1;
+    }
+
+    printf("all colors match\n");
+    return 0;
+}
@@ -7,6 +7,9 @@
 #endif
 
 #include <unistd.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
 #include <atomic>
 #include <chrono>
 #include <thread>
@@ -18,10 +21,14 @@
 #include "script_vision.h"
 #include "workspace.h"
 #include "notify.h"
+#include "scopelock.h"
+#include "script_globals.h"
+#include "mjpeg.h"
 
 using namespace std;
 
 #define USBCAMERA_WINDOW_TITLE "USB camera control"
+#define GRAB_FRAME_TIMEOUT_MS   1000
 
 //uvc_context_t *ctx = NULL;
 //uvc_device_handle_t *devh = NULL;
@@ -50,15 +57,49 @@ static char* cd(const char* str) {
 
 vector<usbCameraInfo_t*> usbCameraInfos;
 
-bool getUSBFrameBufferLock(usbCameraInfo_t *info) {
-    if ( info->frameBufferLocked->load(std::memory_order_acquire) )
-        return false;
-    info->frameBufferLocked->store(true, std::memory_order_release);
-    return true;
+// Same clock as millis() in scripts
+static uint64_t steadyMillis() {
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>( t.time_since_epoch() ).count();
+}
+
+// Returns the index of the latest frame slot, held for reading until releaseUSBFrameSlot is
+// called, or -1 if there is no frame yet.
+static int acquireLatestUSBFrameSlot(usbCameraInfo_t *info) {
+    while ( true ) {
+        int slot = info->latestFrameSlot.load();
+        if ( slot < 0 )
+            return -1;
+        info->frameSlots[slot].readers++;
+        // If the slot is still the latest, the callback can't have started writing over it
+        // before we got our count in. Otherwise let go and try the new latest one.
+        if ( info->latestFrameSlot.load() == slot )
+            return slot;
+        info->frameSlots[slot].readers--;
+    }
 }
 
-void releaseUSBFrameBufferLock(usbCameraInfo_t *info) {
-    info->frameBufferLocked->store(false, std::memory_order_release);
+static void releaseUSBFrameSlot(usbCameraInfo_t *info, int slot) {
+    info->frameSlots[slot].readers--;
+}
+
+// Copies a frame into rgbData, sizing the buffers to suit. Gray frames are spread to all three
+// channels, which is still much cheaper than converting from YUV.
+static void copyUSBFrameSlot(usbFrameSlot_t &fs, videoFrameBuffers_t* b) {
+    resizeFrameBuffers( b, fs.frame->width, fs.frame->height );
+
+    int n = b->width * b->height;
+    const uint8_t* src = (const uint8_t*)fs.frame->data;
+    if ( fs.channels == 3 ) {
+        memcpy( b->rgbData, src, n * 3 );
+        return;
+    }
+
+    uint8_t* dst = b->rgbData;
+    for (int i = 0; i < n; i++) {
+        dst[0] = dst[1] = dst[2] = src[i];
+        dst += 3;
+    }
 }
 
 void usbCameraFrameCallback(uvc_frame_t *frame, void *ptr) {
@@ -70,59 +111,194 @@ void usbCameraFrameCallback(uvc_frame_t *frame, void *ptr) {
     if ( info->uvcAllocateFrameAlreadyFailed )
         return;
 
-    if ( ! info->rgbFrame ) {
-        info->rgbFrame = uvc_allocate_frame(frame->width * frame->height * 3);
-        if ( ! info->rgbFrame ) {
+    uint64_t arrivalTime = steadyMillis();
+
+    // This is called by a separate thread at any time while the camera is open. Write into
+    // a slot that is neither the latest nor being read, so readers never see a partial frame.
+    int latest = info->latestFrameSlot.load();
+    int slot = -1;
+    for (int i = 0; i < USB_FRAME_SLOTS; i++) {
+        if ( i != latest && info->frameSlots[i].readers.load() == 0 ) {
+            slot = i;
+            break;
+        }
+    }
+    if ( slot < 0 )
+        return; // both other slots are being copied from, skip this frame
+
+    usbFrameSlot_t& fs = info->frameSlots[slot];
+
+    if ( ! fs.frame ) {
+        fs.frame = uvc_allocate_frame(frame->width * frame->height * 3);
+        if ( ! fs.frame ) {
             info->uvcAllocateFrameAlreadyFailed = true; // prevent further attempts
             printf("unable to allocate rgbFrame frame!");
             return;
         }
     }
 
-    // This is called by a separate thread at any time while the camera is open.
-    // Need to make sure none of our other code is currently using the frame data.
-    // If we can't get this lock, just skip updating the image data for this frame.
-    if ( ! getUSBFrameBufferLock(info) ) {
-        return;
-    }
-
     //printf("callback! length = %u, ptr = %d\n", frame->data_bytes, (void*) ptr);
 
+    // Scripts that only need gray, or a smaller image for a coarse search, can ask for just that
+    // to be decoded (see script_setUSBCameraDecode).
+    bool gray = info->decodeGray;
+    int scale = info->decodeScale;
+    int channels = 3;
+
     uvc_error_t ret = UVC_SUCCESS;
     switch ( info->currentFrameFormat ) {
     case UVC_FRAME_FORMAT_YUYV:
-        ret = uvc_any2rgb(frame, info->rgbFrame);
+        if ( gray && frame->data_bytes >= frame->width * frame->height * 2 ) {
+            // Y is every second byte, no conversion needed
+            const uint8_t* src = (const uint8_t*)frame->data;
+            uint8_t* dst = (uint8_t*)fs.frame->data;
+            int n = frame->width * frame->height;
+            for (int i = 0; i < n; i++)
+                dst[i] = src[2*i];
+            fs.frame->width = frame->width;
+            fs.frame->height = frame->height;
+            channels = 1;
+        }
+        else
+            ret = uvc_any2rgb(frame, fs.frame);
         break;
     case UVC_FRAME_FORMAT_MJPEG:
-        ret = uvc_mjpeg2rgb(frame, info->rgbFrame);
+        if ( gray || scale > 1 ) {
+            int width, height;
+            if ( decodeMJPEG((const uint8_t*)frame->data, frame->data_bytes, gray, scale, (uint8_t*)fs.frame->data, fs.frame->data_bytes, width, height) ) {
+                fs.frame->width = width;
+                fs.frame->height = height;
+                channels = gray ? 1 : 3;
+                break;
+            }
+        }
+        ret = uvc_mjpeg2rgb(frame, fs.frame); // also the fallback if decodeMJPEG couldn't do it
         break; // if this function doesn't link, you need to build libuvc AFTER installing libjpeg-devel
     default:;
     }
 
     if (ret) {
         uvc_perror(ret, "uvc_any2bgr");
-        releaseUSBFrameBufferLock(info);
         return;
     }
 
-    info->frameBuffers.width = frame->width;
-    info->frameBuffers.height = frame->height;
-    info->frameBuffers.originalData = (uint8_t*)info->rgbFrame->data;
+    fs.channels = channels;
+
+    // The frame was exposed about one frame interval before it finished arriving
+    uint64_t frameInterval = info->mode.fps > 0 ? (uint64_t)(1000 / info->mode.fps) : 0;
+
+    fs.sequence = ++info->lastFrameSequence;
+    fs.captureTime = arrivalTime - frameInterval;
+    info->latestFrameSlot.store(slot);
+
+    // wake the vision thread for this camera, and anything waiting in grabUSBCameraFrame
+    ScopeLock lock(&info->frameMutex);
+    info->frameCounter++;
+    pthread_cond_broadcast(&info->frameCond);
+}
+
+static void* usbCameraVisionThread(void* ptr)
+{
+    usbCameraInfo_t* info = (usbCameraInfo_t*)ptr;
+
+    info->visionContext.buffers = &info->frameBuffers;
+    setCameraThreadVisionContext(&info->visionContext);
+
+    std::chrono::steady_clock::time_point fpsStart = std::chrono::steady_clock::now();
+    int fpsFrames = 0;
+    uint32_t lastFrameCounter = 0;
+
+    while ( true ) {
+        {
+            ScopeLock lock(&info->frameMutex);
+            while ( info->frameCounter == lastFrameCounter && ! info->visionThreadShouldStop )
+                pthread_cond_wait(&info->frameCond, &info->frameMutex);
+            if ( info->visionThreadShouldStop )
+                break;
+            lastFrameCounter = info->frameCounter;
+        }
+
+        int slot = acquireLatestUSBFrameSlot(info);
+        if ( slot < 0 )
+            continue;
+
+        usbFrameSlot_t& fs = info->frameSlots[slot];
+        if ( fs.sequence == info->lastProcessedSequence ) {
+            releaseUSBFrameSlot(info, slot);
+            continue;
+        }
+        info->lastProcessedSequence = fs.sequence;
+
+        int width = fs.frame->width;
+        int height = fs.frame->height;
+        if ( ! info->frameBuffers.rgbData || info->frameBuffers.width != width || info->frameBuffers.height != height ) {
+            resizeFrameBuffers( &info->frameBuffers, width, height );
+
+            ScopeLock lock(&info->resultMutex);
+            delete[] info->resultData;
+            info->resultData = new uint8_t[width * height * 3];
+            info->resultWidth = width;
+            info->resultHeight = height;
+            info->haveNewResult = false;
+        }
+        copyUSBFrameSlot( fs, &info->frameBuffers );
+        releaseUSBFrameSlot(info, slot);
+        resetMask( &info->frameBuffers );
 
-    if ( ! info->frameBuffers.rgbData ) {
-        info->frameBuffers.rgbData = new uint8_t[frame->width * frame->height * 3];
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        info->visionVideoView.runVision();
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+        fpsFrames++;
+        long long fpsTime = std::chrono::duration_cast<std::chrono::microseconds>(t1 - fpsStart).count();
+
+        ScopeLock lock(&info->resultMutex);
+        std::swap( info->frameBuffers.rgbData, info->resultData );
+        info->resultTexts.swap( info->visionContext.renderTexts );
+        info->haveNewResult = true;
+        info->frameProcesstime = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+        info->updateMovingAverage(info->frameProcesstime);
+        if ( fpsTime >= 1000000 ) {
+            info->processedFps = fpsFrames * 1000000.0f / fpsTime;
+            fpsStart = t1;
+            fpsFrames = 0;
+        }
     }
-    memcpy( info->frameBuffers.rgbData, info->frameBuffers.originalData, frame->width * frame->height * 3 );
 
-    // setActiveScriptFrameBuffers(&info->frameBuffers);
+    setCameraThreadVisionContext(NULL);
+
+    return NULL;
+}
 
-    // info->visionVideoView.runVision();
+static void startUSBCameraVisionThread(usbCameraInfo_t* info)
+{
+    if ( info->visionThreadStarted )
+        return;
 
-    // setActiveScriptFrameBuffers(NULL);
+    info->visionThreadShouldStop = false;
+    info->haveNewResult = false;
+    info->processedFps = 0;
 
-    info->frameCounter++;
+    if ( pthread_create(&info->visionThread, NULL, usbCameraVisionThread, info) != 0 ) {
+        g_log.log(LL_ERROR, "Could not start vision thread for USB camera %d", info->index);
+        return;
+    }
+    info->visionThreadStarted = true;
+}
+
+static void stopUSBCameraVisionThread(usbCameraInfo_t* info)
+{
+    if ( ! info->visionThreadStarted )
+        return;
+
+    {
+        ScopeLock lock(&info->frameMutex);
+        info->visionThreadShouldStop = true;
+        pthread_cond_signal(&info->frameCond);
+    }
 
-    releaseUSBFrameBufferLock(info);
+    pthread_join(info->visionThread, NULL);
+    info->visionThreadStarted = false;
 }
 
 bool enumerateUSBCameras(vector<usbCameraInfo_t*> &infos)
@@ -175,6 +351,107 @@ bool enumerateUSBCameras(vector<usbCameraInfo_t*> &infos)
     return true;
 }
 
+// Lists the modes that usbCameraFrameCallback can convert, ie. YUYV and MJPG.
+static void collectFrameModes(uvc_device_handle_t *devh, vector<usbCameraFrameMode_t> &modes)
+{
+    modes.clear();
+
+    const uvc_format_desc_t *formatDesc = uvc_get_format_descs(devh);
+    while ( formatDesc ) {
+        const char* fourcc = NULL;
+        if ( formatDesc->bDescriptorSubtype == UVC_VS_FORMAT_MJPEG )
+            fourcc = "MJPG";
+        else if ( formatDesc->bDescriptorSubtype == UVC_VS_FORMAT_UNCOMPRESSED &&
+                  ( ! memcmp(formatDesc->fourccFormat, "YUY2", 4) || ! memcmp(formatDesc->fourccFormat, "YUYV", 4) ) )
+            fourcc = "YUYV";
+
+        const uvc_frame_desc_t *frameDesc = fourcc ? formatDesc->frame_descs : NULL;
+        while ( frameDesc ) {
+            usbCameraFrameMode_t m;
+            snprintf(m.fourcc, sizeof(m.fourcc), "%s", fourcc);
+            m.width = frameDesc->wWidth;
+            m.height = frameDesc->wHeight;
+
+            uint32_t* interval = frameDesc->intervals;
+            if ( interval ) {
+                while ( *interval ) {
+                    m.fps = 10000000 / (float)*interval;
+                    modes.push_back(m);
+                    interval++;
+                }
+            }
+            else if ( frameDesc->dwDefaultFrameInterval ) { // continuous range of intervals
+                m.fps = 10000000 / (float)frameDesc->dwDefaultFrameInterval;
+                modes.push_back(m);
+            }
+
+            frameDesc = frameDesc->next;
+        }
+        formatDesc = formatDesc->next;
+    }
+}
+
+static string frameModeText(const usbCameraFrameMode_t &m)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s %dx%d %gfps", m.fourcc, m.width, m.height, m.fps);
+    return buf;
+}
+
+static void loadWantedUSBCameraMode(usbCameraInfo_t *info)
+{
+    if ( info->wantedModeLoaded )
+        return;
+    info->wantedModeLoaded = true;
+
+    string str = script_getDBString( DBSTRING_USB_CAMERA_MODE_PREFIX + info->idHash );
+
+    usbCameraFrameMode_t m;
+    if ( sscanf(str.c_str(), "%4s %dx%d %f", m.fourcc, &m.width, &m.height, &m.fps) == 4 )
+        info->wantedMode = m;
+}
+
+static void saveWantedUSBCameraMode(usbCameraInfo_t *info)
+{
+    const usbCameraFrameMode_t &m = info->wantedMode;
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s %dx%d %g", m.fourcc, m.width, m.height, m.fps);
+    script_setDBString( DBSTRING_USB_CAMERA_MODE_PREFIX + info->idHash, buf );
+}
+
+// The wanted mode if the camera has it, or the nearest frame rate at the wanted size. Without a
+// wanted mode, or if the camera doesn't have that size, 640x480 at 30fps.
+static usbCameraFrameMode_t chooseFrameMode(usbCameraInfo_t *info)
+{
+    usbCameraFrameMode_t def;
+    snprintf(def.fourcc, sizeof(def.fourcc), "%s", info->preferMJPG ? "MJPG" : "YUYV");
+    def.width = 640;
+    def.height = 480;
+    def.fps = 30;
+
+    const usbCameraFrameMode_t &w = info->wantedMode;
+    if ( w.width < 1 )
+        return def;
+
+    if ( info->availableModes.empty() )
+        return w; // can't tell, let uvc_get_stream_ctrl_format_size decide
+
+    const usbCameraFrameMode_t* best = NULL;
+    for ( const usbCameraFrameMode_t &m : info->availableModes ) {
+        if ( strcmp(m.fourcc, w.fourcc) || m.width != w.width || m.height != w.height )
+            continue;
+        if ( ! best || fabsf(m.fps - w.fps) < fabsf(best->fps - w.fps) )
+            best = &m;
+    }
+
+    if ( best )
+        return *best;
+
+    g_log.log(LL_WARN, "USB camera %d does not have mode %s, using 640x480", info->index, frameModeText(w).c_str());
+    return def;
+}
+
 bool fetchUSBCameraFormats(int index) {
 
     if ( index >= (int)usbCameraInfos.size() ) {
@@ -230,6 +507,8 @@ bool fetchUSBCameraFormats(int index) {
                 formatDesc = formatDesc->next;
             }
 
+            collectFrameModes(devh, usbCameraInfos[index]->availableModes);
+
             uvc_close(devh);
 
             break;
@@ -293,41 +572,32 @@ bool openUSBCamera(int index) {
                 break;
             }
 
-            const uvc_format_desc_t *formatDesc = uvc_get_format_descs(info->devh);
-            //const uvc_frame_desc_t *frameDesc = formatDesc->frame_descs;
+            collectFrameModes(info->devh, info->availableModes);
+            loadWantedUSBCameraMode(info);
+
+            usbCameraFrameMode_t m = chooseFrameMode(info);
 
             enum uvc_frame_format frame_format = UVC_FRAME_FORMAT_YUYV;
-            /*switch (formatDesc->bDescriptorSubtype) {
-            case UVC_VS_FORMAT_MJPEG:
+            if ( ! strcmp(m.fourcc, "MJPG") )
                 frame_format = UVC_FRAME_FORMAT_MJPEG;
-                break;
-            case UVC_VS_FORMAT_FRAME_BASED:
-                frame_format = UVC_FRAME_FORMAT_H264;
-                break;
-            default:
-                frame_format = UVC_FRAME_FORMAT_YUYV;
-                break;
-            }*/
-
-            int width = 640;
-            int height = 480;
-            int fps = 30;
-
-            // if (frameDesc) {
-            //     width = frameDesc->wWidth;
-            //     height = frameDesc->wHeight;
-            //     fps = 10000000 / frameDesc->dwDefaultFrameInterval;
-            // }
 
-            if ( info->preferMJPG )
-                frame_format = UVC_FRAME_FORMAT_MJPEG;
+            int width = m.width;
+            int height = m.height;
+            int fps = (int)(m.fps + 0.5f);
 
             info->currentFrameFormat = frame_format;
 
-            g_log.log(LL_DEBUG, "Trying format: (%4s) %dx%d %dfps", formatDesc->fourccFormat, width, height, fps);
+            g_log.log(LL_DEBUG, "Trying format: (%4s) %dx%d %dfps", m.fourcc, width, height, fps);
 
             uvc_stream_ctrl_t ctrl;
             res = uvc_get_stream_ctrl_format_size( info->devh, &ctrl, frame_format, width, height, fps );
+            if ( res < 0 && (width != 640 || height != 480 || fps != 30) ) {
+                g_log.log(LL_WARN, "USB camera %d could not use %s %dx%d %dfps, trying 640x480 30fps", index, m.fourcc, width, height, fps);
+                width = 640;
+                height = 480;
+                fps = 30;
+                res = uvc_get_stream_ctrl_format_size( info->devh, &ctrl, frame_format, width, height, fps );
+            }
             if (res < 0) {
                 g_log.log(LL_ERROR, "Could not open USB camera %d (uvc_get_stream_ctrl_format_size): %s", index, uvc_strerror(res));
                 uvc_exit(info->ctx);
@@ -355,6 +625,8 @@ bool openUSBCamera(int index) {
             info->mode.height = height;
             info->mode.fps = fps;
 
+            startUSBCameraVisionThread(info);
+
             break;
         }
         count++;
@@ -953,6 +1225,7 @@ void showUSBCameraControl(bool* p_open)
 
             char buf[64];
             bool shouldCloseCamera = false;
+            bool shouldReopenCamera = false;
 
             usbCameraInfo_t *info = usbCameraInfos[i];
             //ImGui::Text("Index: %d, Vendor ID: 0x%04X, Product ID: 0x%04X", info->index, info->descriptor.idVendor, info->descriptor.idProduct);
@@ -986,6 +1259,42 @@ void showUSBCameraControl(bool* p_open)
                     ImGui::SameLine();
                     ImGui::Checkbox(cd("Continuous update"), &info->continuousUpdate);
 
+                    string currentMode = frameModeText(info->mode);
+                    ImGui::PushItemWidth(240);
+                    if ( ImGui::BeginCombo(cd("Mode"), currentMode.c_str()) ) {
+                        for ( usbCameraFrameMode_t &m : info->availableModes ) {
+                            string modeText = frameModeText(m);
+                            if ( ImGui::Selectable(modeText.c_str(), modeText == currentMode) ) {
+                                info->wantedMode = m;
+                                saveWantedUSBCameraMode(info);
+                                shouldReopenCamera = true;
+                            }
+                        }
+                        ImGui::EndCombo();
+                    }
+
+                    // the same as setUSBCameraDecode from a script, takes effect from the next frame
+                    ImGui::SameLine();
+                    bool gray = info->decodeGray;
+                    if ( ImGui::Checkbox(cd("Gray"), &gray) )
+                        info->decodeGray = gray;
+
+                    if ( info->currentFrameFormat == UVC_FRAME_FORMAT_MJPEG ) {
+                        ImGui::SameLine();
+                        ImGui::PushItemWidth(60);
+                        int scale = info->decodeScale;
+                        sprintf(buf, "1/%d", scale);
+                        if ( ImGui::BeginCombo(cd("Scale"), buf) ) {
+                            for (int s = 1; s <= 4; s *= 2) {
+                                sprintf(buf, "1/%d", s);
+                                if ( ImGui::Selectable(buf, s == scale) )
+                                    info->decodeScale = s;
+                            }
+                            ImGui::EndCombo();
+                        }
+                        ImGui::PopItemWidth();
+                    }
+
                     //ImGui::Text("%s %dx%d %.2f fps", info->mode.fourcc, info->mode.width, info->mode.height, info->mode.fps);
 
                     showUSBCameraZoomSettings(info);
@@ -1000,33 +1309,6 @@ void showUSBCameraControl(bool* p_open)
                     showUSBCameraGammaSettings(info);
                     showUSBCameraHueSettings(info);
 
-
-                    bool didProcessFrame = false;
-                    std::chrono::steady_clock::time_point t0;
-                    std::chrono::steady_clock::time_point t1;
-                    if ( info->lastProcessedFrameCounter != info->frameCounter ) // ideally we would get the lock before checking info->frameCounter, but we only want to check if it is different, not particularly interested in the actual value
-                    {
-                        // usbCameraFrameCallback() might be updating the rgbData buffer in a separate thread.
-                        // If we can't obtain the buffer lock, just skip updating the image texture in this frame.
-                        if ( getUSBFrameBufferLock(info) ) // once we get this lock, give it back asap
-                        {
-                            t0 = std::chrono::steady_clock::now();
-                            info->visionContext.buffers = &info->frameBuffers;
-                            setMainThreadVisionContext(&info->visionContext);
-                            info->visionVideoView.runVision();
-                            //setActiveScriptFrameBuffers(NULL);
-                            t1 = std::chrono::steady_clock::now();
-                            info->lastProcessedFrameCounter = info->frameCounter;
-                            releaseUSBFrameBufferLock(info);
-                            didProcessFrame = true;
-                        }
-                    }
-                    if ( didProcessFrame ) {
-                        info->frameProcesstime = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
-                        info->updateMovingAverage(info->frameProcesstime);
-                        info->visionVideoView.updateImageData( info->frameBuffers.rgbData );
-                    }
-
                     //sprintf(buf, "USB camera %d", i);
                     //info->visionVideoView.show(buf, info);
 
@@ -1039,6 +1321,10 @@ void showUSBCameraControl(bool* p_open)
             if ( shouldCloseCamera ) {
                 closeUSBCamera(info);
             }
+            else if ( shouldReopenCamera ) {
+                closeUSBCamera(info);
+                openUSBCamera(info->index);
+            }
 
             //            ImGui::Text("    UVC compliance level: %d", info->descriptor.bcdUVC);
             //            ImGui::Text("    Serial number: %s", info->descriptor.serialNumber);
@@ -1059,11 +1345,29 @@ void showOpenUSBCameraViews()
         if ( info->devh ) {
             char buf[64];
             sprintf(buf, "USB camera %d", i);
+
+            // upload the latest frame finished by the vision thread, if there is a new one
+            {
+                ScopeLock lock(&info->resultMutex);
+                if ( info->haveNewResult ) {
+                    info->visionVideoView.updateImageData( info->resultData, info->resultWidth, info->resultHeight );
+                    info->shownTexts = info->resultTexts;
+                    info->haveNewResult = false;
+                }
+            }
+
             info->visionVideoView.show(buf, info);
         }
     }
 }
 
+// Called before a script editor window is deleted, so that camera threads stop printing to its log
+void removeUSBCameraScriptLog(void* sl)
+{
+    for (usbCameraInfo_t* info : usbCameraInfos)
+        info->visionVideoView.removeScriptLog(sl);
+}
+
 void closeUSBCamera(usbCameraInfo_t* info)
 {
     if ( ! info )
@@ -1075,6 +1379,8 @@ void closeUSBCamera(usbCameraInfo_t* info)
         uvc_close(info->devh);
     }
 
+    stopUSBCameraVisionThread(info);
+
     info->visionVideoView.cleanup();
 
     if ( info->ctx ) {
@@ -1088,15 +1394,28 @@ void closeUSBCamera(usbCameraInfo_t* info)
 
     info->devh = NULL;
     info->ctx = NULL;
-    info->frameBuffers.rgbData = NULL;
 
-    if ( info->frameBuffers.grayData )
-        delete[] info->frameBuffers.grayData;
-    info->frameBuffers.grayData = NULL;
-
-    if ( info->rgbFrame ) {
-        uvc_free_frame(info->rgbFrame);
-        info->rgbFrame = NULL;
+    freeFrameBuffers( &info->frameBuffers );
+
+    if ( info->resultData )
+        delete[] info->resultData;
+    info->resultData = NULL;
+    info->resultWidth = 0;
+    info->resultHeight = 0;
+    info->resultTexts.clear();
+    info->shownTexts.clear();
+
+    // the stream is stopped, so once any grabUSBCameraFrame copying out has finished the
+    // slots can go
+    info->latestFrameSlot = -1;
+    for (int i = 0; i < USB_FRAME_SLOTS; i++) {
+        usbFrameSlot_t& fs = info->frameSlots[i];
+        while ( fs.readers.load() > 0 )
+            this_thread::sleep_for( 1ms );
+        if ( fs.frame ) {
+            uvc_free_frame(fs.frame);
+            fs.frame = NULL;
+        }
     }
 }
 
@@ -1110,7 +1429,7 @@ void closeAllUSBCameras() {
     usbCameraInfos.clear();
 }
 
-bool grabUSBCameraFrame(int index, videoFrameBuffers_t* buffers) {
+bool grabUSBCameraFrame(int index, videoFrameBuffers_t* buffers, uint64_t newerThan) {
 
     if ( index >= (int)usbCameraInfos.size() ) {
         //g_log.log(LL_ERROR, "Invalid index for USB camera: %d", index);
@@ -1121,41 +1440,44 @@ bool grabUSBCameraFrame(int index, videoFrameBuffers_t* buffers) {
     if ( ! info->devh )
         return false;
 
-    if ( ! buffers->rgbData ) {
-        initFrameBuffers( buffers, info->frameBuffers.width, info->frameBuffers.height );
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += GRAB_FRAME_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (GRAB_FRAME_TIMEOUT_MS % 1000) * 1000000L;
+    if ( deadline.tv_nsec >= 1000000000L ) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
     }
 
-    int srcSize = info->frameBuffers.width * info->frameBuffers.height * 3;
-    int dstSize = buffers->width * buffers->height * 3;
+    pthread_mutex_lock(&info->frameMutex);
+    while ( true ) {
+        // The callback takes frameMutex to wake us, so a frame arriving after this counter was
+        // read will not be missed.
+        uint32_t counter = info->frameCounter;
+        pthread_mutex_unlock(&info->frameMutex);
 
-    if ( dstSize != srcSize )
-        return false;
+        int slot = acquireLatestUSBFrameSlot(info);
+        if ( slot >= 0 ) {
+            usbFrameSlot_t& fs = info->frameSlots[slot];
+            if ( fs.captureTime >= newerThan ) {
 
-    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+                copyUSBFrameSlot( fs, buffers );
+                releaseUSBFrameSlot(info, slot);
 
-    int retries = 1000;
-    while ( retries > 0 ) {
-        if ( getUSBFrameBufferLock(info) ) // once we get this lock, give it back asap
-            break;
-        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
-        long long waited = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
-        if ( waited > 200 ) {
-            g_log.log(LL_WARN, "grabFrame giving up after 200 milliseconds!");
-            return false; // no grab after 200 millseconds
+                resetMask(buffers);
+                return true;
+            }
+            releaseUSBFrameSlot(info, slot);
         }
-        retries--;
-        this_thread::sleep_for( 1ms );
-    }
-    if ( retries < 1 ) {
-        g_log.log(LL_WARN, "grabFrame giving up after 1000 attempts!");
-        return false;
-    }
 
-    //if ( getUSBFrameBufferLock(info) ) // once we get this lock, give it back asap
-    {
-        memcpy(buffers->rgbData, info->frameBuffers.originalData, dstSize);
-        releaseUSBFrameBufferLock(info);
-        return true;
+        pthread_mutex_lock(&info->frameMutex);
+        while ( info->frameCounter == counter ) {
+            if ( pthread_cond_timedwait(&info->frameCond, &info->frameMutex, &deadline) == ETIMEDOUT ) {
+                pthread_mutex_unlock(&info->frameMutex);
+                g_log.log(LL_WARN, "grabFrame giving up after %d milliseconds!", GRAB_FRAME_TIMEOUT_MS);
+                return false;
+            }
+        }
     }
 
     return false;
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <atomic>
+#include <pthread.h>
 
 #include "libuvc/libuvc.h"
 
@@ -11,6 +12,19 @@
 #include "script_vision.h"
 
 #define PROCESS_TIME_MA_COUNT   60
+#define USB_FRAME_SLOTS         3
+
+// The capture callback converts each frame straight into a slot that nobody is reading, then
+// makes it the latest one. Readers hold a slot only while copying out of it. With three slots
+// there is always one free for the callback, unless two readers are both copying at the time
+// a frame arrives, in which case that frame is dropped.
+struct usbFrameSlot_t {
+    uvc_frame_t* frame;
+    uint32_t sequence;              // counts up from 1 for each frame
+    uint64_t captureTime;           // millis() time the exposure of the frame started, roughly
+    int channels;                   // 3 for RGB, 1 for gray
+    std::atomic<int> readers;
+};
 
 struct usbCameraFeature_u16_t {
     bool alreadyInited;
@@ -80,6 +94,12 @@ struct usbCameraFrameMode_t {
     int width;
     int height;
     float fps;
+    usbCameraFrameMode_t() {
+        fourcc[0] = 0;
+        width = 0;
+        height = 0;
+        fps = 0;
+    }
 };
 
 // struct videoFrameBuffers_t {
@@ -94,25 +114,49 @@ struct usbCameraInfo_t
     uvc_context_t *ctx;
     uvc_device_handle_t *devh;
     usbCameraFrameMode_t mode;    
+    std::vector<usbCameraFrameMode_t> availableModes; // from the format descriptors, YUYV and MJPG only
+    usbCameraFrameMode_t wantedMode;    // width is zero until set, then 640x480 is used
+    bool wantedModeLoaded;              // wantedMode has been read from the database
     bool continuousUpdate;
     bool preferMJPG;
     uvc_frame_format currentFrameFormat;
+    std::atomic<bool> decodeGray;       // only decode the brightness
+    std::atomic<int> decodeScale;       // 1, 2 or 4, only for MJPG
 
     std::string idHash;
 
     bool uvcAllocateFrameAlreadyFailed;
-    uvc_frame_t *rgbFrame;
+    usbFrameSlot_t frameSlots[USB_FRAME_SLOTS];
+    std::atomic<int> latestFrameSlot;   // -1 until the first frame arrives
+    uint32_t lastFrameSequence;         // only used by the capture callback
     videoFrameBuffers_t frameBuffers;
     visionContext_t visionContext;
-    std::atomic<bool> * frameBufferLocked;
-    uint8_t frameCounter;
-    uint8_t lastProcessedFrameCounter;
+
+    // The camera view script runs on a thread of its own for each open camera, woken by the
+    // frame callback. The UI only uploads the latest frame the thread has finished.
+    pthread_t visionThread;
+    bool visionThreadStarted;
+    pthread_mutex_t frameMutex;         // protects frameCounter and visionThreadShouldStop
+    pthread_cond_t frameCond;           // a new frame has arrived, or the thread should stop
+    uint32_t frameCounter;
+    bool visionThreadShouldStop;
+    uint32_t lastProcessedSequence;     // only used by the vision thread
+
+    pthread_mutex_t resultMutex;        // protects everything below down to maTotal
+    uint8_t* resultData;                // swapped with frameBuffers.rgbData after each frame
+    int resultWidth;
+    int resultHeight;
+    std::vector<script_renderText> resultTexts;
+    bool haveNewResult;
     long long frameProcesstime;
+    float processedFps;
 
     int maCounts[PROCESS_TIME_MA_COUNT];
     int maIndex;
     int maTotal;
 
+    std::vector<script_renderText> shownTexts; // UI thread only, goes with the uploaded frame
+
     VisionVideoView visionVideoView;
     usbCameraFeature_u16_t zoom;
     usbCameraFeature_u16_t focus;
@@ -129,22 +173,42 @@ struct usbCameraInfo_t
         ctx = NULL;
         devh = NULL;
         uvcAllocateFrameAlreadyFailed = false;
-        rgbFrame = NULL;
+        for (int i = 0; i < USB_FRAME_SLOTS; i++) {
+            frameSlots[i].frame = NULL;
+            frameSlots[i].sequence = 0;
+            frameSlots[i].captureTime = 0;
+            frameSlots[i].channels = 3;
+            frameSlots[i].readers = 0;
+        }
+        latestFrameSlot = -1;
+        lastFrameSequence = 0;
         frameBuffers.rgbData = NULL;
         frameBuffers.grayData = NULL;
-        frameBufferLocked = new std::atomic<bool>(false);
-        frameCounter = 0;
-        lastProcessedFrameCounter = 0;
 
+        visionThreadStarted = false;
+        pthread_mutex_init(&frameMutex, NULL);
+        pthread_cond_init(&frameCond, NULL);
+        frameCounter = 0;
+        visionThreadShouldStop = false;
+        lastProcessedSequence = 0;
+
+        pthread_mutex_init(&resultMutex, NULL);
+        resultData = NULL;
+        resultWidth = 0;
+        resultHeight = 0;
+        haveNewResult = false;
         frameProcesstime = 0;
+        processedFps = 0;
         memset(maCounts, 0, sizeof(maCounts));
         maIndex = 0;
         maTotal = 0;
 
-        //frameBufferLocked->store(false);
         currentFrameFormat = UVC_FRAME_FORMAT_YUYV;
         continuousUpdate = true;
         preferMJPG = false;
+        wantedModeLoaded = false;
+        decodeGray = false;
+        decodeScale = 1;
     }
     void updateMovingAverage(long int n) {
         maTotal -= maCounts[maIndex];
@@ -153,7 +217,9 @@ struct usbCameraInfo_t
         maIndex = (maIndex + 1) % PROCESS_TIME_MA_COUNT;
     }
     ~usbCameraInfo_t() {
-        delete frameBufferLocked;
+        pthread_mutex_destroy(&frameMutex);
+        pthread_cond_destroy(&frameCond);
+        pthread_mutex_destroy(&resultMutex);
     }
 };
 
@@ -161,7 +227,8 @@ bool enumerateUSBCameras(std::vector<usbCameraInfo_t*> &infos);
 void showUSBCameraControl(bool* p_open);
 void showOpenUSBCameraViews();
 void closeAllUSBCameras();
+void removeUSBCameraScriptLog(void* sl);
 int script_getUSBCameraIndexByHash(std::string fragment);
-bool grabUSBCameraFrame(int index, videoFrameBuffers_t* buffers);
+bool grabUSBCameraFrame(int index, videoFrameBuffers_t* buffers, uint64_t newerThan = 0);
 
 #endif
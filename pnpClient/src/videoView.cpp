@@ -1,6 +1,9 @@
 
 #include <stdio.h>
+#include <string.h>
 #include <vector>
+#include <GLFW/glfw3.h>
+#include <GL/glext.h>
 #include "imgui.h"
 #include "videoView.h"
 #include "usbcamera.h"
@@ -11,18 +14,43 @@
 
 using namespace std;
 
+// Pixel buffer objects are not in the GL 1.1 headers, so the functions are fetched from the
+// driver the first time a view is set up.
+static bool triedPixelBufferFuncs = false;
+static PFNGLGENBUFFERSPROC p_glGenBuffers = NULL;
+static PFNGLDELETEBUFFERSPROC p_glDeleteBuffers = NULL;
+static PFNGLBINDBUFFERPROC p_glBindBuffer = NULL;
+static PFNGLBUFFERDATAPROC p_glBufferData = NULL;
+static PFNGLMAPBUFFERPROC p_glMapBuffer = NULL;
+static PFNGLUNMAPBUFFERPROC p_glUnmapBuffer = NULL;
+
+static bool havePixelBufferFuncs()
+{
+    if ( ! triedPixelBufferFuncs ) {
+        triedPixelBufferFuncs = true;
+        p_glGenBuffers = (PFNGLGENBUFFERSPROC)glfwGetProcAddress("glGenBuffers");
+        p_glDeleteBuffers = (PFNGLDELETEBUFFERSPROC)glfwGetProcAddress("glDeleteBuffers");
+        p_glBindBuffer = (PFNGLBINDBUFFERPROC)glfwGetProcAddress("glBindBuffer");
+        p_glBufferData = (PFNGLBUFFERDATAPROC)glfwGetProcAddress("glBufferData");
+        p_glMapBuffer = (PFNGLMAPBUFFERPROC)glfwGetProcAddress("glMapBuffer");
+        p_glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)glfwGetProcAddress("glUnmapBuffer");
+    }
+    return p_glGenBuffers && p_glDeleteBuffers && p_glBindBuffer && p_glBufferData && p_glMapBuffer && p_glUnmapBuffer;
+}
+
 VideoView::VideoView()
 {
     textureId = 0;
+    for (int i = 0; i < VIDEO_PIXEL_BUFFERS; i++)
+        pixelBuffers[i] = 0;
+    nextPixelBuffer = 0;
     zoom = 1;
     initDone = false;
-    doneFirstUpload = false;
-
-    pixels = new uint8_t[640*480*3];
+    textureWidth = 0;
+    textureHeight = 0;
 }
 
 VideoView::~VideoView() {
-    delete pixels;
 }
 
 void VideoView::setup() {
@@ -32,33 +60,65 @@ void VideoView::setup() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // This is required on WebGL for non power-of-two textures
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); // Same
+    if ( havePixelBufferFuncs() )
+        p_glGenBuffers(VIDEO_PIXEL_BUFFERS, pixelBuffers);
     initDone = true;
 }
 
 void VideoView::cleanup() {
     glDeleteTextures(1, &textureId);
+    if ( pixelBuffers[0] ) {
+        p_glDeleteBuffers(VIDEO_PIXEL_BUFFERS, pixelBuffers);
+        for (int i = 0; i < VIDEO_PIXEL_BUFFERS; i++)
+            pixelBuffers[i] = 0;
+    }
     initDone = false;
-    doneFirstUpload = false;
+    textureWidth = 0;
+    textureHeight = 0;
 }
 
-void VideoView::updateImageData(uint8_t* imgData) {
-
-    if ( imgData ) {
-        memcpy( pixels, imgData, 640*480*3 );
-    }
+void VideoView::updateImageData(uint8_t* imgData, int width, int height) {
 
     if ( ! initDone )
         setup();
 
-    if ( imgData ) {
-        glBindTexture(GL_TEXTURE_2D, textureId);
-        if ( ! doneFirstUpload )
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 640, 480, 0, GL_RGB, GL_UNSIGNED_BYTE, imgData);
-        else
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 640, 480, GL_RGB, GL_UNSIGNED_BYTE, imgData);
-        doneFirstUpload = true;
+    if ( ! imgData || width < 1 || height < 1 )
+        return;
+
+    int size = width * height * 3;
+
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of RGB are not a multiple of 4 bytes for every width
+
+    if ( width != textureWidth || height != textureHeight ) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        textureWidth = width;
+        textureHeight = height;
     }
 
+    // Copy into the next buffer of the ring and have the texture filled from that, so the driver
+    // can do the transfer later instead of stalling here. Giving the buffer new storage first
+    // means the map doesn't wait for the GPU to finish with what was in it.
+    bool uploaded = false;
+    if ( pixelBuffers[0] ) {
+        p_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[nextPixelBuffer]);
+        nextPixelBuffer = (nextPixelBuffer + 1) % VIDEO_PIXEL_BUFFERS;
+
+        p_glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        void* dst = p_glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if ( dst ) {
+            memcpy(dst, imgData, size);
+            p_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+            uploaded = true;
+        }
+        p_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    if ( ! uploaded )
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, imgData);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
 struct aspectControlInfo_t {
@@ -78,8 +138,9 @@ void VideoView::show(const char* title, usbCameraInfo_t* info)
 {
     ImGui::SetNextWindowSize(ImVec2(640, 480), ImGuiCond_FirstUseEver);
 
+    // until the first frame arrives the window keeps the aspect ratio of the usual 640x480
     aspectControlInfo_t aspectInfo;
-    aspectInfo.aspectRatio = 640.0f / 480.0f;
+    aspectInfo.aspectRatio = textureHeight > 0 ? textureWidth / (float)textureHeight : 640.0f / 480.0f;
     aspectInfo.leadingSpace = getLeadingSpace();
 
     ImGui::SetNextWindowSizeConstraints( ImVec2(128, 96), ImVec2(FLT_MAX, FLT_MAX), aspectRatioCallback, (void*)&aspectInfo);
@@ -90,7 +151,7 @@ void VideoView::show(const char* title, usbCameraInfo_t* info)
     {
         showLeadingItems(info);
 
-        if ( textureId ) {
+        if ( textureId && textureWidth > 0 ) {
 
             if (ImGui::IsWindowHovered()) {
                 ImGuiIO& io = ImGui::GetIO();
@@ -118,7 +179,7 @@ void VideoView::show(const char* title, usbCameraInfo_t* info)
             //ImGui::Image((void*)(intptr_t)textureId, s, uv0, uv1);
             ImGui::Image(textureId, s, uv0, uv1);
 
-            float scale = s.x / 640;
+            float scale = s.x / textureWidth;
 
             drawOtherStuff(imgPos, scale, info);
 
@@ -4,18 +4,22 @@
 #include <GL/gl.h>
 #include "imgui.h"
 
+#define VIDEO_PIXEL_BUFFERS     3
+
 class VideoView {
     GLuint textureId;
+    GLuint pixelBuffers[VIDEO_PIXEL_BUFFERS]; // uploads go round these, all zero if not supported
+    int nextPixelBuffer;
     bool initDone;
-    bool doneFirstUpload;
+    int textureWidth;   // zero until the first upload
+    int textureHeight;
     float zoom;
-    uint8_t* pixels;
 public:
     VideoView();
     ~VideoView();
     void setup();
     void cleanup();
-    void updateImageData(uint8_t* imgData);
+    void updateImageData(uint8_t* imgData, int width, int height);
 
     virtual int getLeadingSpace() { return 0; }
     void show(const char *title, struct usbCameraInfo_t* info);
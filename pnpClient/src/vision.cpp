@@ -1,165 +1,179 @@
 
+#include <string.h>
+#include <math.h>
 #include <algorithm>
 
 #include "vision.h"
-#include "quickblob.h"
 
-//int visionCount = 0;
-
-//blobParams_t visionParams;
-//blobRun_t br;
-//blob_t* bestblob = NULL;
-
-int init_pixel_stream_hook(void* user_struct, struct stream_state* stream) {
-    blobRun_t* br = (blobRun_t*)user_struct;
-
-    // if ( br->params.maskSize > br->width )
-    //     br->params.maskSize = br->width;
-    // if ( br->params.maskSize > br->height )
-    //     br->params.maskSize = br->height;
-
-    //stream->w = br->params.maskSize;
-    //stream->h = br->params.maskSize;
-
-    stream->w = br->width;
-    stream->h = br->height;
-
-    return 0;
-}
-
-int close_pixel_stream_hook(void* user_struct, struct stream_state* stream) {
-    // free up anything you allocated in init_pixel_stream_hook
-    return 0;
-}
-
-int next_row_hook(void* user_struct, struct stream_state* stream) {
-    // load the (grayscale) row at stream->y into the (8 bit) stream->row array
-    blobRun_t* br = (blobRun_t*)user_struct;
-
-    //stream->row = br->image->bits() + stream->y * stream->w;
-
-    int startOffsetX = 0;//(br->width - br->params.maskSize) / 2;
-    int startOffsetY = 0;//(br->height - br->params.maskSize) / 2;
-    stream->row = br->bytes + (stream->y+startOffsetY) * br->width + startOffsetX;
-
-    return 0;
-}
-
-int next_frame_hook(void* user_struct, struct stream_state* stream) {
-    blobRun_t* br = (blobRun_t*)user_struct;
-    return br->frame++;
+#ifndef RADTODEG
+#define RADTODEG 57.2957795131
+#endif
+
+// Blobs are found by run-length connected component labelling. Each row is cut into runs of the
+// target color, and each run is joined (union-find) with the runs of the row above that touch it,
+// including diagonally. Everything the blobs report can be summed up run by run, so once all the
+// runs are labelled, one pass over the runs gives the totals for each blob.
+
+typedef struct {
+    int x1, x2;     // first and last pixel, inclusive
+    int y;
+    int parent;     // the first run of a blob is its root, so blobs come out in raster order
+    int touching;   // pixels of this run with a pixel of the same color directly above
+} pixelRun_t;
+
+typedef struct {
+    int64_t n, sx, sy, sxx, sxy, syy;
+    int lx, ux, ly, uy;
+    int perimeter;
+} blobSums_t;
+
+static int findRoot(std::vector<pixelRun_t>& runs, int i)
+{
+    while ( runs[i].parent != i ) {
+        runs[i].parent = runs[runs[i].parent].parent;
+        i = runs[i].parent;
+    }
+    return i;
 }
 
-void log_blob_hook(void* user_struct, struct blob* b) {
-    blobRun_t* br = (blobRun_t*)user_struct;
-    if ( b->color != br->params.color || b->size < br->params.minPixels || b->size > br->params.maxPixels )
-        return;
-    int w = b->bb_x2 - b->bb_x1;
-    if ( w < br->params.minWidth || w > br->params.maxWidth )
-        return;
-    int h = b->bb_y2 - b->bb_y1;
-    if ( h < br->params.minWidth || h > br->params.maxWidth )
-        return;
-    /*int diff = abs(w - h);
-    int maxAspectDiff = ((br->params.maxWidth + br->params.minWidth) / 2) / 10;
-    if ( diff > maxAspectDiff )
-        return;
-
-    float radius = (w+h) / 4.0f;
-    int area = 3.14159265359f * radius * radius;
-    int areaDiff = abs(area - b->size);
-    if ( areaDiff > area / 4 )
-        return;*/
-
-    int startOffsetX = 0;//(br->width - br->params.maskSize) / 2;
-    int startOffsetY = 0;//(br->height - br->params.maskSize) / 2;
-
-    script_blob bs;
-    bs.size = b->size;
-    bs.ax = b->center_x + startOffsetX;
-    bs.ay = b->center_y + startOffsetY;
-    bs.bb_x1 = b->bb_x1 + startOffsetX;
-    bs.bb_x2 = b->bb_x2 + startOffsetX;
-    bs.bb_y1 = b->bb_y1 + startOffsetY;
-    bs.bb_y2 = b->bb_y2 + startOffsetY;
-    bs.pixels = b->size;
-    br->blobs.push_back( bs );
+static void joinRuns(std::vector<pixelRun_t>& runs, int a, int b)
+{
+    a = findRoot(runs, a);
+    b = findRoot(runs, b);
+    if ( a < b )
+        runs[b].parent = a;
+    else if ( b < a )
+        runs[a].parent = b;
 }
 
-bool compareBlobSize(script_blob& a, script_blob& b)
+// sum of k*k for k = 0..n
+static int64_t sumOfSquares(int64_t n)
 {
-    return (a.size > b.size);
+    return n * (n + 1) * (2 * n + 1) / 6;
 }
 
-
-// void initVision() {
-//     visionParams.color = VISION_DEFAULT_COLOR;
-//     visionParams.threshold = VISION_DEFAULT_THRESHOLD;
-//     visionParams.maskSize = VISION_DEFAULT_MASKSIZE;
-//     visionParams.minPixels = VISION_DEFAULT_MINPIXELS;
-//     visionParams.maxPixels = VISION_DEFAULT_MAXPIXELS;
-//     visionParams.minWidth = VISION_DEFAULT_MINWIDTH;
-//     visionParams.maxWidth = VISION_DEFAULT_MAXWIDTH;
-//     //visionParams.maxAspectDiff = (visionParams.maxWidth + visionParams.minWidth) / 2 / 10;
-//     visionParams.saveFile = false;
-//     visionParams.displayType = VISION_DEFAULT_DISPLAYTYPE;
-
-//     visionParams.focus = VISION_DEFAULT_FOCUS;
-//     visionParams.zoom = VISION_DEFAULT_ZOOM;
-
-//     visionParams.overlayElements = 0xFFFFFFFF;
-// }
-
-bool runQuickblob(blobRun_t* br) {
-
-    /*int numBytes = br->width * br->height;
-    for ( int i = 0; i < numBytes; i++ ) {
-        if (br->bytes[i] > br->params.threshold)
-            br->bytes[i] = 255;
-        else
-            br->bytes[i] = 0;
-    }*/
+bool findBlobs(blobRun_t* br) {
 
     br->blobs.clear();
-    br->blobs.reserve(100);
-    if ( extract_image(br) ) {
-        return false;
-    }
-
-
-    //std::sort(br->blobs.begin(), br->blobs.end(), compareBlobSize);
-
-    //    if ( visionCount++ % 10 == 0 ) {
-    //        image->save("threshold.png");
-    //    }
-
-
-    /*br->bestblob = NULL;
 
-    int bestDelta = br->height * br->height;
-
-    int hx = br->width / 2;
-    int hy = br->height / 2;
+    blobParams_t& params = br->params;
+    int stride = br->stride > 0 ? br->stride : br->width;
+
+    std::vector<pixelRun_t> runs;
+    runs.reserve(1024);
+
+    int aboveStart = 0;
+    int aboveEnd = 0;
+
+    for (int y = 0; y < br->height; y++) {
+        const uint8_t* row = &br->bytes[y * stride];
+        int rowStart = runs.size();
+        int above = aboveStart; // first run of the row above that could still touch
+
+        int x = 0;
+        while ( x < br->width ) {
+            const uint8_t* p = (const uint8_t*)memchr(&row[x], params.color, br->width - x);
+            if ( ! p )
+                break;
+
+            pixelRun_t run;
+            run.x1 = p - row;
+            x = run.x1 + 1;
+            while ( x < br->width && row[x] == params.color )
+                x++;
+            run.x2 = x - 1;
+            run.y = y;
+            run.parent = runs.size();
+            run.touching = 0;
+            runs.push_back(run);
+
+            while ( above < aboveEnd && runs[above].x2 < run.x1 - 1 )
+                above++;
+            for (int k = above; k < aboveEnd && runs[k].x1 <= run.x2 + 1; k++) {
+                joinRuns(runs, k, run.parent);
+                int overlap = std::min(runs[k].x2, run.x2) - std::max(runs[k].x1, run.x1) + 1;
+                if ( overlap > 0 )
+                    runs.back().touching += overlap;
+            }
+        }
 
-    //std::vector<blob_t>::iterator it = br->blobs.begin();
-    //while ( it != br->blobs.end() ) {
-    for (script_blob& bs : br->blobs) {
+        aboveStart = rowStart;
+        aboveEnd = runs.size();
+    }
 
-        float dx = bs.ax - hx;
-        float dy = bs.ay - hy;
-        int delta = dx*dx + dy*dy;
-        if ( delta < bestDelta ) {
-            bestDelta = delta;
-            br->bestblob = &bs;
-            br->bbdx = dx;
-            br->bbdy = dy;
+    // add up each run into the blob it belongs to
+    std::vector<int> blobIndex(runs.size(), -1);
+    std::vector<blobSums_t> sums;
+
+    for (int i = 0; i < (int)runs.size(); i++) {
+        pixelRun_t& run = runs[i];
+        int root = findRoot(runs, i);
+        if ( blobIndex[root] < 0 ) {
+            blobIndex[root] = sums.size();
+            blobSums_t s;
+            memset(&s, 0, sizeof(s));
+            s.lx = run.x1;
+            s.ux = run.x2;
+            s.ly = s.uy = run.y;
+            sums.push_back(s);
         }
+        blobSums_t& s = sums[blobIndex[root]];
+
+        int64_t n = run.x2 - run.x1 + 1;
+        int64_t sx = n * (run.x1 + run.x2) / 2;
+        s.n += n;
+        s.sx += sx;
+        s.sy += n * run.y;
+        s.sxx += sumOfSquares(run.x2) - sumOfSquares(run.x1 - 1);
+        s.sxy += sx * run.y;
+        s.syy += n * run.y * run.y;
+        s.lx = std::min(s.lx, run.x1);
+        s.ux = std::max(s.ux, run.x2);
+        s.uy = run.y;
+
+        // each pixel has four sides, take off the ones shared with another pixel of the blob
+        s.perimeter += 2 * n + 2 - 2 * run.touching;
+    }
 
-    }*/
+    for (blobSums_t& s : sums) {
+        if ( s.n < params.minPixels || s.n > params.maxPixels )
+            continue;
+        int w = s.ux - s.lx;
+        if ( w < params.minWidth || w > params.maxWidth )
+            continue;
+        int h = s.uy - s.ly;
+        if ( h < params.minWidth || h > params.maxWidth )
+            continue;
+
+        script_blob bs;
+        bs.size = s.n;
+        bs.pixels = s.n;
+        bs.ax = s.sx / (double)s.n;
+        bs.ay = s.sy / (double)s.n;
+        bs.bb_x1 = s.lx;
+        bs.bb_x2 = s.ux;
+        bs.bb_y1 = s.ly;
+        bs.bb_y2 = s.uy;
+        bs.perimeter = s.perimeter;
+
+        // second order central moments, as the covariance of the pixel positions
+        double mx = s.sx / (double)s.n;
+        double my = s.sy / (double)s.n;
+        double mxx = s.sxx / (double)s.n - mx * mx;
+        double mxy = s.sxy / (double)s.n - mx * my;
+        double myy = s.syy / (double)s.n - my * my;
+
+        // spread along the longest and shortest axes
+        double mid = 0.5 * (mxx + myy);
+        double diff = sqrt(0.25 * (mxx - myy) * (mxx - myy) + mxy * mxy);
+        double major = mid + diff;
+        double minor = mid - diff;
+
+        bs.angle = 0.5 * atan2(2 * mxy, mxx - myy) * RADTODEG;
+        bs.eccentricity = major > 0 ? sqrt(std::max(0.0, 1 - minor / major)) : 0;
+
+        br->blobs.push_back( bs );
+    }
 
     return true;
-
 }
-
-
-
@@ -35,10 +35,10 @@ typedef struct {
     uint8_t* bytes;
     int width;
     int height;
+    int stride;     // bytes from one row to the next, can be more than width
 
     blobParams_t params;
 
-    int frame;
     std::vector<script_blob> blobs;
     //script_blob* bestblob;
     //float bbdx;
@@ -49,6 +49,6 @@ typedef struct {
 //extern visionParams_t visionParams;
 
 void initVision();
-bool runQuickblob(blobRun_t* blobrun);
+bool findBlobs(blobRun_t* blobrun);
 
 #endif // VISION_H
@@ -5,6 +5,8 @@
 #include "usbcamera.h"
 #include "util.h"
 #include "workspace.h"
+#include "scopelock.h"
+#include "codeEditorWindow.h"
 
 using namespace std;
 
@@ -14,6 +16,8 @@ VisionVideoView::VisionVideoView()
     continuousUpdate = false;;
     entryFunction[0] = 0;
     sprintf(entryFunction, "circleSym");
+    pthread_mutex_init(&scriptMutex, NULL);
+    scriptLog = NULL;
     shouldTryImageLoad = false;
 }
 
@@ -59,16 +63,29 @@ void VisionVideoView::showLeadingItems(usbCameraInfo_t* info)
     }
 
     ImGui::SameLine();
-    ImGui::Checkbox("Apply", &continuousUpdate);
+    bool apply = continuousUpdate;
+    if ( ImGui::Checkbox("Apply", &apply) )
+        continuousUpdate = apply;
 
-    int movingAverage = info->maTotal / (float)PROCESS_TIME_MA_COUNT;
-    ImGui::Text("%s %dx%d %.1f fps, processing time: %lld us (avg: %d us)", info->mode.fourcc, info->mode.width, info->mode.height, info->mode.fps, info->frameProcesstime, movingAverage);
+    float processedFps;
+    long long processTime;
+    int movingAverage;
+    {
+        ScopeLock lock(&info->resultMutex);
+        processedFps = info->processedFps;
+        processTime = info->frameProcesstime;
+        movingAverage = info->maTotal / (float)PROCESS_TIME_MA_COUNT;
+    }
+    ImGui::Text("%s %dx%d %.1f fps, processed: %.1f fps, processing time: %lld us (avg: %d us)", info->mode.fourcc, info->mode.width, info->mode.height, info->mode.fps, processedFps, processTime, movingAverage);
 
     ImGui::SetCursorPosY( ImGui::GetCursorPosY() + 4 );
 }
 
 void VisionVideoView::prepareFunction()
 {
+    // waits for the vision thread to finish the frame it's on, if any
+    ScopeLock lock(&scriptMutex);
+
     discardCompiledFunction(compiled);
 
     if ( ! entryFunction[0] )
@@ -76,6 +93,10 @@ void VisionVideoView::prepareFunction()
 
     shouldTryImageLoad = true;
 
+    scriptLog = NULL;
+    if ( ! scriptEditorWindows.empty() )
+        scriptLog = &scriptEditorWindows[0]->log;
+
     char buf[64];
     sprintf(buf, "visionVideoModule%d", cameraInfo->index);
     if ( compileScript(buf, compiled) ) {
@@ -83,20 +104,35 @@ void VisionVideoView::prepareFunction()
     }
 }
 
+// UI thread, when a script editor window is closed
+void VisionVideoView::removeScriptLog(void* sl)
+{
+    ScopeLock lock(&scriptMutex);
+    if ( scriptLog == sl )
+        scriptLog = NULL;
+}
+
 extern bool script_shouldTryImageLoad;
 
 void VisionVideoView::runVision()
 {
     visionContext_t* ctx = getVisionContextForThread();
     ctx->renderTexts.clear();
+    resetPyramid(ctx); // a new frame was just copied in
 
     if ( ! continuousUpdate )
         return;
 
+    ScopeLock lock(&scriptMutex);
+
     if ( compiled.func ) {
         ctx->shouldTryImageLoad = shouldTryImageLoad;
         shouldTryImageLoad = false;
-        runCompiledFunction_simple(compiled);
+        runCompiledFunction_simple(compiled, scriptLog);
+
+        // the view shows rgbData, so any binary result left in the mask needs to be drawn in
+        if ( ctx->buffers )
+            flushMask(ctx->buffers);
     }
 }
 
@@ -104,7 +140,7 @@ extern ImFont* font_visionOverlay;
 void VisionVideoView::drawOtherStuff(ImVec2 imgPos, float scale, usbCameraInfo_t* info)
 {
     ImDrawList* draw_list = ImGui::GetWindowDrawList();
-    for (script_renderText& t : info->visionContext.renderTexts) {
+    for (script_renderText& t : info->shownTexts) {
         draw_list->AddText(font_visionOverlay, t.fontSize, ImVec2(imgPos.x+scale*t.x,imgPos.y+scale*t.y), ImColor(t.r/255.0f,t.g/255.0f,t.b/255.0f,1.0f), t.text.c_str());
     }
 }
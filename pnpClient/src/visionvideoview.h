@@ -1,15 +1,19 @@
 #ifndef VISIONVIDEOVIEW_H
 #define VISIONVIDEOVIEW_H
 
+#include <atomic>
+#include <pthread.h>
 #include "videoView.h"
 #include "scriptexecution.h"
 
 class VisionVideoView : public VideoView
 {
     struct usbCameraInfo_t* cameraInfo;
-    bool continuousUpdate;
+    std::atomic<bool> continuousUpdate;
     char entryFunction[128];
+    pthread_mutex_t scriptMutex; // held while compiled is being run or replaced
     compiledScript_t compiled;
+    void* scriptLog;             // where the script prints to, chosen by the UI thread when compiling
 
     bool shouldTryImageLoad; // image load should only be attempted once per click of the 'set' button
 
@@ -21,7 +25,8 @@ public:
     void showLeadingItems(struct usbCameraInfo_t* info);
 
     void prepareFunction();
-    void runVision();
+    void removeScriptLog(void* sl);
+    void runVision(); // called by the vision thread of the camera
 
     void drawOtherStuff(ImVec2 imgPos, float scale, usbCameraInfo_t *info);
 };
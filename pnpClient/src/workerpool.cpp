@@ -0,0 +1,117 @@
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include "workerpool.h"
+#include "scopelock.h"
+
+#define MAX_WORKERS             3   // plus the calling thread
+#define MIN_ROWS_PER_BAND       16  // smaller jobs are not worth waking the workers for
+
+static pthread_mutex_t callerMutex = PTHREAD_MUTEX_INITIALIZER; // held by whoever is using the pool
+static pthread_mutex_t jobMutex = PTHREAD_MUTEX_INITIALIZER;    // protects everything below
+static pthread_cond_t jobCond = PTHREAD_COND_INITIALIZER;       // a new job has been set
+static pthread_cond_t doneCond = PTHREAD_COND_INITIALIZER;      // the last band of a job is done
+
+static int numWorkers = -1; // -1 until the threads have been started
+
+static unsigned int jobNumber = 0;
+static rowBandFunc_t jobFunc = NULL;
+static void* jobArg = NULL;
+static int jobRows = 0;
+static int jobBands = 0;
+static int nextBand = 0;
+static int bandsDone = 0;
+
+// Call with jobMutex locked. Does bands of the current job until there are none left, unlocking
+// while each band is being done.
+static void doBands()
+{
+    while ( nextBand < jobBands ) {
+        int band = nextBand++;
+        int firstRow = band * jobRows / jobBands;
+        int lastRow = (band + 1) * jobRows / jobBands;
+
+        pthread_mutex_unlock(&jobMutex);
+        jobFunc(jobArg, firstRow, lastRow);
+        pthread_mutex_lock(&jobMutex);
+
+        bandsDone++;
+        if ( bandsDone == jobBands )
+            pthread_cond_signal(&doneCond);
+    }
+}
+
+static void* workerThreadFunc(void* arg)
+{
+    ScopeLock lock(&jobMutex);
+
+    unsigned int lastJob = jobNumber;
+    while ( true ) {
+        while ( jobNumber == lastJob )
+            pthread_cond_wait(&jobCond, &jobMutex);
+        lastJob = jobNumber;
+        doBands();
+    }
+
+    return NULL;
+}
+
+// Call with callerMutex locked.
+static void startWorkers()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int wanted = cpus > 1 ? cpus - 1 : 0;
+    if ( wanted > MAX_WORKERS )
+        wanted = MAX_WORKERS;
+
+    numWorkers = 0;
+    for (int i = 0; i < wanted; i++) {
+        pthread_t thread;
+        if ( pthread_create(&thread, NULL, workerThreadFunc, NULL) != 0 )
+            break;
+        pthread_detach(thread);
+        numWorkers++;
+    }
+}
+
+void runInRowBands(int numRows, rowBandFunc_t func, void* arg)
+{
+    if ( numRows < 2 * MIN_ROWS_PER_BAND || pthread_mutex_trylock(&callerMutex) != 0 ) {
+        func(arg, 0, numRows);
+        return;
+    }
+
+    if ( numWorkers < 0 )
+        startWorkers();
+
+    int bands = numWorkers + 1;
+    if ( bands > numRows / MIN_ROWS_PER_BAND )
+        bands = numRows / MIN_ROWS_PER_BAND;
+
+    if ( bands < 2 ) {
+        pthread_mutex_unlock(&callerMutex);
+        func(arg, 0, numRows);
+        return;
+    }
+
+    {
+        ScopeLock lock(&jobMutex);
+
+        jobFunc = func;
+        jobArg = arg;
+        jobRows = numRows;
+        jobBands = bands;
+        nextBand = 0;
+        bandsDone = 0;
+        jobNumber++;
+        pthread_cond_broadcast(&jobCond);
+
+        doBands();
+
+        while ( bandsDone < jobBands )
+            pthread_cond_wait(&doneCond, &jobMutex);
+    }
+
+    pthread_mutex_unlock(&callerMutex);
+}
@@ -0,0 +1,16 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+// A few threads shared by the vision functions, for splitting the work on a frame into bands
+// of rows. The threads are started the first time they are needed and stay around after that.
+
+// Called with the range of rows to do, from firstRow up to but not including lastRow.
+typedef void (*rowBandFunc_t)(void* arg, int firstRow, int lastRow);
+
+// Calls func for bands covering rows 0 to numRows, in parallel, and returns when they are all
+// done. The calling thread does some of the bands itself. Only one caller can use the pool at
+// a time, if another is already using it (eg. a vision script running on the async script
+// thread at the same time as one on the main thread) the bands are all done by the caller.
+void runInRowBands(int numRows, rowBandFunc_t func, void* arg);
+
+#endif
@@ -8,8 +8,10 @@
 #include <stdexcept>
 #include <cstring>
 
-#include "rpispi.h"
+#include "spiTransport.h"
 #include "RTThread.h"
+#include "rtAllocCheck.h"
+#include "rtStats.h"
 #include "log.h"
 
 bool sigInt = false;
@@ -74,13 +76,21 @@ void RTThread::Run() noexcept {
     //pid_t threadId = syscall(__NR_gettid);
     //printf("RTThread id = %d\n", threadId);
 
-    if ( ! rpispi_init() ) {
+    if ( ! spiTransport->init() ) {
         g_log.log(LL_ERROR, "RTThread returning!");
         return;
     }
 
+    // From here on, nothing in this thread should need the heap
+    markRealtimeThread();
+
     while ( ! sigIntRT ) {
+        struct timespec woke, done;
+        clock_gettime(CLOCK_MONOTONIC, &woke);
         Loop();
+        clock_gettime(CLOCK_MONOTONIC, &done);
+        rtStatsTick(next_wakeup_time_, woke, done, period_ns_);
+
         next_wakeup_time_ = AddTimespecByNs(next_wakeup_time_, period_ns_);
         clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_wakeup_time_, NULL);
     }
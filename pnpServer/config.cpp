@@ -495,7 +495,8 @@ bool readConfigFile()
         for (int i = 0; i < NUM_MOTION_AXES; i++ ) {
             sprintf(buf, "%c", axisNames[i]);
             stepsPerUnit[i] = stepsPerUnitValue.get(buf, 0).asFloat();
-            data.pos_scale[i] = stepsPerUnit[i];
+            if ( i < JOINTS ) // the remaining axes don't exist on the PRU
+                data.pos_scale[i] = stepsPerUnit[i];
             g_log.log(LL_DEBUG, "Config: steps per unit %s = %f", buf, stepsPerUnit[i]);
         }
     }
@@ -1,6 +1,7 @@
 
 #include "homing.h"
 #include "log.h"
+#include "rtLog.h"
 #include "motionGlobals.h"
 #include "estop.h"
 #include "weeny.h"
@@ -85,7 +86,7 @@ void startHomeNextAxis() {
 
     if ( homing_currentAxis == 0 ) {
         //printf("homeNextAxis: finished ok\n");
-        g_log.log(LL_INFO, "Homing offset: %f %f %f", offsetAtHome.x, offsetAtHome.y, offsetAtHome.z);
+        rtLog(LL_INFO, "Homing offset: %f %f %f", offsetAtHome.x, offsetAtHome.y, offsetAtHome.z);
         homing_result = HR_SUCCESS;
         motionMode = MM_NONE; // successful completion
         v = vec3_zero;
@@ -93,7 +94,7 @@ void startHomeNextAxis() {
     }
 
     if ( homing_currentAxis >= 5 ) {
-        g_log.log(LL_ERROR, "homeNextAxis: invalid axis %d\n", homing_currentAxis);
+        rtLog(LL_ERROR, "homeNextAxis: invalid axis %d", homing_currentAxis);
         homing_result = HR_FAIL_CONFIG;
         motionMode = MM_NONE;
         v = vec3_zero;
@@ -114,7 +115,7 @@ void doHomingUpdate() {
         std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
         long long timeSinceHomingStart = std::chrono::duration_cast<std::chrono::milliseconds>(now - homingStartTime).count();
         if ( timeSinceHomingStart > homingTimeout ) {
-            g_log.log(LL_INFO, "homing: axis %d timed out", homing_currentAxis);
+            rtLog(LL_INFO, "homing: axis %d timed out", homing_currentAxis);
             homing_result = HR_FAIL_TIMED_OUT;
             homing_phase = HP_DONE;
             initEstop();
@@ -127,7 +128,7 @@ void doHomingUpdate() {
         int pinState = (data.inputs & (1 << params.triggerPin)) ? 1 : 0;
 
         if ( pinState == params.triggerState ) {
-            g_log.log(LL_INFO, "homing: axis %d triggered", homing_currentAxis);
+            rtLog(LL_INFO, "homing: axis %d triggered", homing_currentAxis);
 
             homing_phase = (homingPhase_e)(homing_phase + 1);
             prepareHomingPlanner();
@@ -179,13 +180,13 @@ bool checkHomingStartConditions() {
                 params.approachspeed2 <= 0 ||
                 params.backoffDistance1 <= 0 ||
                 params.backoffDistance2 <= 0 ) {
-                g_log.log(LL_INFO, "homing: Invalid approach speed or backoff distance (<=0) for axis %d", axis+1);
+                rtLog(LL_INFO, "homing: Invalid approach speed or backoff distance (<=0) for axis %d", axis+1);
                 homing_result = HR_FAIL_CONFIG;
                 return false;
             }
 
             if ( params.triggerPin >= 16 ) {
-                g_log.log(LL_INFO, "homing: Invalid trigger pin (>=16) for axis %d", axis+1);
+                rtLog(LL_INFO, "homing: Invalid trigger pin (>=16) for axis %d", axis+1);
                 homing_result = HR_FAIL_CONFIG;
                 return false;
             }
@@ -193,7 +194,7 @@ bool checkHomingStartConditions() {
             int pinState = (data.inputs & (1 << params.triggerPin)) ? 1 : 0;
             //printf("pinState: %d\n", pinState);
             if ( pinState == params.triggerState ) {
-                g_log.log(LL_INFO, "homing: pin already in trigger state for axis %d", axis+1);
+                rtLog(LL_INFO, "homing: pin already in trigger state for axis %d", axis+1);
                 homing_result = HR_FAIL_LIMIT_ALREADY_TRIGGERED;
                 return false;
             }
@@ -39,7 +39,6 @@ int rtReportCheck(motionStatus *mStatus)
     // make sure any non-'none' messages are caught
     homingResult_e hr = HR_NONE;
     probingResult_e pr = PR_NONE;
-    trajectoryResult_e tr = TR_NONE;
 
     message_fromRT_toNT* d = &datalist_RT2NT[readInd_RT2NT];
     while ( d->ready.load(std::memory_order_acquire) ) {
@@ -50,8 +49,6 @@ int rtReportCheck(motionStatus *mStatus)
             hr = (homingResult_e)d->mStatus.homingResult;
         if ( d->mStatus.probingResult != PR_NONE )
             pr = (probingResult_e)d->mStatus.probingResult;
-        if ( d->mStatus.trajectoryResult != TR_NONE )
-            tr = (trajectoryResult_e)d->mStatus.trajectoryResult;
 
         d->ready.store(false, std::memory_order_release);
         readInd_RT2NT = (readInd_RT2NT + 1) % NUM_RT_REPORT;
@@ -61,7 +58,7 @@ int rtReportCheck(motionStatus *mStatus)
 
     mStatus->homingResult = hr;
     mStatus->probingResult = pr;
-    mStatus->trajectoryResult = tr;
+    mStatus->trajectoryResult = TR_NONE;
 
     return ret;
 }
@@ -129,6 +126,131 @@ int ntQueueLength() {
 
 
 
+//---------------------------------------------------------------------------
+
+// There can never be more programs in flight than there are planners to hold them,
+// so PROGRAM_QUEUE_SIZE is enough here. Results are drained every main loop.
+
+message_program datalist_programs[PROGRAM_QUEUE_SIZE];
+
+int writeInd_programs = 0;
+int readInd_programs = 0;
+
+// The realtime thread only looks at the programs that were queued when its tick started, so that
+// the tick a program is first seen on can be recorded and given again in a replay (see spiRecord.h).
+std::atomic<uint32_t> numProgramsQueued(0);    // ever, by the normal thread
+uint32_t numProgramsVisible = 0;                // realtime thread
+uint32_t numProgramsTaken = 0;                  // realtime thread
+std::atomic<uint32_t> programAbortGeneration(0);
+
+// normal thread hands a fully planned trajectory to the realtime thread
+bool ntQueueProgram(scv::planner* traj, uint16_t programId, float blendStart, uint32_t abortGeneration)
+{
+    message_program* d = &datalist_programs[writeInd_programs];
+    if ( d->ready.load(std::memory_order_acquire) )
+        return false; // caller reports this as a TR_FAIL_BUSY result
+
+    d->traj = traj;
+    d->programId = programId;
+    d->blendStart = blendStart;
+    d->abortGeneration = abortGeneration;
+
+    d->ready.store(true, std::memory_order_release);
+    writeInd_programs = (writeInd_programs + 1) % PROGRAM_QUEUE_SIZE;
+    numProgramsQueued.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+uint32_t rtProgramsQueued()
+{
+    return numProgramsQueued.load(std::memory_order_acquire);
+}
+
+void rtSetProgramsVisible(uint32_t numQueued)
+{
+    numProgramsVisible = numQueued;
+}
+
+// realtime thread looks at the next program without taking it
+bool rtPeekProgram(scv::planner** traj, uint16_t* programId, float* blendStart, uint32_t* abortGeneration)
+{
+    if ( numProgramsTaken == numProgramsVisible )
+        return false;
+
+    message_program* d = &datalist_programs[readInd_programs];
+    if ( ! d->ready.load(std::memory_order_acquire) )
+        return false;
+
+    *traj = d->traj;
+    *programId = d->programId;
+    *blendStart = d->blendStart;
+    *abortGeneration = d->abortGeneration;
+    return true;
+}
+
+void rtPopProgram()
+{
+    if ( numProgramsTaken == numProgramsVisible )
+        return;
+
+    message_program* d = &datalist_programs[readInd_programs];
+    if ( ! d->ready.load(std::memory_order_acquire) )
+        return;
+
+    d->ready.store(false, std::memory_order_release);
+    readInd_programs = (readInd_programs + 1) % PROGRAM_QUEUE_SIZE;
+    numProgramsTaken++;
+}
+
+void rtAbortPrograms()
+{
+    programAbortGeneration.fetch_add(1, std::memory_order_release);
+}
+
+uint32_t getProgramAbortGeneration()
+{
+    return programAbortGeneration.load(std::memory_order_acquire);
+}
+
+
+#define NUM_PROGRAM_RESULTS (2 * PROGRAM_QUEUE_SIZE)
+
+message_programResult datalist_programResults[NUM_PROGRAM_RESULTS];
+
+int writeInd_programResults = 0;
+int readInd_programResults = 0;
+
+void rtProgramResult(uint16_t programId, uint8_t result)
+{
+    message_programResult* d = &datalist_programResults[writeInd_programResults];
+    if ( ! d->ready.load(std::memory_order_acquire) ) {
+
+        d->programId = programId;
+        d->result = result;
+
+        d->ready.store(true, std::memory_order_release);
+        writeInd_programResults = (writeInd_programResults + 1) % NUM_PROGRAM_RESULTS;
+    }
+    else
+        ;//printf("rtProgramResult: no room\n");
+}
+
+// normal thread takes one result at a time, call until it returns false
+bool ntProgramResultCheck(uint16_t* programId, uint8_t* result)
+{
+    message_programResult* d = &datalist_programResults[readInd_programResults];
+    if ( ! d->ready.load(std::memory_order_acquire) )
+        return false;
+
+    *programId = d->programId;
+    *result = d->result;
+
+    d->ready.store(false, std::memory_order_release);
+    readInd_programResults = (readInd_programResults + 1) % NUM_PROGRAM_RESULTS;
+    return true;
+}
+
+
 
 void initInterThread() {
     for (int i = 0; i < NUM_RT_REPORT; i++) {
@@ -137,4 +259,6 @@ void initInterThread() {
     for (int i = 0; i < NUM_NT_COMMAND; i++) {
         memset((void*)datalist_NT2RT, 0, sizeof(datalist_NT2RT));
     }
+    memset((void*)datalist_programs, 0, sizeof(datalist_programs));
+    memset((void*)datalist_programResults, 0, sizeof(datalist_programResults));
 }
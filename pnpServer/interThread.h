@@ -41,7 +41,7 @@ typedef struct motionStatus {
     uint16_t pwm;
     uint8_t homingResult;
     uint8_t probingResult;
-    uint8_t trajectoryResult;
+    uint8_t trajectoryResult; // filled in by the normal thread from the program results
 } motionStatus;
 
 // from normal to realtime thread
@@ -50,7 +50,6 @@ typedef struct motionCommand {
     float speedScale;
     float jogSpeedScale;
     int8_t jogDirs[3];
-    scv::planner* traj;
 
     uint8_t homeAxes[NUM_HOMABLE_AXES]; // 1 indexed, so 0 = skip. Any non-zero will start homing
 
@@ -78,6 +77,24 @@ struct message_fromNT_toRT {
     motionCommand mCmd;
 };
 
+// A planned program waiting to be run. If blendStart is not negative, the program
+// can be started while the previous one is still running, when the traversal time
+// of the previous one reaches blendStart. abortGeneration is the number of aborts the
+// normal thread had seen when it planned the program, see rtAbortPrograms.
+struct message_program {
+    std::atomic<bool> ready;
+    scv::planner* traj;
+    uint16_t programId;
+    float blendStart;
+    uint32_t abortGeneration;
+};
+
+struct message_programResult {
+    std::atomic<bool> ready;
+    uint16_t programId;
+    uint8_t result;
+};
+
 
 void rtReport(motionStatus* sts);
 int rtReportCheck(motionStatus *d);
@@ -87,6 +104,21 @@ void ntCommand(motionCommand *cmd);
 int ntCommandCheck(motionCommand *cmd);
 int ntQueueLength();
 
+bool ntQueueProgram(scv::planner* traj, uint16_t programId, float blendStart, uint32_t abortGeneration);
+uint32_t rtProgramsQueued();
+void rtSetProgramsVisible(uint32_t numQueued);
+bool rtPeekProgram(scv::planner** traj, uint16_t* programId, float* blendStart, uint32_t* abortGeneration);
+void rtPopProgram();
+
+// Programs are planned to start where the one before them ends, which is no longer true once
+// the realtime thread has aborted. Each abort starts a new generation, and programs planned
+// in an earlier one are not run.
+void rtAbortPrograms();
+uint32_t getProgramAbortGeneration();
+
+void rtProgramResult(uint16_t programId, uint8_t result);
+bool ntProgramResultCheck(uint16_t* programId, uint8_t* result);
+
 void initInterThread();
 
 #endif
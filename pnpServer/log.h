@@ -11,6 +11,8 @@ enum logLevel_e {
 
 #ifdef CLIENT
 #include "imgui.h"
+#else
+#include <time.h>
 #endif
 
 #if !defined(IMGUI_USE_STB_SPRINTF) && defined(__MINGW32__) && !defined(__clang__)
@@ -38,6 +40,9 @@ public:
 
     AppLog();
     void log(logLevel_e level, const char* fmt, ...) IM_FMTARGS(3);
+#ifndef CLIENT
+    void logAt(time_t when, logLevel_e level, const char* fmt, ...) IM_FMTARGS(4);
+#endif
 #ifdef CLIENT
     void clear();
     void draw(const char* title, bool* p_open = NULL);
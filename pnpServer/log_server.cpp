@@ -21,19 +21,32 @@ AppLog::AppLog()
 
 char logbuf[2048];
 
-void AppLog::log(logLevel_e level, const char* fmt, ...)
+static void logv(time_t t, logLevel_e level, const char* fmt, va_list args)
 {
-    time_t t = time(NULL);
     struct tm *lt = localtime(&t);
     snprintf(logbuf, 2048, "[%02d/%02d/%02d %02d:%02d:%02d] [%s] ", lt->tm_year%100, lt->tm_mon+1, lt->tm_mday, lt->tm_hour, lt->tm_min, lt->tm_sec, logPrefixArray[level]);
 
-    printf(logbuf);
+    fputs(logbuf, stdout);
+
+    vsnprintf(logbuf, 2048, fmt, args);
+
+    fputs(logbuf, stdout);
+    printf("\n");
+}
 
+void AppLog::log(logLevel_e level, const char* fmt, ...)
+{
     va_list args;
     va_start(args, fmt);
-    vsnprintf(logbuf, 2048, fmt, args);
+    logv(time(NULL), level, fmt, args);
     va_end(args);
+}
 
-    printf(logbuf);
-    printf("\n");
+// For messages that happened a little earlier than they are printed, eg. from the realtime log ring
+void AppLog::logAt(time_t when, logLevel_e level, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    logv(when, level, fmt, args);
+    va_end(args);
 }
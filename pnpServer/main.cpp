@@ -2,6 +2,7 @@
 #include <experimental/filesystem>
 #include <thread>
 #include <cstring>
+#include <cerrno>
 #include <sys/mman.h> // mlockall
 #include <signal.h>
 #include <sys/types.h>
@@ -13,7 +14,9 @@
 
 #include "../common/scv/planner.h"
 #include "weeny.h"
-#include "rpispi.h"
+#include "spiTransport.h"
+#include "weenySim.h"
+#include "spiRecord.h"
 #include "RTThread.h"
 #include "interThread.h"
 
@@ -32,6 +35,11 @@
 #include "estop.h"
 #include "homing.h"
 #include "probing.h"
+#include "programQueue.h"
+#include "rtAllocCheck.h"
+#include "rtStats.h"
+#include "rtLog.h"
+#include "rtTelemetry.h"
 
 //#include "zhelpers.h"
 
@@ -61,6 +69,7 @@ using namespace scv;
 
 volatile bool allowSPI = false;
 unsigned long spiTransferCount = 0;
+bool replayingInputs = false; // commands and programs for the realtime thread come from an SPI recording
 volatile bool estop = false;
 volatile bool allowOverrideExecution = true;
 
@@ -372,7 +381,68 @@ void processOverrides() {
     }
 }
 
-trajectoryResult_e traj_result = TR_NONE;
+uint16_t currentProgramId = 0; // zero when the current trajectory is not from the program queue, eg. estop
+
+// When the next program allows it, it is started before the current one finishes and the two
+// are overlapped, the same way that interpolated moves are blended within a single program.
+scv::planner* blendingTraj = NULL;
+uint16_t blendingProgramId = 0;
+vec3 blendingOrigin = vec3_zero;
+scv::traverseFeedback_t blendingFeedback;
+
+void finishProgram(trajectoryResult_e result) {
+    if ( currentProgramId )
+        rtProgramResult( currentProgramId, result );
+    currentProgramId = 0;
+}
+
+// Anything queued was planned to start where the current program ends, so if the
+// current program does not finish normally none of the queued ones can be run. That includes
+// any the main thread queues before it sees the result, which are dropped by peekNextProgram.
+void abortQueuedPrograms() {
+    rtAbortPrograms();
+
+    if ( blendingTraj ) {
+        rtProgramResult( blendingProgramId, TR_FAIL_ABORTED );
+        blendingTraj = NULL;
+        blendingProgramId = 0;
+    }
+
+    scv::planner* traj = NULL;
+    uint16_t programId = 0;
+    float blendStart = -1;
+    uint32_t abortGeneration = 0;
+    while ( rtPeekProgram(&traj, &programId, &blendStart, &abortGeneration) ) {
+        rtProgramResult( programId, TR_FAIL_ABORTED );
+        rtPopProgram();
+    }
+}
+
+// Like rtPeekProgram, but programs planned before the last abort are aborted and skipped
+bool peekNextProgram(scv::planner** traj, uint16_t* programId, float* blendStart) {
+    uint32_t abortGeneration = 0;
+    while ( rtPeekProgram(traj, programId, blendStart, &abortGeneration) ) {
+        if ( abortGeneration == getProgramAbortGeneration() )
+            return true;
+        rtProgramResult( *programId, TR_FAIL_ABORTED );
+        rtPopProgram();
+    }
+    return false;
+}
+
+bool startNextProgram() {
+    scv::planner* traj = NULL;
+    uint16_t programId = 0;
+    float blendStart = -1;
+    if ( ! peekNextProgram(&traj, &programId, &blendStart) )
+        return false;
+    rtPopProgram();
+
+    currentTraj = traj;
+    currentProgramId = programId;
+    motionMode = MM_TRAJECTORY;
+    return true;
+}
 
 bool anyLimitSwitchTriggered(int &which) { //return false;
     for (int i = 0; i < 3; i++) {
@@ -399,10 +469,11 @@ void doTrajectoryUpdate() {
 
         int which = 0;
         if ( anyLimitSwitchTriggered(which) ) {
-            g_log.log(LL_INFO, "limit switch triggered during trajectory");
+            rtLog(LL_INFO, "limit switch triggered during trajectory");
             // no estop trajectory, just slam to a stop
+            finishProgram( TR_FAIL_LIMIT_TRIGGERED );
+            abortQueuedPrograms();
             currentTraj = NULL;
-            traj_result = TR_FAIL_LIMIT_TRIGGERED;
             motionMode = MM_NONE;
             v = vec3_zero;
             return;
@@ -414,18 +485,51 @@ void doTrajectoryUpdate() {
         for (int i = 0; i < 3; i++) {
             float fe = fabsf( followError[i] );
             if ( fe > 10 ) {
-                g_log.log(LL_INFO, "follow error during trajectory");
+                rtLog(LL_INFO, "follow error during trajectory");
                 // no estop trajectory, just slam to a stop
+                finishProgram( TR_FAIL_FOLLOWING_ERROR );
+                abortQueuedPrograms();
                 currentTraj = NULL;
-                traj_result = TR_FAIL_FOLLOWING_ERROR;
                 motionMode = MM_NONE;
                 v = vec3_zero;
                 return;
             }
         }
 
+        // Interpolated moves leave p and v unchanged when no move is active, which is fine for a single
+        // program, but while blending p is the sum of both so it would be counted again. This one has
+        // already reached the end of its last move if nothing is active, and that is where the next one starts.
+        if ( blendingTraj ) {
+            p = blendingOrigin;
+            v = vec3_zero;
+        }
+
         stillRunning = currentTraj->advanceTraverse( advanceTime, rtCommand.speedScale, &p, &v, rots, &segmentFeedback );
 
+        if ( currentProgramId && ! blendingTraj ) {
+            scv::planner* nextTraj = NULL;
+            uint16_t nextProgramId = 0;
+            float blendStart = -1;
+            if ( peekNextProgram(&nextTraj, &nextProgramId, &blendStart) && blendStart >= 0 && currentTraj->traversal_totalTime >= blendStart ) {
+                rtPopProgram();
+                blendingTraj = nextTraj;
+                blendingProgramId = nextProgramId;
+                blendingOrigin = nextTraj->moves[0].src;
+            }
+        }
+
+        if ( blendingTraj ) {
+            // The next program starts from where this one ends, so only its displacement from
+            // there is added. Its rotations are still at their starting values during the
+            // overlap (no events are allowed there) so the rotations come from this one.
+            vec3 blendP = blendingOrigin;
+            vec3 blendV = vec3_zero;
+            float blendRots[NUM_ROTATION_AXES];
+            blendingTraj->advanceTraverse( advanceTime, rtCommand.speedScale, &blendP, &blendV, blendRots, &blendingFeedback );
+            p += blendP - blendingOrigin;
+            v += blendV;
+        }
+
         v *= rtCommand.speedScale;
 
         if ( segmentFeedback.stillRunning )
@@ -447,10 +551,20 @@ void doTrajectoryUpdate() {
         }
 
         if ( ! stillRunning ) {
-            currentTraj = NULL;
-            traj_result = TR_SUCCESS;
-            motionMode = MM_NONE;
-            v = vec3_zero;
+            finishProgram( TR_SUCCESS );
+
+            // switch straight to the next program if there is one, so there is no idle tick in between
+            if ( blendingTraj ) {
+                currentTraj = blendingTraj;
+                currentProgramId = blendingProgramId;
+                blendingTraj = NULL;
+                blendingProgramId = 0;
+            }
+            else if ( ! startNextProgram() ) {
+                currentTraj = NULL;
+                motionMode = MM_NONE;
+                v = vec3_zero;
+            }
         }
     }
 }
@@ -488,7 +602,7 @@ void doRTReport() {
     vec3 actualPos = vec3(data.pos_fb[0], data.pos_fb[1], data.pos_fb[2]);
 
     if ( motionMode != lastMode ) {
-        printf("Entered mode: %d\n", motionMode);
+        rtLog(LL_DEBUG, "Entered mode: %d", motionMode);
         lastMode = motionMode;
     }
 
@@ -516,18 +630,38 @@ void doRTReport() {
 
     sts.homingResult = homing_result;
     sts.probingResult = probing_result;
-    sts.trajectoryResult = traj_result;
+    sts.trajectoryResult = TR_NONE; // program results are reported separately
 
     rtReport( &sts );
 
     homing_result = HR_NONE;
     probing_result = PR_NONE;
-    traj_result = TR_NONE;
+}
+
+// Done after the frequency outputs are set, so the sample has what will be sent this tick
+void doRTTelemetry() {
+    telemetrySample_t ts;
+    for (int i = 0; i < 3; i++) {
+        ts.targetPos[i] = p[i] + offsetAtHome[i];
+        ts.actualPos[i] = data.pos_fb[i] + offsetAtHome[i];
+        ts.vel[i] = v[i];
+    }
+    memcpy(ts.freq, data.freq, sizeof(ts.freq));
+    ts.inputs = data.inputs;
+    ts.outputs = data.outputs;
+    ts.pressure = data.pressure;
+    ts.loadcell = data.loadcell;
+
+    rtTelemetryPush( ts );
 }
 
 void updateMotion() {
 
+    updateLoadcell( data.loadcell );
+
     if ( estop ) {
+        finishProgram( TR_FAIL_ABORTED );
+        abortQueuedPrograms();
         initEstop();
         estop = false;
     }
@@ -538,14 +672,9 @@ void updateMotion() {
     for (int i = 0; i < 3; i++)
         jogInfos[i].lastDir = rtCommand.jogDirs[i];
 
-    // begin a trajectory if there was one commanded
-    if ( motionMode == MM_NONE ) {        
-        if ( rtCommand.traj ) {
-            currentTraj = rtCommand.traj;
-            rtCommand.traj = NULL;
-            motionMode = MM_TRAJECTORY;
-            traj_result = TR_NONE; // trajectory will stop if this becomes TR_FAIL
-        }
+    // begin a trajectory if there is one queued
+    if ( motionMode == MM_NONE ) {
+        startNextProgram();
     }
 
     // begin homing if commanded to
@@ -596,6 +725,7 @@ void updateMotion() {
 
     doRTReport();
     setFrequencyOutputs();
+    doRTTelemetry();
 }
 
 void updateOutputs() {
@@ -617,6 +747,24 @@ void rtLoop() {
     rtCommand.pwm = INVALID_FLOAT;
 
     bool gotCommand = ntCommandCheck( &rtCommand );
+    uint32_t programsQueued = rtProgramsQueued();
+
+    if ( replayingInputs ) {
+        // whatever the main thread sent is replaced by what was taken on this tick when recording
+        gotCommand = spiReplay.takeCommand( &rtCommand );
+        programsQueued = spiReplay.getProgramsQueued();
+        if ( spiReplay.takeEstop() )
+            estop = true;
+    }
+    else {
+        if ( gotCommand )
+            spiRecordCommand( rtCommand );
+        spiRecordProgramsQueued( programsQueued );
+        if ( estop )
+            spiRecordEstop();
+    }
+
+    rtSetProgramsVisible( programsQueued );
 
     if ( allowSPI ) {
 
@@ -634,11 +782,15 @@ void rtLoop() {
         processOverrides();
 
         hal_float_t yBefore = data.pos_fb[1];
+        struct timespec spiStart, spiEnd;
+        clock_gettime(CLOCK_MONOTONIC, &spiStart);
         spi_transfer();
+        clock_gettime(CLOCK_MONOTONIC, &spiEnd);
+        rtStatsSetSPITime( timespecDiffNs(spiEnd, spiStart) );
         hal_float_t yAfter = data.pos_fb[1];
 
         if ( fabsf(yBefore - yAfter) > 10 ) {
-            printf( "****** %f --> %f\n", yBefore, yAfter );
+            rtLog(LL_WARN, "****** %f --> %f", yBefore, yAfter );
         }
 
         allSPIOk &= data.lastSPIPacketGood;
@@ -698,6 +850,8 @@ void reportActualPosition(int numReports, motionStatus& s, bool force) {
     //printf("spi: %d, rtq: %d, mode: %d, actualPos: %f %f %f, freq: %f\r", s.spiOk, numReports, s.mode, s.actualPos.x, s.actualPos.y, s.actualPos.z, s.freq);
 
 #ifdef DO_ZMQ
+    publishTelemetry(); // every tick, not throttled like the status below
+
     static std::chrono::steady_clock::time_point lastPublishTime = {};
 
     std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
@@ -836,14 +990,31 @@ bool isValidHomingOrder(char* s) {
 }
 
 
-planner plan;
+// Planners that are rebuilt by the realtime thread itself get all their storage up front,
+// so that jogging, homing, probing and estop never need to allocate. Probing is the
+// largest, with a move or sync plus a wait and an output.
+#define RT_PLANNER_MAX_MOVES    4
+#define RT_PLANNER_MAX_EVENTS   4
+
+void reserveRealtimePlanners() {
+    for (int i = 0; i < 3; i++) {
+        jogInfos[i].planner.reserve( RT_PLANNER_MAX_MOVES, RT_PLANNER_MAX_EVENTS );
+    }
+    estopPlanner.reserve( RT_PLANNER_MAX_MOVES, RT_PLANNER_MAX_EVENTS );
+    homingPlanner.reserve( RT_PLANNER_MAX_MOVES, RT_PLANNER_MAX_EVENTS );
+    probingPlanner.reserve( RT_PLANNER_MAX_MOVES, RT_PLANNER_MAX_EVENTS );
+
+    homing_axesRemaining.reserve( sizeof(rtCommand.homeAxes) + 1 );
+}
 
 void updateLimitsInPlans() {
     g_log.log(LL_DEBUG, "updateLimitsInPlans");
     for (int i = 0; i < 3; i++) {
         machineLimits.setLimitsInPlan( &jogInfos[i].planner );
     }
-    machineLimits.setLimitsInPlan( &plan );
+    for (int i = 0; i < PROGRAM_QUEUE_SIZE; i++) {
+        machineLimits.setLimitsInPlan( &programPlanners[i] );
+    }
     machineLimits.setLimitsInPlan( &estopPlanner );
     machineLimits.setLimitsInPlan( &homingPlanner );
     machineLimits.setLimitsInPlan( &probingPlanner );
@@ -908,7 +1079,40 @@ void backupConfig() {
 
 motionStatus mStatus = {0};
 
-int main() {
+int main(int argc, char** argv) {
+
+    // --sim runs without any hardware, using a simulated PRU instead of SPI
+    // --record <file> keeps the last --record-seconds of SPI transfers in a file (see spiRecord.h)
+    // --replay <file> plays back the PRU side of a recording instead of using SPI
+    // --dump <file> prints a recording as CSV and exits
+    bool simulate = false;
+    const char* recordFile = NULL;
+    uint32_t recordSeconds = SPI_RECORD_DEFAULT_SECONDS;
+    const char* replayFile = NULL;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if ( strcmp(argv[i], "--sim") == 0 )
+            simulate = true;
+        else if ( strcmp(argv[i], "--record") == 0 && hasValue )
+            recordFile = argv[++i];
+        else if ( strcmp(argv[i], "--record-seconds") == 0 && hasValue ) {
+            const char* arg = argv[++i];
+            char* end = NULL;
+            errno = 0;
+            long n = strtol(arg, &end, 10);
+            if ( errno || end == arg || *end || n < 1 || n > SPI_RECORD_MAX_SECONDS ) {
+                g_log.log(LL_FATAL, "Invalid --record-seconds: %s (must be 1 to %d)", arg, SPI_RECORD_MAX_SECONDS);
+                return -1;
+            }
+            recordSeconds = n;
+        }
+        else if ( strcmp(argv[i], "--replay") == 0 && hasValue )
+            replayFile = argv[++i];
+        else if ( strcmp(argv[i], "--dump") == 0 && hasValue )
+            return dumpSPIRecording(argv[++i]) ? 0 : -1;
+        else
+            g_log.log(LL_WARN, "Unknown argument: %s", argv[i]);
+    }
 
     g_log.log(LL_INFO, "ScriptPNP server v%d.%d.%d", SCRIPTPNP_SERVER_VERSION_MAJOR, SCRIPTPNP_SERVER_VERSION_MINOR, SCRIPTPNP_SERVER_VERSION_PATCH);
 
@@ -916,7 +1120,26 @@ int main() {
     zmq_version(&major, &minor, &patch);
     g_log.log(LL_INFO, "   ZeroMQ %d.%d.%d", major, minor, patch);
 
-    if ( ! checkPiType() ) {
+    if ( simulate && replayFile ) {
+        g_log.log(LL_FATAL, "Can't use --sim and --replay together");
+        return -1;
+    }
+    if ( recordFile && replayFile ) {
+        g_log.log(LL_FATAL, "Can't use --record and --replay together");
+        return -1;
+    }
+
+    if ( simulate )
+        spiTransport = &simulatedPRU;
+    else if ( replayFile ) {
+        if ( ! spiReplay.open(replayFile) )
+            return -1;
+        spiTransport = &spiReplay;
+        replayingInputs = spiReplay.hasInputs();
+    }
+    bool noHardware = simulate || replayFile;
+
+    if ( ! spiTransport->check() ) {
         g_log.log(LL_FATAL, "Could not determine RPi type!");
         return -1;
     }
@@ -929,12 +1152,19 @@ int main() {
     backupConfig();
 
     if ( !LockMemory() ) {
-        g_log.log(LL_FATAL, "Could not lock memory!");
-        return -1;
+        // not needed for correct results, so without hardware carry on without it (eg. not running as root)
+        if ( noHardware )
+            g_log.log(LL_WARN, "Could not lock memory, continuing anyway");
+        else {
+            g_log.log(LL_FATAL, "Could not lock memory!");
+            return -1;
+        }
     }
 
     resetConfig();
     readConfigFile();
+    if ( simulate )
+        simulatedPRU.configure();
 
     initWeenyData();
     initInterThread();
@@ -960,8 +1190,17 @@ int main() {
     rtCommand.jogSpeedScale = 1;
 
     resetLoadcell();
+    reserveRealtimePlanners();
+
+    // A realtime policy needs root, which the simulation and replay should be able to run without
+    bool realtimePolicy = ! noHardware || getuid() == 0;
+    if ( ! realtimePolicy )
+        g_log.log(LL_WARN, "Not running as root, realtime thread will use the normal scheduler");
+
+    if ( recordFile && ! openSPIRecording(recordFile, recordSeconds) )
+        return -1;
 
-    RTThread rt_thread(98, SCHED_FIFO, 1000000);
+    RTThread rt_thread(realtimePolicy ? 98 : 0, realtimePolicy ? SCHED_FIFO : SCHED_OTHER, 1000000);
     rt_thread.Start();
 
     // Let realtime thread do about 10 iterations to settle the sleep time.
@@ -994,7 +1233,6 @@ int main() {
     motionCommand mCmd = {0};
     mCmd.speedScale = 1;
     mCmd.jogSpeedScale = 1;
-    mCmd.traj = &plan;    
     mCmd.rgb[0] = 0b00010001;
     mCmd.rgb[1] = 0b00000001;
     mCmd.pwm = INVALID_FLOAT;
@@ -1020,7 +1258,9 @@ int main() {
     //setPlanDefaults(estopPlanner);
     //setPlanDefaults(homingPlanner);
 
-    machineLimits.setLimitsInPlan( &plan );
+    for (int i = 0; i < PROGRAM_QUEUE_SIZE; i++) {
+        machineLimits.setLimitsInPlan( &programPlanners[i] );
+    }
     machineLimits.setLimitsInPlan( &estopPlanner );
     machineLimits.setLimitsInPlan( &homingPlanner );
     machineLimits.setLimitsInPlan( &probingPlanner );
@@ -1071,7 +1311,6 @@ int main() {
 
     //int reps = 0;
 
-    uint8_t rejectedTrajectoryResult = TR_NONE;
     uint8_t rejectedProbingResult = PR_NONE;
 
     while ( ! sigInt ) {
@@ -1104,10 +1343,10 @@ int main() {
             forceReport = true;
         }
 
-        if ( rejectedTrajectoryResult != TR_NONE ) {
-            mStatus.trajectoryResult = rejectedTrajectoryResult;
-            rejectedTrajectoryResult = TR_NONE;
-        }
+        drainRTLog();
+        checkRTAllocations();
+
+        mStatus.trajectoryResult = checkProgramResults();
         if ( mStatus.trajectoryResult != TR_NONE ) {
             g_log.log(LL_INFO, "Trajectory result: %s", getTrajectoryResultName(mStatus.trajectoryResult));
             forceReport = true;
@@ -1127,8 +1366,6 @@ int main() {
 
         reportActualPosition(numReports, mStatus, forceReport);
 
-        updateLoadcell( mStatus.loadcell );
-
         std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
 
         commandRequest_t req = {0};
@@ -1136,19 +1373,47 @@ int main() {
         commandMessageType_e msgType = MT_NONE;
         int didRecv = checkCommandRequests(&msgType, &req, &program);
         bool ackOrNack = true; // true if message is recognized
-        if ( didRecv ) {
+        bool resetRTStats = false;
+
+        // When replaying, the recorded programs are planned again as soon as there is room for them,
+        // and the realtime thread is only given each one on the tick it was given it when recording.
+        const spiRecordedProgram_t* replayedProgram = NULL;
+        if ( ! didRecv && replayingInputs && ! isProgramQueueFull() ) {
+            replayedProgram = spiReplay.takeProgram(program);
+            if ( replayedProgram )
+                msgType = MT_SET_PROGRAM;
+        }
+
+        if ( didRecv || replayedProgram ) {
 
             if ( msgType == MT_SET_PROGRAM ) {
+                // Programs still queued from before an abort will not be run, so a new one
+                // starts from the current position instead of where they would have ended.
+                uint32_t abortGeneration = replayedProgram ? replayedProgram->abortGeneration : getProgramAbortGeneration();
+                scv::vec3 queueEndPos;
+                float queueEndRots[NUM_ROTATION_AXES];
+                bool continueQueue = getProgramQueueEnd(abortGeneration, &queueEndPos, queueEndRots);
+
                 /*if ( homing_homedAxes < 0x07 ) {
                     g_log.log(LL_ERROR, "Ignoring program, not homed");
                     rejectedTrajectoryResult = TR_FAIL_NOT_HOMED;
                 }
-                else*/ if ( mStatus.mode != MM_NONE ) {
+                else*/ if ( replayingInputs && ! replayedProgram ) {
+                    g_log.log(LL_ERROR, "Ignoring program, replaying a recording");
+                    rejectProgram(program.programId, TR_FAIL_BUSY);
+                }
+                else if ( isProgramQueueFull() ) {
+                    g_log.log(LL_ERROR, "Ignoring program, queue is full");
+                    rejectProgram(program.programId, TR_FAIL_BUSY);
+                }
+                else if ( ! replayedProgram && ! continueQueue && mStatus.mode != MM_NONE ) {
                     g_log.log(LL_ERROR, "Ignoring program, not in idle state");
+                    rejectProgram(program.programId, TR_FAIL_BUSY);
                 }
                 else {
                     dumpCommandList(program);
 
+                    planner& plan = *getFreeProgramPlanner();
                     plan.clear();
 
                     plan.setCornerBlendMethod(program.cornerBlendMethod);
@@ -1156,14 +1421,38 @@ int main() {
 
                     //printf("Blending: method = %d, max fraction = %f\n", program.cornerBlendMethod, program.cornerBlendMaxFraction);
 
-                    memcpy(plan.traversal_rots, mStatus.actualRots, sizeof(plan.traversal_rots));
-                    memcpy(plan.startingRotations, mStatus.actualRots, sizeof(plan.startingRotations));
+                    // ie. last position, just for convenience in loop below
+                    float startRots[NUM_ROTATION_AXES];
+                    if ( replayedProgram ) {
+                        // start from the same place as when it was recorded, whatever state this thread is in now
+                        m1.dst = replayedProgram->startPos;
+                        memcpy(startRots, replayedProgram->startRots, sizeof(startRots));
+                        for (int i = 0; i < NUM_ROTATION_AXES; i++)
+                            r1[i].dst = replayedProgram->rotateFrom[i];
+                    }
+                    else if ( continueQueue ) {
+                        // continue from where the previous program will finish
+                        m1.dst = queueEndPos;
+                        memcpy(startRots, queueEndRots, sizeof(startRots));
+                        for (int i = 0; i < NUM_ROTATION_AXES; i++)
+                            r1[i].dst = startRots[i];
+                    }
+                    else {
+                        m1.dst = mStatus.actualPos;
+                        memcpy(startRots, mStatus.actualRots, sizeof(startRots));
+                        for (int i = 0; i < NUM_ROTATION_AXES; i++)
+                            r1[i].dst = mStatus.actualRots[0];
+                    }
 
+                    memcpy(plan.traversal_rots, startRots, sizeof(plan.traversal_rots));
+                    memcpy(plan.startingRotations, startRots, sizeof(plan.startingRotations));
 
-                    // ie. last position, just for convenience in loop below
-                    m1.dst = mStatus.actualPos;
+                    spiRecordedProgram_t recorded;
+                    recorded.startPos = m1.dst;
+                    memcpy(recorded.startRots, startRots, sizeof(recorded.startRots));
                     for (int i = 0; i < NUM_ROTATION_AXES; i++)
-                        r1[i].dst = mStatus.actualRots[0];
+                        recorded.rotateFrom[i] = r1[i].dst;
+                    recorded.homeOffset = replayedProgram ? replayedProgram->homeOffset : offsetAtHome;
 
                     // if any move would be outside machine work area, abandon entire program
                     bool programIsValid = true;
@@ -1311,20 +1600,33 @@ int main() {
 
                     if ( programIsValid ) {
                         plan.printConstraints();
-                        plan.calculateMoves();
-                        plan.addOffsetToMoves(offsetAtHome);
-                        plan.printConstraints();
-                        plan.printMoves();
-                        //plan.printSegments();
-
-                        plan.resetTraverse();
-
-                        mCmd.traj = &plan;
-                        shouldSendRTCommand = true;
+                        if ( ! plan.calculateMoves() ) {
+                            // bad limits, or more moves than the planner has room for
+                            g_log.log(LL_ERROR, "Ignoring program, could not calculate moves");
+                            rejectProgram(program.programId, TR_FAIL_CONFIG);
+                        }
+                        else {
+                            plan.addOffsetToMoves(recorded.homeOffset);
+                            plan.printConstraints();
+                            plan.printMoves();
+                            //plan.printSegments();
+
+                            plan.resetTraverse();
+
+                            float endRots[NUM_ROTATION_AXES];
+                            for (int i = 0; i < NUM_ROTATION_AXES; i++)
+                                endRots[i] = r1[i].dst;
+                            recorded.programId = replayedProgram ? replayedProgram->programId : program.programId;
+                            recorded.abortGeneration = abortGeneration;
+                            recorded.blendStart = replayedProgram ? replayedProgram->blendStart : getProgramBlendStart(abortGeneration, &plan);
+                            recorded.programId = queueProgram(&plan, recorded.programId, abortGeneration, recorded.blendStart, m1.dst, endRots);
+                            if ( recorded.programId && ! replayedProgram )
+                                spiRecordProgram(recorded, program);
+                        }
                     }
                     else {
                         g_log.log(LL_ERROR, "Ignoring program, would move outside work area");
-                        rejectedTrajectoryResult = TR_FAIL_OUTSIDE_BOUNDS;
+                        rejectProgram(program.programId, TR_FAIL_OUTSIDE_BOUNDS);
                     }
                 }
             }
@@ -1336,7 +1638,6 @@ int main() {
                 if ( req.setSpeedScale.scale >= 0.1 && req.setSpeedScale.scale <= 1 ) {
                     mCmd.speedScale = req.setSpeedScale.scale;
                     speedScale = mCmd.speedScale;
-                    mCmd.traj = NULL;
                     shouldSendRTCommand = true;
                 }
             }
@@ -1344,15 +1645,13 @@ int main() {
                 if ( req.setSpeedScale.scale >= 0.1 && req.setSpeedScale.scale <= 1 ) {
                     mCmd.jogSpeedScale = req.setSpeedScale.scale;
                     jogSpeedScale = mCmd.jogSpeedScale;
-                    mCmd.traj = NULL;
                     shouldSendRTCommand = true;
                 }
             }
             else if ( req.type == MT_SET_JOG_STATUS ) {
-                if ( mStatus.mode == MM_NONE || mStatus.mode == MM_JOG ) {
+                if ( isProgramQueueEmpty() && (mStatus.mode == MM_NONE || mStatus.mode == MM_JOG) ) {
                     memcpy(jogDirs, req.setJogStatus.jogDirs, sizeof(mCmd.jogDirs));
                     memcpy(mCmd.jogDirs, req.setJogStatus.jogDirs, sizeof(mCmd.jogDirs));
-                    mCmd.traj = NULL;
                     shouldSendRTCommand = true;
                     lastJogRecvTime = now;
                 }
@@ -1389,7 +1688,6 @@ int main() {
             else if ( req.type == MT_SET_DIGITAL_OUTPUTS ) {
                 mCmd.outputBits = req.setDigitalOutputs.bits;
                 mCmd.outputChanged = req.setDigitalOutputs.changed;
-                mCmd.traj = NULL;
                 shouldSendRTCommand = true;
 
                 g_log.log(LL_DEBUG,"motionMode = %s", getModeName(motionMode));
@@ -1399,35 +1697,31 @@ int main() {
             else if ( req.type == MT_SET_PWM_OUTPUT ) {
                 mCmd.pwm = req.setPWMOutput.val / 65535.0f;
                 //printf("pwm: %d\n", mCmd.pwm);
-                mCmd.traj = NULL;
                 shouldSendRTCommand = true;
             }
             else if ( req.type == MT_SET_RGB_OUTPUT ) {
                 memcpy(mCmd.rgb, req.setRGBOutput.rgb, 6);
-                mCmd.traj = NULL;
                 shouldSendRTCommand = true;
             }
             else if ( req.type == MT_SET_TMC_PARAMS ) {
                 memcpy(mCmd.microsteps, req.setTMCParams.microsteps, JOINTS*sizeof(uint16_t));
                 memcpy(mCmd.rmsCurrent, req.setTMCParams.rmsCurrent, JOINTS*sizeof(uint16_t));
-                mCmd.traj = NULL;
                 shouldSendRTCommand = true;
             }
             else if ( req.type == MT_HOME_AXES ) {
-                if ( mStatus.mode != MM_NONE ) {
+                if ( mStatus.mode != MM_NONE || ! isProgramQueueEmpty() ) {
                     g_log.log(LL_WARN, "Ignoring homing request, not in idle state.");
                 }
                 else {
                     memcpy(mCmd.homeAxes, req.homeAxes.ordering, sizeof(mCmd.homeAxes));
                     resetAxesAboutToHome( mCmd.homeAxes );
-                    mCmd.traj = NULL;
                     shouldSendRTCommand = true;
                     lastHomeRecvTime = now;
                     g_log.log(LL_INFO, "Homing requested.");
                 }
             }
             else if ( req.type == MT_HOME_ALL ) {
-                if ( mStatus.mode != MM_NONE ) {
+                if ( mStatus.mode != MM_NONE || ! isProgramQueueEmpty() ) {
                     g_log.log(LL_WARN, "Ignoring homing request, not in idle state.");
                 }
                 else {
@@ -1444,7 +1738,6 @@ int main() {
                     }
                     resetAxesAboutToHome(mCmd.homeAxes);
 
-                    mCmd.traj = NULL;
                     shouldSendRTCommand = true;
                     lastHomeRecvTime = now;
                     g_log.log(LL_INFO, "Homing requested.");
@@ -1464,7 +1757,8 @@ int main() {
                         if ( fabs(req.configSteps.perUnit[i]) >= 0.05 ) {
                             // todo: change actual data.pos_scale
                             stepsPerUnit[i] = req.configSteps.perUnit[i];
-                            data.pos_scale[i] = req.configSteps.perUnit[i];
+                            if ( i < JOINTS )
+                                data.pos_scale[i] = req.configSteps.perUnit[i];
                             g_log.log(LL_INFO, "Steps per unit %c set to %f", axisNames[i], req.configSteps.perUnit[i]);
                         }
                     }
@@ -1788,13 +2082,16 @@ int main() {
 
                 saveConfigToFile();
             }
+            else if ( req.type == MT_RT_STATS_FETCH ) {
+                resetRTStats = req.rtStatsFetch.reset; // after the reply has been filled
+            }
             else if ( req.type == MT_PROBE ) {
                 //if ( homing_homedAxes < 0x07 ) {
                 if ( (homing_homedAxes & 0x04) == 0 ) { // z axis only required
                     g_log.log(LL_ERROR, "Ignoring probe request, not homed");
                     rejectedProbingResult = TR_FAIL_NOT_HOMED;
                 }
-                else if ( mStatus.mode != MM_NONE ) {
+                else if ( mStatus.mode != MM_NONE || ! isProgramQueueEmpty() ) {
                     g_log.log(LL_WARN, "Ignoring probing request, not in idle state.");
                 }
                 else {
@@ -1803,7 +2100,6 @@ int main() {
                     mCmd.probeZ = req.probe.z;
                     mCmd.probeFlags = req.probe.flags;
 
-                    mCmd.traj = NULL;
                     shouldSendRTCommand = true;
                     g_log.log(LL_INFO, "Probing requested.");
                 }
@@ -1813,7 +2109,11 @@ int main() {
                 ackOrNack = false;
             }
 
-            processCommandReply(&req, ackOrNack);
+            if ( ! replayedProgram )
+                processCommandReply(&req, ackOrNack);
+
+            if ( resetRTStats )
+                requestRTStatsReset();
         }
 
 
@@ -1824,7 +2124,6 @@ int main() {
                 for (int i = 0; i < 3; i++)
                     jogDirs[i] = 0;
                 memcpy(mCmd.jogDirs, jogDirs, sizeof(mCmd.jogDirs));
-                mCmd.traj = NULL;
                 shouldSendRTCommand = true;
             }
         }
@@ -1838,7 +2137,6 @@ int main() {
 
         if ( shouldSendRTCommand ) {
             ntCommand( &mCmd );
-            mCmd.traj = NULL;
         }
 
         //mCmd.pwm = INVALID_FLOAT;
@@ -1868,6 +2166,12 @@ int main() {
 
     rt_thread.Join();
 
+    drainRTLog();
+
+    closeSPIRecording();
+    if ( replayFile )
+        spiReplay.printSummary();
+
     rtReportCheck(&mStatus);
     g_log.log(LL_INFO, "Exiting with position %f, %f, %f", mStatus.actualPos.x, mStatus.actualPos.y, mStatus.actualPos.z);
     g_log.log(LL_INFO, "maxFollowError %f, %f, %f", maxFollowError.x, maxFollowError.y, maxFollowError.z);
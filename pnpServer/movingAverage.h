@@ -2,11 +2,13 @@
 #ifndef MOVING_AVERAGE_H
 #define MOVING_AVERAGE_H
 
-template<typename rawType, int numReadings>
+// totalType must be able to hold numReadings times the largest reading, eg. int64_t for raw
+// 24 bit load cell values over 1000 readings
+template<typename rawType, int numReadings, typename totalType = rawType>
 class MovingAverage {
     int readingCount;
     rawType readings[numReadings];
-    rawType total;
+    totalType total;
     rawType delta; // delta between newest and oldest readings
     int index;
     int numReadingsTaken;
@@ -1,7 +1,9 @@
 #include <stdio.h>
+#include <atomic>
 
 #include "probing.h"
 #include "log.h"
+#include "rtLog.h"
 #include "motionGlobals.h"
 #include "estop.h"
 #include "weeny.h"
@@ -26,6 +28,7 @@ uint16_t pressureBeforeSniff = 0;
 uint16_t probing_vac_baseline = 0;
 bool probing_vac_contacted = false;
 bool isLoadcellTriggered = false;
+float loadcellTriggerZ = 0; // actual Z position when the load cell threshold was crossed
 
 extern motionStatus mStatus;
 
@@ -151,7 +154,7 @@ void prepareProbingPlanner() {
     float maxZLimit = machineLimits.posLimitUpper.z - offsetAtHome.z;
     if ( zDest > maxZLimit ) {
         zDest = maxZLimit;
-        g_log.log(LL_DEBUG,"prepareProbingPlanner, limiting backoff to workspace");
+        rtLog(LL_DEBUG,"prepareProbingPlanner, limiting backoff to workspace");
     }
 
     probingPlanner.clear();
@@ -175,7 +178,7 @@ void prepareProbingPlanner() {
 
 void startProbe() {
 
-    g_log.log(LL_DEBUG,"startProbe");
+    rtLog(LL_DEBUG,"startProbe");
 
     probing_phase_vacuum = PPVA_SNIFFING;
     probing_vac_contacted = false;
@@ -227,12 +230,12 @@ void doProbingUpdate_vacuum() {
 
             if ( probing_phase_vacuum_sniffCount == 1 ) {
                 probing_vac_baseline = pressureDiff;
-                printf("probing_vac_baseline: %d\n", probing_vac_baseline);
+                rtLog(LL_DEBUG, "probing_vac_baseline: %d", probing_vac_baseline);
             }
             else {
-                printf("Pressure diff: %d\n", pressureDiff );
+                rtLog(LL_DEBUG, "Pressure diff: %d", pressureDiff);
                 if ( pressureDiff < (probing_vac_baseline * 0.45) ) {
-                    printf("Contacted!\n");
+                    rtLog(LL_DEBUG, "Contacted!");
                     probing_resultHeight = mStatus.actualPos.z; // this is quantized to steps
                     probing_vac_contacted = true;
                 }
@@ -250,7 +253,7 @@ void doProbingUpdate_vacuum() {
 
             if ( probing_vac_contacted ) {
                 probing_phase = PP_BACKOFF2;
-                printf("Resuming normal backoff2\n");
+                rtLog(LL_DEBUG, "Resuming normal backoff2");
                 prepareProbingPlanner(); // <---- back to normal procedure
                 return;
             }
@@ -305,10 +308,13 @@ void doProbingUpdate() {
     if ( probing_phase == PP_APPROACH1 || probing_phase == PP_APPROACH2 ) {
 
         if ( isProbeTriggered() ) {
-            printf("probing: triggered\n");
+            rtLog(LL_DEBUG, "probing: triggered");
             if ( probing_phase == PP_APPROACH2 ) {
-                probing_resultHeight = mStatus.actualPos.z; // this is quantized to steps
-                printf("probing_resultHeight: %f\n", probing_resultHeight);
+                if ( probing_type == PT_LOADCELL )
+                    probing_resultHeight = loadcellTriggerZ;
+                else
+                    probing_resultHeight = mStatus.actualPos.z; // this is quantized to steps
+                rtLog(LL_DEBUG, "probing_resultHeight: %f", probing_resultHeight);
             }
             probing_phase = (probingPhase_e)(probing_phase + 1);
             prepareProbingPlanner();
@@ -328,7 +334,7 @@ void doProbingUpdate() {
 
     if ( probing_phase == PP_APPROACH1 || probing_phase == PP_APPROACH2 ) {
         if ( ! stillRunning ) {
-            printf("probing: no hit detected\n");
+            rtLog(LL_DEBUG, "probing: no hit detected");
             probing_result = PR_FAIL_NOT_TRIGGERED;
             probing_phase = PP_DONE;
             motionMode = MM_NONE;
@@ -340,7 +346,7 @@ void doProbingUpdate() {
             // backoff just finished
             probing_phase = (probingPhase_e)(probing_phase + 1);
             if ( probing_phase == PP_DONE ) {
-                printf("probing: completed\n");
+                rtLog(LL_DEBUG, "probing: completed");
                 probing_result = PR_SUCCESS;
                 probing_phase = PP_DONE;
                 motionMode = MM_NONE;
@@ -350,7 +356,7 @@ void doProbingUpdate() {
                 if ( probing_phase == PP_APPROACH2 ) {
                     // just entered second approach phase, check if already triggered
                     if ( isProbeTriggered() ) {
-                        printf("probing: backoff too short?\n");
+                        rtLog(LL_DEBUG, "probing: backoff too short?");
                         probing_result = PR_FAIL_ALREADY_TRIGGERED;
                         probing_phase = PP_DONE;
                         motionMode = MM_NONE;
@@ -364,7 +370,7 @@ void doProbingUpdate() {
             // still backing off
             if ( ! isProbeTriggered() ) {
                 // trigger has been cleared can start approach2 early
-                printf("probing: trigger cleared\n");
+                rtLog(LL_DEBUG, "probing: trigger cleared");
                 probing_phase = (probingPhase_e)(probing_phase + 1);
                 prepareProbingPlanner();
             }
@@ -378,27 +384,27 @@ bool checkProbingStartConditions() {
         probingParams.approachspeed2 <= 0 ||
         probingParams.backoffDistance1 <= 0 ||
         probingParams.backoffDistance2 < 0 ) {
-        g_log.log(LL_INFO, "probing: invalid approach speed or backoff distance (<=0)");
+        rtLog(LL_INFO, "probing: invalid approach speed or backoff distance (<=0)");
         probing_result = PR_FAIL_CONFIG;
         return false;
     }
 
     if ( probingParams.digitalTriggerPin >= 16 ) {
-        g_log.log(LL_INFO, "probing: invalid trigger pin (>=16)");
+        rtLog(LL_INFO, "probing: invalid trigger pin (>=16)");
         probing_result = PR_FAIL_CONFIG;
         return false;
     }
 
     if ( rtCommand.probeZ < machineLimits.posLimitLower.z ||
         rtCommand.probeZ > machineLimits.posLimitUpper.z ) {
-        g_log.log(LL_INFO, "probing: invalid Z depth");
+        rtLog(LL_INFO, "probing: invalid Z depth");
         probing_result = PR_FAIL_CONFIG;
         return false;
     }
 
     /*if ( rtCommand.probeType == (PT_LOADCELL+1) ) {
         if ( rtCommand.probeWeight < 0 ) {
-            g_log.log(LL_INFO, "probing: invalid weight for loadcell probe");
+            rtLog(LL_INFO, "probing: invalid weight for loadcell probe");
             probing_result = PR_FAIL_CONFIG;
             return false;
         }
@@ -406,22 +412,22 @@ bool checkProbingStartConditions() {
 
     if ( rtCommand.probeType == (PT_VACUUM+1) ) {
         if ( probingParams.vacuumSniffPin >= 16 ) {
-            g_log.log(LL_INFO, "probing: invalid vacuum pin for vacuum probe");
+            rtLog(LL_INFO, "probing: invalid vacuum pin for vacuum probe");
             probing_result = PR_FAIL_CONFIG;
             return false;
         }
         if ( probingParams.vacuumSniffTimeMs <= 0 ) {
-            g_log.log(LL_INFO, "probing: invalid sniff time for vacuum probe");
+            rtLog(LL_INFO, "probing: invalid sniff time for vacuum probe");
             probing_result = PR_FAIL_CONFIG;
             return false;
         }
         if ( probingParams.vacuumReplenishTimeMs < 0 ) {
-            g_log.log(LL_INFO, "probing: invalid replenish time for vacuum probe");
+            rtLog(LL_INFO, "probing: invalid replenish time for vacuum probe");
             probing_result = PR_FAIL_CONFIG;
             return false;
         }
         if ( probingParams.vacuumStep < 0.001 ) {
-            g_log.log(LL_INFO, "probing: invalid step distance for vacuum probe");
+            rtLog(LL_INFO, "probing: invalid step distance for vacuum probe");
             probing_result = PR_FAIL_CONFIG;
             return false;
         }
@@ -434,7 +440,7 @@ bool checkProbingStartConditions() {
     // for vaccum sniff, how to know if it's already touching?
 
     if ( isProbeTriggered() ) {
-        g_log.log(LL_INFO, "probing: already in triggered state");
+        rtLog(LL_INFO, "probing: already in triggered state");
         probing_result = PR_FAIL_ALREADY_TRIGGERED;
         return false;
     }
@@ -463,16 +469,28 @@ extern motionMode_e motionMode;
 int32_t loadcellCalibrationRawOffset = 1000;
 float loadcellCalibrationWeight = 100;
 
-MovingAverage<int32_t, 200> baselineMA;    // 1 sec
+// The baseline and trigger are updated by the realtime thread every tick, so a contact is seen
+// on the same tick as the reading that crosses the threshold.
+MovingAverage<int32_t, 1000, int64_t> baselineMA;    // 1 sec
 //MovingAverage<int32_t,   2> measurementMA; // 0.01 sec
 
+std::atomic<bool> loadcellResetRequested(true);
+std::atomic<float> loadcellBaseline(0);
+
+// main thread, the realtime thread does the actual reset on its next tick
 void resetLoadcell() {
-    baselineMA.reset();
-    //measurementMA.reset();
+    loadcellResetRequested = true;
 }
 
+// realtime thread
 void updateLoadcell(int32_t loadCellRaw) {
 
+    if ( loadcellResetRequested.exchange(false) ) {
+        baselineMA.reset();
+        //measurementMA.reset();
+    }
+
+    bool wasTriggered = isLoadcellTriggered;
     isLoadcellTriggered = false;
 
     int fullCount = baselineMA.getReadingCount();
@@ -480,6 +498,7 @@ void updateLoadcell(int32_t loadCellRaw) {
     // always use for baseline if just started
     if ( baselineMA.getNumReadingsTaken() < fullCount ) {
         baselineMA.addReading(loadCellRaw);
+        loadcellBaseline.store( baselineMA.getAverage(), std::memory_order_relaxed );
         //measurementMA.reset();
         return;
     }
@@ -496,6 +515,9 @@ void updateLoadcell(int32_t loadCellRaw) {
         ( probingParams.loadcellTriggerThreshold > 0 && loadCellRaw > threshold ) ||
         ( probingParams.loadcellTriggerThreshold < 0 && loadCellRaw < threshold );
 
+    if ( isLoadcellTriggered && ! wasTriggered )
+        loadcellTriggerZ = data.pos_fb[2] + offsetAtHome.z; // same as mStatus.actualPos.z
+
     // only update baseline while not probing, or during first approach which tends to be longer and baseline slowly moves
     bool allowBaselineAdjustment =
         (motionMode == MM_NONE) ||
@@ -512,10 +534,12 @@ void updateLoadcell(int32_t loadCellRaw) {
     }
 
     //measurementMA.addReading(loadCellRaw);
+
+    loadcellBaseline.store( baselineMA.getAverage(), std::memory_order_relaxed );
 }
 
 float getLoadCellBaseline() {
-    return baselineMA.getAverage();
+    return loadcellBaseline.load(std::memory_order_relaxed);
 }
 
 
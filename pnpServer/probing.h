@@ -31,8 +31,8 @@ void startProbe();
 void doProbingUpdate();
 bool checkProbingStartConditions();
 
-void resetLoadcell();
-void updateLoadcell(int32_t loadCellRaw);
+void resetLoadcell();                       // main thread
+void updateLoadcell(int32_t loadCellRaw);   // realtime thread, every tick
 float getLoadCellBaseline();
 
 #endif
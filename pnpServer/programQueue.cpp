@@ -0,0 +1,206 @@
+
+#include <string.h>
+#include <algorithm>
+
+#include "programQueue.h"
+#include "interThread.h"
+#include "log.h"
+
+using namespace scv;
+
+struct queuedProgram {
+    uint16_t programId;
+    planner* plan;
+    uint32_t abortGeneration;           // see rtAbortPrograms
+    vec3 endPos;                        // without home offset, same as the commands it was made from
+    float endRots[NUM_ROTATION_AXES];
+};
+
+planner programPlanners[PROGRAM_QUEUE_SIZE];
+
+// Programs that have been handed to the realtime thread and have no result yet, in the order they will run.
+queuedProgram programQueue[PROGRAM_QUEUE_SIZE];
+int programQueueDepth = 0;
+
+uint16_t nextProgramId = 1;
+
+programResult_t programResultHistory[PROGRAM_RESULT_HISTORY];
+uint16_t programResultCount = 0;
+trajectoryResult_e newestProgramResult = TR_NONE; // most recent result since last checkProgramResults
+
+bool isProgramQueueEmpty() {
+    return programQueueDepth == 0;
+}
+
+bool isProgramQueueFull() {
+    return programQueueDepth >= PROGRAM_QUEUE_SIZE;
+}
+
+scv::planner* getFreeProgramPlanner() {
+    for (int i = 0; i < PROGRAM_QUEUE_SIZE; i++) {
+        planner* plan = &programPlanners[i];
+        bool inUse = false;
+        for (int k = 0; k < programQueueDepth; k++) {
+            if ( programQueue[k].plan == plan )
+                inUse = true;
+        }
+        if ( ! inUse )
+            return plan;
+    }
+    return NULL;
+}
+
+// Where the last queued program will finish, so that the next one can continue from there.
+// Returns false if the queue is empty, or the realtime thread has aborted since the last one
+// was planned (it will not be run), in which case the current position should be used.
+bool getProgramQueueEnd(uint32_t abortGeneration, scv::vec3* pos, float* rots) {
+    if ( programQueueDepth == 0 )
+        return false;
+    queuedProgram& last = programQueue[programQueueDepth-1];
+    if ( last.abortGeneration != abortGeneration )
+        return false;
+    *pos = last.endPos;
+    memcpy(rots, last.endRots, sizeof(last.endRots));
+    return true;
+}
+
+// Returns the traversal time of 'prev' at which 'next' can be started, so that the last move
+// of one overlaps the first move of the other in the same way that interpolated moves do
+// within a single program. Returns -1 if they should just run one after the other.
+float getSeamBlendStart(planner& prev, planner& next) {
+
+    if ( prev.cornerBlendMethod != CBM_INTERPOLATED_MOVES || next.cornerBlendMethod != CBM_INTERPOLATED_MOVES )
+        return -1;
+
+    if ( prev.moves.empty() || next.moves.empty() )
+        return -1;
+
+    move& m0 = prev.moves.back();
+    move& m1 = next.moves.front();
+
+    if ( m0.moveType != MT_NORMAL || m1.moveType != MT_NORMAL || m1.blendType == CBT_NONE )
+        return -1;
+
+    // If anything else is still happening at the end of the previous program (eg. a rotation or a
+    // delayed output) it must finish before the next program starts, so no overlap is possible.
+    float prevEnd = m0.scheduledTime + m0.duration;
+    if ( prev.getTraverseTime() > prevEnd + 0.0001f )
+        return -1;
+
+    // Same rules as calculateSchedules, if a move is already blended at its other end then
+    // only 0.49 of it can be used here, so that no more than two moves are ever blended together.
+    bool m0BlendedAlready = prev.moves.size() > 1 && m0.blendType != CBT_NONE && prev.moves[prev.moves.size()-2].moveType == MT_NORMAL;
+    bool m1BlendedAlready = next.moves.size() > 1 && next.moves[1].blendType != CBT_NONE && next.moves[1].moveType == MT_NORMAL;
+
+    float allowableFraction0 = std::min(m0BlendedAlready ? 0.49f : 1.0f, (float)prev.maxOverlapFraction);
+    float allowableFraction1 = std::min(m1BlendedAlready ? 0.49f : 1.0f, (float)next.maxOverlapFraction);
+
+    float blendTime = std::min(allowableFraction0 * m0.duration, allowableFraction1 * m1.duration);
+    if ( blendTime <= 0 )
+        return -1;
+
+    // While overlapping, the output state comes from the previous program, so the next one
+    // must not have any events (outputs, rotations) that would occur in that time.
+    for (delayableEvent& de : next.delayableEvents) {
+        if ( de.triggerTime + de.delay < blendTime )
+            return -1;
+    }
+
+    return prevEnd - blendTime;
+}
+
+void addProgramResult(uint16_t programId, trajectoryResult_e result) {
+    programResult_t& pr = programResultHistory[programResultCount % PROGRAM_RESULT_HISTORY];
+    pr.programId = programId;
+    pr.result = result;
+    programResultCount++;
+
+    newestProgramResult = result;
+}
+
+// Uses the ID the client gave the program, so it can tell which result is for which program.
+uint16_t getProgramId(uint16_t requestedId) {
+    if ( requestedId != 0 )
+        return requestedId;
+    uint16_t id = nextProgramId++;
+    if ( nextProgramId == 0 )
+        nextProgramId = 1; // zero is never used
+    return id;
+}
+
+// How far into the last queued program the given one could be started, or -1 if it must wait for it to finish.
+float getProgramBlendStart(uint32_t abortGeneration, scv::planner* plan) {
+    if ( programQueueDepth == 0 || programQueue[programQueueDepth-1].abortGeneration != abortGeneration )
+        return -1;
+    return getSeamBlendStart( *programQueue[programQueueDepth-1].plan, *plan );
+}
+
+// The plan should be fully calculated with the home offset applied and traverse reset.
+uint16_t queueProgram(scv::planner* plan, uint16_t requestedId, uint32_t abortGeneration, float blendStart, scv::vec3 endPos, float* endRots) {
+
+    if ( isProgramQueueFull() ) {
+        g_log.log(LL_ERROR, "queueProgram: queue is full");
+        return 0;
+    }
+
+    uint16_t id = getProgramId(requestedId);
+
+    if ( ! ntQueueProgram(plan, id, blendStart, abortGeneration) ) {
+        g_log.log(LL_ERROR, "queueProgram: no room to hand program to realtime thread");
+        addProgramResult(id, TR_FAIL_BUSY);
+        return 0;
+    }
+
+    queuedProgram& qp = programQueue[programQueueDepth++];
+    qp.programId = id;
+    qp.plan = plan;
+    qp.abortGeneration = abortGeneration;
+    qp.endPos = endPos;
+    memcpy(qp.endRots, endRots, sizeof(qp.endRots));
+
+    g_log.log(LL_DEBUG, "Queued program %d (depth %d, blend start %f)", id, programQueueDepth, blendStart);
+
+    return id;
+}
+
+// For programs that were never given to the realtime thread, so that every
+// program the client sends still gets exactly one result.
+void rejectProgram(uint16_t requestedId, trajectoryResult_e result) {
+    addProgramResult(getProgramId(requestedId), result);
+}
+
+// Collects results from the realtime thread and frees the planners of finished programs.
+// Returns the most recent result since the last call, or TR_NONE if there was none.
+trajectoryResult_e checkProgramResults() {
+
+    uint16_t programId = 0;
+    uint8_t result = TR_NONE;
+    while ( ntProgramResultCheck(&programId, &result) ) {
+
+        for (int i = 0; i < programQueueDepth; i++) {
+            if ( programQueue[i].programId == programId ) {
+                for (int k = i; k < programQueueDepth-1; k++)
+                    programQueue[k] = programQueue[k+1];
+                programQueueDepth--;
+                break;
+            }
+        }
+
+        g_log.log(LL_DEBUG, "Program %d result: %s", programId, getTrajectoryResultName(result));
+
+        addProgramResult(programId, (trajectoryResult_e)result);
+    }
+
+    trajectoryResult_e ret = newestProgramResult;
+    newestProgramResult = TR_NONE;
+    return ret;
+}
+
+void fillProgramQueueReport(clientReport_t* apr) {
+    apr->programQueueDepth = programQueueDepth;
+    memset(apr->queuedProgramIds, 0, sizeof(apr->queuedProgramIds));
+    for (int i = 0; i < programQueueDepth; i++)
+        apr->queuedProgramIds[i] = programQueue[i].programId;
+    apr->programResultCount = programResultCount;
+    memcpy(apr->programResults, programResultHistory, sizeof(apr->programResults));
+}
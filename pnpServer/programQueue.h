@@ -0,0 +1,24 @@
+#ifndef PROGRAM_QUEUE_H
+#define PROGRAM_QUEUE_H
+
+#include "../common/scv/planner.h"
+#include "../common/pnpMessages.h"
+
+// Programs received from the client are planned in the main thread and handed to
+// the realtime thread, which runs them back to back. Each program gets its own planner
+// from this pool, which is not reused until the realtime thread reports a result for it.
+extern scv::planner programPlanners[PROGRAM_QUEUE_SIZE];
+
+bool isProgramQueueEmpty();
+bool isProgramQueueFull();
+scv::planner* getFreeProgramPlanner();
+bool getProgramQueueEnd(uint32_t abortGeneration, scv::vec3* pos, float* rots);
+
+float getProgramBlendStart(uint32_t abortGeneration, scv::planner* plan);
+uint16_t queueProgram(scv::planner* plan, uint16_t requestedId, uint32_t abortGeneration, float blendStart, scv::vec3 endPos, float* endRots);
+void rejectProgram(uint16_t requestedId, trajectoryResult_e result);
+trajectoryResult_e checkProgramResults();
+
+void fillProgramQueueReport(clientReport_t* apr);
+
+#endif
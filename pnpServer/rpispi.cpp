@@ -21,6 +21,7 @@
 #include "spi-dw.c"
 
 #include "log.h"
+#include "spiTransport.h"
 
 #define RPI5_RP1_PERI_BASE 0x7c000000
 
@@ -398,9 +399,18 @@ bool rpispi_close() {
     }
 }
 
+bool RPiSPITransport::check() {
+    return checkPiType();
+}
 
+bool RPiSPITransport::init() {
+    return rpispi_init();
+}
 
+void RPiSPITransport::transfer(char* tbuf, char* rbuf, uint32_t len) {
+    rpispi_transfernb(tbuf, rbuf, len);
+}
 
+RPiSPITransport rpiSPITransport;
 
-
-
+SPITransport* spiTransport = &rpiSPITransport;
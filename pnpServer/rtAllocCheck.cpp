@@ -0,0 +1,118 @@
+
+#include <stdlib.h>
+#include <atomic>
+
+#include "rtAllocCheck.h"
+#include "log.h"
+
+#ifdef RT_ALLOC_CHECK
+
+// These are the glibc implementations, which the wrappers below pass everything on to.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+static thread_local bool isRealtimeThread = false;
+static std::atomic<unsigned long> rtAllocationCount(0);
+static std::atomic<unsigned long> rtFreeCount(0);
+
+static inline void countAllocation() {
+    if ( ! isRealtimeThread )
+        return;
+#ifdef RT_ALLOC_CHECK_ABORT
+    abort();
+#endif
+    rtAllocationCount++;
+}
+
+static inline void countFree(void* ptr) {
+    if ( ! isRealtimeThread || ! ptr )
+        return;
+#ifdef RT_ALLOC_CHECK_ABORT
+    abort();
+#endif
+    rtFreeCount++;
+}
+
+// Everything else (operator new, std containers, strdup etc) ends up in these.
+extern "C" {
+
+void* malloc(size_t size) {
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    countAllocation();
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    countAllocation();
+    void* p = __libc_memalign(alignment, size);
+    if ( ! p )
+        return 12; // ENOMEM
+    *ptr = p;
+    return 0;
+}
+
+void free(void* ptr) {
+    countFree(ptr);
+    __libc_free(ptr);
+}
+
+} // extern "C"
+
+void markRealtimeThread() {
+    isRealtimeThread = true;
+}
+
+unsigned long getRTAllocationCount() {
+    return rtAllocationCount;
+}
+
+unsigned long getRTFreeCount() {
+    return rtFreeCount;
+}
+
+#else
+
+void markRealtimeThread() {}
+unsigned long getRTAllocationCount() { return 0; }
+unsigned long getRTFreeCount() { return 0; }
+
+#endif
+
+// Called regularly from the main thread, to report any new heap use by the realtime thread.
+void checkRTAllocations() {
+    static unsigned long lastAllocationCount = 0;
+    static unsigned long lastFreeCount = 0;
+
+    unsigned long allocationCount = getRTAllocationCount();
+    unsigned long freeCount = getRTFreeCount();
+
+    if ( allocationCount != lastAllocationCount || freeCount != lastFreeCount ) {
+        g_log.log(LL_WARN, "Realtime thread used the heap: %lu allocations, %lu frees so far", allocationCount, freeCount);
+        lastAllocationCount = allocationCount;
+        lastFreeCount = freeCount;
+    }
+}
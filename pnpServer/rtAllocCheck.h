@@ -0,0 +1,15 @@
+#ifndef RTALLOCCHECK_H
+#define RTALLOCCHECK_H
+
+// Debug check for heap use in the realtime thread. When built with RT_ALLOC_CHECK defined
+// (make RT_ALLOC_CHECK=1) malloc and free are wrapped, and any call from the realtime thread
+// is counted. With RT_ALLOC_CHECK_ABORT defined as well (make RT_ALLOC_CHECK=abort) the first
+// one calls abort() instead, so the offending call can be found from the core dump or debugger.
+// Without these defines, nothing is wrapped and the counts are always zero.
+
+void markRealtimeThread();
+unsigned long getRTAllocationCount();
+unsigned long getRTFreeCount();
+void checkRTAllocations();
+
+#endif
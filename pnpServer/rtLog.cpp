@@ -0,0 +1,174 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+
+#include "rtLog.h"
+
+struct rtLogEntry {
+    timespec time;
+    logLevel_e level;
+    const char* fmt;
+    int numArgs;
+    rtLogArg args[RT_LOG_MAX_ARGS];
+};
+
+rtLogEntry rtLogEntries[RT_LOG_SIZE];
+
+// Single producer (realtime thread) and single consumer (main thread). These only ever increase,
+// the difference between them is the number of messages waiting.
+std::atomic<uint32_t> rtLogWriteIndex(0);
+std::atomic<uint32_t> rtLogReadIndex(0);
+std::atomic<uint32_t> rtLogDroppedCount(0);
+
+uint32_t lastReportedDroppedCount = 0;
+
+void rtLogPush(logLevel_e level, const char* fmt, const rtLogArg* args, int numArgs) {
+
+    uint32_t w = rtLogWriteIndex.load(std::memory_order_relaxed);
+    uint32_t r = rtLogReadIndex.load(std::memory_order_acquire);
+
+    if ( w - r >= RT_LOG_SIZE ) {
+        rtLogDroppedCount.store( rtLogDroppedCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed );
+        return;
+    }
+
+    rtLogEntry& e = rtLogEntries[w & (RT_LOG_SIZE - 1)];
+    clock_gettime(CLOCK_REALTIME, &e.time);
+    e.level = level;
+    e.fmt = fmt;
+    e.numArgs = numArgs < RT_LOG_MAX_ARGS ? numArgs : RT_LOG_MAX_ARGS;
+    for (int i = 0; i < e.numArgs; i++)
+        e.args[i] = args[i];
+
+    rtLogWriteIndex.store(w + 1, std::memory_order_release);
+}
+
+// Formats one argument with a single conversion spec from the original format, eg. "%5.2f",
+// converting the stored value to whatever type the conversion expects.
+static int formatArg(char* buf, int bufSize, const char* spec, int specLen, char conversion, const rtLogArg* arg) {
+
+    // copy the spec without any length modifiers, those are added back below to suit the stored value
+    char s[32];
+    int n = 0;
+    for (int i = 0; i < specLen - 1 && n < (int)sizeof(s) - 4; i++) {
+        if ( ! strchr("hlLqjzt", spec[i]) )
+            s[n++] = spec[i];
+    }
+
+    if ( ! arg ) {
+        // more conversions than arguments, just print the spec as it was
+        return snprintf(buf, bufSize, "%.*s", specLen, spec);
+    }
+
+    long long i = arg->type == RLA_DOUBLE ? (long long)arg->d : arg->i; // RLA_UINT shares the storage
+    double d = arg->type == RLA_DOUBLE ? arg->d : arg->type == RLA_UINT ? (double)arg->u : (double)arg->i;
+
+    if ( strchr("diouxX", conversion) ) {
+        s[n++] = 'l';
+        s[n++] = 'l';
+        s[n++] = conversion;
+        s[n] = 0;
+        return snprintf(buf, bufSize, s, i);
+    }
+    if ( strchr("fFeEgGaA", conversion) ) {
+        s[n++] = conversion;
+        s[n] = 0;
+        return snprintf(buf, bufSize, s, d);
+    }
+    if ( conversion == 'c' ) {
+        s[n++] = conversion;
+        s[n] = 0;
+        return snprintf(buf, bufSize, s, (int)i);
+    }
+    if ( conversion == 's' ) {
+        s[n++] = conversion;
+        s[n] = 0;
+        return snprintf(buf, bufSize, s, arg->type == RLA_STRING && arg->s ? arg->s : "(?)");
+    }
+    if ( conversion == 'p' ) {
+        s[n++] = conversion;
+        s[n] = 0;
+        return snprintf(buf, bufSize, s, (void*)arg->s);
+    }
+
+    return snprintf(buf, bufSize, "%.*s", specLen, spec);
+}
+
+static void formatEntry(const rtLogEntry& e, char* buf, int bufSize) {
+
+    const char* f = e.fmt;
+    int pos = 0;
+    int argIndex = 0;
+
+    while ( *f && pos < bufSize - 1 ) {
+
+        if ( *f != '%' ) {
+            buf[pos++] = *f++;
+            continue;
+        }
+
+        if ( f[1] == '%' ) {
+            buf[pos++] = '%';
+            f += 2;
+            continue;
+        }
+
+        // find the end of this conversion spec
+        const char* spec = f++;
+        while ( *f && strchr("-+ #0123456789.hlLqjzt", *f) )
+            f++;
+        if ( ! *f )
+            break;
+        char conversion = *f++;
+
+        const rtLogArg* arg = argIndex < e.numArgs ? &e.args[argIndex] : NULL;
+        argIndex++;
+
+        int len = formatArg(&buf[pos], bufSize - pos, spec, (int)(f - spec), conversion, arg);
+        if ( len > 0 )
+            pos += len;
+        if ( pos > bufSize - 1 )
+            pos = bufSize - 1;
+    }
+
+    // the formats are mostly shared with g_log, which adds its own line ending
+    while ( pos > 0 && buf[pos-1] == '\n' )
+        pos--;
+
+    buf[pos] = 0;
+}
+
+// Prints any messages waiting in the ring, returns how many there were.
+int drainRTLog() {
+
+    int count = 0;
+
+    uint32_t r = rtLogReadIndex.load(std::memory_order_relaxed);
+    uint32_t w = rtLogWriteIndex.load(std::memory_order_acquire);
+
+    while ( r != w ) {
+        const rtLogEntry& e = rtLogEntries[r & (RT_LOG_SIZE - 1)];
+
+        char buf[512];
+        formatEntry(e, buf, sizeof(buf));
+        g_log.logAt(e.time.tv_sec, e.level, "%s", buf);
+
+        r++;
+        rtLogReadIndex.store(r, std::memory_order_release);
+        count++;
+    }
+
+    uint32_t dropped = rtLogDroppedCount.load(std::memory_order_relaxed);
+    if ( dropped != lastReportedDroppedCount ) {
+        g_log.log(LL_WARN, "Realtime log ring was full, %u messages dropped (%u total)", dropped - lastReportedDroppedCount, dropped);
+        lastReportedDroppedCount = dropped;
+    }
+
+    return count;
+}
+
+uint32_t getRTLogDroppedCount() {
+    return rtLogDroppedCount.load(std::memory_order_relaxed);
+}
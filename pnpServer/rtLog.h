@@ -0,0 +1,61 @@
+#ifndef RTLOG_H
+#define RTLOG_H
+
+#include <stdint.h>
+#include "log.h"
+
+// Logging for the realtime thread, which must never block on stdout. A message is stored in a
+// fixed size ring as the time, the format string pointer and the arguments as binary values,
+// and the main loop does the actual formatting and printing later (see drainRTLog).
+// The format must be a string literal, and so must any %s arguments, because only the pointers
+// are kept. If the ring is full the message is dropped and counted.
+
+#define RT_LOG_SIZE         256 // number of messages the ring can hold, must be a power of two
+#define RT_LOG_MAX_ARGS     4
+
+enum rtLogArgType_e {
+    RLA_INT,
+    RLA_UINT,
+    RLA_DOUBLE,
+    RLA_STRING
+};
+
+struct rtLogArg {
+    uint8_t type;
+    union {
+        long long i;
+        unsigned long long u;
+        double d;
+        const char* s;
+    };
+
+    rtLogArg()                      { type = RLA_INT; i = 0; }
+    rtLogArg(int v)                 { type = RLA_INT; i = v; }
+    rtLogArg(long v)                { type = RLA_INT; i = v; }
+    rtLogArg(long long v)           { type = RLA_INT; i = v; }
+    rtLogArg(unsigned int v)        { type = RLA_UINT; u = v; }
+    rtLogArg(unsigned long v)       { type = RLA_UINT; u = v; }
+    rtLogArg(unsigned long long v)  { type = RLA_UINT; u = v; }
+    rtLogArg(double v)              { type = RLA_DOUBLE; d = v; }
+    rtLogArg(const char* v)         { type = RLA_STRING; s = v; }
+};
+
+// realtime thread
+void rtLogPush(logLevel_e level, const char* fmt, const rtLogArg* args, int numArgs);
+
+inline void rtLog(logLevel_e level, const char* fmt) {
+    rtLogPush(level, fmt, NULL, 0);
+}
+
+template<typename... Args>
+inline void rtLog(logLevel_e level, const char* fmt, Args... args) {
+    static_assert(sizeof...(args) <= RT_LOG_MAX_ARGS, "too many arguments for rtLog");
+    const rtLogArg a[] = { rtLogArg(args)... };
+    rtLogPush(level, fmt, a, sizeof...(args));
+}
+
+// main thread
+int drainRTLog();
+uint32_t getRTLogDroppedCount();
+
+#endif
@@ -0,0 +1,86 @@
+
+#include <atomic>
+
+#include "rtStats.h"
+
+struct rtStats_t {
+    std::atomic<uint32_t> ticks;
+    std::atomic<uint32_t> overruns;
+    std::atomic<uint32_t> maxMicros[RTH_MAX];
+    std::atomic<uint32_t> bins[RTH_MAX][RT_STATS_NUM_BINS];
+};
+
+rtStats_t rtStats;
+
+std::atomic<bool> rtStatsResetRequested(false);
+
+long spiTimeThisTick = -1; // realtime thread only, negative if no transfer was done
+
+// There is only one writer, so a plain load and store is enough (and cheaper than fetch_add)
+static inline void increment(std::atomic<uint32_t>& a) {
+    a.store( a.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed );
+}
+
+static void addSample(int which, long ns) {
+    uint32_t micros = ns > 0 ? ns / 1000 : 0;
+    increment( rtStats.bins[which][getRTStatsBin(micros)] );
+    if ( micros > rtStats.maxMicros[which].load(std::memory_order_relaxed) )
+        rtStats.maxMicros[which].store( micros, std::memory_order_relaxed );
+}
+
+static void resetRTStats() {
+    rtStats.ticks.store( 0, std::memory_order_relaxed );
+    rtStats.overruns.store( 0, std::memory_order_relaxed );
+    for (int i = 0; i < RTH_MAX; i++) {
+        rtStats.maxMicros[i].store( 0, std::memory_order_relaxed );
+        for (int k = 0; k < RT_STATS_NUM_BINS; k++)
+            rtStats.bins[i][k].store( 0, std::memory_order_relaxed );
+    }
+}
+
+long timespecDiffNs(const timespec& later, const timespec& earlier) {
+    return (later.tv_sec - earlier.tv_sec) * 1000000000L + (later.tv_nsec - earlier.tv_nsec);
+}
+
+void rtStatsSetSPITime(long ns) {
+    spiTimeThisTick = ns;
+}
+
+// Called once per loop, with the time the loop was supposed to start, when it actually
+// started, and when it finished.
+void rtStatsTick(const timespec& scheduled, const timespec& woke, const timespec& done, long periodNs) {
+
+    if ( rtStatsResetRequested.exchange(false) )
+        resetRTStats();
+
+    long loopNs = timespecDiffNs(done, woke);
+
+    addSample( RTH_WAKEUP_LATENESS, timespecDiffNs(woke, scheduled) );
+
+    if ( spiTimeThisTick >= 0 ) {
+        addSample( RTH_SPI_TIME, spiTimeThisTick );
+        loopNs -= spiTimeThisTick;
+        spiTimeThisTick = -1;
+    }
+
+    addSample( RTH_COMPUTE_TIME, loopNs );
+
+    if ( timespecDiffNs(done, scheduled) > periodNs )
+        increment( rtStats.overruns );
+
+    increment( rtStats.ticks );
+}
+
+void getRTStats(msg_rtStats* stats) {
+    stats->ticks = rtStats.ticks.load(std::memory_order_relaxed);
+    stats->overruns = rtStats.overruns.load(std::memory_order_relaxed);
+    for (int i = 0; i < RTH_MAX; i++) {
+        stats->maxMicros[i] = rtStats.maxMicros[i].load(std::memory_order_relaxed);
+        for (int k = 0; k < RT_STATS_NUM_BINS; k++)
+            stats->bins[i][k] = rtStats.bins[i][k].load(std::memory_order_relaxed);
+    }
+}
+
+void requestRTStatsReset() {
+    rtStatsResetRequested = true;
+}
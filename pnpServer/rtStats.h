@@ -0,0 +1,21 @@
+#ifndef RTSTATS_H
+#define RTSTATS_H
+
+#include <time.h>
+#include "../common/pnpMessages.h"
+
+// Timing histograms for the realtime loop. Only the realtime thread writes to them, the main
+// thread can read them at any time (each value on its own is consistent, but the set as a whole
+// may be from slightly different ticks) and ask for them to be reset.
+
+// realtime thread
+void rtStatsSetSPITime(long ns);
+void rtStatsTick(const timespec& scheduled, const timespec& woke, const timespec& done, long periodNs);
+
+// main thread
+void getRTStats(msg_rtStats* stats);
+void requestRTStatsReset();
+
+long timespecDiffNs(const timespec& later, const timespec& earlier);
+
+#endif
@@ -0,0 +1,60 @@
+
+#include <atomic>
+
+#include "rtTelemetry.h"
+#include "server.h"
+
+telemetrySample_t rtTelemetrySamples[RT_TELEMETRY_SIZE];
+
+// Single producer (realtime thread) and single consumer (main thread), same as the log ring.
+std::atomic<uint32_t> rtTelemetryWriteIndex(0);
+std::atomic<uint32_t> rtTelemetryReadIndex(0);
+
+uint32_t rtTelemetrySeq = 0; // realtime thread only
+
+// main thread only, the frame being filled
+telemetrySample_t pendingTelemetry[TELEMETRY_SAMPLES_PER_FRAME];
+int numPendingTelemetry = 0;
+
+void rtTelemetryPush(telemetrySample_t& sample) {
+
+    sample.seq = rtTelemetrySeq++;
+
+    uint32_t w = rtTelemetryWriteIndex.load(std::memory_order_relaxed);
+    uint32_t r = rtTelemetryReadIndex.load(std::memory_order_acquire);
+
+    if ( w - r >= RT_TELEMETRY_SIZE )
+        return;
+
+    rtTelemetrySamples[w & (RT_TELEMETRY_SIZE - 1)] = sample;
+
+    rtTelemetryWriteIndex.store(w + 1, std::memory_order_release);
+}
+
+// Moves samples from the ring into frames, and publishes each frame as it fills.
+// Returns the number of frames published.
+int publishTelemetry() {
+
+    int count = 0;
+
+    uint32_t r = rtTelemetryReadIndex.load(std::memory_order_relaxed);
+    uint32_t w = rtTelemetryWriteIndex.load(std::memory_order_acquire);
+
+    while ( r != w ) {
+        pendingTelemetry[numPendingTelemetry++] = rtTelemetrySamples[r & (RT_TELEMETRY_SIZE - 1)];
+
+        r++;
+        rtTelemetryReadIndex.store(r, std::memory_order_release);
+
+        if ( numPendingTelemetry == TELEMETRY_SAMPLES_PER_FRAME ) {
+            uint8_t buf[TELEMETRY_MAX_FRAME_SIZE];
+            int size = encodeTelemetryFrame(pendingTelemetry, numPendingTelemetry, buf, sizeof(buf));
+            if ( size > 0 )
+                publishTelemetryFrame(buf, size);
+            numPendingTelemetry = 0;
+            count++;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,19 @@
+#ifndef RTTELEMETRY_H
+#define RTTELEMETRY_H
+
+#include "../common/telemetry.h"
+
+// The realtime thread adds a sample every tick to a fixed size ring, and the main thread
+// collects them into frames and publishes them (see common/telemetry.h). If the main thread
+// falls more than RT_TELEMETRY_SIZE ticks behind, samples are dropped but still use up a
+// sequence number, so the gap shows up on the client.
+
+#define RT_TELEMETRY_SIZE   1024 // must be a power of two
+
+// realtime thread
+void rtTelemetryPush(telemetrySample_t& sample);
+
+// main thread
+int publishTelemetry();
+
+#endif
@@ -1,6 +1,7 @@
 
 #include <unistd.h>
 
+#include <stdio.h>
 #include <string.h>
 #include <zmq.h>
 
@@ -11,12 +12,16 @@
 #include "socketMonitor.h"
 #include "../common/machinelimits.h"
 #include "../common/overrides.h"
+#include "programQueue.h"
+#include "rtStats.h"
+#include "../common/telemetry.h"
 
 using namespace scv;
 
 void *context = NULL;
 void *publisher = NULL;
 void *replier = NULL;
+void *telemetryPublisher = NULL;
 
 bool startServer() {
 
@@ -79,6 +84,27 @@ bool startServer() {
         return false;
     }
 
+    // Not conflated, every frame should get through. If the client can't keep up the oldest
+    // frames are dropped after the high water mark, which shows as a gap in the sequence numbers.
+    telemetryPublisher = zmq_socket(context, ZMQ_PUB);
+    if ( ! telemetryPublisher ) {
+        g_log.log(LL_ERROR, "zmq_socket failed, telemetry publisher: %d (%s)\n", errno, strerror(errno));
+    }
+    else {
+        int hwm = 200; // frames, about 10 seconds
+        zmq_setsockopt(telemetryPublisher, ZMQ_SNDHWM, &hwm, sizeof(int));
+
+        char url[32];
+        snprintf(url, sizeof(url), "tcp://*:%d", TELEMETRY_PORT);
+        rc = zmq_bind(telemetryPublisher, url);
+        if ( rc != 0 ) {
+            // not fatal, everything else still works without it
+            g_log.log(LL_ERROR, "zmq_bind failed, telemetry publisher: %d (%s)\n", errno, strerror(errno));
+            zmq_close(telemetryPublisher);
+            telemetryPublisher = NULL;
+        }
+    }
+
     g_log.log(LL_INFO, "Started server");
 
     startSocketMonitor(publisher);
@@ -90,10 +116,13 @@ void stopServer() {
 
     //printf("Stopping server... ");
 
+    if ( telemetryPublisher )
+        zmq_close (telemetryPublisher);
     zmq_close (replier);
     zmq_close (publisher);
     zmq_ctx_destroy (context);
 
+    telemetryPublisher = NULL;
     replier = NULL;
     publisher = NULL;
     context = NULL;
@@ -332,6 +361,10 @@ void processCommandReply(commandRequest_t* req, bool ackOrNack) {
         }
         rep.estopParams.pwmUsed = estopPWMUsed;
     }
+    else if ( req->type == MT_RT_STATS_FETCH ) {
+        rep.type = MT_RT_STATS_FETCH;
+        getRTStats(&rep.rtStats);
+    }
 
 
     size_t msgSize = sizeof(commandReply_t);
@@ -392,6 +425,8 @@ void publishStatus(motionStatus *s, motionLimits currentMoveLimits, motionLimits
     apr.limRotateAcc = currentRotationLimits.acc;
     apr.limRotateJerk = currentRotationLimits.jerk;
 
+    fillProgramQueueReport(&apr);
+
     // if ( apr.probingResult ) {
     //     g_log.log(LL_DEBUG, "publish: %d, %f", apr.probingResult, apr.probedHeight);
     // }
@@ -408,3 +443,13 @@ void publishStatus(motionStatus *s, motionLimits currentMoveLimits, motionLimits
         g_log.log(LL_ERROR, "zmq_msg_send failed\n");
     }
 }
+
+void publishTelemetryFrame(const uint8_t* data, int size)
+{
+    if ( ! telemetryPublisher )
+        return;
+
+    if ( size != zmq_send( telemetryPublisher, data, size, ZMQ_DONTWAIT ) ) {
+        g_log.log(LL_ERROR, "zmq_send failed, telemetry publisher: %d (%s)", errno, strerror(errno));
+    }
+}
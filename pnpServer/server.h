@@ -10,6 +10,7 @@ bool startServer();
 void stopServer();
 
 void publishStatus(motionStatus* s, motionLimits currentMoveLimits, motionLimits currentRotationLimits, float speedScale, float jogSpeedScale, float weight, float probingZ);
+void publishTelemetryFrame(const uint8_t* data, int size);
 
 bool checkCommandRequests(commandMessageType_e *msgType, commandRequest_t* req, CommandList* program);
 void processCommandReply(commandRequest_t* rep, bool ackOrNack);
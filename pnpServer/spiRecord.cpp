@@ -0,0 +1,607 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "spiRecord.h"
+#include "rtLog.h"
+
+static_assert(sizeof(spiRecordHeader_t) % 8 == 0, "spiRecordHeader_t must keep the records aligned");
+static_assert(sizeof(motionCommand) <= SPI_RECORD_DATA_SIZE, "motionCommand must fit in a record");
+static_assert((SPI_RECORD_BUFFER_SIZE & (SPI_RECORD_BUFFER_SIZE - 1)) == 0, "SPI_RECORD_BUFFER_SIZE must be a power of two");
+
+#define SPI_RECORD_WRITE_INTERVAL_US    20000
+
+int spiRecordFd = -1;
+spiRecordHeader_t spiRecordFileHeader;      // writer thread, copied to the start of the file after each batch
+
+// Single producer (realtime thread) and single consumer (writer thread). The indexes only ever
+// increase, the difference between them is the number of records waiting to be written.
+spiRecord_t* spiRecordBuffer = NULL;
+std::atomic<bool> spiRecording(false);
+std::atomic<uint64_t> spiRecordWriteIndex(0);
+std::atomic<uint64_t> spiRecordReadIndex(0);
+std::atomic<uint64_t> spiRecordDropped(0);
+
+uint64_t spiRecordTick = 0;                 // realtime thread
+uint32_t spiRecordLastProgramsQueued = 0;   // realtime thread
+uint64_t spiRecordPendingIndex = 0;         // realtime thread, between beginRecord and commitRecord
+
+// Programs come from the main thread, which is allowed to take a lock
+pthread_mutex_t spiRecordProgramMutex = PTHREAD_MUTEX_INITIALIZER;
+std::vector<spiRecord_t> spiRecordProgramRecords;
+
+pthread_t spiRecordWriterThread;
+std::atomic<bool> spiRecordWriterRunning(false);
+bool spiRecordWriteFailed = false;
+
+SPIReplayTransport spiReplay;
+
+static uint64_t timespecToNs(const timespec& ts) {
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t nowNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespecToNs(now);
+}
+
+// writer thread
+static void writeRecordsToFile(const spiRecord_t* recs, uint64_t num) {
+
+    while ( num > 0 && ! spiRecordWriteFailed ) {
+
+        // split where the file ring wraps around
+        uint64_t slot = spiRecordFileHeader.count % spiRecordFileHeader.capacity;
+        uint64_t n = spiRecordFileHeader.capacity - slot;
+        if ( n > num )
+            n = num;
+
+        size_t bytes = n * sizeof(spiRecord_t);
+        off_t pos = sizeof(spiRecordHeader_t) + slot * sizeof(spiRecord_t);
+        if ( pwrite(spiRecordFd, recs, bytes, pos) != (ssize_t)bytes ) {
+            g_log.log(LL_ERROR, "Could not write SPI recording: %s", strerror(errno));
+            spiRecordWriteFailed = true;
+            return;
+        }
+
+        spiRecordFileHeader.count += n;
+        recs += n;
+        num -= n;
+    }
+}
+
+// writer thread, and the main thread once the writer has stopped
+static void writePendingRecords() {
+
+    uint64_t r = spiRecordReadIndex.load(std::memory_order_relaxed);
+    uint64_t w = spiRecordWriteIndex.load(std::memory_order_acquire);
+
+    while ( r != w ) {
+        // split where the memory ring wraps around
+        uint64_t slot = r & (SPI_RECORD_BUFFER_SIZE - 1);
+        uint64_t n = SPI_RECORD_BUFFER_SIZE - slot;
+        if ( n > w - r )
+            n = w - r;
+        writeRecordsToFile(&spiRecordBuffer[slot], n);
+        r += n;
+        spiRecordReadIndex.store(r, std::memory_order_release);
+    }
+
+    std::vector<spiRecord_t> programRecords;
+    pthread_mutex_lock(&spiRecordProgramMutex);
+    programRecords.swap(spiRecordProgramRecords);
+    pthread_mutex_unlock(&spiRecordProgramMutex);
+
+    if ( ! programRecords.empty() )
+        writeRecordsToFile(programRecords.data(), programRecords.size());
+
+    spiRecordFileHeader.dropped = spiRecordDropped.load(std::memory_order_relaxed);
+    if ( ! spiRecordWriteFailed )
+        pwrite(spiRecordFd, &spiRecordFileHeader, sizeof(spiRecordFileHeader), 0);
+}
+
+static void* spiRecordWriter(void*) {
+    while ( spiRecordWriterRunning.load(std::memory_order_acquire) ) {
+        writePendingRecords();
+        usleep(SPI_RECORD_WRITE_INTERVAL_US);
+    }
+    return NULL;
+}
+
+bool openSPIRecording(const char* filename, uint32_t seconds) {
+
+    if ( seconds < 1 )
+        seconds = 1;
+    uint64_t capacity = (uint64_t)seconds * 1000; // one record per 1ms tick, commands and programs are rare
+    size_t size = sizeof(spiRecordHeader_t) + capacity * sizeof(spiRecord_t);
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if ( fd < 0 ) {
+        g_log.log(LL_ERROR, "Could not open SPI recording file %s: %s", filename, strerror(errno));
+        return false;
+    }
+
+    // allocate all the blocks now, so the writer can't run into a full disk later
+    int err = posix_fallocate(fd, 0, size);
+    if ( err ) {
+        g_log.log(LL_ERROR, "Could not allocate %lu bytes for SPI recording: %s", (unsigned long)size, strerror(err));
+        ::close(fd);
+        return false;
+    }
+
+    spiRecordHeader_t& header = spiRecordFileHeader;
+    memset(&header, 0, sizeof(spiRecordHeader_t));
+    memcpy(header.magic, SPI_RECORD_MAGIC, sizeof(header.magic));
+    header.version = SPI_RECORD_VERSION;
+    header.recordSize = sizeof(spiRecord_t);
+    header.txSize = sizeof(txData_t);
+    header.rxSize = sizeof(rxData_t);
+    header.capacity = capacity;
+    header.count = 0;
+
+    if ( pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ) {
+        g_log.log(LL_ERROR, "Could not write SPI recording header: %s", strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    // The buffer the realtime thread writes to is private memory, populated and locked so that it
+    // never takes a page fault or waits for the disk.
+    size_t bufferSize = SPI_RECORD_BUFFER_SIZE * sizeof(spiRecord_t);
+    void* buffer = mmap(NULL, bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if ( buffer == MAP_FAILED ) {
+        g_log.log(LL_ERROR, "Could not allocate SPI recording buffer: %s", strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    if ( mlock(buffer, bufferSize) != 0 )
+        g_log.log(LL_WARN, "Could not lock SPI recording buffer: %s", strerror(errno));
+
+    spiRecordFd = fd;
+    spiRecordBuffer = (spiRecord_t*)buffer;
+    spiRecordWriteFailed = false;
+
+    spiRecordWriterRunning = true;
+    int tret = pthread_create( &spiRecordWriterThread, NULL, spiRecordWriter, NULL );
+    if ( tret != 0 ) {
+        g_log.log(LL_ERROR, "openSPIRecording: pthread_create failed %d (%s)", tret, strerror(tret));
+        spiRecordWriterRunning = false;
+        munmap(buffer, bufferSize);
+        spiRecordBuffer = NULL;
+        ::close(fd);
+        spiRecordFd = -1;
+        return false;
+    }
+
+    spiRecording.store(true, std::memory_order_release); // set last, the realtime thread checks this to see if recording is on
+
+    g_log.log(LL_INFO, "Recording SPI transfers to %s (last %u seconds, %lu MB)", filename, seconds, (unsigned long)(size >> 20));
+
+    return true;
+}
+
+// Only call this after the realtime thread has stopped.
+void closeSPIRecording() {
+
+    if ( ! spiRecording )
+        return;
+
+    spiRecording = false;
+
+    spiRecordWriterRunning.store(false, std::memory_order_release);
+    pthread_join(spiRecordWriterThread, NULL);
+    writePendingRecords();
+
+    fsync(spiRecordFd);
+    ::close(spiRecordFd);
+    spiRecordFd = -1;
+
+    munmap(spiRecordBuffer, SPI_RECORD_BUFFER_SIZE * sizeof(spiRecord_t));
+    spiRecordBuffer = NULL;
+
+    uint64_t count = spiRecordFileHeader.count;
+    uint64_t capacity = spiRecordFileHeader.capacity;
+    g_log.log(LL_INFO, "SPI recording closed, %llu records written (%llu kept)",
+              (unsigned long long)count, (unsigned long long)(count < capacity ? count : capacity));
+    if ( spiRecordFileHeader.dropped )
+        g_log.log(LL_WARN, "SPI recording dropped %llu records, the writer could not keep up",
+                  (unsigned long long)spiRecordFileHeader.dropped);
+}
+
+// Splits the program into records on the main thread, the writer puts them in the file with the rest.
+void spiRecordProgram(const spiRecordedProgram_t& info, CommandList& program) {
+
+    if ( ! spiRecording )
+        return;
+
+    std::vector<uint8_t> bytes( sizeof(info) + program.getSize() );
+    spiRecordedProgram_t* header = (spiRecordedProgram_t*)bytes.data();
+    *header = info;
+    header->dataSize = program.pack( &bytes[sizeof(info)] );
+    bytes.resize( sizeof(info) + header->dataSize );
+
+    uint64_t time = nowNs();
+
+    pthread_mutex_lock(&spiRecordProgramMutex);
+    for (size_t pos = 0; pos < bytes.size(); pos += SPI_RECORD_DATA_SIZE) {
+        spiRecord_t r;
+        memset(&r, 0, sizeof(r));
+        r.tick = 0; // not known here, SRT_PROGRAMS_QUEUED says when the realtime thread saw it
+        r.time = time;
+        r.type = pos == 0 ? SRT_PROGRAM : SRT_PROGRAM_MORE;
+        r.size = bytes.size() - pos < SPI_RECORD_DATA_SIZE ? bytes.size() - pos : SPI_RECORD_DATA_SIZE;
+        memcpy(r.data, &bytes[pos], r.size);
+        spiRecordProgramRecords.push_back(r);
+    }
+    pthread_mutex_unlock(&spiRecordProgramMutex);
+}
+
+// realtime thread, returns NULL if the buffer is full
+static spiRecord_t* beginRecord(uint32_t type) {
+
+    uint64_t w = spiRecordWriteIndex.load(std::memory_order_relaxed);
+    uint64_t r = spiRecordReadIndex.load(std::memory_order_acquire);
+
+    if ( w - r >= SPI_RECORD_BUFFER_SIZE ) {
+        spiRecordDropped.store( spiRecordDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed );
+        return NULL;
+    }
+
+    spiRecord_t* rec = &spiRecordBuffer[w & (SPI_RECORD_BUFFER_SIZE - 1)];
+    rec->tick = spiRecordTick;
+    rec->time = nowNs();
+    rec->type = type;
+    rec->size = 0;
+
+    spiRecordPendingIndex = w;
+    return rec;
+}
+
+// realtime thread, the writer never sees a partial record
+static void commitRecord() {
+    spiRecordWriteIndex.store(spiRecordPendingIndex + 1, std::memory_order_release);
+}
+
+void spiRecordTransfer(const txData_t& tx, const rxData_t& rx) {
+
+    if ( ! spiRecording.load(std::memory_order_acquire) )
+        return;
+
+    spiRecord_t* r = beginRecord(SRT_TRANSFER);
+    if ( r ) {
+        r->transfer.tx = tx;
+        r->transfer.rx = rx;
+        commitRecord();
+    }
+
+    spiRecordTick++;
+}
+
+void spiRecordCommand(const motionCommand& cmd) {
+
+    if ( ! spiRecording.load(std::memory_order_acquire) )
+        return;
+
+    spiRecord_t* r = beginRecord(SRT_COMMAND);
+    if ( r ) {
+        r->command = cmd;
+        commitRecord();
+    }
+}
+
+void spiRecordProgramsQueued(uint32_t numQueued) {
+
+    if ( ! spiRecording.load(std::memory_order_acquire) )
+        return;
+
+    if ( numQueued == spiRecordLastProgramsQueued )
+        return;
+
+    spiRecord_t* r = beginRecord(SRT_PROGRAMS_QUEUED);
+    if ( r ) {
+        r->programsQueued = numQueued;
+        commitRecord();
+        spiRecordLastProgramsQueued = numQueued;
+    }
+}
+
+void spiRecordEstop() {
+
+    if ( ! spiRecording.load(std::memory_order_acquire) )
+        return;
+
+    if ( beginRecord(SRT_ESTOP) )
+        commitRecord();
+}
+
+// Maps a recording read-only and checks that it was written by a compatible build.
+static const spiRecordHeader_t* mapRecording(const char* filename, int& fd, uint8_t*& map, size_t& size) {
+
+    fd = open(filename, O_RDONLY);
+    if ( fd < 0 ) {
+        g_log.log(LL_ERROR, "Could not open SPI recording %s: %s", filename, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if ( fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(spiRecordHeader_t) ) {
+        g_log.log(LL_ERROR, "%s is not an SPI recording", filename);
+        ::close(fd);
+        return NULL;
+    }
+    size = st.st_size;
+
+    map = (uint8_t*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if ( map == MAP_FAILED ) {
+        g_log.log(LL_ERROR, "Could not map SPI recording %s: %s", filename, strerror(errno));
+        ::close(fd);
+        return NULL;
+    }
+
+    const spiRecordHeader_t* header = (const spiRecordHeader_t*)map;
+    const char* problem = NULL;
+    if ( memcmp(header->magic, SPI_RECORD_MAGIC, sizeof(header->magic)) != 0 )
+        problem = "not an SPI recording";
+    else if ( header->version != SPI_RECORD_VERSION )
+        problem = "unsupported recording version";
+    else if ( header->recordSize != sizeof(spiRecord_t) || header->txSize != sizeof(txData_t) || header->rxSize != sizeof(rxData_t) )
+        problem = "recorded with different packet sizes";
+    else if ( header->capacity == 0 || size < sizeof(spiRecordHeader_t) + header->capacity * sizeof(spiRecord_t) )
+        problem = "file is truncated";
+
+    if ( problem ) {
+        g_log.log(LL_ERROR, "Can't use %s: %s", filename, problem);
+        munmap(map, size);
+        ::close(fd);
+        return NULL;
+    }
+
+    return header;
+}
+
+// Prints the transfers in a recording as CSV on stdout, oldest first.
+bool dumpSPIRecording(const char* filename) {
+
+    int fd;
+    uint8_t* map;
+    size_t size;
+    const spiRecordHeader_t* header = mapRecording(filename, fd, map, size);
+    if ( ! header )
+        return false;
+
+    const spiRecord_t* recs = (const spiRecord_t*)(map + sizeof(spiRecordHeader_t));
+    uint64_t count = header->count;
+    uint64_t num = count < header->capacity ? count : header->capacity;
+    uint64_t first = count - num;
+
+    printf("tick,time,txHeader,freq0,freq1,freq2,freq3,jointEnable,outputs,spindleSpeed,"
+           "rxHeader,feedback0,feedback1,feedback2,feedback3,jogcount0,inputs,adc0,adc1,pressure,loadcell\n");
+
+    uint64_t startTime = num ? recs[first % header->capacity].time : 0;
+    uint64_t numCommands = 0;
+    uint64_t numPrograms = 0;
+
+    for (uint64_t i = first; i < count; i++) {
+        const spiRecord_t& r = recs[i % header->capacity];
+        if ( r.type == SRT_COMMAND )
+            numCommands++;
+        else if ( r.type == SRT_PROGRAM )
+            numPrograms++;
+        if ( r.type != SRT_TRANSFER )
+            continue;
+        const txData_t& tx = r.transfer.tx;
+        const rxData_t& rx = r.transfer.rx;
+        printf("%llu,%.6f,%08x,%d,%d,%d,%d,%u,%u,%u,%08x,%d,%d,%d,%d,%d,%u,%u,%u,%u,%d\n",
+               (unsigned long long)r.tick, (r.time - startTime) * 1e-9,
+               tx.header, tx.jointFreqCmd[0], tx.jointFreqCmd[1], tx.jointFreqCmd[2], tx.jointFreqCmd[3],
+               tx.jointEnable, tx.outputs, tx.spindleSpeed,
+               rx.header, rx.jointFeedback[0], rx.jointFeedback[1], rx.jointFeedback[2], rx.jointFeedback[3],
+               rx.jogcounts[0], rx.inputs, rx.adc[0], rx.adc[1], rx.pressure, rx.loadcell);
+    }
+
+    g_log.log(LL_INFO, "%llu commands and %llu programs not shown, %llu records dropped while recording",
+              (unsigned long long)numCommands, (unsigned long long)numPrograms, (unsigned long long)header->dropped);
+
+    munmap(map, size);
+    ::close(fd);
+
+    return true;
+}
+
+SPIReplayTransport::SPIReplayTransport() {
+    fd = -1;
+    map = NULL;
+    mapSize = 0;
+    header = NULL;
+    records = NULL;
+    complete = false;
+    next = 0;
+    nextCommand = 0;
+    nextQueued = 0;
+    nextEstop = 0;
+    nextProgram = 0;
+    numQueued = 0;
+    numMismatches = 0;
+    firstMismatch = 0;
+}
+
+bool SPIReplayTransport::open(const char* filename) {
+
+    header = mapRecording(filename, fd, map, mapSize);
+    if ( ! header )
+        return false;
+
+    records = (const spiRecord_t*)(map + sizeof(spiRecordHeader_t));
+
+    uint64_t count = header->count;
+    uint64_t numRecords = count < header->capacity ? count : header->capacity;
+    uint64_t first = count - numRecords;
+    complete = count <= header->capacity;
+
+    // Sort the records out now, so the realtime thread only has to step through them
+    std::vector<uint8_t> programBytes;
+    for (uint64_t i = first; i < count; i++) {
+        const spiRecord_t& r = records[i % header->capacity];
+        if ( r.type == SRT_TRANSFER )
+            transfers.push_back(&r);
+        else if ( ! complete )
+            continue; // without the start of the session these would not be given on the right ticks
+        else if ( r.type == SRT_COMMAND )
+            commands.push_back( { r.tick, r.command } );
+        else if ( r.type == SRT_PROGRAMS_QUEUED )
+            queued.push_back( { r.tick, r.programsQueued } );
+        else if ( r.type == SRT_ESTOP )
+            estops.push_back( r.tick );
+        else if ( r.type == SRT_PROGRAM || (r.type == SRT_PROGRAM_MORE && ! programBytes.empty()) ) {
+            if ( r.type == SRT_PROGRAM )
+                programBytes.clear();
+            programBytes.insert(programBytes.end(), r.data, r.data + r.size);
+            if ( programBytes.size() >= sizeof(spiRecordedProgram_t) ) {
+                replayProgram_t p;
+                memcpy(&p.info, programBytes.data(), sizeof(p.info));
+                if ( programBytes.size() == sizeof(p.info) + p.info.dataSize ) {
+                    p.data.assign(programBytes.begin() + sizeof(p.info), programBytes.end());
+                    programs.push_back(p);
+                    programBytes.clear();
+                }
+            }
+        }
+    }
+
+    if ( transfers.empty() ) {
+        g_log.log(LL_ERROR, "SPI recording %s is empty", filename);
+        close();
+        return false;
+    }
+
+    double seconds = (transfers.back()->time - transfers.front()->time) * 1e-9;
+    g_log.log(LL_INFO, "Replaying %llu SPI transfers (%.1f seconds), %llu commands and %llu programs from %s",
+              (unsigned long long)transfers.size(), seconds, (unsigned long long)commands.size(), (unsigned long long)programs.size(), filename);
+
+    if ( ! complete )
+        g_log.log(LL_WARN, "The start of this recording was overwritten, so commands and programs can't be replayed. Commands from the client will be used instead.");
+    if ( header->dropped )
+        g_log.log(LL_WARN, "%llu records were dropped while recording, the replay will not follow it exactly", (unsigned long long)header->dropped);
+
+    return true;
+}
+
+void SPIReplayTransport::close() {
+    if ( map )
+        munmap(map, mapSize);
+    if ( fd >= 0 )
+        ::close(fd);
+    map = NULL;
+    fd = -1;
+    header = NULL;
+    records = NULL;
+    transfers.clear();
+    commands.clear();
+    queued.clear();
+    programs.clear();
+}
+
+bool SPIReplayTransport::hasInputs() {
+    return complete;
+}
+
+// Only call this after the realtime thread has stopped.
+void SPIReplayTransport::printSummary() {
+    if ( numMismatches )
+        g_log.log(LL_WARN, "SPI replay: %llu of %llu sent packets were different to the recording, the first at %llu",
+                  (unsigned long long)numMismatches, (unsigned long long)next, (unsigned long long)firstMismatch);
+    else
+        g_log.log(LL_INFO, "SPI replay: all %llu sent packets matched the recording", (unsigned long long)next);
+}
+
+bool SPIReplayTransport::init() {
+    g_log.log(LL_INFO, "Using %s", getName());
+    return header != NULL;
+}
+
+void SPIReplayTransport::transfer(char* tbuf, char* rbuf, uint32_t len) {
+
+    uint64_t numTransfers = transfers.size();
+    uint64_t i = next < numTransfers ? next : numTransfers - 1;
+    const spiRecord_t& r = *transfers[i];
+
+    if ( next < numTransfers ) {
+        if ( memcmp(tbuf, &r.transfer.tx, sizeof(r.transfer.tx)) != 0 ) {
+            if ( numMismatches == 0 ) {
+                firstMismatch = next;
+                rtLog(LL_WARN, "SPI replay: sent packet %llu is different to the recording", (unsigned long long)next);
+            }
+            numMismatches++;
+        }
+        next++;
+        if ( next == numTransfers )
+            rtLog(LL_INFO, "SPI replay: reached the end of the recording");
+    }
+
+    memcpy(rbuf, &r.transfer.rx, len < sizeof(r.transfer.rx) ? len : sizeof(r.transfer.rx));
+}
+
+// Gives the command that was taken on this tick when recording, if there was one.
+bool SPIReplayTransport::takeCommand(motionCommand* cmd) {
+    bool got = false;
+    while ( nextCommand < commands.size() && commands[nextCommand].tick <= next ) {
+        *cmd = commands[nextCommand].command;
+        nextCommand++;
+        got = true;
+    }
+    return got;
+}
+
+// The number of programs the realtime thread could see on this tick when recording. The main
+// thread plans the recorded programs again, and might not have caught up yet, so this waits for
+// it. That's fine here because a replay does not need to keep to real time.
+uint32_t SPIReplayTransport::getProgramsQueued() {
+
+    while ( nextQueued < queued.size() && queued[nextQueued].tick <= next ) {
+        numQueued = queued[nextQueued].numQueued;
+        nextQueued++;
+    }
+
+    for (int waited = 0; rtProgramsQueued() < numQueued && waited < 5000; waited++)
+        usleep(1000);
+
+    if ( rtProgramsQueued() < numQueued ) {
+        rtLog(LL_ERROR, "SPI replay: program %u was not planned in time", numQueued);
+        numQueued = rtProgramsQueued();
+    }
+
+    return numQueued;
+}
+
+// True if the estop was taken on this tick when recording.
+bool SPIReplayTransport::takeEstop() {
+    bool got = false;
+    while ( nextEstop < estops.size() && estops[nextEstop] <= next ) {
+        nextEstop++;
+        got = true;
+    }
+    return got;
+}
+
+const spiRecordedProgram_t* SPIReplayTransport::takeProgram(CommandList& program) {
+
+    if ( nextProgram >= programs.size() )
+        return NULL;
+
+    replayProgram_t& p = programs[nextProgram++];
+    if ( ! program.unpack( p.data.data() ) ) {
+        g_log.log(LL_ERROR, "SPI replay: could not unpack program %d", p.info.programId);
+        return NULL;
+    }
+
+    return &p.info;
+}
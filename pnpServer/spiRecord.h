@@ -0,0 +1,163 @@
+#ifndef SPIRECORD_H
+#define SPIRECORD_H
+
+#include <stdint.h>
+#include <vector>
+#include "weeny.h"
+#include "spiTransport.h"
+#include "interThread.h"
+#include "../common/commandlist.h"
+
+// Recording of every packet exchanged with the PRU, and of everything the main thread hands to
+// the realtime thread, for looking at what went over the wire after something goes wrong, or for
+// running changed code against real input (see SPIReplayTransport).
+//
+// The realtime thread only copies records into a ring in locked anonymous memory. A normal
+// priority writer thread moves them from there into the file, so the realtime thread never
+// touches the file or its page cache. The file is a header followed by a fixed number of records,
+// used as a ring so the newest records are always kept. It is created at full size before the
+// realtime thread starts, so the writer can't run into a full disk either. Records the writer has
+// written are in the kernel's hands, and are not lost if the server crashes.
+//
+// Every record has the number of the transfer it belongs to (its tick), so that a replay can give
+// the realtime thread each command and program on exactly the same tick as it was recorded.
+
+#define SPI_RECORD_MAGIC            "PNPSPIR"
+#define SPI_RECORD_VERSION          3
+#define SPI_RECORD_DEFAULT_SECONDS  600     // ring size when not given, 600s is about 70MB
+#define SPI_RECORD_MAX_SECONDS      86400
+#define SPI_RECORD_BUFFER_SIZE      8192    // records the realtime thread can get ahead of the writer, must be a power of two
+
+enum spiRecordType_e {
+    SRT_TRANSFER,           // one SPI packet exchange
+    SRT_COMMAND,            // motionCommand taken by the realtime thread from the main thread
+    SRT_PROGRAMS_QUEUED,    // number of programs the realtime thread has been able to see so far
+    SRT_ESTOP,              // estop taken by the realtime thread, which also aborts queued programs
+    SRT_PROGRAM,            // start of a program as the main thread planned it (spiRecordedProgram_t then the packed command list)
+    SRT_PROGRAM_MORE,       // the rest of it, in as many records as needed
+};
+
+struct spiRecordHeader_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;    // sizeof(spiRecord_t), so a file from a different build is not misread
+    uint32_t txSize;
+    uint32_t rxSize;
+    uint64_t capacity;      // number of records the ring can hold
+    uint64_t count;         // number of records ever written, the newest is at (count-1) % capacity
+    uint64_t dropped;       // records lost because the writer fell behind
+};
+
+#define SPI_RECORD_DATA_SIZE    (sizeof(txData_t) + sizeof(rxData_t))
+
+struct spiRecord_t {
+    uint64_t tick;          // number of transfers before this record
+    uint64_t time;          // CLOCK_MONOTONIC in nanoseconds
+    uint32_t type;          // spiRecordType_e
+    uint32_t size;          // bytes used in data, for SRT_PROGRAM and SRT_PROGRAM_MORE
+    union {
+        struct {
+            txData_t tx;
+            rxData_t rx;
+        } transfer;
+        motionCommand command;
+        uint32_t programsQueued;
+        uint8_t data[SPI_RECORD_DATA_SIZE];
+    };
+};
+
+// What the main thread used to plan a program, other than the commands themselves. When replaying,
+// programs are planned again from this instead of from whatever state the main thread is in.
+struct spiRecordedProgram_t {
+    uint16_t programId;
+    uint32_t abortGeneration;   // see rtAbortPrograms
+    float blendStart;
+    scv::vec3 startPos;
+    float startRots[NUM_ROTATION_AXES];
+    float rotateFrom[NUM_ROTATION_AXES];    // where the first rotate of each axis starts
+    scv::vec3 homeOffset;
+    uint32_t dataSize;      // size of the packed CommandList that follows
+};
+
+// main thread
+bool openSPIRecording(const char* filename, uint32_t seconds);
+void closeSPIRecording();
+bool dumpSPIRecording(const char* filename);
+void spiRecordProgram(const spiRecordedProgram_t& info, CommandList& program);
+
+// realtime thread
+void spiRecordTransfer(const txData_t& tx, const rxData_t& rx);
+void spiRecordCommand(const motionCommand& cmd);
+void spiRecordProgramsQueued(uint32_t numQueued);
+void spiRecordEstop();
+
+// Plays back the packets received in a recording instead of talking to the PRU, in the same
+// order and one per tick, so that the server sees exactly the same input again. The commands and
+// programs from the main thread are also taken from the recording, on the tick they were taken
+// when recording, and anything the client sends meanwhile is ignored. Config changes made by the
+// client are not recorded, so the server should be started with the same config as the recording.
+// The packets the server sends are compared with the recorded ones, and any difference is counted.
+// Once the end of the recording is reached the last packet is repeated.
+class SPIReplayTransport : public SPITransport {
+
+    struct replayProgram_t {
+        spiRecordedProgram_t info;
+        std::vector<uint8_t> data;
+    };
+
+    struct replayCommand_t {
+        uint64_t tick;
+        motionCommand command;
+    };
+
+    struct replayQueued_t {
+        uint64_t tick;
+        uint32_t numQueued;
+    };
+
+    int fd;
+    uint8_t* map;
+    size_t mapSize;
+    const spiRecordHeader_t* header;
+    const spiRecord_t* records;
+    bool complete;          // false if the ring had wrapped, so the start of the session is missing
+
+    std::vector<const spiRecord_t*> transfers;
+    std::vector<replayCommand_t> commands;
+    std::vector<replayQueued_t> queued;
+    std::vector<uint64_t> estops;
+    std::vector<replayProgram_t> programs;
+
+    uint64_t next;          // position in the playback, 0 to transfers.size()
+    size_t nextCommand;
+    size_t nextQueued;
+    size_t nextEstop;
+    size_t nextProgram;     // main thread
+    uint32_t numQueued;
+    uint64_t numMismatches;
+    uint64_t firstMismatch;
+
+public:
+    SPIReplayTransport();
+
+    bool open(const char* filename);
+    void close();
+    bool hasInputs();       // false if commands and programs can't be replayed, so the client's should be used
+    void printSummary();
+
+    const char* getName() { return "SPI replay"; }
+    bool init();
+    void transfer(char* tbuf, char* rbuf, uint32_t len);
+
+    // realtime thread, in place of ntCommandCheck, the number of programs queued and the estop flag
+    bool takeCommand(motionCommand* cmd);
+    uint32_t getProgramsQueued();
+    bool takeEstop();
+
+    // main thread, gives the next recorded program to be planned again
+    const spiRecordedProgram_t* takeProgram(CommandList& program);
+};
+
+extern SPIReplayTransport spiReplay;
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SPITRANSPORT_H
+#define SPITRANSPORT_H
+
+#include <stdint.h>
+
+// Carries the packet exchange with the weeny PRU each realtime tick. Normally this is the SPI
+// hardware of the Pi, but it can be swapped for the simulated PRU (see weenySim.h) to run the
+// server without any hardware.
+class SPITransport {
+public:
+    virtual ~SPITransport() {}
+
+    virtual const char* getName() = 0;
+    virtual bool check() { return true; }   // main thread, at startup
+    virtual bool init() = 0;                // realtime thread, before the first transfer
+    virtual void transfer(char* tbuf, char* rbuf, uint32_t len) = 0;
+};
+
+class RPiSPITransport : public SPITransport {
+public:
+    const char* getName() { return "Raspberry Pi SPI"; }
+    bool check();
+    bool init();
+    void transfer(char* tbuf, char* rbuf, uint32_t len);
+};
+
+extern SPITransport* spiTransport;
+
+#endif
@@ -0,0 +1,120 @@
+
+// Traverses a long program the way the realtime thread does, one tick at a time, and checks that
+// the cost of a tick does not grow as the traversal gets further into the list of moves. Run by
+// 'make test', or directly: returns non-zero if the ticks near the end of the program are much
+// slower than those near the start, or if the traversal doesn't end where the program does.
+
+#include <stdio.h>
+#include <chrono>
+
+#include "../../common/scv/planner.h"
+
+using namespace scv;
+
+#define NUM_MOVES       10000
+#define NUM_BANDS       10      // the traversal is timed separately in this many ranges of move index
+#define NUM_PASSES      3       // the fastest pass is used for each band, to leave out other load on the machine
+#define TICK_SECONDS    0.001f  // same as the realtime thread
+#define MAX_SLOWDOWN    3       // how much slower the last band may be than the first
+
+static void setupPlan(planner& plan) {
+
+    plan.setCornerBlendMethod(CBM_INTERPOLATED_MOVES);
+    plan.setPositionLimits(-1000, -1000, -1000, 1000, 1000, 1000);
+    plan.setVelocityLimits(500, 500, 500);
+    plan.setAccelerationLimits(5000, 5000, 5000);
+    plan.setJerkLimits(50000, 50000, 50000);
+    for (int i = 0; i < NUM_ROTATION_AXES; i++)
+        plan.setRotationPositionLimits(i, -1000, 1000);
+    plan.setRotationVAJLimits(500, 5000, 50000);
+
+    // a zigzag of short moves with different lengths, so that consecutive moves blend into each other
+    move m;
+    m.vel = 200;
+    m.acc = 2000;
+    m.jerk = 20000;
+    m.dst = vec3_zero;
+    for (int i = 0; i < NUM_MOVES; i++) {
+        m.src = m.dst;
+        m.dst.x = (i % 2) ? 0 : 5 + (i % 7);
+        m.dst.y += 2 + (i % 3);
+        m.dst.z = (i % 5) * 0.5f;
+        plan.appendMove(m);
+    }
+}
+
+int main() {
+
+    planner plan;
+    setupPlan(plan);
+
+    if ( ! plan.calculateMoves() ) {
+        printf("Could not calculate moves\n");
+        return 1;
+    }
+
+    vec3 lastDst = plan.moves.back().dst;
+
+    double bandNs[NUM_BANDS];
+    long bandTicks[NUM_BANDS];
+    double fastest[NUM_BANDS];
+    for (int b = 0; b < NUM_BANDS; b++)
+        fastest[b] = 0;
+
+    for (int pass = 0; pass < NUM_PASSES; pass++) {
+
+        for (int b = 0; b < NUM_BANDS; b++) {
+            bandNs[b] = 0;
+            bandTicks[b] = 0;
+        }
+
+        plan.resetTraverse();
+
+        vec3 p, v;
+        float rots[NUM_ROTATION_AXES];
+        traverseFeedback_t feedback;
+        bool stillRunning = true;
+
+        while ( stillRunning ) {
+            int band = plan.traversal_moveIndex * NUM_BANDS / NUM_MOVES;
+            if ( band >= NUM_BANDS )
+                band = NUM_BANDS - 1;
+
+            auto start = std::chrono::steady_clock::now();
+            stillRunning = plan.advanceTraverse(TICK_SECONDS, 1, &p, &v, rots, &feedback);
+            auto end = std::chrono::steady_clock::now();
+
+            bandNs[band] += std::chrono::duration<double, std::nano>(end - start).count();
+            bandTicks[band]++;
+        }
+
+        vec3 diff = p - lastDst;
+        if ( fabs(diff.x) > 0.001 || fabs(diff.y) > 0.001 || fabs(diff.z) > 0.001 ) {
+            printf("Traversal ended at %f, %f, %f instead of %f, %f, %f\n", p.x, p.y, p.z, lastDst.x, lastDst.y, lastDst.z);
+            return 1;
+        }
+
+        for (int b = 0; b < NUM_BANDS; b++) {
+            if ( bandTicks[b] == 0 ) {
+                printf("No ticks were spent in moves %d to %d\n", b * NUM_MOVES / NUM_BANDS, (b + 1) * NUM_MOVES / NUM_BANDS - 1);
+                return 1;
+            }
+            double avg = bandNs[b] / bandTicks[b];
+            if ( pass == 0 || avg < fastest[b] )
+                fastest[b] = avg;
+        }
+    }
+
+    printf("moves        ns per tick\n");
+    for (int b = 0; b < NUM_BANDS; b++)
+        printf("%5d-%-5d  %8.1f\n", b * NUM_MOVES / NUM_BANDS, (b + 1) * NUM_MOVES / NUM_BANDS - 1, fastest[b]);
+
+    if ( fastest[NUM_BANDS - 1] > MAX_SLOWDOWN * fastest[0] ) {
+        printf("Ticks at the end of the program are %.1f times slower than at the start\n", fastest[NUM_BANDS - 1] / fastest[0]);
+        return 1;
+    }
+
+    printf("Ticks at the end of the program take %.2f times as long as at the start\n", fastest[NUM_BANDS - 1] / fastest[0]);
+
+    return 0;
+}
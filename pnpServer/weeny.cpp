@@ -2,58 +2,16 @@
 #include <stdio.h>
 #include <cstring>
 
-#include "bcm2835.h"
-#include "rpispi.h"
 #include "weeny.h"
+#include "spiTransport.h"
+#include "spiRecord.h"
+#include "rtLog.h"
 
 #define STEPBIT				22			// bit location in DDS accum
 #define STEP_MASK			(1L<<STEPBIT)
 #define STEP_OFFSET			(1L<<(STEPBIT-1))
 
 
-
-#define PRU_DATA            0x64617461 	// "data" SPI payload
-#define PRU_READ            0x72656164  // "read" SPI payload
-#define PRU_WRITE           0x77726974  // "writ" SPI payload
-#define PRU_ESTOP           0x65737470  // "estp" SPI payload
-
-
-typedef struct __attribute__((__packed__))
-{
-    // this data goes from LinuxCNC to PRU
-
-    int32_t header;                 // 4 bytes
-    int32_t jointFreqCmd[JOINTS];   // 16 bytes
-    uint8_t jointEnable;            // 1 byte
-    uint16_t outputs;               // 2 bytes
-    uint8_t rgb[6];                 // 6 bytes (3 bits per LED x 16 LEDs = 48 bits)
-    uint16_t spindleSpeed;          // 2 bytes
-
-    uint8_t microsteps[JOINTS];     // 4 bytes
-    uint8_t rmsCurrent[JOINTS];     // 4 bytes
-
-    uint8_t dummy[9];               // make up to same size as rxData_t
-} txData_t;
-
-typedef struct __attribute__((__packed__))
-{
-    // this data goes from PRU back to LinuxCNC
-
-    int32_t header;                 // 4 bytes
-    int32_t jointFeedback[JOINTS];  // 16 bytes
-    int32_t jogcounts[4];           // 16 bytes
-    uint16_t inputs;                // 2 bytes
-    uint16_t adc[2];                // 4 bytes
-    uint16_t pressure;              // 2 bytes
-    int32_t loadcell;               // 4 bytes
-} rxData_t;
-
-typedef union
-{
-    rxData_t rx;
-    txData_t tx;
-} commPacket_t;
-
 static rxData_t rxData;
 static txData_t txData;
 
@@ -221,7 +179,7 @@ void processRxData() {
     }
     else {
         if ( (processRxCount == 0) || data.lastSPIPacketGood ) {// only print when changed from good to bad
-            printf("Bad SPI payload: %x (count: %ld)\n", rxData.header, processRxCount);
+            rtLog(LL_WARN, "Bad SPI payload: %x (count: %ld)", rxData.header, processRxCount);
             //printSPIPacket();
         }
         data.lastSPIPacketGood = false;
@@ -235,7 +193,9 @@ void spi_transfer()
     prepareTxData();
 
     // send and receive data to and from the weeny PRU concurrently
-    rpispi_transfernb( (char*)&txData, (char*)&rxData, sizeof(commPacket_t) );
+    spiTransport->transfer( (char*)&txData, (char*)&rxData, sizeof(commPacket_t) );
+
+    spiRecordTransfer(txData, rxData);
 
     processRxData();
 }
@@ -2,6 +2,8 @@
 #ifndef WEENY_H
 #define WEENY_H
 
+#include <stdint.h>
+
 typedef double real_t __attribute__((aligned(8)));
 #define hal_float_t volatile real_t
 
@@ -10,6 +12,49 @@ typedef double real_t __attribute__((aligned(8)));
 #define DIGITAL_INPUTS		16
 #define RGB_BITS		48
 
+#define PRU_DATA            0x64617461 	// "data" SPI payload
+#define PRU_READ            0x72656164  // "read" SPI payload
+#define PRU_WRITE           0x77726974  // "writ" SPI payload
+#define PRU_ESTOP           0x65737470  // "estp" SPI payload
+
+
+typedef struct __attribute__((__packed__))
+{
+    // this data goes from LinuxCNC to PRU
+
+    int32_t header;                 // 4 bytes
+    int32_t jointFreqCmd[JOINTS];   // 16 bytes
+    uint8_t jointEnable;            // 1 byte
+    uint16_t outputs;               // 2 bytes
+    uint8_t rgb[6];                 // 6 bytes (3 bits per LED x 16 LEDs = 48 bits)
+    uint16_t spindleSpeed;          // 2 bytes
+
+    uint8_t microsteps[JOINTS];     // 4 bytes
+    uint8_t rmsCurrent[JOINTS];     // 4 bytes
+
+    uint8_t dummy[9];               // make up to same size as rxData_t
+} txData_t;
+
+typedef struct __attribute__((__packed__))
+{
+    // this data goes from PRU back to LinuxCNC
+
+    int32_t header;                 // 4 bytes
+    int32_t jointFeedback[JOINTS];  // 16 bytes
+    int32_t jogcounts[4];           // 16 bytes
+    uint16_t inputs;                // 2 bytes
+    uint16_t adc[2];                // 4 bytes
+    uint16_t pressure;              // 2 bytes
+    int32_t loadcell;               // 4 bytes
+} rxData_t;
+
+typedef union
+{
+    rxData_t rx;
+    txData_t tx;
+} commPacket_t;
+
+
 typedef struct {
     bool                lastSPIPacketGood;
 
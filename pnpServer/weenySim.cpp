@@ -0,0 +1,130 @@
+
+#include <math.h>
+#include <string.h>
+
+#include "weenySim.h"
+#include "log.h"
+
+#define SIM_TICK_SECONDS    0.001
+
+SimulatedPRU simulatedPRU;
+
+SimulatedPRU::SimulatedPRU() {
+    for (int i = 0; i < JOINTS; i++)
+        steps[i] = 0;
+    pressure = SIM_PRESSURE_RESERVOIR;
+    noiseState = 2463534242;
+    memset(homing, 0, sizeof(homing));
+    memset(&probing, 0, sizeof(probing));
+    memset(stepsPerMM, 0, sizeof(stepsPerMM));
+    vacuumValveOutput = 0;
+}
+
+void SimulatedPRU::configure() {
+    memcpy(homing, homingParams, sizeof(homing));
+    probing = probingParams;
+    for (int i = 0; i < JOINTS; i++)
+        stepsPerMM[i] = stepsPerUnit[i];
+    vacuumValveOutput = 0;
+    if ( probing.vacuumSniffPin >= 0 && probing.vacuumSniffPin <= 15 )
+        vacuumValveOutput = 1 << probing.vacuumSniffPin;
+}
+
+// xorshift, repeatable from run to run and cheap enough for the realtime thread
+int32_t SimulatedPRU::noise(int peakToPeak) {
+    noiseState ^= noiseState << 13;
+    noiseState ^= noiseState >> 17;
+    noiseState ^= noiseState << 5;
+    if ( peakToPeak <= 0 )
+        return 0;
+    return (int32_t)(noiseState % (peakToPeak + 1)) - peakToPeak / 2;
+}
+
+// in mm, relative to where the axis was when the server started
+double SimulatedPRU::getPosition(int axis) {
+    if ( stepsPerMM[axis] == 0 )
+        return 0;
+    return steps[axis] / stepsPerMM[axis];
+}
+
+bool SimulatedPRU::isLimitTriggered(int axis) {
+    if ( homing[axis].direction == 0 )
+        return getPosition(axis) <= -SIM_HOME_DISTANCE;
+    return getPosition(axis) >= SIM_HOME_DISTANCE;
+}
+
+// how far the nozzle is pushed into the surface, negative if it's not touching
+double SimulatedPRU::getSurfacePenetration() {
+    return -SIM_SURFACE_DEPTH - getPosition(2);
+}
+
+static void setInput(uint16_t& inputs, int pin, bool triggered, int triggerState) {
+    if ( pin < 0 || pin >= DIGITAL_INPUTS )
+        return;
+    bool high = triggered ? triggerState : ! triggerState;
+    if ( high )
+        inputs |= (1 << pin);
+    else
+        inputs &= ~(1 << pin);
+}
+
+bool SimulatedPRU::init() {
+    g_log.log(LL_INFO, "Using %s", getName());
+    return true;
+}
+
+void SimulatedPRU::update(const txData_t& tx) {
+
+    if ( tx.header == PRU_WRITE ) {
+        // the frequency commands are in steps per second
+        for (int i = 0; i < JOINTS; i++) {
+            if ( tx.jointEnable & (1 << i) )
+                steps[i] += tx.jointFreqCmd[i] * SIM_TICK_SECONDS;
+        }
+    }
+
+    // The reservoir is pumped down towards SIM_PRESSURE_RESERVOIR. Opening the sniff valve lets
+    // air in quickly, or hardly at all if the nozzle is sealed against the surface.
+    bool valveOpen = tx.outputs & vacuumValveOutput;
+    if ( valveOpen ) {
+        double rate = getSurfacePenetration() >= 0 ? 0.001 : 0.02;
+        pressure += (SIM_PRESSURE_ATMOSPHERE - pressure) * rate;
+    }
+    else
+        pressure += (SIM_PRESSURE_RESERVOIR - pressure) * 0.005;
+}
+
+void SimulatedPRU::transfer(char* tbuf, char* rbuf, uint32_t len) {
+
+    txData_t tx;
+    memcpy(&tx, tbuf, sizeof(tx));
+
+    update(tx);
+
+    rxData_t rx;
+    memset(&rx, 0, sizeof(rx));
+
+    rx.header = PRU_DATA;
+
+    for (int i = 0; i < JOINTS; i++)
+        rx.jointFeedback[i] = (int32_t)lround(steps[i]);
+
+    double penetration = getSurfacePenetration();
+    bool touching = penetration >= 0;
+
+    uint16_t inputs = 0;
+    for (int i = 0; i < NUM_HOMABLE_AXES; i++)
+        setInput(inputs, homing[i].triggerPin, isLimitTriggered(i), homing[i].triggerState);
+    setInput(inputs, probing.digitalTriggerPin, touching, probing.digitalTriggerState);
+    rx.inputs = inputs;
+
+    int32_t force = touching ? (int32_t)(penetration * SIM_LOADCELL_COUNTS_PER_MM) : 0;
+    if ( probing.loadcellTriggerThreshold < 0 )
+        force = -force;
+    rx.loadcell = SIM_LOADCELL_BASELINE + force + noise(SIM_LOADCELL_NOISE);
+
+    int32_t p = (int32_t)pressure + noise(SIM_PRESSURE_NOISE);
+    rx.pressure = p < 0 ? 0 : p > 0xffff ? 0xffff : p;
+
+    memcpy(rbuf, &rx, len < sizeof(rx) ? len : sizeof(rx));
+}
@@ -0,0 +1,59 @@
+#ifndef WEENYSIM_H
+#define WEENYSIM_H
+
+#include "spiTransport.h"
+#include "weeny.h"
+#include "../common/config.h"
+
+// A stand-in for the weeny PRU, so that the whole server can run on any Linux machine (start it
+// with --sim). The frequency commands are integrated into step counts like the real step
+// generator does, and there is enough of a machine around it for homing and probing to work:
+//  - each homable axis has a limit switch SIM_HOME_DISTANCE from where it started, in the
+//    direction it homes, using the pin and trigger state from the homing config
+//  - there is a flat surface SIM_SURFACE_DEPTH below where Z started, which triggers the digital
+//    probe pin, presses on the load cell, and seals the nozzle for vacuum probing
+//  - the pressure sensor reads a vacuum reservoir, which the sniff valve lets air into
+// The pins and steps per unit are taken from the config once at startup (see configure), as they
+// would be wired up and fixed on a real machine. Changes made by the client afterwards are not seen.
+
+#define SIM_HOME_DISTANCE               20      // mm from the starting position to each limit switch
+#define SIM_SURFACE_DEPTH               30      // mm below the starting Z position
+
+#define SIM_LOADCELL_BASELINE           100000
+#define SIM_LOADCELL_COUNTS_PER_MM      20000   // how hard the surface pushes back
+#define SIM_LOADCELL_NOISE              40      // peak to peak
+
+#define SIM_PRESSURE_ATMOSPHERE         50000
+#define SIM_PRESSURE_RESERVOIR          30000   // what the pump holds the reservoir at
+#define SIM_PRESSURE_NOISE              10
+
+class SimulatedPRU : public SPITransport {
+
+    double steps[JOINTS];
+    double pressure;
+    uint32_t noiseState;
+
+    // copied from the config by configure, so the realtime thread doesn't read them while the main thread changes them
+    homingParams_t homing[NUM_HOMABLE_AXES];
+    probingParams_t probing;
+    float stepsPerMM[JOINTS];
+    uint16_t vacuumValveOutput;   // the output vacuum probing sniffs with, zero if there is none
+
+    int32_t noise(int peakToPeak);
+    double getPosition(int axis);
+    bool isLimitTriggered(int axis);
+    double getSurfacePenetration();
+    void update(const txData_t& tx);
+
+public:
+    SimulatedPRU();
+
+    void configure();   // main thread, after the config is read and before the realtime thread starts
+    const char* getName() { return "simulated weeny PRU"; }
+    bool init();
+    void transfer(char* tbuf, char* rbuf, uint32_t len);
+};
+
+extern SimulatedPRU simulatedPRU;
+
+#endif